@@ -0,0 +1,303 @@
+#include "Aggregator.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <new>
+#include <string>
+
+#include "Predicate.hpp"
+#include "Query.hpp"
+
+namespace {
+
+constexpr uint64_t kSeed = 0x9E3779B97F4A7C15ULL;
+
+// SQLite's kahanBabuskaNeumaierStep and friends, so that sums round alike.
+void addReal(double& sum, double& error, double r) {
+    double s = sum;
+    double t = s + r;
+    if (std::fabs(s) > std::fabs(r)) error += (s - t) + r;
+    else error += (r - t) + s;
+    sum = t;
+}
+
+void addInteger(double& sum, double& error, int64_t v) {
+    // Integers beyond 2^52 go in two parts, so no bits are lost
+    if (v <= -4503599627370496LL || v >= 4503599627370496LL) {
+        int64_t big = v - v % 16384;
+        addReal(sum, error, static_cast<double>(big));
+        addReal(sum, error, static_cast<double>(v - big));
+    } else {
+        addReal(sum, error, static_cast<double>(v));
+    }
+}
+
+void startReal(double& sum, double& error, int64_t v) {
+    if (v <= -4503599627370496LL || v >= 4503599627370496LL) {
+        int64_t small = v % 16384;
+        sum = static_cast<double>(v - small);
+        error = static_cast<double>(small);
+    } else {
+        sum = static_cast<double>(v);
+        error = 0;
+    }
+}
+
+bool sameKeys(const Value* a, const Value* b, size_t n) {
+    for (size_t k = 0; k < n; ++k) {
+        if (compareValues(a[k], b[k]) != 0) return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+Aggregator::Aggregator(const BoundSelect& query) : query_(query), keys_(query.group_by.size()), key_scratch_(query.group_by.size()) {
+    for (const Expr* key : query_.group_by) key_collations_.push_back(collationOf(*key));
+    for (const Expr* call : query_.aggregates) {
+        const std::string& name = call->name;
+        Function function = Function::Max;
+        if (call->star) function = Function::CountStar;
+        else if (name == "COUNT") function = Function::Count;
+        else if (name == "SUM") function = Function::Sum;
+        else if (name == "TOTAL") function = Function::Total;
+        else if (name == "AVG") function = Function::Avg;
+        else if (name == "MIN") function = Function::Min;
+        functions_.push_back(function);
+        collations_.push_back(call->star ? Collation::Binary : collationOf(*call->args[0]));
+    }
+    for (size_t a = 0; a < functions_.size(); ++a) {
+        if (functions_[a] != Function::Min && functions_[a] != Function::Max) continue;
+        if (extreme_call_ != std::string::npos) {
+            extreme_call_ = std::string::npos;
+            break;
+        }
+        extreme_call_ = a;
+    }
+}
+
+template <typename T>
+T* Aggregator::allocate(size_t n) {
+    // Every allocation from state_ is a multiple of 8 bytes, so each starts
+    // aligned
+    static_assert(sizeof(T) % 8 == 0 && alignof(T) <= 8);
+    if (n == 0) return nullptr;
+    T* items = reinterpret_cast<T*>(state_.allocate(n * sizeof(T)));
+    for (size_t i = 0; i < n; ++i) new (items + i) T();
+    return items;
+}
+
+void Aggregator::grow() {
+    size_t capacity = std::max<size_t>(16, slots_.size() * 2);
+    slots_.assign(capacity, 0);
+    size_t mask = capacity - 1;
+    for (size_t g = 0; g < groups_.size(); ++g) {
+        size_t i = groups_[g].hash & mask;
+        while (slots_[i] != 0) i = (i + 1) & mask;
+        slots_[i] = static_cast<uint32_t>(g + 1);
+    }
+}
+
+size_t Aggregator::findOrInsert(uint64_t hash, const Value* keys, bool& created) {
+    // At most half full, so probe runs stay short
+    if ((groups_.size() + 1) * 2 > slots_.size()) grow();
+    size_t num_keys = keys_.size();
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        uint32_t slot = slots_[i];
+        if (slot == 0) {
+            Group group;
+            group.hash = hash;
+            group.keys = allocate<Value>(num_keys);
+            for (size_t k = 0; k < num_keys; ++k) group.keys[k] = text_.copy(keys[k]);
+            group.columns = allocate<Value>(query_.group_columns.size());
+            group.accumulators = allocate<Accumulator>(functions_.size());
+            groups_.push_back(group);
+            slots_[i] = static_cast<uint32_t>(groups_.size());
+            created = true;
+            return groups_.size() - 1;
+        }
+        const Group& group = groups_[slot - 1];
+        if (group.hash == hash && sameKeys(group.keys, keys, num_keys)) {
+            created = false;
+            return slot - 1;
+        }
+    }
+}
+
+void Aggregator::add(Evaluator& evaluator, Record* record, int64_t rowid) {
+    uint64_t hash = kSeed;
+    for (size_t k = 0; k < keys_.size(); ++k) {
+        keys_[k] = collationKey(evaluator.evaluate(*query_.group_by[k], record, rowid), key_collations_[k], key_scratch_[k]);
+        hash = hashValue(keys_[k], hash);
+    }
+    bool created = false;
+    Group& group = groups_[findOrInsert(hash, keys_.data(), created)];
+    bool load_columns = created;
+    for (size_t a = 0; a < functions_.size(); ++a) {
+        Accumulator& accumulator = group.accumulators[a];
+        if (functions_[a] == Function::CountStar) {
+            ++accumulator.count;
+            continue;
+        }
+        Value value = evaluator.evaluate(*query_.aggregates[a]->args[0], record, rowid);
+        // Until MIN or MAX has a value, each NULL row loads the columns
+        bool extreme = value.isNull() ? accumulator.count == 0 : step(accumulator, functions_[a], collations_[a], value);
+        if (a == extreme_call_ && extreme) load_columns = true;
+    }
+    if (load_columns) {
+        for (size_t c = 0; c < query_.group_columns.size(); ++c) group.columns[c] = text_.copy(evaluator.evaluate(*query_.group_columns[c], record, rowid));
+    }
+}
+
+bool Aggregator::step(Accumulator& accumulator, Function function, Collation collation, const Value& value) {
+    ++accumulator.count;
+    switch (function) {
+        case Function::CountStar:
+        case Function::Count:
+            return false;
+        case Function::Min:
+        case Function::Max: {
+            // The first of equal values stays
+            int c = accumulator.count == 1 ? 0 : compareValues(value, accumulator.extreme, collation);
+            if (accumulator.count > 1 && (function == Function::Min ? c >= 0 : c <= 0)) return false;
+            accumulator.extreme = text_.copy(value);
+            return true;
+        }
+        case Function::Sum:
+        case Function::Total:
+        case Function::Avg:
+            break;
+    }
+    // Text that reads as an integer adds as one; other non-integers add
+    // their numeric prefix as a real
+    Value number = value;
+    if (value.type == Value::Type::Text || value.type == Value::Type::Blob) {
+        Value exact = value.type == Value::Type::Text ? numericValue(std::string_view(reinterpret_cast<const char*>(value.data), value.size)) : Value{};
+        number = exact.type == Value::Type::Integer ? exact : Value::makeReal(toNumeric(value).asReal());
+    }
+    if (number.type == Value::Type::Integer) {
+        int64_t sum = 0;
+        if (accumulator.approximate) {
+            addInteger(accumulator.real_sum, accumulator.real_error, number.integer);
+        } else if (__builtin_add_overflow(accumulator.integer_sum, number.integer, &sum)) {
+            // SQLite fails SUM with "integer overflow" here; it goes on as a real
+            startReal(accumulator.real_sum, accumulator.real_error, accumulator.integer_sum);
+            accumulator.approximate = true;
+            addInteger(accumulator.real_sum, accumulator.real_error, number.integer);
+        } else {
+            accumulator.integer_sum = sum;
+        }
+        return false;
+    }
+    if (!accumulator.approximate) {
+        startReal(accumulator.real_sum, accumulator.real_error, accumulator.integer_sum);
+        accumulator.approximate = true;
+    }
+    addReal(accumulator.real_sum, accumulator.real_error, number.asReal());
+    return false;
+}
+
+bool Aggregator::combine(Accumulator& into, const Accumulator& from, Function function, Collation collation) {
+    // Until MIN or MAX has a value, later rows with a NULL argument take the
+    // columns
+    if (from.count == 0) return (function == Function::Min || function == Function::Max) && into.count == 0;
+    bool first = into.count == 0;
+    into.count += from.count;
+    switch (function) {
+        case Function::CountStar:
+        case Function::Count:
+            return false;
+        case Function::Min:
+        case Function::Max: {
+            int c = first ? 0 : compareValues(from.extreme, into.extreme, collation);
+            if (!first && (function == Function::Min ? c >= 0 : c <= 0)) return false;
+            into.extreme = text_.copy(from.extreme);
+            return true;
+        }
+        case Function::Sum:
+        case Function::Total:
+        case Function::Avg:
+            break;
+    }
+    int64_t sum = 0;
+    if (!into.approximate && !from.approximate && !__builtin_add_overflow(into.integer_sum, from.integer_sum, &sum)) {
+        into.integer_sum = sum;
+        return false;
+    }
+    if (!into.approximate) {
+        startReal(into.real_sum, into.real_error, into.integer_sum);
+        into.approximate = true;
+    }
+    if (from.approximate) {
+        addReal(into.real_sum, into.real_error, from.real_sum);
+        addReal(into.real_sum, into.real_error, from.real_error);
+    } else {
+        addInteger(into.real_sum, into.real_error, from.integer_sum);
+    }
+    return false;
+}
+
+void Aggregator::merge(const Aggregator& other) {
+    for (const Group& theirs : other.groups_) {
+        bool created = false;
+        Group& ours = groups_[findOrInsert(theirs.hash, theirs.keys, created)];
+        bool load_columns = created;
+        for (size_t a = 0; a < functions_.size(); ++a) {
+            bool extreme = combine(ours.accumulators[a], theirs.accumulators[a], functions_[a], collations_[a]);
+            if (a == extreme_call_ && extreme) load_columns = true;
+        }
+        if (load_columns) {
+            for (size_t c = 0; c < query_.group_columns.size(); ++c) ours.columns[c] = text_.copy(theirs.columns[c]);
+        }
+    }
+}
+
+void Aggregator::finish() {
+    size_t num_keys = keys_.size();
+    if (num_keys == 0) {
+        // Without GROUP BY there is one group, even of no rows
+        bool created = false;
+        if (groups_.empty()) findOrInsert(kSeed, nullptr, created);
+        return;
+    }
+    std::sort(groups_.begin(), groups_.end(), [num_keys](const Group& a, const Group& b) {
+        for (size_t k = 0; k < num_keys; ++k) {
+            int c = compareValues(a.keys[k], b.keys[k]);
+            if (c != 0) return c < 0;
+        }
+        return false;
+    });
+}
+
+void Aggregator::results(size_t group, Value* values) const {
+    const Accumulator* accumulators = groups_[group].accumulators;
+    for (size_t a = 0; a < functions_.size(); ++a) {
+        const Accumulator& accumulator = accumulators[a];
+        double sum = !accumulator.approximate ? static_cast<double>(accumulator.integer_sum)
+                     : std::isfinite(accumulator.real_error) ? accumulator.real_sum + accumulator.real_error
+                                                             : accumulator.real_sum;
+        Value& value = values[a];
+        value = Value();
+        switch (functions_[a]) {
+            case Function::CountStar:
+            case Function::Count:
+                value = Value::makeInteger(accumulator.count);
+                break;
+            case Function::Sum:
+                if (accumulator.count == 0) break;
+                value = accumulator.approximate ? Value::makeReal(sum) : Value::makeInteger(accumulator.integer_sum);
+                break;
+            case Function::Total:
+                value = Value::makeReal(sum);
+                break;
+            case Function::Avg:
+                if (accumulator.count > 0) value = Value::makeReal(sum / static_cast<double>(accumulator.count));
+                break;
+            case Function::Min:
+            case Function::Max:
+                if (accumulator.count > 0) value = accumulator.extreme;
+                break;
+        }
+    }
+}
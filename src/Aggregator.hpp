@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Arena.hpp"
+#include "Expression.hpp"
+#include "Record.hpp"
+#include "Value.hpp"
+
+struct BoundSelect;
+
+// Folds rows into groups for GROUP BY and the aggregate functions COUNT,
+// SUM, TOTAL, AVG, MIN and MAX. Groups are found through an open-addressing
+// hash table keyed by the typed GROUP BY values, which match as compareValues
+// compares their collationKey(): 1 and 1.0 share a group, NULLs group
+// together, and so do 'a' and 'A' under NOCASE. Each
+// group's keys, bare columns and accumulators are allocated from arenas,
+// so rows are never copied whole. Workers can each fold part of a table into
+// an Aggregator of their own, merged into one at the end in table order.
+class Aggregator {
+public:
+    explicit Aggregator(const BoundSelect& query);
+    Aggregator(const Aggregator&) = delete;
+    Aggregator& operator=(const Aggregator&) = delete;
+
+    // Evaluates the row's GROUP BY values and aggregate arguments.
+    void add(Evaluator& evaluator, Record* record, int64_t rowid);
+    // Folds in the groups of an Aggregator for the same query over rows
+    // that come after this one's.
+    void merge(const Aggregator& other);
+    // Puts the groups in GROUP BY order, as SQLite outputs them, or makes
+    // the single group of a query without GROUP BY if no row came. No rows
+    // may be added after.
+    void finish();
+
+    size_t size() const { return groups_.size(); }
+    // The group's values of BoundSelect::group_columns: from the row that
+    // set the value of the only MIN or MAX call if the query has exactly
+    // one, as SQLite does, otherwise from its first row.
+    const Value* columns(size_t group) const { return groups_[group].columns; }
+    // Writes the final value of each of BoundSelect::aggregates.
+    void results(size_t group, Value* values) const;
+
+private:
+    enum class Function : uint8_t { CountStar, Count, Sum, Total, Avg, Min, Max };
+
+    // State of one aggregate call in one group. Sums stay exact integers
+    // until a value that is not one, or an overflow, turns them into a
+    // Kahan-Babuska-Neumaier compensated sum, as SQLite's do.
+    struct Accumulator {
+        // Values that were not NULL.
+        int64_t count = 0;
+        int64_t integer_sum = 0;
+        bool approximate = false;
+        double real_sum = 0;
+        double real_error = 0;
+        // MIN/MAX so far.
+        Value extreme;
+    };
+
+    struct Group {
+        uint64_t hash;
+        Value* keys;
+        Value* columns;
+        Accumulator* accumulators;
+    };
+
+    template <typename T>
+    T* allocate(size_t n);
+    // Index of the group with these keys, made with NULL columns and empty
+    // accumulators if there is none yet.
+    size_t findOrInsert(uint64_t hash, const Value* keys, bool& created);
+    void grow();
+    // True if a MIN or MAX took its value from value, or from from, whose
+    // rows come later; also if neither into nor from has one yet.
+    bool step(Accumulator& accumulator, Function function, Collation collation, const Value& value);
+    bool combine(Accumulator& into, const Accumulator& from, Function function, Collation collation);
+
+    const BoundSelect& query_;
+    std::vector<Function> functions_;
+    // Per aggregate call, the collation MIN and MAX compare text by.
+    std::vector<Collation> collations_;
+    // Position of the only MIN or MAX call, npos if there are none or
+    // several.
+    size_t extreme_call_ = std::string::npos;
+    // Groups and their Value and Accumulator arrays; text of key, column and
+    // MIN/MAX values goes to text_ so that the arrays stay aligned.
+    Arena state_;
+    Arena text_;
+    std::vector<Group> groups_;
+    // Group index + 1 per slot, 0 for an empty one; the size is a power of 2.
+    std::vector<uint32_t> slots_;
+    // GROUP BY values of the row being added, as collationKey() of their
+    // collations.
+    std::vector<Value> keys_;
+    std::vector<Collation> key_collations_;
+    std::vector<std::string> key_scratch_;
+};
@@ -0,0 +1,39 @@
+#include "Arena.hpp"
+
+#include <cstring>
+
+unsigned char* Arena::allocate(size_t n) {
+    if (n == 0) n = 1;
+    while (current_ < blocks_.size() && offset_ + n > blocks_[current_].size) {
+        ++current_;
+        offset_ = 0;
+    }
+    if (current_ == blocks_.size()) {
+        size_t size = n > block_size_ ? n : block_size_;
+        blocks_.push_back({std::make_unique<unsigned char[]>(size), size});
+        offset_ = 0;
+    }
+    unsigned char* p = blocks_[current_].data.get() + offset_;
+    offset_ += n;
+    bytes_used_ += n;
+    return p;
+}
+
+Value Arena::copy(const Value& value) {
+    if (value.type != Value::Type::Text && value.type != Value::Type::Blob) return value;
+    Value owned = value;
+    if (value.size > 0) {
+        unsigned char* p = allocate(value.size);
+        std::memcpy(p, value.data, value.size);
+        owned.data = p;
+    }
+    return owned;
+}
+
+void Arena::clear() {
+    // Oversized blocks made for single large values are not worth keeping.
+    while (!blocks_.empty() && blocks_.back().size > block_size_) blocks_.pop_back();
+    current_ = 0;
+    offset_ = 0;
+    bytes_used_ = 0;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "Value.hpp"
+
+// Bump allocator for bytes that must outlive the page or scratch buffer they
+// were read from. Allocations never move; clear() releases them all at once
+// but keeps the blocks for reuse.
+class Arena {
+public:
+    explicit Arena(size_t block_size = 64 << 10) : block_size_(block_size) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    unsigned char* allocate(size_t n);
+    // Copies the bytes of a text or blob value into the arena; other values
+    // are returned as they are.
+    Value copy(const Value& value);
+    void clear();
+
+    // Bytes handed out since the last clear().
+    size_t bytesUsed() const { return bytes_used_; }
+
+private:
+    struct Block {
+        std::unique_ptr<unsigned char[]> data;
+        size_t size;
+    };
+
+    size_t block_size_;
+    std::vector<Block> blocks_;
+    // Block being filled and the offset of its first free byte.
+    size_t current_ = 0;
+    size_t offset_ = 0;
+    size_t bytes_used_ = 0;
+};
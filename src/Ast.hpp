@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Catalog.hpp"
+#include "Predicate.hpp"
+
+struct Expr;
+using ExprPtr = std::unique_ptr<Expr>;
+
+// One node of a parsed expression; which fields are used depends on kind.
+struct Expr {
+    enum class Kind { Literal, Column, Unary, Binary, In, Like, Between, IsNull, Function };
+    enum class Op {
+        None,
+        // Unary
+        Negate, Plus, Not,
+        // Binary
+        Or, And, Eq, Ne, Lt, Le, Gt, Ge, Is, IsNot, Add, Subtract, Multiply, Divide, Remainder, Concat,
+    };
+
+    // Values of `column` before binding, and for the rowid (or its
+    // INTEGER PRIMARY KEY alias) after it.
+    static constexpr size_t kUnbound = static_cast<size_t>(-1);
+    static constexpr size_t kRowid = static_cast<size_t>(-2);
+
+    Kind kind = Kind::Literal;
+    Op op = Op::None;
+    // NOT IN, NOT LIKE, NOT BETWEEN, IS NOT NULL.
+    bool negated = false;
+    Literal literal;
+    // Column: the optional table qualifier and the name, both unquoted.
+    // Function: the name, upper-cased.
+    std::string table;
+    std::string name;
+    // Column: the FROM table it belongs to after binding, 0, or 1 for the
+    // second table of a join.
+    size_t source = 0;
+    // A column written as "name"; like SQLite, it reads as a string literal
+    // if no column has that name.
+    bool double_quoted = false;
+    // COUNT(*).
+    bool star = false;
+    // Unary/Binary: the operands. In: the value, then the list. Like: the
+    // value, the pattern and an optional escape. Between: the value, lower,
+    // upper. IsNull: the value. Function: the arguments.
+    std::vector<ExprPtr> args;
+
+    // Filled in by bindSelect; for an aggregate call, its position in
+    // BoundSelect::aggregates.
+    size_t column = kUnbound;
+    // Column: its affinity and collation; the rowid's are INTEGER and
+    // BINARY.
+    Affinity affinity = Affinity::Blob;
+    Collation collation = Collation::Binary;
+    bool real_affinity = false;
+
+    bool isColumn() const { return kind == Kind::Column; }
+    bool isLiteral() const { return kind == Kind::Literal; }
+};
+
+struct ResultColumn {
+    // nullptr for `*`.
+    ExprPtr expr;
+    std::string alias;
+};
+
+struct OrderingTerm {
+    ExprPtr expr;
+    bool descending = false;
+};
+
+struct SelectStatement {
+    // EXPLAIN QUERY PLAN: list the candidate access paths instead of running.
+    bool explain = false;
+    std::vector<ResultColumn> columns;
+    // Empty without a FROM clause.
+    std::string table;
+    std::string table_alias;
+    // The second table of a join, empty if there is none. Its ON condition is
+    // ANDed into where, as it means the same for an inner join.
+    std::string join_table;
+    std::string join_alias;
+    ExprPtr where;
+    std::vector<ExprPtr> group_by;
+    ExprPtr having;
+    std::vector<OrderingTerm> order_by;
+    ExprPtr limit;
+    ExprPtr offset;
+};
+
+// INSERT, UPDATE or DELETE on one table.
+struct ModifyStatement {
+    enum class Kind { Insert, Update, Delete };
+
+    Kind kind = Kind::Insert;
+    std::string table;
+    // INSERT: the column list, empty without one. UPDATE: the SET targets.
+    std::vector<std::string> columns;
+    // UPDATE: the value for each SET target.
+    std::vector<ExprPtr> values;
+    // INSERT ... VALUES: one list per row.
+    std::vector<std::vector<ExprPtr>> rows;
+    // INSERT ... SELECT.
+    std::unique_ptr<SelectStatement> select;
+    // INSERT ... DEFAULT VALUES.
+    bool default_values = false;
+    // UPDATE and DELETE.
+    ExprPtr where;
+};
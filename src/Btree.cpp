@@ -0,0 +1,325 @@
+#include "Btree.hpp"
+
+#include <algorithm>
+
+uint64_t getLeafRowidAt(PageView page, size_t header_off, size_t cell_index) {
+    size_t cell_ptr_array_off = header_off + 8;
+    size_t ptr_pos = cell_ptr_array_off + cell_index * 2;
+    uint16_t cell_off = readBE16(page, ptr_pos);
+    size_t p = cell_off;
+    auto pr = readVarint(page, p);
+    p += pr.second;
+    pr = readVarint(page, p);
+    return pr.first;
+}
+
+int64_t lowerBoundLeafByRowid(PageView page, size_t header_off, int64_t target_rowid) {
+    uint16_t num_cells = readBE16(page, header_off + 3);
+    int64_t lo = 0, hi = static_cast<int64_t>(num_cells) - 1, ans = num_cells;
+    while (lo <= hi) {
+        int64_t mid = (lo + hi) / 2;
+        int64_t rid = static_cast<int64_t>(getLeafRowidAt(page, header_off, static_cast<size_t>(mid)));
+        if (rid >= target_rowid) {
+            ans = mid;
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return ans;
+}
+
+uint64_t getInteriorKeyAt(PageView page, size_t header_off, size_t cell_index) {
+    size_t cell_ptr_array_off = header_off + 12;
+    size_t ptr_pos = cell_ptr_array_off + cell_index * 2;
+    uint16_t cell_off = readBE16(page, ptr_pos);
+    size_t p = cell_off + 4;
+    auto pr = readVarint(page, p);
+    return pr.first;
+}
+
+int64_t firstChildIntersectingRange(PageView page, size_t header_off, int64_t min_rowid) {
+    uint16_t num_cells = readBE16(page, header_off + 3);
+    int64_t lo = 0, hi = static_cast<int64_t>(num_cells) - 1, ans = num_cells;
+    while (lo <= hi) {
+        int64_t mid = (lo + hi) / 2;
+        int64_t key = static_cast<int64_t>(getInteriorKeyAt(page, header_off, static_cast<size_t>(mid)));
+        if (min_rowid <= key) {
+            ans = mid;
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return ans;
+}
+
+// Child index num_cells is the right-most pointer.
+uint32_t interiorChildAt(PageView page, size_t header_off, size_t child_index) {
+    uint16_t num_cells = readBE16(page, header_off + 3);
+    if (child_index >= num_cells) return readBE32(page, header_off + 8);
+    uint16_t cell_off = readBE16(page, header_off + 12 + child_index * 2);
+    return readBE32(page, cell_off);
+}
+
+void readAheadChildren(Pager& pager, PageView page, size_t header_off, size_t child_index) {
+    size_t window = pager.readAheadWindow();
+    if (window == 0) return;
+    size_t last_child = readBE16(page, header_off + 3);
+    size_t first = child_index == 0 ? 1 : child_index + window;
+    size_t last = std::min(child_index + window, last_child);
+    for (size_t k = first; k <= last; ++k) pager.prefetch(interiorChildAt(page, header_off, k));
+}
+
+// Pushes child child_index of the current top page (or the root when the
+// stack is empty), deriving the child's key range from the parent's keys.
+bool TableCursor::push(uint32_t page_number, size_t child_index) {
+    Level level;
+    level.page = pager_.page(page_number);
+    if (level.page.empty()) return false;
+    level.page_number = page_number;
+    level.header_off = headerOffsetFor(page_number);
+    if (!stack_.empty()) {
+        Level& parent = stack_.back();
+        parent.child_index = child_index;
+        PageView ppage = parent.page;
+        uint16_t num_cells = readBE16(ppage, parent.header_off + 3);
+        level.has_lo = parent.has_lo;
+        level.lo = parent.lo;
+        level.has_hi = parent.has_hi;
+        level.hi = parent.hi;
+        if (child_index > 0) {
+            level.has_lo = true;
+            level.lo = static_cast<int64_t>(getInteriorKeyAt(ppage, parent.header_off, child_index - 1));
+        }
+        if (child_index < num_cells) {
+            level.has_hi = true;
+            level.hi = static_cast<int64_t>(getInteriorKeyAt(ppage, parent.header_off, child_index));
+        }
+    }
+    stack_.push_back(std::move(level));
+    return true;
+}
+
+// Descends from the lowest page covering target_rowid to the leaf that would
+// hold it.
+bool TableCursor::descend(int64_t target_rowid) {
+    while (!stack_.empty() && !covers(stack_.back(), target_rowid)) stack_.pop_back();
+    if (stack_.empty() && !push(root_page_, 0)) return false;
+    while (true) {
+        Level& top = stack_.back();
+        PageView page = top.page;
+        unsigned char flags = page[top.header_off];
+        if (flags == 0x0D) return true;
+        if (flags != 0x05) return false;
+        size_t child_index = static_cast<size_t>(firstChildIntersectingRange(page, top.header_off, target_rowid));
+        if (!push(interiorChildAt(page, top.header_off, child_index), child_index)) return false;
+    }
+}
+
+bool TableCursor::positionOnCell(size_t cell_index) {
+    const Level& leaf = stack_.back();
+    if (cell_index >= readBE16(leaf.page, leaf.header_off + 3)) return false;
+    cell_index_ = cell_index;
+    cell_offset_ = readBE16(leaf.page, leaf.header_off + 8 + cell_index * 2);
+    return true;
+}
+
+// Moves to the first cell of the next non-empty leaf.
+bool TableCursor::advanceLeaf() {
+    stack_.pop_back();
+    while (!stack_.empty()) {
+        Level& top = stack_.back();
+        PageView page = top.page;
+        if (page[top.header_off] != 0x05) return false;
+        uint16_t num_cells = readBE16(page, top.header_off + 3);
+        if (top.child_index >= num_cells) {
+            stack_.pop_back();
+            continue;
+        }
+        size_t child_index = top.child_index + 1;
+        readAheadChildren(pager_, page, top.header_off, child_index);
+        if (!push(interiorChildAt(page, top.header_off, child_index), child_index)) return false;
+        // Walk down the left edge of the new subtree.
+        while (true) {
+            Level& cur = stack_.back();
+            PageView cpage = cur.page;
+            unsigned char flags = cpage[cur.header_off];
+            if (flags == 0x0D) break;
+            if (flags != 0x05) return false;
+            if (!push(interiorChildAt(cpage, cur.header_off, 0), 0)) return false;
+        }
+        if (positionOnCell(0)) return true;
+        stack_.pop_back();
+    }
+    return false;
+}
+
+bool TableCursor::seek(int64_t target_rowid) {
+    if (!descend(target_rowid)) return false;
+    const Level& leaf = stack_.back();
+    int64_t idx = lowerBoundLeafByRowid(leaf.page, leaf.header_off, target_rowid);
+    if (!positionOnCell(static_cast<size_t>(idx))) return false;
+    return rowid() == target_rowid;
+}
+
+bool TableCursor::seekAtLeast(int64_t target_rowid) {
+    if (!descend(target_rowid)) return false;
+    const Level& leaf = stack_.back();
+    int64_t idx = lowerBoundLeafByRowid(leaf.page, leaf.header_off, target_rowid);
+    if (positionOnCell(static_cast<size_t>(idx))) return true;
+    return advanceLeaf();
+}
+
+bool TableCursor::next() {
+    if (stack_.empty()) return false;
+    if (positionOnCell(cell_index_ + 1)) return true;
+    return advanceLeaf();
+}
+
+int64_t TableCursor::rowid() const {
+    const Level& leaf = stack_.back();
+    return static_cast<int64_t>(getLeafRowidAt(leaf.page, leaf.header_off, cell_index_));
+}
+
+bool IndexCursor::push(uint32_t page_number) {
+    Level level;
+    level.page = pager_.page(page_number);
+    if (level.page.empty()) return false;
+    level.header_off = headerOffsetFor(page_number);
+    unsigned char flags = level.page[level.header_off];
+    if (flags != 0x02 && flags != 0x0A) return false;
+    level.interior = flags == 0x02;
+    level.num_cells = readBE16(level.page, level.header_off + 3);
+    stack_.push_back(std::move(level));
+    return true;
+}
+
+bool IndexCursor::loadCell(const Level& level, size_t cell) {
+    size_t p = readBE16(level.page, level.header_off + (level.interior ? 12 : 8) + cell * 2);
+    // Interior cells start with the left child pointer
+    if (level.interior) p += 4;
+    auto pr = readVarint(level.page, p);
+    return record_.load(level.page, p + pr.second, pr.first, true);
+}
+
+// Walks down the left edge of the subtree on top of the stack to its first
+// entry.
+bool IndexCursor::descendToFirst() {
+    while (stack_.back().interior) {
+        Level& top = stack_.back();
+        top.cell = 0;
+        if (!push(interiorChildAt(top.page, top.header_off, 0))) return false;
+    }
+    Level& leaf = stack_.back();
+    leaf.cell = 0;
+    if (leaf.num_cells > 0) return loadCell(leaf, 0);
+    return ascend();
+}
+
+// Leaves a finished leaf or right-most subtree for the next interior entry
+// up the stack.
+bool IndexCursor::ascend() {
+    stack_.pop_back();
+    while (!stack_.empty()) {
+        Level& top = stack_.back();
+        if (top.cell < top.num_cells) return loadCell(top, top.cell);
+        stack_.pop_back();
+    }
+    return false;
+}
+
+bool IndexCursor::seek(const KeyRange& key) {
+    stack_.clear();
+    if (!push(root_page_)) return false;
+    while (true) {
+        // Binary search for the first cell not below the lower bound; in an
+        // interior page, its left child holds the first candidates
+        Level& top = stack_.back();
+        size_t lo = 0, hi = top.num_cells;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (loadCell(top, mid) && key.aboveLower(record_)) hi = mid;
+            else lo = mid + 1;
+        }
+        top.cell = lo;
+        if (!top.interior) break;
+        if (!push(interiorChildAt(top.page, top.header_off, lo))) return false;
+    }
+    Level& leaf = stack_.back();
+    if (leaf.cell < leaf.num_cells) return loadCell(leaf, leaf.cell);
+    return ascend();
+}
+
+bool IndexCursor::next() {
+    if (stack_.empty()) return false;
+    Level& top = stack_.back();
+    if (top.interior) {
+        // An interior entry is followed by the subtree to its right
+        size_t child = ++top.cell;
+        readAheadChildren(pager_, top.page, top.header_off, child);
+        if (!push(interiorChildAt(top.page, top.header_off, child))) return false;
+        return descendToFirst();
+    }
+    if (++top.cell < top.num_cells) return loadCell(top, top.cell);
+    return ascend();
+}
+
+int64_t IndexCursor::rowid() {
+    if (record_.columnCount() == 0) return 0;
+    size_t last = record_.columnCount() - 1;
+    uint64_t rowid_serial = record_.serialType(last);
+    if (rowid_serial == 8) return 0;
+    if (rowid_serial == 9) return 1;
+    PageView rowid_bytes = record_.column(last);
+    return readBigEndianSigned(rowid_bytes.data(), rowid_bytes.size());
+}
+
+uint64_t countTableRows(Pager& pager, uint32_t root_page) {
+    uint64_t total = 0;
+    std::vector<uint32_t> pending{root_page};
+    while (!pending.empty()) {
+        uint32_t page_number = pending.back();
+        pending.pop_back();
+        PageRef page = pager.page(page_number);
+        if (page.empty()) continue;
+        size_t header_off = headerOffsetFor(page_number);
+        unsigned char flags = page[header_off];
+        uint16_t num_cells = readBE16(page, header_off + 3);
+        if (flags == 0x0D) {
+            total += num_cells;
+        } else if (flags == 0x05) {
+            // Children are visited in order, so the whole level can be requested up front.
+            size_t window = pager.readAheadWindow();
+            for (size_t i = 0; window > 0 && i <= num_cells; ++i) pager.prefetch(interiorChildAt(page, header_off, i));
+            for (size_t i = num_cells + 1; i-- > 0;) pending.push_back(interiorChildAt(page, header_off, i));
+        }
+    }
+    return total;
+}
+
+TreeEstimate estimateTree(Pager& pager, uint32_t root_page) {
+    TreeEstimate estimate;
+    double pages_at_level = 1;
+    // Index interior pages hold entries too
+    double interior_entries = 0;
+    uint32_t page_number = root_page;
+    while (page_number != 0 && estimate.depth < 64) {
+        PageRef page = pager.page(page_number);
+        if (page.empty()) break;
+        ++estimate.depth;
+        size_t header_off = headerOffsetFor(page_number);
+        unsigned char flags = page[header_off];
+        uint16_t num_cells = readBE16(page, header_off + 3);
+        if (flags == 0x0D || flags == 0x0A) {
+            estimate.leaf_pages = pages_at_level;
+            estimate.entries = pages_at_level * num_cells + interior_entries;
+            break;
+        }
+        if (flags != 0x05 && flags != 0x02) break;
+        if (flags == 0x02) interior_entries += pages_at_level * num_cells;
+        pages_at_level *= num_cells + 1;
+        page_number = interiorChildAt(page, header_off, num_cells / 2u);
+    }
+    return estimate;
+}
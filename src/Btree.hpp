@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Pager.hpp"
+#include "Predicate.hpp"
+#include "Record.hpp"
+
+inline std::pair<uint64_t, size_t> readVarint(PageView data, size_t start_index) {
+    // Most varints (small sizes, rowids, serial types) are one byte
+    if (data[start_index] < 0x80) return {data[start_index], 1};
+    uint64_t value = 0;
+    size_t i = 0;
+    for (; i < 9; ++i) {
+        unsigned char byte = data[start_index + i];
+        if (i == 8) {
+            value = (value << 8) | byte;
+            ++i;
+            break;
+        }
+        value = (value << 7) | (byte & 0x7Fu);
+        if ((byte & 0x80u) == 0) {
+            ++i;
+            break;
+        }
+    }
+    return {value, i};
+}
+
+inline uint16_t readBE16(PageView p, size_t pos) {
+    return static_cast<uint16_t>((p[pos] << 8) | p[pos + 1]);
+}
+
+inline uint32_t readBE32(PageView p, size_t pos) {
+    return (static_cast<uint32_t>(p[pos]) << 24) | (static_cast<uint32_t>(p[pos + 1]) << 16) | (static_cast<uint32_t>(p[pos + 2]) << 8) | static_cast<uint32_t>(p[pos + 3]);
+}
+
+inline void storeBE16(unsigned char* p, uint32_t v) {
+    p[0] = static_cast<unsigned char>(v >> 8);
+    p[1] = static_cast<unsigned char>(v);
+}
+
+inline void storeBE32(unsigned char* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) p[i] = static_cast<unsigned char>(v >> (24 - 8 * i));
+}
+
+inline size_t headerOffsetFor(uint32_t page_number) {
+    return (page_number == 1 ? 100 : 0);
+}
+
+uint64_t getLeafRowidAt(PageView page, size_t header_off, size_t cell_index);
+// Rowids are signed 64-bit keys; the searches below compare them as such.
+int64_t lowerBoundLeafByRowid(PageView page, size_t header_off, int64_t target_rowid);
+uint64_t getInteriorKeyAt(PageView page, size_t header_off, size_t cell_index);
+int64_t firstChildIntersectingRange(PageView page, size_t header_off, int64_t min_rowid);
+uint32_t interiorChildAt(PageView page, size_t header_off, size_t child_index);
+
+// Called before descending into child child_index of an interior page: keeps
+// the next pager.readAheadWindow() children requested ahead of the scan.
+void readAheadChildren(Pager& pager, PageView page, size_t header_off, size_t child_index);
+
+// Row count of a table B-tree: sums the cell counts of its leaf pages without
+// looking at any record.
+uint64_t countTableRows(Pager& pager, uint32_t root_page);
+
+// Size of a table or index B-tree, estimated from a single root-to-leaf path
+// through the middle child of each interior page, so only `depth` pages are
+// read however large the tree is.
+struct TreeEstimate {
+    // Pages on a root-to-leaf path.
+    size_t depth = 0;
+    double leaf_pages = 0;
+    double entries = 0;
+};
+
+TreeEstimate estimateTree(Pager& pager, uint32_t root_page);
+
+// Point lookups and range scans on a table B-tree. Every level is searched
+// with a binary search, and the path from the root is kept so a following
+// seek to a nearby rowid only re-descends from the lowest page whose key range
+// still covers it. Feeding it ascending rowids walks the tree once.
+class TableCursor {
+public:
+    TableCursor(Pager& pager, uint32_t root_page) : pager_(pager), root_page_(root_page) {}
+
+    // Positions the cursor on target_rowid; returns false if it is absent.
+    bool seek(int64_t target_rowid);
+    // Positions the cursor on the first row with rowid >= target_rowid;
+    // returns false if there is none.
+    bool seekAtLeast(int64_t target_rowid);
+    // Moves to the next row in rowid order; returns false past the last row.
+    bool next();
+
+    // Valid while positioned on a row.
+    PageView leaf() const { return stack_.back().page; }
+    uint32_t leafPageNumber() const { return stack_.back().page_number; }
+    size_t cellOffset() const { return cell_offset_; }
+    int64_t rowid() const;
+
+private:
+    struct Level {
+        PageRef page;
+        uint32_t page_number = 0;
+        size_t header_off = 0;
+        size_t child_index = 0;
+        bool has_lo = false;
+        bool has_hi = false;
+        int64_t lo = 0;
+        int64_t hi = 0;
+    };
+
+    static bool covers(const Level& level, int64_t rowid) {
+        return (!level.has_lo || rowid > level.lo) && (!level.has_hi || rowid <= level.hi);
+    }
+    bool push(uint32_t page_number, size_t child_index);
+    bool descend(int64_t target_rowid);
+    bool positionOnCell(size_t cell_index);
+    bool advanceLeaf();
+
+    Pager& pager_;
+    uint32_t root_page_;
+    std::vector<Level> stack_;
+    size_t cell_index_ = 0;
+    size_t cell_offset_ = 0;
+};
+
+// Walks the entries of an index B-tree in key order, keeping the path from
+// the root on an explicit stack so entries stream out one at a time. Interior
+// cells carry entries of their own, which follow every entry of their left
+// child.
+class IndexCursor {
+public:
+    IndexCursor(Pager& pager, uint32_t root_page) : pager_(pager), root_page_(root_page), record_(pager) {}
+
+    // Positions the cursor on the first entry key.aboveLower accepts (the
+    // first entry if key has no lower bound); returns false if there is none.
+    bool seek(const KeyRange& key);
+    // Moves to the next entry in key order; returns false past the last one.
+    bool next();
+
+    // The entry under the cursor; valid until the cursor moves.
+    Record& record() { return record_; }
+    // Rowid stored in the last column of the entry.
+    int64_t rowid();
+
+private:
+    struct Level {
+        PageRef page;
+        size_t header_off = 0;
+        bool interior = false;
+        uint16_t num_cells = 0;
+        // Leaf: the current cell. Interior: the child being walked
+        // (num_cells for the right-most one), or once the walk is back on
+        // this page, the cell whose entry is current.
+        size_t cell = 0;
+    };
+
+    bool push(uint32_t page_number);
+    bool loadCell(const Level& level, size_t cell);
+    bool descendToFirst();
+    bool ascend();
+
+    Pager& pager_;
+    uint32_t root_page_;
+    Record record_;
+    std::vector<Level> stack_;
+};
@@ -0,0 +1,573 @@
+#include "BtreeWriter.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+#include <utility>
+
+#include "Btree.hpp"
+#include "Record.hpp"
+
+namespace {
+
+// The longest path from a root that a valid database can have.
+constexpr size_t kMaxDepth = 40;
+
+bool validType(unsigned char type) {
+    return type == 0x0D || type == 0x05 || type == 0x0A || type == 0x02;
+}
+
+// readVarint for bytes that may be malformed: false if the varint runs past
+// end.
+bool readVarintWithin(PageView data, size_t pos, size_t end, uint64_t& value, size_t& length) {
+    if (pos >= end) return false;
+    size_t last = pos;
+    while (last + 1 < end && last - pos < 8 && (data[last] & 0x80) != 0) ++last;
+    if (last - pos < 8 && (data[last] & 0x80) != 0) return false;
+    std::tie(value, length) = readVarint(data, pos);
+    return true;
+}
+
+// Where the payload of a cell starts, its size and how much of it is on the
+// page; false if the cell is cut short.
+bool payloadLayout(PageView cell, size_t end, unsigned char type, uint32_t usable_size, size_t& start, uint64_t& size, size_t& local) {
+    size_t pos = type == 0x02 ? 4 : 0;
+    size_t length = 0;
+    if (!readVarintWithin(cell, pos, end, size, length)) return false;
+    pos += length;
+    if (type == 0x0D) {
+        uint64_t rowid = 0;
+        if (!readVarintWithin(cell, pos, end, rowid, length)) return false;
+        pos += length;
+    }
+    start = pos;
+    local = localPayloadSize(size, usable_size, type != 0x0D);
+    return true;
+}
+
+int64_t leafCellRowid(const std::vector<unsigned char>& cell) {
+    PageView view(cell);
+    size_t pos = readVarint(view, 0).second;
+    return static_cast<int64_t>(readVarint(view, pos).first);
+}
+
+// Splits items costing cost[i] bytes into pages of at most capacity bytes.
+// With promote, the item between two pages goes up to the parent instead of
+// onto either. Pages are filled left to right, then evened out from the
+// right so the last one is not left nearly empty. Returns [begin, end) of
+// each page, or nothing if the items cannot be placed.
+std::vector<std::pair<size_t, size_t>> partitionItems(const std::vector<size_t>& cost, size_t capacity, bool promote) {
+    size_t n = cost.size();
+    if (n == 0) return {{0, 0}};
+    std::vector<size_t> prefix(n + 1, 0);
+    for (size_t i = 0; i < n; ++i) prefix[i + 1] = prefix[i] + cost[i];
+    auto used = [&](const std::pair<size_t, size_t>& page) { return prefix[page.second] - prefix[page.first]; };
+
+    std::vector<std::pair<size_t, size_t>> pages;
+    for (size_t begin = 0;;) {
+        size_t end = begin;
+        while (end < n && prefix[end + 1] - prefix[begin] <= capacity) ++end;
+        if (end == begin) return {};
+        if (end == n) {
+            pages.emplace_back(begin, end);
+            break;
+        }
+        // A divider needs a page after it
+        if (promote && end + 1 == n) {
+            if (end - begin < 2) return {};
+            --end;
+        }
+        pages.emplace_back(begin, end);
+        begin = promote ? end + 1 : end;
+    }
+    for (size_t j = pages.size() - 1; j > 0; --j) {
+        auto& left = pages[j - 1];
+        auto& right = pages[j];
+        while (left.second - left.first >= 2) {
+            // Without promote the left page's last item moves over; with it,
+            // that item becomes the divider and the old divider moves over
+            size_t moved_out = cost[left.second - 1];
+            size_t moved_in = promote ? cost[left.second] : moved_out;
+            if (used(right) + moved_in > capacity || used(right) + moved_in > used(left) - moved_out) break;
+            --left.second;
+            --right.first;
+        }
+    }
+    return pages;
+}
+
+}  // namespace
+
+size_t BtreeWriter::cellSize(PageView page, size_t offset, unsigned char type) const {
+    size_t end = txn_.usableSize();
+    if (type == 0x05) {
+        uint64_t key = 0;
+        size_t length = 0;
+        if (offset + 4 >= end || !readVarintWithin(page, offset + 4, end, key, length)) return 0;
+        return 4 + length;
+    }
+    PageView cell = page.subspan(offset);
+    size_t start = 0, local = 0;
+    uint64_t size = 0;
+    if (!payloadLayout(cell, end - offset, type, txn_.usableSize(), start, size, local)) return 0;
+    size_t total = start + local + (local < size ? 4 : 0);
+    return offset + total <= end ? total : 0;
+}
+
+size_t BtreeWriter::nodeBytes(const Node& node) const {
+    size_t bytes = node.interior() ? 12 : 8;
+    // Cells take at least 4 bytes, so any cell's space can become a freeblock
+    for (const Cell& cell : node.cells) bytes += 2 + std::max<size_t>(4, cell.size());
+    return bytes;
+}
+
+size_t BtreeWriter::capacity(uint32_t page_number) const {
+    return txn_.usableSize() - headerOffsetFor(page_number);
+}
+
+bool BtreeWriter::readNode(uint32_t page_number, Node& node) {
+    PageView page = txn_.page(page_number);
+    if (page.empty()) return false;
+    size_t header_off = headerOffsetFor(page_number);
+    node.type = page[header_off];
+    if (!validType(node.type)) return false;
+    uint16_t num_cells = readBE16(page, header_off + 3);
+    node.right = node.interior() ? readBE32(page, header_off + 8) : 0;
+    size_t pointers = header_off + (node.interior() ? 12 : 8);
+    size_t usable = txn_.usableSize();
+    if (pointers + 2 * static_cast<size_t>(num_cells) > usable) return false;
+    node.cells.assign(num_cells, {});
+    for (size_t i = 0; i < num_cells; ++i) {
+        size_t offset = readBE16(page, pointers + 2 * i);
+        if (offset < pointers + 2 * static_cast<size_t>(num_cells) || offset >= usable) return false;
+        size_t size = cellSize(page, offset, node.type);
+        if (size == 0) return false;
+        node.cells[i].assign(page.data() + offset, page.data() + offset + size);
+    }
+    return true;
+}
+
+bool BtreeWriter::writeNode(uint32_t page_number, const Node& node) {
+    unsigned char* page = txn_.write(page_number);
+    if (page == nullptr) return false;
+    size_t header_off = headerOffsetFor(page_number);
+    size_t pointers = header_off + (node.interior() ? 12 : 8);
+    size_t content = txn_.usableSize();
+    for (size_t i = 0; i < node.cells.size(); ++i) {
+        const Cell& cell = node.cells[i];
+        size_t size = std::max<size_t>(4, cell.size());
+        content -= size;
+        std::memcpy(page + content, cell.data(), cell.size());
+        std::memset(page + content + cell.size(), 0, size - cell.size());
+        storeBE16(page + pointers + 2 * i, static_cast<uint32_t>(content));
+    }
+    size_t gap = pointers + 2 * node.cells.size();
+    std::memset(page + gap, 0, content - gap);
+    page[header_off] = node.type;
+    storeBE16(page + header_off + 1, 0);
+    storeBE16(page + header_off + 3, static_cast<uint32_t>(node.cells.size()));
+    // 65536 is written as 0
+    storeBE16(page + header_off + 5, static_cast<uint32_t>(content & 0xFFFF));
+    page[header_off + 7] = 0;
+    if (node.interior()) storeBE32(page + header_off + 8, node.right);
+    return true;
+}
+
+bool BtreeWriter::makeCell(const std::vector<unsigned char>& payload, int64_t rowid, Cell& cell) {
+    cell.clear();
+    appendVarint(cell, payload.size());
+    if (!index_) appendVarint(cell, static_cast<uint64_t>(rowid));
+    size_t usable = txn_.usableSize();
+    size_t local = localPayloadSize(payload.size(), static_cast<uint32_t>(usable), index_);
+    cell.insert(cell.end(), payload.begin(), payload.begin() + static_cast<ptrdiff_t>(local));
+    if (local == payload.size()) return true;
+    // Each overflow page holds the next page number, then usable - 4 bytes
+    uint32_t first = 0;
+    unsigned char* previous = nullptr;
+    for (size_t pos = local; pos < payload.size();) {
+        uint32_t page_number = txn_.allocate();
+        unsigned char* page = page_number != 0 ? txn_.write(page_number) : nullptr;
+        if (page == nullptr) return false;
+        if (previous != nullptr) storeBE32(previous, page_number);
+        else first = page_number;
+        size_t n = std::min(usable - 4, payload.size() - pos);
+        std::memcpy(page + 4, payload.data() + pos, n);
+        pos += n;
+        previous = page;
+    }
+    cell.resize(cell.size() + 4);
+    storeBE32(cell.data() + cell.size() - 4, first);
+    return true;
+}
+
+bool BtreeWriter::readPayload(const Cell& cell, unsigned char type, std::vector<unsigned char>& payload) {
+    size_t start = 0, local = 0;
+    uint64_t size = 0;
+    if (!payloadLayout(PageView(cell), cell.size(), type, txn_.usableSize(), start, size, local)) return false;
+    payload.assign(cell.begin() + static_cast<ptrdiff_t>(start), cell.begin() + static_cast<ptrdiff_t>(start + local));
+    if (local == size) return true;
+    uint32_t page_number = readBE32(PageView(cell), start + local);
+    size_t per_page = txn_.usableSize() - 4;
+    while (payload.size() < size) {
+        PageView page = txn_.page(page_number);
+        if (page.empty()) return false;
+        size_t n = std::min<uint64_t>(per_page, size - payload.size());
+        payload.insert(payload.end(), page.begin() + 4, page.begin() + 4 + static_cast<ptrdiff_t>(n));
+        page_number = readBE32(page, 0);
+    }
+    return true;
+}
+
+bool BtreeWriter::freeOverflow(const Cell& cell, unsigned char type) {
+    if (type == 0x05) return true;
+    size_t start = 0, local = 0;
+    uint64_t size = 0;
+    if (!payloadLayout(PageView(cell), cell.size(), type, txn_.usableSize(), start, size, local)) return false;
+    if (local == size) return true;
+    uint32_t page_number = readBE32(PageView(cell), start + local);
+    size_t per_page = txn_.usableSize() - 4;
+    for (uint64_t pages = (size - local + per_page - 1) / per_page; pages > 0; --pages) {
+        PageView page = txn_.page(page_number);
+        if (page.empty()) return false;
+        uint32_t next = readBE32(page, 0);
+        if (!txn_.release(page_number)) return false;
+        page_number = next;
+    }
+    return true;
+}
+
+int BtreeWriter::compareEntry(const std::vector<Value>& entry, const Value* key, size_t n) const {
+    for (size_t i = 0; i < n; ++i) {
+        if (i >= entry.size()) return -1;
+        int c = compareValues(entry[i], key[i]);
+        if (i < descending_.size() && descending_[i]) c = -c;
+        if (c != 0) return c;
+    }
+    return 0;
+}
+
+bool BtreeWriter::descendTable(int64_t rowid, std::vector<Step>& path, bool& found) {
+    path.clear();
+    found = false;
+    uint32_t page_number = root_page_;
+    while (path.size() < kMaxDepth) {
+        PageView page = txn_.page(page_number);
+        if (page.empty()) return false;
+        size_t header_off = headerOffsetFor(page_number);
+        unsigned char type = page[header_off];
+        if (type == 0x05) {
+            size_t child = static_cast<size_t>(firstChildIntersectingRange(page, header_off, rowid));
+            path.push_back({page_number, child});
+            page_number = interiorChildAt(page, header_off, child);
+            continue;
+        }
+        if (type != 0x0D) return false;
+        size_t cell = static_cast<size_t>(lowerBoundLeafByRowid(page, header_off, rowid));
+        found = cell < readBE16(page, header_off + 3) && static_cast<int64_t>(getLeafRowidAt(page, header_off, cell)) == rowid;
+        path.push_back({page_number, cell});
+        return true;
+    }
+    return false;
+}
+
+bool BtreeWriter::descendIndex(const Value* key, size_t n, std::vector<Step>& path, bool& found) {
+    path.clear();
+    found = false;
+    uint32_t page_number = root_page_;
+    Node node;
+    while (path.size() < kMaxDepth) {
+        if (!readNode(page_number, node) || (node.type != 0x0A && node.type != 0x02)) return false;
+        // First cell whose entry is not below key
+        size_t lo = 0, hi = node.cells.size();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (!readPayload(node.cells[mid], node.type, scratch_) || !decodeRecord(PageView(scratch_), values_)) return false;
+            int c = compareEntry(values_, key, n);
+            if (c == 0) {
+                path.push_back({page_number, mid});
+                found = true;
+                return true;
+            }
+            if (c < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        path.push_back({page_number, lo});
+        if (node.type == 0x0A) return true;
+        page_number = lo < node.cells.size() ? readBE32(PageView(node.cells[lo]), 0) : node.right;
+    }
+    return false;
+}
+
+bool BtreeWriter::findRow(int64_t rowid, std::vector<unsigned char>& payload, bool& found) {
+    std::vector<Step> path;
+    if (!descendTable(rowid, path, found)) return false;
+    if (!found) return true;
+    PageView page = txn_.page(path.back().page);
+    size_t header_off = headerOffsetFor(path.back().page);
+    size_t offset = readBE16(page, header_off + 8 + 2 * path.back().child);
+    size_t size = offset < txn_.usableSize() ? cellSize(page, offset, 0x0D) : 0;
+    if (size == 0) return false;
+    Cell cell(page.data() + offset, page.data() + offset + size);
+    return readPayload(cell, 0x0D, payload);
+}
+
+bool BtreeWriter::lastRowid(int64_t& rowid, bool& empty) {
+    uint32_t page_number = root_page_;
+    for (size_t depth = 0; depth < kMaxDepth; ++depth) {
+        PageView page = txn_.page(page_number);
+        if (page.empty()) return false;
+        size_t header_off = headerOffsetFor(page_number);
+        uint16_t num_cells = readBE16(page, header_off + 3);
+        if (page[header_off] == 0x05) {
+            page_number = readBE32(page, header_off + 8);
+            continue;
+        }
+        if (page[header_off] != 0x0D) return false;
+        empty = num_cells == 0;
+        if (!empty) rowid = static_cast<int64_t>(getLeafRowidAt(page, header_off, num_cells - 1));
+        return true;
+    }
+    return false;
+}
+
+bool BtreeWriter::putRow(int64_t rowid, const std::vector<unsigned char>& payload) {
+    std::vector<Step> path;
+    bool found = false;
+    if (!descendTable(rowid, path, found)) return false;
+    Node leaf;
+    Cell cell;
+    if (!readNode(path.back().page, leaf) || !makeCell(payload, rowid, cell)) return false;
+    size_t position = path.back().child;
+    if (found) {
+        if (!freeOverflow(leaf.cells[position], leaf.type)) return false;
+        leaf.cells[position] = std::move(cell);
+    } else {
+        leaf.cells.insert(leaf.cells.begin() + static_cast<ptrdiff_t>(position), std::move(cell));
+    }
+    bool appended = !found && position + 1 == leaf.cells.size();
+    return settle(path, path.size() - 1, std::move(leaf), appended);
+}
+
+bool BtreeWriter::removeRow(int64_t rowid) {
+    std::vector<Step> path;
+    bool found = false;
+    if (!descendTable(rowid, path, found)) return false;
+    if (!found) return true;
+    Node leaf;
+    if (!readNode(path.back().page, leaf)) return false;
+    size_t position = path.back().child;
+    if (!freeOverflow(leaf.cells[position], leaf.type)) return false;
+    leaf.cells.erase(leaf.cells.begin() + static_cast<ptrdiff_t>(position));
+    return settle(path, path.size() - 1, std::move(leaf), false);
+}
+
+bool BtreeWriter::insertEntry(const std::vector<Value>& entry) {
+    std::vector<Step> path;
+    bool found = false;
+    if (!descendIndex(entry.data(), entry.size(), path, found)) return false;
+    if (found) return true;
+    std::vector<unsigned char> payload;
+    appendRecord(payload, entry.data(), entry.size());
+    Node leaf;
+    Cell cell;
+    if (!readNode(path.back().page, leaf) || !makeCell(payload, 0, cell)) return false;
+    leaf.cells.insert(leaf.cells.begin() + static_cast<ptrdiff_t>(path.back().child), std::move(cell));
+    return settle(path, path.size() - 1, std::move(leaf), false);
+}
+
+bool BtreeWriter::removeEntry(const std::vector<Value>& entry) {
+    std::vector<Step> path;
+    bool found = false;
+    if (!descendIndex(entry.data(), entry.size(), path, found)) return false;
+    if (!found) return true;
+    Node node;
+    if (!readNode(path.back().page, node)) return false;
+    size_t position = path.back().child;
+    if (node.type == 0x0A) {
+        if (!freeOverflow(node.cells[position], node.type)) return false;
+        node.cells.erase(node.cells.begin() + static_cast<ptrdiff_t>(position));
+        return settle(path, path.size() - 1, std::move(node), false);
+    }
+
+    // An entry on an interior page is replaced by the one before it, the
+    // last of its left subtree, taken off its leaf with its overflow chain
+    uint32_t page_number = readBE32(PageView(node.cells[position]), 0);
+    Node leaf;
+    while (true) {
+        if (path.size() >= kMaxDepth || !readNode(page_number, leaf)) return false;
+        if (leaf.type == 0x0A) break;
+        if (leaf.type != 0x02) return false;
+        path.push_back({page_number, leaf.cells.size()});
+        page_number = leaf.right;
+    }
+    if (leaf.cells.empty()) return false;
+    Cell predecessor = std::move(leaf.cells.back());
+    leaf.cells.pop_back();
+    path.push_back({page_number, leaf.cells.size()});
+    if (!settle(path, path.size() - 1, std::move(leaf), false)) return false;
+
+    // Rebalancing the leaf may have moved the entry, even onto a leaf
+    if (!descendIndex(entry.data(), entry.size(), path, found) || !found || !readNode(path.back().page, node)) return false;
+    position = path.back().child;
+    if (!freeOverflow(node.cells[position], node.type)) return false;
+    if (node.type == 0x02) {
+        Cell replacement(node.cells[position].begin(), node.cells[position].begin() + 4);
+        replacement.insert(replacement.end(), predecessor.begin(), predecessor.end());
+        node.cells[position] = std::move(replacement);
+        return settle(path, path.size() - 1, std::move(node), false);
+    }
+    node.cells.erase(node.cells.begin() + static_cast<ptrdiff_t>(position));
+    if (!settle(path, path.size() - 1, std::move(node), false)) return false;
+    // Then the predecessor goes back in as a leaf entry, chain and all
+    std::vector<unsigned char> payload;
+    std::vector<Value> values;
+    if (!readPayload(predecessor, 0x0A, payload) || !decodeRecord(PageView(payload), values)) return false;
+    if (!descendIndex(values.data(), values.size(), path, found) || found || !readNode(path.back().page, node)) return false;
+    node.cells.insert(node.cells.begin() + static_cast<ptrdiff_t>(path.back().child), std::move(predecessor));
+    return settle(path, path.size() - 1, std::move(node), false);
+}
+
+bool BtreeWriter::containsKey(const Value* key, size_t n, bool& found) {
+    std::vector<Step> path;
+    return descendIndex(key, n, path, found);
+}
+
+bool BtreeWriter::settle(std::vector<Step>& path, size_t level, Node node, bool appended) {
+    while (true) {
+        uint32_t page_number = path[level].page;
+        size_t used = nodeBytes(node);
+        bool overfull = used > capacity(page_number);
+        if (level == 0) {
+            if (!overfull) return node.interior() && node.cells.empty() ? collapseRoot(page_number, node) : writeNode(page_number, node);
+            // The root's cells move down to a new child, which is then
+            // split like any other page
+            uint32_t child = txn_.allocate();
+            if (child == 0) return false;
+            Node root;
+            root.type = node.type == 0x0D || node.type == 0x05 ? 0x05 : 0x02;
+            root.right = child;
+            if (!writeNode(page_number, root)) return false;
+            path[0].child = 0;
+            path.insert(path.begin() + 1, Step{child, 0});
+            level = 1;
+            continue;
+        }
+        bool underfull = used * 3 < capacity(page_number);
+        if (!overfull && !underfull) return writeNode(page_number, node);
+        Node parent;
+        if (!readNode(path[level - 1].page, parent) || !parent.interior()) return false;
+        if (!balance(parent, path[level - 1].child, node, appended && overfull)) return false;
+        node = std::move(parent);
+        --level;
+        appended = false;
+    }
+}
+
+bool BtreeWriter::balance(Node& parent, size_t child, Node& changed, bool appended) {
+    size_t num_children = parent.cells.size() + 1;
+    if (child >= num_children) return false;
+    auto childPage = [&](size_t i) { return i < parent.cells.size() ? readBE32(PageView(parent.cells[i]), 0) : parent.right; };
+
+    if (appended && changed.type == 0x0D && child == parent.cells.size() && changed.cells.size() > 1) {
+        // The new last row starts a leaf of its own to the right, which
+        // leaves the full leaf as it was
+        uint32_t page_number = childPage(child);
+        uint32_t new_page = txn_.allocate();
+        if (new_page == 0) return false;
+        Node right;
+        right.type = 0x0D;
+        right.cells.push_back(std::move(changed.cells.back()));
+        changed.cells.pop_back();
+        if (!writeNode(page_number, changed) || !writeNode(new_page, right)) return false;
+        Cell divider(4);
+        storeBE32(divider.data(), page_number);
+        appendVarint(divider, static_cast<uint64_t>(leafCellRowid(changed.cells.back())));
+        parent.cells.push_back(std::move(divider));
+        parent.right = new_page;
+        return true;
+    }
+
+    size_t n = std::min<size_t>(3, num_children);
+    size_t first = child == 0 ? 0 : child - 1;
+    if (first + n > num_children) first = num_children - n;
+    std::vector<uint32_t> old_pages(n);
+    std::vector<Node> nodes(n);
+    for (size_t j = 0; j < n; ++j) {
+        old_pages[j] = childPage(first + j);
+        if (first + j == child) nodes[j] = std::move(changed);
+        else if (!readNode(old_pages[j], nodes[j])) return false;
+    }
+    unsigned char type = nodes[child - first].type;
+    for (const Node& node : nodes) {
+        if (node.type != type) return false;
+    }
+    bool interior = nodes[0].interior();
+    // Table leaves get fresh dividers; in the other trees the dividers come
+    // down between their siblings' cells, and new ones go back up
+    bool promote = type != 0x0D;
+
+    std::vector<Cell> items;
+    for (size_t j = 0; j < n; ++j) {
+        for (Cell& cell : nodes[j].cells) items.push_back(std::move(cell));
+        if (j + 1 == n || !promote) continue;
+        const Cell& divider = parent.cells[first + j];
+        Cell item;
+        if (interior) {
+            // Its child pointer becomes the left sibling's right-most child
+            item.resize(4);
+            storeBE32(item.data(), nodes[j].right);
+        }
+        item.insert(item.end(), divider.begin() + 4, divider.end());
+        items.push_back(std::move(item));
+    }
+    uint32_t last_right = nodes[n - 1].right;
+
+    std::vector<size_t> cost(items.size());
+    for (size_t i = 0; i < items.size(); ++i) cost[i] = 2 + std::max<size_t>(4, items[i].size());
+    std::vector<std::pair<size_t, size_t>> pages = partitionItems(cost, txn_.usableSize() - (interior ? 12 : 8), promote);
+    if (pages.empty()) return false;
+
+    std::vector<uint32_t> new_pages(old_pages.begin(), old_pages.begin() + static_cast<ptrdiff_t>(std::min(n, pages.size())));
+    while (new_pages.size() < pages.size()) {
+        uint32_t page_number = txn_.allocate();
+        if (page_number == 0) return false;
+        new_pages.push_back(page_number);
+    }
+    for (size_t j = pages.size(); j < n; ++j) {
+        if (!txn_.release(old_pages[j])) return false;
+    }
+
+    std::vector<Cell> dividers;
+    for (size_t j = 0; j < pages.size(); ++j) {
+        auto [begin, end] = pages[j];
+        Node node;
+        node.type = type;
+        for (size_t i = begin; i < end; ++i) node.cells.push_back(std::move(items[i]));
+        bool last = j + 1 == pages.size();
+        if (interior) node.right = last ? last_right : readBE32(PageView(items[end]), 0);
+        if (!last) {
+            Cell divider(4);
+            storeBE32(divider.data(), new_pages[j]);
+            if (!promote) appendVarint(divider, static_cast<uint64_t>(leafCellRowid(node.cells.back())));
+            else divider.insert(divider.end(), items[end].begin() + (interior ? 4 : 0), items[end].end());
+            dividers.push_back(std::move(divider));
+        }
+        if (!writeNode(new_pages[j], node)) return false;
+    }
+
+    // The group's dividers are replaced by the new ones, and the slot that
+    // pointed at its last page points at the new last page
+    parent.cells.erase(parent.cells.begin() + static_cast<ptrdiff_t>(first), parent.cells.begin() + static_cast<ptrdiff_t>(first + n - 1));
+    if (first == parent.cells.size()) parent.right = new_pages.back();
+    else storeBE32(parent.cells[first].data(), new_pages.back());
+    parent.cells.insert(parent.cells.begin() + static_cast<ptrdiff_t>(first), std::make_move_iterator(dividers.begin()), std::make_move_iterator(dividers.end()));
+    return true;
+}
+
+bool BtreeWriter::collapseRoot(uint32_t page_number, const Node& node) {
+    Node child;
+    if (!readNode(node.right, child)) return false;
+    // Page 1 has less room than its child, which may not fit
+    if (nodeBytes(child) > capacity(page_number)) return writeNode(page_number, node);
+    return writeNode(page_number, child) && txn_.release(node.right);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Transaction.hpp"
+#include "Value.hpp"
+
+// Changes one table or index B-tree inside a transaction and keeps it
+// balanced the way SQLite does. A page that overflows is split, and a page
+// left less than a third full is merged or evened out with up to two
+// siblings. A row appended past the end of the right-most leaf starts a new
+// leaf rather than splitting the full one. The root never moves: when it
+// overflows, its cells move down to a new child, and when it is left with a
+// single child, that child moves back up if it fits. Payloads too large for a
+// page spill into overflow chains.
+//
+// Each change rewrites the pages it touches with their cells packed together
+// at the end of the page. Methods return false if the tree is malformed or a
+// page cannot be allocated.
+class BtreeWriter {
+public:
+    // An index tree passes index and the sort order of its key columns.
+    BtreeWriter(Transaction& txn, uint32_t root_page, bool index = false, std::vector<bool> descending = {})
+        : txn_(txn), root_page_(root_page), index_(index), descending_(std::move(descending)) {}
+
+    // Table trees. Copies the record stored under rowid into payload; found
+    // is false if there is none.
+    bool findRow(int64_t rowid, std::vector<unsigned char>& payload, bool& found);
+    // The largest rowid; empty is set if the table has no rows.
+    bool lastRowid(int64_t& rowid, bool& empty);
+    // Stores payload under rowid, replacing the row there if there is one.
+    bool putRow(int64_t rowid, const std::vector<unsigned char>& payload);
+    // Does nothing if there is no row with that rowid.
+    bool removeRow(int64_t rowid);
+
+    // Index trees. An entry is the key columns, then the rowid.
+    bool insertEntry(const std::vector<Value>& entry);
+    bool removeEntry(const std::vector<Value>& entry);
+    // Whether some entry starts with the n values of key.
+    bool containsKey(const Value* key, size_t n, bool& found);
+
+private:
+    using Cell = std::vector<unsigned char>;
+
+    // A page decoded into its cells, as they are laid out on the page.
+    struct Node {
+        unsigned char type = 0;
+        std::vector<Cell> cells;
+        uint32_t right = 0;
+
+        bool interior() const { return type == 0x05 || type == 0x02; }
+    };
+
+    // A page on the path from the root: the child descended into, or on the
+    // leaf the cell position.
+    struct Step {
+        uint32_t page = 0;
+        size_t child = 0;
+    };
+
+    size_t cellSize(PageView page, size_t offset, unsigned char type) const;
+    size_t nodeBytes(const Node& node) const;
+    size_t capacity(uint32_t page_number) const;
+    bool readNode(uint32_t page_number, Node& node);
+    bool writeNode(uint32_t page_number, const Node& node);
+
+    // A leaf cell for payload, with its overflow chain written.
+    bool makeCell(const std::vector<unsigned char>& payload, int64_t rowid, Cell& cell);
+    bool readPayload(const Cell& cell, unsigned char type, std::vector<unsigned char>& payload);
+    bool freeOverflow(const Cell& cell, unsigned char type);
+    int compareEntry(const std::vector<Value>& entry, const Value* key, size_t n) const;
+
+    bool descendTable(int64_t rowid, std::vector<Step>& path, bool& found);
+    // Stops at the first entry whose first n columns equal key's, on a leaf
+    // or an interior page; otherwise ends on the leaf where key belongs.
+    bool descendIndex(const Value* key, size_t n, std::vector<Step>& path, bool& found);
+
+    // Writes node as the page at path[level], then splits, merges or
+    // rebalances it and the levels above as needed. appended is set when
+    // the change added a cell after the last one of a table leaf.
+    bool settle(std::vector<Step>& path, size_t level, Node node, bool appended);
+    // Redistributes the cells of child (holding changed, which need not fit
+    // a page) and up to two of its siblings over as many pages as they need,
+    // and updates the dividers in parent.
+    bool balance(Node& parent, size_t child, Node& changed, bool appended);
+    // Moves the only child of an empty interior root up into the root.
+    bool collapseRoot(uint32_t page_number, const Node& node);
+
+    Transaction& txn_;
+    uint32_t root_page_;
+    bool index_;
+    std::vector<bool> descending_;
+    std::vector<unsigned char> scratch_;
+    std::vector<Value> values_;
+};
@@ -0,0 +1,157 @@
+#include "BufferPool.hpp"
+
+#include <unistd.h>
+
+bool readFully(int fd, unsigned char* buf, size_t len, uint64_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = ::pread(fd, buf + done, len - done, static_cast<off_t>(offset + done));
+        if (n <= 0) return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void BufferPool::reset(size_t capacity, uint32_t page_size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    page_size_ = page_size;
+    arena_.assign(capacity * page_size, 0);
+    frame_key_.assign(capacity, 0);
+    pin_count_.assign(capacity, 0);
+    referenced_.assign(capacity, 0);
+    loading_.assign(capacity, 0);
+    prefetched_.assign(capacity, 0);
+    page_table_.clear();
+    page_table_.reserve(capacity);
+    hand_ = 0;
+    stats_ = CacheStats{};
+}
+
+uint32_t BufferPool::pin(uint32_t page_number, int fd) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return pinLocked(lock, page_number, fd, static_cast<uint64_t>(page_number - 1) * page_size_, false);
+}
+
+uint32_t BufferPool::pinLogFrame(uint32_t page_number, uint32_t log_frame, int fd, uint64_t offset) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return pinLocked(lock, page_number | static_cast<uint64_t>(log_frame) << 32, fd, offset, false);
+}
+
+void BufferPool::prefetch(uint32_t page_number, int fd) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (page_table_.count(page_number) != 0) return;
+    uint32_t frame = pinLocked(lock, page_number, fd, static_cast<uint64_t>(page_number - 1) * page_size_, true);
+    if (frame != kNoFrame && pin_count_[frame] > 0) --pin_count_[frame];
+}
+
+uint32_t BufferPool::pinLocked(std::unique_lock<std::mutex>& lock, uint64_t key, int fd, uint64_t offset, bool prefetch) {
+    auto it = page_table_.find(key);
+    if (it != page_table_.end()) {
+        uint32_t frame = it->second;
+        ++pin_count_[frame];
+        referenced_[frame] = 1;
+        if (!prefetch) {
+            ++stats_.hits;
+            if (prefetched_[frame]) {
+                prefetched_[frame] = 0;
+                ++stats_.prefetch_hits;
+            }
+        }
+        loaded_.wait(lock, [&]() { return !loading_[frame]; });
+        if (frame_key_[frame] != key) {
+            // The load failed and the frame was released.
+            --pin_count_[frame];
+            return kNoFrame;
+        }
+        return frame;
+    }
+    uint32_t frame = findVictim();
+    if (frame == kNoFrame) return kNoFrame;
+    if (prefetch) ++stats_.prefetched;
+    else ++stats_.misses;
+    if (frame_key_[frame] != 0) {
+        page_table_.erase(frame_key_[frame]);
+        ++stats_.evictions;
+    }
+    frame_key_[frame] = key;
+    pin_count_[frame] = 1;
+    referenced_[frame] = 1;
+    loading_[frame] = 1;
+    prefetched_[frame] = prefetch ? 1 : 0;
+    page_table_.emplace(key, frame);
+
+    unsigned char* dst = arena_.data() + static_cast<size_t>(frame) * page_size_;
+    lock.unlock();
+    bool ok = readFully(fd, dst, page_size_, offset);
+    lock.lock();
+    loading_[frame] = 0;
+    if (ok) {
+        stats_.bytes_read += page_size_;
+    } else {
+        page_table_.erase(key);
+        frame_key_[frame] = 0;
+        --pin_count_[frame];
+        referenced_[frame] = 0;
+        frame = kNoFrame;
+    }
+    loaded_.notify_all();
+    return frame;
+}
+
+void BufferPool::unpin(uint32_t frame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (frame < pin_count_.size() && pin_count_[frame] > 0) --pin_count_[frame];
+}
+
+void BufferPool::invalidate(uint32_t page_number) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = page_table_.find(page_number);
+    if (it == page_table_.end()) return;
+    uint32_t frame = it->second;
+    loaded_.wait(lock, [&]() { return !loading_[frame]; });
+    if (frame_key_[frame] != page_number) return;
+    page_table_.erase(page_number);
+    frame_key_[frame] = 0;
+    referenced_[frame] = 0;
+    prefetched_[frame] = 0;
+}
+
+void BufferPool::dropLogFrames() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (size_t frame = 0; frame < frame_key_.size(); ++frame) {
+        if (frame_key_[frame] >> 32 == 0) continue;
+        loaded_.wait(lock, [&]() { return !loading_[frame]; });
+        if (frame_key_[frame] >> 32 == 0) continue;
+        page_table_.erase(frame_key_[frame]);
+        frame_key_[frame] = 0;
+        referenced_[frame] = 0;
+        prefetched_[frame] = 0;
+    }
+}
+
+CacheStats BufferPool::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+PageView BufferPool::frameView(uint32_t frame) const {
+    return PageView(arena_.data() + static_cast<size_t>(frame) * page_size_, page_size_);
+}
+
+uint32_t BufferPool::findVictim() {
+    size_t n = frame_key_.size();
+    if (n == 0) return kNoFrame;
+    // Two full sweeps clear every reference bit, so an unpinned frame is found
+    // by then if one exists.
+    for (size_t step = 0; step < 2 * n + 1; ++step) {
+        size_t frame = hand_;
+        hand_ = (hand_ + 1) % n;
+        if (pin_count_[frame] > 0 || loading_[frame]) continue;
+        if (frame_key_[frame] != 0 && referenced_[frame]) {
+            referenced_[frame] = 0;
+            continue;
+        }
+        return static_cast<uint32_t>(frame);
+    }
+    return kNoFrame;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+using PageView = std::span<const unsigned char>;
+
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t bytes_read = 0;
+    // Pages loaded by read-ahead, and how many of those a reader later found
+    // already resident (i.e. reads that overlapped other work).
+    uint64_t prefetched = 0;
+    uint64_t prefetch_hits = 0;
+};
+
+// Fixed-capacity page cache. All frames live in one contiguous arena that is
+// allocated up front; replacement uses the CLOCK algorithm and skips pinned
+// frames. pin and unpin may be called from several threads; the pool lock is
+// dropped while a frame is being read, and other readers of that page wait
+// for the load to finish.
+class BufferPool {
+public:
+    static constexpr uint32_t kNoFrame = UINT32_MAX;
+
+    void reset(size_t capacity, uint32_t page_size);
+    size_t capacity() const { return frame_key_.size(); }
+
+    // Pins page_number into a frame, reading it from fd on a miss. Returns
+    // kNoFrame if the read fails or every frame is pinned.
+    uint32_t pin(uint32_t page_number, int fd);
+    // Like pin, for the version of page_number in frame log_frame of the
+    // write-ahead log, whose bytes are at offset in fd. Each log frame is
+    // cached apart from the page in the database file and from other frames
+    // of the same page, so every snapshot finds the version it reads.
+    uint32_t pinLogFrame(uint32_t page_number, uint32_t log_frame, int fd, uint64_t offset);
+    void unpin(uint32_t frame);
+    // Loads page_number without keeping it pinned; does nothing if it is
+    // already resident or no frame is free.
+    void prefetch(uint32_t page_number, int fd);
+    PageView frameView(uint32_t frame) const;
+    // Drops page_number, whose bytes on disk have changed, so the next pin
+    // reads it again. A reader still holding it keeps the old bytes.
+    void invalidate(uint32_t page_number);
+    // Drops every cached log frame, for when the log starts over and its
+    // frame numbers are reused.
+    void dropLogFrames();
+
+    CacheStats stats() const;
+
+private:
+    uint32_t findVictim();
+    // key is the page number, with the log frame number, if any, in the
+    // high 32 bits.
+    uint32_t pinLocked(std::unique_lock<std::mutex>& lock, uint64_t key, int fd, uint64_t offset, bool prefetch);
+
+    mutable std::mutex mutex_;
+    std::condition_variable loaded_;
+    uint32_t page_size_ = 0;
+    std::vector<unsigned char> arena_;
+    std::vector<uint64_t> frame_key_;
+    std::vector<uint32_t> pin_count_;
+    std::vector<uint8_t> referenced_;
+    std::vector<uint8_t> loading_;
+    std::vector<uint8_t> prefetched_;
+    std::unordered_map<uint64_t, uint32_t> page_table_;
+    size_t hand_ = 0;
+    CacheStats stats_;
+};
+
+bool readFully(int fd, unsigned char* buf, size_t len, uint64_t offset);
@@ -0,0 +1,863 @@
+#include "BulkLoad.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Btree.hpp"
+#include "Catalog.hpp"
+#include "Lexer.hpp"
+#include "Record.hpp"
+#include "Script.hpp"
+#include "Sorter.hpp"
+#include "Value.hpp"
+
+namespace {
+
+constexpr size_t kWriteBufferBytes = 1 << 20;
+constexpr size_t kReadBufferBytes = 1 << 20;
+constexpr size_t kFirstPageOffset = 100;
+constexpr uint64_t kLockByteOffset = uint64_t{1} << 30;
+
+enum PageType : unsigned char { kIndexInterior = 0x02, kTableInterior = 0x05, kIndexLeaf = 0x0A, kTableLeaf = 0x0D };
+
+// Appends pages to a new file in page-number order through one large buffer,
+// so the file is written front to back in big sequential writes. Page 1 is
+// written last, once the header's page count is known.
+class PageWriter {
+public:
+    explicit PageWriter(uint32_t page_size)
+        : page_size_(page_size), lock_page_(static_cast<uint32_t>(kLockByteOffset / page_size + 1)), offset_(page_size) {
+        buffer_.reserve(kWriteBufferBytes + 2 * page_size);
+    }
+    PageWriter(const PageWriter&) = delete;
+    PageWriter& operator=(const PageWriter&) = delete;
+    ~PageWriter() {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    // Fails if the file exists.
+    bool create(const std::string& path) {
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        return fd_ >= 0;
+    }
+    uint32_t pageSize() const { return page_size_; }
+    uint32_t nextPage() const { return next_; }
+    // The number the page after page will be written as.
+    uint32_t pageAfter(uint32_t page) const { return page + 1 == lock_page_ ? page + 2 : page + 1; }
+    uint32_t pageCount() const { return next_ - 1; }
+
+    // Returns the number the page was written as.
+    uint32_t append(const unsigned char* page) {
+        uint32_t number = next_;
+        buffer_.insert(buffer_.end(), page, page + page_size_);
+        next_ = pageAfter(number);
+        // SQLite never uses the page holding the lock bytes
+        if (next_ != number + 1) buffer_.resize(buffer_.size() + page_size_, 0);
+        if (buffer_.size() >= kWriteBufferBytes) flush();
+        return number;
+    }
+    // Writes page 1 and syncs the file. False if any write failed.
+    bool finish(const unsigned char* first_page) {
+        flush();
+        if (ok_) ok_ = writeAt(first_page, page_size_, 0);
+        if (ok_) ok_ = ::fsync(fd_) == 0;
+        int fd = std::exchange(fd_, -1);
+        return ::close(fd) == 0 && ok_;
+    }
+
+private:
+    void flush() {
+        if (ok_ && !buffer_.empty()) ok_ = writeAt(buffer_.data(), buffer_.size(), offset_);
+        offset_ += static_cast<off_t>(buffer_.size());
+        buffer_.clear();
+    }
+    bool writeAt(const unsigned char* bytes, size_t size, off_t offset) {
+        while (size > 0) {
+            ssize_t n = ::pwrite(fd_, bytes, size, offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            bytes += n;
+            size -= static_cast<size_t>(n);
+            offset += n;
+        }
+        return true;
+    }
+
+    int fd_ = -1;
+    uint32_t page_size_;
+    uint32_t lock_page_;
+    uint32_t next_ = 2;
+    off_t offset_;
+    std::vector<unsigned char> buffer_;
+    bool ok_ = true;
+};
+
+// A B-tree page being filled: the page header at offset (100 on page 1), the
+// cell pointer array after it, and cell content packed down from the end.
+class Node {
+public:
+    Node(uint32_t page_size, unsigned char type, size_t offset = 0) : page_(page_size), type_(type), offset_(offset) { reset(); }
+
+    size_t count() const { return count_; }
+    bool fits(size_t cell_size) const { return headerEnd() + 2 * (count_ + 1) + cell_size <= content_; }
+    void add(const unsigned char* cell, size_t size) {
+        content_ -= size;
+        std::memcpy(page_.data() + content_, cell, size);
+        storeBE16(page_.data() + headerEnd() + 2 * count_, static_cast<uint32_t>(content_));
+        ++count_;
+        last_size_ = size;
+    }
+    void add(const std::vector<unsigned char>& cell) { add(cell.data(), cell.size()); }
+    // Takes back the cell added last.
+    void removeLast(std::vector<unsigned char>& cell) {
+        cell.assign(page_.data() + content_, page_.data() + content_ + last_size_);
+        content_ += last_size_;
+        --count_;
+    }
+    void setRightChild(uint32_t page) { storeBE32(page_.data() + offset_ + 8, page); }
+    // Fills in the header; the page is valid until the next reset().
+    const unsigned char* finish() {
+        unsigned char* header = page_.data() + offset_;
+        header[0] = type_;
+        storeBE16(header + 1, 0);
+        storeBE16(header + 3, static_cast<uint32_t>(count_));
+        // 65536 is stored as 0
+        storeBE16(header + 5, static_cast<uint32_t>(content_));
+        header[7] = 0;
+        return page_.data();
+    }
+    void reset() {
+        std::fill(page_.begin() + static_cast<ptrdiff_t>(offset_), page_.end(), 0);
+        content_ = page_.size();
+        count_ = 0;
+    }
+    unsigned char* data() { return page_.data(); }
+
+private:
+    bool leaf() const { return type_ == kTableLeaf || type_ == kIndexLeaf; }
+    size_t headerEnd() const { return offset_ + (leaf() ? 8 : 12); }
+
+    std::vector<unsigned char> page_;
+    unsigned char type_;
+    size_t offset_;
+    size_t content_ = 0;
+    size_t count_ = 0;
+    size_t last_size_ = 0;
+};
+
+// Byte strings stored back to back.
+class CellList {
+public:
+    size_t size() const { return ends_.size(); }
+    const unsigned char* data(size_t i) const { return bytes_.data() + start(i); }
+    size_t length(size_t i) const { return ends_[i] - start(i); }
+    void add(const unsigned char* bytes, size_t size) {
+        bytes_.insert(bytes_.end(), bytes, bytes + size);
+        ends_.push_back(bytes_.size());
+    }
+    void add(const std::vector<unsigned char>& bytes) { add(bytes.data(), bytes.size()); }
+    void replaceLast(const std::vector<unsigned char>& bytes) {
+        bytes_.resize(start(size() - 1));
+        ends_.pop_back();
+        add(bytes);
+    }
+
+private:
+    size_t start(size_t i) const { return i == 0 ? 0 : ends_[i - 1]; }
+
+    std::vector<unsigned char> bytes_;
+    std::vector<size_t> ends_;
+};
+
+// Makes the cell of a table row (index is false) or an index entry: the
+// payload size, the rowid, as much payload as SQLite keeps on the page, and
+// the first overflow page. Overflow pages are written right away.
+void makeCell(PageWriter& writer, bool index, int64_t rowid, const std::vector<unsigned char>& payload, std::vector<unsigned char>& cell) {
+    size_t usable = writer.pageSize();
+    size_t max_local = index ? (usable - 12) * 64 / 255 - 23 : usable - 35;
+    size_t min_local = (usable - 12) * 32 / 255 - 23;
+    size_t size = payload.size();
+    size_t local = size;
+    if (size > max_local) {
+        local = min_local + (size - min_local) % (usable - 4);
+        if (local > max_local) local = min_local;
+    }
+    cell.clear();
+    appendVarint(cell, size);
+    if (!index) appendVarint(cell, static_cast<uint64_t>(rowid));
+    cell.insert(cell.end(), payload.begin(), payload.begin() + static_cast<ptrdiff_t>(local));
+    if (local == size) return;
+    // The chain's pages are written one after another, so each knows the
+    // next one's number
+    unsigned char first[4];
+    storeBE32(first, writer.nextPage());
+    cell.insert(cell.end(), first, first + 4);
+    std::vector<unsigned char> page(usable);
+    for (size_t done = local; done < size;) {
+        size_t chunk = std::min(size - done, usable - 4);
+        std::fill(page.begin(), page.end(), 0);
+        storeBE32(page.data(), done + chunk < size ? writer.pageAfter(writer.nextPage()) : 0);
+        std::memcpy(page.data() + 4, payload.data() + done, chunk);
+        writer.append(page.data());
+        done += chunk;
+    }
+}
+
+// Builds one B-tree bottom-up from cells in key order. Leaves are written as
+// they fill; only their page numbers and the divider keys between them are
+// kept, and finish() packs those into the interior levels one level at a
+// time, so each level is written sequentially after the one below.
+class TreeBuilder {
+public:
+    TreeBuilder(PageWriter& writer, bool index)
+        : writer_(writer),
+          index_(index),
+          leaf_(writer.pageSize(), index ? kIndexLeaf : kTableLeaf),
+          pending_(writer.pageSize(), index ? kIndexLeaf : kTableLeaf) {}
+
+    // Table rows, by increasing rowid.
+    void addRow(int64_t rowid, const std::vector<unsigned char>& record) {
+        makeCell(writer_, false, rowid, record, cell_);
+        if (!leaf_.fits(cell_.size())) {
+            // The divider of a table is the largest rowid on its left
+            children_.push_back(write(leaf_));
+            divider_.clear();
+            appendVarint(divider_, static_cast<uint64_t>(last_rowid_));
+            dividers_.add(divider_);
+        }
+        leaf_.add(cell_);
+        last_rowid_ = rowid;
+    }
+
+    // Index entries, in index order. An index keeps each entry once, so the
+    // entry that does not fit in a full leaf goes up as the divider.
+    void addEntry(const std::vector<unsigned char>& record) {
+        makeCell(writer_, true, 0, record, cell_);
+        if (leaf_.fits(cell_.size())) {
+            leaf_.add(cell_);
+            return;
+        }
+        if (has_pending_) children_.push_back(write(pending_));
+        std::swap(leaf_, pending_);
+        has_pending_ = true;
+        dividers_.add(cell_);
+    }
+
+    // Writes the rest of the tree and returns its root page.
+    uint32_t finish() {
+        if (has_pending_) {
+            if (leaf_.count() == 0) {
+                // The last entry went up with nothing after it: it comes
+                // down into the last leaf, and the one before it goes up
+                divider_.assign(dividers_.data(dividers_.size() - 1), dividers_.data(dividers_.size() - 1) + dividers_.length(dividers_.size() - 1));
+                leaf_.add(divider_);
+                pending_.removeLast(cell_);
+                dividers_.replaceLast(cell_);
+            }
+            children_.push_back(write(pending_));
+        }
+        children_.push_back(write(leaf_));
+        return buildInterior();
+    }
+
+private:
+    uint32_t write(Node& node) {
+        uint32_t page = writer_.append(node.finish());
+        node.reset();
+        return page;
+    }
+
+    // dividers_[i] separates children_[i] and children_[i + 1]. Each pass
+    // packs cells greedily into nodes; the divider after a node's last child
+    // goes up to the next level.
+    uint32_t buildInterior() {
+        size_t usable = writer_.pageSize();
+        Node node(writer_.pageSize(), index_ ? kIndexInterior : kTableInterior);
+        std::vector<unsigned char> cell;
+        while (children_.size() > 1) {
+            size_t last = children_.size() - 1;
+            // Ranges of children; each node holds the dividers between its own
+            std::vector<std::pair<size_t, size_t>> nodes;
+            size_t first = 0, used = 12;
+            for (size_t i = 0; i < last; ++i) {
+                size_t cost = 2 + 4 + dividers_.length(i);
+                if (used + cost <= usable) {
+                    used += cost;
+                    continue;
+                }
+                nodes.emplace_back(first, i);
+                first = i + 1;
+                used = 12;
+            }
+            nodes.emplace_back(first, last);
+            if (nodes.size() > 1 && nodes.back().first == last) {
+                // A node needs a cell besides its right child: take one from
+                // the node before
+                --nodes[nodes.size() - 2].second;
+                --nodes.back().first;
+            }
+            std::vector<uint32_t> parents;
+            CellList parent_dividers;
+            for (auto [from, to] : nodes) {
+                for (size_t i = from; i < to; ++i) {
+                    cell.resize(4);
+                    storeBE32(cell.data(), children_[i]);
+                    cell.insert(cell.end(), dividers_.data(i), dividers_.data(i) + dividers_.length(i));
+                    node.add(cell);
+                }
+                node.setRightChild(children_[to]);
+                parents.push_back(write(node));
+                if (to < last) parent_dividers.add(dividers_.data(to), dividers_.length(to));
+            }
+            children_ = std::move(parents);
+            dividers_ = std::move(parent_dividers);
+        }
+        return children_.front();
+    }
+
+    PageWriter& writer_;
+    bool index_;
+    Node leaf_;
+    // A full index leaf held back until the next leaf has an entry, in case
+    // the last entry must come down from the divider above it.
+    Node pending_;
+    bool has_pending_ = false;
+    int64_t last_rowid_ = 0;
+    std::vector<unsigned char> cell_;
+    std::vector<unsigned char> divider_;
+    std::vector<uint32_t> children_;
+    CellList dividers_;
+};
+
+// Reads a file or stdin through a large buffer.
+class Input {
+public:
+    Input() : buffer_(kReadBufferBytes) {}
+    Input(const Input&) = delete;
+    Input& operator=(const Input&) = delete;
+    ~Input() {
+        if (fd_ > STDIN_FILENO) ::close(fd_);
+    }
+
+    bool open(const std::string& path) {
+        fd_ = path == "-" ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        return fd_ >= 0;
+    }
+    // The next byte, or -1 at the end of the input.
+    int get() {
+        if (pos_ == end_ && !fill()) return -1;
+        return buffer_[pos_++];
+    }
+    // Returns how many bytes were read; fewer than size only at the end.
+    size_t read(unsigned char* out, size_t size) {
+        size_t done = 0;
+        while (done < size) {
+            if (pos_ == end_ && !fill()) break;
+            size_t n = std::min(size - done, end_ - pos_);
+            std::memcpy(out + done, buffer_.data() + pos_, n);
+            pos_ += n;
+            done += n;
+        }
+        return done;
+    }
+    bool failed() const { return failed_; }
+
+private:
+    bool fill() {
+        while (true) {
+            ssize_t n = ::read(fd_, buffer_.data(), buffer_.size());
+            if (n < 0 && errno == EINTR) continue;
+            failed_ = n < 0;
+            pos_ = 0;
+            end_ = n > 0 ? static_cast<size_t>(n) : 0;
+            return n > 0;
+        }
+    }
+
+    int fd_ = -1;
+    std::vector<unsigned char> buffer_;
+    size_t pos_ = 0, end_ = 0;
+    bool failed_ = false;
+};
+
+// Reads CSV records the way the sqlite3 shell's .import does: fields
+// separated by ',', records by '\n' (a '\r' before it is dropped), and quoted
+// fields with "" for a quote, which may span lines.
+class CsvReader {
+public:
+    explicit CsvReader(Input& in) : in_(in) {}
+
+    // Returns false at the end of the input. The fields point into the
+    // reader and are valid until the next call.
+    bool next(std::vector<Value>& fields) {
+        bytes_.clear();
+        spans_.clear();
+        fields.clear();
+        int c = in_.get();
+        if (c < 0) return false;
+        while (true) {
+            size_t start = bytes_.size();
+            if (c == '"') {
+                while ((c = in_.get()) >= 0) {
+                    if (c == '"' && (c = in_.get()) != '"') break;
+                    bytes_.push_back(static_cast<unsigned char>(c));
+                }
+            }
+            while (c >= 0 && c != ',' && c != '\n') {
+                bytes_.push_back(static_cast<unsigned char>(c));
+                c = in_.get();
+            }
+            size_t end = bytes_.size();
+            if (c != ',' && end > start && bytes_[end - 1] == '\r') --end;
+            spans_.emplace_back(start, end - start);
+            if (c != ',') break;
+            c = in_.get();
+        }
+        for (auto [start, size] : spans_) fields.push_back(Value::makeText(bytes_.data() + start, size));
+        return true;
+    }
+
+private:
+    Input& in_;
+    std::vector<unsigned char> bytes_;
+    std::vector<std::pair<size_t, size_t>> spans_;
+};
+
+uint64_t loadLittleEndian(const unsigned char* p, size_t size) {
+    uint64_t v = 0;
+    for (size_t i = size; i-- > 0;) v = (v << 8) | p[i];
+    return v;
+}
+
+// Reads one row of the binary format ResultSink writes. Returns false at the
+// end of the input, or with error set if the row is cut short or malformed.
+bool readBinaryRow(Input& in, std::string& bytes, std::vector<Value>& fields, std::string& error) {
+    fields.clear();
+    unsigned char length[4];
+    size_t n = in.read(length, 4);
+    if (n == 0) return false;
+    uint32_t size = static_cast<uint32_t>(loadLittleEndian(length, 4));
+    bytes.resize(size);
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(bytes.data());
+    if (n < 4 || size < 2 || in.read(reinterpret_cast<unsigned char*>(bytes.data()), size) < size) {
+        error = "truncated row";
+        return false;
+    }
+    const unsigned char* end = p + size;
+    size_t count = loadLittleEndian(p, 2);
+    p += 2;
+    for (size_t i = 0; i < count; ++i) {
+        if (p == end) break;
+        unsigned char tag = *p++;
+        Value value;
+        size_t body = tag == 1 || tag == 2 ? 8 : tag == 3 || tag == 4 ? 4 : 0;
+        if (tag > 4 || static_cast<size_t>(end - p) < body) break;
+        if (tag == 1) value = Value::makeInteger(static_cast<int64_t>(loadLittleEndian(p, 8)));
+        else if (tag == 2) value = Value::makeReal(std::bit_cast<double>(loadLittleEndian(p, 8)));
+        p += body;
+        if (tag == 3 || tag == 4) {
+            size_t len = loadLittleEndian(p - 4, 4);
+            if (static_cast<size_t>(end - p) < len) break;
+            value = Value::makeText(p, len);
+            if (tag == 4) value.type = Value::Type::Blob;
+            p += len;
+        }
+        fields.push_back(value);
+    }
+    if (fields.size() != count || p != end) {
+        error = "malformed row";
+        return false;
+    }
+    return true;
+}
+
+bool isName(const Token& token) {
+    return token.kind == Token::Kind::Identifier || token.kind == Token::Kind::QuotedIdentifier || token.kind == Token::Kind::String;
+}
+
+// Reads the statements into sqlite_schema rows: the table first, then its
+// indexes. Sort order per index key column goes to descending.
+bool parseSchema(const std::string& schema, std::vector<SchemaEntry>& entries, std::vector<std::vector<bool>>& descending, std::string& error) {
+    std::vector<Token> tokens;
+    for (const std::string& sql : splitStatements(schema)) {
+        if (!tokenize(sql, tokens, error)) return false;
+        size_t i = 0;
+        auto at = [&](size_t k) -> const Token& { return tokens[std::min(k, tokens.size() - 1)]; };
+        auto skipIfNotExists = [&]() {
+            if (at(i).isKeyword("IF") && at(i + 1).isKeyword("NOT") && at(i + 2).isKeyword("EXISTS")) i += 3;
+        };
+        if (!at(i++).isKeyword("CREATE")) {
+            error = "only CREATE TABLE and CREATE INDEX statements can be bulk loaded";
+            return false;
+        }
+        bool unique = at(i).isKeyword("UNIQUE");
+        if (unique) ++i;
+        SchemaEntry entry;
+        entry.sql = sql;
+        if (!unique && at(i).isKeyword("TABLE")) {
+            ++i;
+            skipIfNotExists();
+            if (!entries.empty()) {
+                error = "only one table can be bulk loaded at a time";
+                return false;
+            }
+            if (!isName(at(i)) || !at(i + 1).isOperator("(")) {
+                error = "expected a column list after CREATE TABLE " + at(i).text;
+                return false;
+            }
+            entry.type = "table";
+            entry.name = entry.table_name = at(i).text;
+            for (size_t k = i; k < tokens.size(); ++k) {
+                const Token& t = tokens[k];
+                if (t.isKeyword("CHECK")) error = "CHECK constraints are not supported";
+                else if (t.isKeyword("AS") || t.isKeyword("GENERATED")) error = "generated columns are not supported";
+                else if (t.isKeyword("COLLATE") && !at(k + 1).isKeyword("BINARY")) error = "collations other than BINARY are not supported";
+                if (!error.empty()) return false;
+            }
+            entries.push_back(std::move(entry));
+            descending.emplace_back();
+            continue;
+        }
+        if (!at(i).isKeyword("INDEX")) {
+            error = "only CREATE TABLE and CREATE INDEX statements can be bulk loaded";
+            return false;
+        }
+        ++i;
+        skipIfNotExists();
+        if (entries.empty()) {
+            error = "CREATE TABLE must come before CREATE INDEX";
+            return false;
+        }
+        if (!isName(at(i)) || !at(i + 1).isKeyword("ON") || !isName(at(i + 2)) || !at(i + 3).isOperator("(")) {
+            error = "expected CREATE INDEX name ON table (column, ...)";
+            return false;
+        }
+        entry.type = "index";
+        entry.name = at(i).text;
+        entry.table_name = at(i + 2).text;
+        if (normalizeIdentifier(entry.table_name) != normalizeIdentifier(entries.front().name)) {
+            error = "no such table: " + entry.table_name;
+            return false;
+        }
+        entry.table_name = entries.front().name;
+        std::vector<bool> order;
+        for (i += 4;; ++i) {
+            // column [COLLATE BINARY] [ASC | DESC]
+            if (!isName(at(i))) {
+                error = "index " + entry.name + ": only columns can be index keys";
+                return false;
+            }
+            ++i;
+            if (at(i).isKeyword("COLLATE")) {
+                if (!at(i + 1).isKeyword("BINARY")) {
+                    error = "collations other than BINARY are not supported";
+                    return false;
+                }
+                i += 2;
+            }
+            bool desc = at(i).isKeyword("DESC");
+            if (desc || at(i).isKeyword("ASC")) ++i;
+            order.push_back(desc);
+            if (at(i).isOperator(")")) break;
+            if (!at(i).isOperator(",")) {
+                error = "index " + entry.name + ": only columns can be index keys";
+                return false;
+            }
+        }
+        if (at(i + 1).kind != Token::Kind::End) {
+            error = at(i + 1).isKeyword("WHERE") ? "partial indexes are not supported" : "unexpected text after CREATE INDEX " + entry.name;
+            return false;
+        }
+        entries.push_back(std::move(entry));
+        descending.push_back(std::move(order));
+    }
+    if (entries.empty()) {
+        error = "the schema has no CREATE TABLE statement";
+        return false;
+    }
+    for (size_t e = 0; e < entries.size(); ++e) {
+        std::string name = normalizeIdentifier(entries[e].name);
+        if (name.starts_with("SQLITE_")) {
+            error = "object name reserved for internal use: " + entries[e].name;
+            return false;
+        }
+        for (size_t other = 0; other < e; ++other) {
+            if (normalizeIdentifier(entries[other].name) == name) {
+                error = (entries[e].type == "index" ? "index " : "table ") + entries[e].name + " already exists";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Writes the header and sqlite_schema into page 1. Schema rows that do not
+// all fit on page 1 go one per leaf, under page 1 as an interior page.
+bool writeSchema(PageWriter& writer, const std::vector<SchemaEntry>& entries, std::vector<unsigned char>& first_page, std::string& error) {
+    CellList cells;
+    std::vector<unsigned char> record, cell;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const SchemaEntry& e = entries[i];
+        auto text = [](const std::string& s) { return Value::makeText(reinterpret_cast<const unsigned char*>(s.data()), s.size()); };
+        Value row[5] = {text(e.type), text(e.name), text(e.table_name), Value::makeInteger(e.root_page), text(e.sql)};
+        record.clear();
+        appendRecord(record, row, 5);
+        makeCell(writer, false, static_cast<int64_t>(i + 1), record, cell);
+        cells.add(cell);
+    }
+    uint32_t page_size = writer.pageSize();
+    Node root(page_size, kTableLeaf, kFirstPageOffset);
+    size_t needed = 0;
+    for (size_t i = 0; i < cells.size(); ++i) needed += 2 + cells.length(i);
+    if (kFirstPageOffset + 8 + needed <= page_size) {
+        for (size_t i = 0; i < cells.size(); ++i) root.add(cells.data(i), cells.length(i));
+    } else {
+        if (cells.size() < 2) {
+            error = "the CREATE TABLE statement is too long for the page size";
+            return false;
+        }
+        root = Node(page_size, kTableInterior, kFirstPageOffset);
+        Node leaf(page_size, kTableLeaf);
+        for (size_t i = 0; i < cells.size(); ++i) {
+            leaf.add(cells.data(i), cells.length(i));
+            uint32_t page = writer.append(leaf.finish());
+            leaf.reset();
+            if (i + 1 == cells.size()) {
+                root.setRightChild(page);
+                break;
+            }
+            cell.resize(4);
+            storeBE32(cell.data(), page);
+            appendVarint(cell, i + 1);
+            root.add(cell);
+        }
+    }
+    root.finish();
+    first_page.assign(root.data(), root.data() + page_size);
+
+    unsigned char* header = first_page.data();
+    std::memcpy(header, "SQLite format 3", 16);
+    storeBE16(header + 16, page_size == 65536 ? 1 : page_size);
+    header[18] = 1;  // rollback journal, not WAL
+    header[19] = 1;
+    header[20] = 0;   // reserved bytes per page
+    header[21] = 64;  // payload fractions
+    header[22] = 32;
+    header[23] = 32;
+    storeBE32(header + 24, 1);  // change counter
+    storeBE32(header + 28, writer.pageCount());
+    storeBE32(header + 40, 1);  // schema cookie
+    storeBE32(header + 44, 4);  // schema format
+    storeBE32(header + 56, 1);  // UTF-8
+    storeBE32(header + 92, 1);  // version-valid-for, matching the change counter
+    storeBE32(header + 96, 3045000);
+    return true;
+}
+
+// Copies the text and blob bytes of values into storage so they outlive the
+// row they came from.
+void keepValues(const Value* values, size_t n, std::vector<Value>& kept, std::vector<std::string>& storage) {
+    kept.assign(values, values + n);
+    storage.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        if (kept[i].type != Value::Type::Text && kept[i].type != Value::Type::Blob) continue;
+        storage[i].assign(reinterpret_cast<const char*>(kept[i].data), kept[i].size);
+        kept[i].data = reinterpret_cast<const unsigned char*>(storage[i].data());
+    }
+}
+
+bool load(PageWriter& writer, const BulkLoadOptions& options, std::string& error) {
+    std::vector<SchemaEntry> entries;
+    std::vector<std::vector<bool>> descending;
+    if (!parseSchema(options.schema, entries, descending, error)) return false;
+    Catalog catalog;
+    catalog.build(entries);
+    const TableInfo& table = catalog.tables().front();
+    const std::vector<IndexInfo>& indexes = catalog.indexes();
+    if (table.columns.empty()) {
+        error = "table " + table.name + " has no columns";
+        return false;
+    }
+    if (indexes.size() + 1 != entries.size()) {
+        for (size_t e = 1; e < entries.size(); ++e) {
+            bool found = std::any_of(indexes.begin(), indexes.end(), [&](const IndexInfo& index) { return index.name == entries[e].name; });
+            if (!found) error = "index " + entries[e].name + " names a column " + table.name + " does not have";
+        }
+        return false;
+    }
+    // SQLite would expect an automatic index for these
+    std::vector<Token> tokens;
+    tokenize(table.sql, tokens, error);
+    for (const Token& t : tokens) {
+        if (t.isKeyword("UNIQUE") || (t.isKeyword("PRIMARY") && table.rowid_alias < 0) || t.isKeyword("WITHOUT")) {
+            error = "UNIQUE, PRIMARY KEY (other than INTEGER PRIMARY KEY) and WITHOUT ROWID tables are not supported; use CREATE UNIQUE INDEX";
+            return false;
+        }
+    }
+
+    Input input;
+    if (!input.open(options.input_path)) {
+        error = "cannot open " + options.input_path + ": " + std::strerror(errno);
+        return false;
+    }
+    size_t ncols = table.columns.size();
+    ssize_t alias = table.rowid_alias;
+    size_t sorts = indexes.size() + (alias >= 0 ? 1 : 0);
+    size_t budget = options.memory_budget / std::max<size_t>(sorts, 1);
+    // Rows are sorted by rowid only when the rowid comes from the input;
+    // each row carries its rowid as a last value
+    std::unique_ptr<Sorter> row_sorter;
+    if (alias >= 0) row_sorter = std::make_unique<Sorter>(std::vector<bool>{false}, ncols + 1, -1, budget);
+    // Index entries are the key columns then the rowid, sorted on all of them
+    std::vector<std::unique_ptr<Sorter>> entry_sorters;
+    for (size_t x = 0; x < indexes.size(); ++x) {
+        std::vector<bool> order = descending[x + 1];
+        order.push_back(false);
+        entry_sorters.push_back(std::make_unique<Sorter>(order, order.size(), -1, budget));
+    }
+
+    TreeBuilder rows(writer, false);
+    CsvReader csv(input);
+    std::string bytes;
+    std::vector<Value> fields, values(ncols + 1), entry;
+    std::vector<std::string> scratch(ncols);
+    std::vector<unsigned char> record;
+    int64_t last_rowid = 0;
+    uint64_t row_number = 0;
+    while (true) {
+        bool more = options.input_format == OutputFormat::Binary ? readBinaryRow(input, bytes, fields, error) : csv.next(fields);
+        if (!more) break;
+        ++row_number;
+        auto where = [&]() { return " (row " + std::to_string(row_number) + ")"; };
+        if (fields.size() != ncols) {
+            error = table.name + " has " + std::to_string(ncols) + " columns but " + std::to_string(fields.size()) + " values were supplied" + where();
+            return false;
+        }
+        for (size_t c = 0; c < ncols; ++c) {
+            values[c] = applyAffinity(fields[c], table.columns[c].affinity, scratch[c]);
+            if (values[c].isNull() && table.columns[c].not_null && static_cast<ssize_t>(c) != alias) {
+                error = "NOT NULL constraint failed: " + table.name + "." + table.columns[c].name + where();
+                return false;
+            }
+        }
+        int64_t rowid = 0;
+        if (alias >= 0) {
+            // Without a value, the rowid is one past the largest so far
+            const Value& key = values[static_cast<size_t>(alias)];
+            if (key.type == Value::Type::Integer) rowid = key.integer;
+            else if (!key.isNull()) error = "datatype mismatch" + where();
+            else if (row_number == 1) rowid = 1;
+            else if (last_rowid == std::numeric_limits<int64_t>::max()) error = "no rowid is left after " + std::to_string(last_rowid) + where();
+            else rowid = last_rowid + 1;
+            if (!error.empty()) return false;
+            last_rowid = row_number == 1 ? rowid : std::max(last_rowid, rowid);
+        } else {
+            rowid = ++last_rowid;
+        }
+        values[ncols] = Value::makeInteger(rowid);
+        for (size_t x = 0; x < indexes.size(); ++x) {
+            entry.clear();
+            for (size_t c : indexes[x].columns) entry.push_back(static_cast<ssize_t>(c) == alias ? values[ncols] : values[c]);
+            entry.push_back(values[ncols]);
+            entry_sorters[x]->add(entry.data(), entry.data());
+        }
+        // The INTEGER PRIMARY KEY is stored as NULL; the rowid holds it
+        if (alias >= 0) {
+            values[static_cast<size_t>(alias)] = Value{};
+            row_sorter->add(&values[ncols], values.data());
+            continue;
+        }
+        record.clear();
+        appendRecord(record, values.data(), ncols);
+        rows.addRow(rowid, record);
+    }
+    if (!error.empty() || input.failed()) {
+        if (error.empty()) error = std::string("read failed: ") + std::strerror(errno);
+        error += " (row " + std::to_string(row_number + 1) + ")";
+        return false;
+    }
+    if (alias >= 0) {
+        bool first = true;
+        int64_t previous = 0;
+        row_sorter->finish([&](const Value* row) {
+            int64_t rowid = row[ncols].integer;
+            if (!first && rowid == previous) {
+                error = "UNIQUE constraint failed: " + table.name + "." + table.columns[static_cast<size_t>(alias)].name + " (rowid " + std::to_string(rowid) + ")";
+                return false;
+            }
+            first = false;
+            previous = rowid;
+            record.clear();
+            appendRecord(record, row, ncols);
+            rows.addRow(rowid, record);
+            return true;
+        });
+        if (!error.empty()) return false;
+    }
+    entries[0].root_page = rows.finish();
+
+    for (size_t x = 0; x < indexes.size(); ++x) {
+        const IndexInfo& index = indexes[x];
+        size_t keys = index.columns.size();
+        TreeBuilder tree(writer, true);
+        std::vector<Value> previous;
+        std::vector<std::string> storage;
+        entry_sorters[x]->finish([&](const Value* key) {
+            if (index.unique) {
+                // NULLs are distinct from each other
+                bool duplicate = !previous.empty();
+                for (size_t k = 0; duplicate && k < keys; ++k) duplicate = !key[k].isNull() && compareValues(key[k], previous[k]) == 0;
+                if (duplicate) {
+                    error = "UNIQUE constraint failed: ";
+                    for (size_t k = 0; k < keys; ++k) error += (k > 0 ? ", " : "") + table.name + "." + table.columns[index.columns[k]].name;
+                    error += " (rowid " + std::to_string(key[keys].integer) + ")";
+                    return false;
+                }
+                keepValues(key, keys, previous, storage);
+            }
+            record.clear();
+            appendRecord(record, key, keys + 1);
+            tree.addEntry(record);
+            return true;
+        });
+        if (!error.empty()) return false;
+        entry_sorters[x].reset();
+        entries[x + 1].root_page = tree.finish();
+    }
+
+    std::vector<unsigned char> first_page;
+    if (!writeSchema(writer, entries, first_page, error)) return false;
+    if (!writer.finish(first_page.data())) {
+        error = std::string("write failed: ") + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int bulkLoad(const std::string& path, const BulkLoadOptions& options, std::ostream& err) {
+    std::string error;
+    PageWriter writer(options.page_size);
+    if (!writer.create(path)) {
+        err << "Error: cannot create " << path << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    if (!load(writer, options, error)) {
+        ::unlink(path.c_str());
+        err << "Error: " << error << std::endl;
+        return 1;
+    }
+    return 0;
+}
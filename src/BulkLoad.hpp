@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+#include "ResultSink.hpp"
+
+struct BulkLoadOptions {
+    // A CREATE TABLE statement, then any CREATE INDEX statements on that
+    // table, separated by ';'.
+    std::string schema;
+    // CSV or the binary row format, from a file or "-" for stdin.
+    std::string input_path;
+    OutputFormat input_format = OutputFormat::Csv;
+    uint32_t page_size = 4096;
+    // Bytes of rows held in memory by each sort before it spills.
+    size_t memory_budget = size_t{64} << 20;
+};
+
+// Writes a new SQLite database at path holding one table loaded from the
+// input, and its indexes. Nothing is inserted row by row: rows go in rowid
+// order into leaf pages packed full and written one after another, and the
+// interior levels are built bottom-up from the list of pages below them.
+// Each index is built the same way from its (key, rowid) entries, sorted
+// with spilling to temporary files. Rowids are sorted the same way if the
+// table has an INTEGER PRIMARY KEY, and otherwise numbered in input order.
+//
+// Values take the column's affinity as INSERT would give them; CSV fields
+// are text until then. The file is not overwritten if it exists, and is
+// removed again on failure. Returns 0, or 1 after writing an error to err.
+int bulkLoad(const std::string& path, const BulkLoadOptions& options, std::ostream& err);
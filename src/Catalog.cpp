@@ -0,0 +1,412 @@
+#include "Catalog.hpp"
+
+#include <cctype>
+#include <cstdlib>
+#include <limits>
+
+#include "Btree.hpp"
+#include "Profiler.hpp"
+#include "Record.hpp"
+
+namespace {
+
+std::string toUpper(std::string_view s) {
+    std::string out(s);
+    for (char& c : out) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    return out;
+}
+
+bool isSpace(char c) { return std::isspace(static_cast<unsigned char>(c)) != 0; }
+
+// Reads one token of a column or index definition at pos: a quoted
+// identifier, a parenthesised group, or a run of other characters.
+std::string_view nextToken(std::string_view s, size_t& pos) {
+    while (pos < s.size() && isSpace(s[pos])) ++pos;
+    if (pos >= s.size()) return {};
+    size_t start = pos;
+    char c = s[pos];
+    char close = c == '"' ? '"' : c == '`' ? '`' : c == '[' ? ']' : c == '\'' ? '\'' : '\0';
+    if (close != '\0') {
+        ++pos;
+        while (pos < s.size()) {
+            if (s[pos] == close) {
+                if (close != ']' && pos + 1 < s.size() && s[pos + 1] == close) {
+                    pos += 2;
+                    continue;
+                }
+                ++pos;
+                break;
+            }
+            ++pos;
+        }
+    } else if (c == '(') {
+        int depth = 0;
+        for (; pos < s.size(); ++pos) {
+            if (s[pos] == '(') ++depth;
+            else if (s[pos] == ')' && --depth == 0) {
+                ++pos;
+                break;
+            }
+        }
+    } else {
+        while (pos < s.size() && !isSpace(s[pos]) && s[pos] != '(' && s[pos] != ',') ++pos;
+        if (pos == start) ++pos;
+    }
+    return s.substr(start, pos - start);
+}
+
+// Splits the text between the parentheses at open_pos on top-level commas.
+std::vector<std::string_view> splitParenthesised(std::string_view s, size_t open_pos) {
+    std::vector<std::string_view> parts;
+    int depth = 0;
+    char quote = '\0';
+    size_t start = open_pos + 1;
+    for (size_t i = open_pos; i < s.size(); ++i) {
+        char c = s[i];
+        if (quote != '\0') {
+            if (c == quote) quote = '\0';
+            continue;
+        }
+        if (c == '"' || c == '`' || c == '\'') quote = c;
+        else if (c == '[') quote = ']';
+        else if (c == '(') ++depth;
+        else if (c == ')' && --depth == 0) {
+            parts.push_back(s.substr(start, i - start));
+            break;
+        } else if (c == ',' && depth == 1) {
+            parts.push_back(s.substr(start, i - start));
+            start = i + 1;
+        }
+    }
+    return parts;
+}
+
+bool isKeyword(std::string_view token, std::initializer_list<const char*> keywords) {
+    std::string upper = toUpper(token);
+    for (const char* kw : keywords) {
+        if (upper == kw) return true;
+    }
+    return false;
+}
+
+// Parses one entry of a CREATE TABLE column list. Returns false for table
+// constraints; single-column PRIMARY KEY constraints are reported through
+// primary_key_column. A CHECK constraint, generated column or AUTOINCREMENT,
+// which writes do not handle, is described in unsupported.
+bool parseColumnDefinition(std::string_view def, ColumnInfo& column, bool& primary_key, std::string& primary_key_column, std::string& unsupported) {
+    size_t pos = 0;
+    std::string_view first = nextToken(def, pos);
+    if (first.empty()) return false;
+    {
+        size_t p = 0;
+        std::string_view tok;
+        while (!(tok = nextToken(def, p)).empty()) {
+            if (isKeyword(tok, {"CHECK"})) unsupported = "CHECK constraints are not supported";
+            else if (isKeyword(tok, {"GENERATED", "AS"})) unsupported = "generated columns are not supported";
+            else if (isKeyword(tok, {"AUTOINCREMENT"})) unsupported = "AUTOINCREMENT is not supported";
+        }
+    }
+    if (isKeyword(first, {"CONSTRAINT", "PRIMARY", "UNIQUE", "CHECK", "FOREIGN"})) {
+        size_t p = 0;
+        std::string_view tok;
+        while (!(tok = nextToken(def, p)).empty()) {
+            if (isKeyword(tok, {"KEY"})) {
+                std::string_view cols = nextToken(def, p);
+                if (!cols.empty() && cols.front() == '(') {
+                    std::vector<std::string_view> parts = splitParenthesised(cols, 0);
+                    if (parts.size() == 1) {
+                        size_t q = 0;
+                        primary_key_column = normalizeIdentifier(nextToken(parts[0], q));
+                    }
+                }
+                break;
+            }
+        }
+        return false;
+    }
+    column.name = std::string(first);
+    if (!column.name.empty() && (column.name.front() == '"' || column.name.front() == '`' || column.name.front() == '[' || column.name.front() == '\'')) {
+        column.name = column.name.substr(1, column.name.size() - 2);
+    }
+    std::string type;
+    std::string_view tok;
+    bool in_type = true;
+    primary_key = false;
+    while (!(tok = nextToken(def, pos)).empty()) {
+        if (in_type && isKeyword(tok, {"CONSTRAINT", "PRIMARY", "NOT", "NULL", "UNIQUE", "CHECK", "DEFAULT", "COLLATE", "REFERENCES", "GENERATED", "AS"})) {
+            in_type = false;
+        }
+        if (in_type) {
+            if (!type.empty() && tok.front() != '(') type.push_back(' ');
+            type += tok;
+        } else if (isKeyword(tok, {"NOT"})) {
+            size_t p = pos;
+            if (isKeyword(nextToken(def, p), {"NULL"})) column.not_null = true;
+        } else if (isKeyword(tok, {"DEFAULT"})) {
+            column.default_value = std::string(nextToken(def, pos));
+        } else if (isKeyword(tok, {"COLLATE"})) {
+            column.collation = normalizeIdentifier(nextToken(def, pos));
+        } else if (isKeyword(tok, {"PRIMARY"})) {
+            primary_key = true;
+            size_t p = pos;
+            nextToken(def, p);  // KEY
+            if (isKeyword(nextToken(def, p), {"DESC"})) primary_key = false;
+        }
+    }
+    column.declared_type = type;
+    column.affinity = affinityForType(type);
+    return true;
+}
+
+}  // namespace
+
+Affinity affinityForType(std::string_view declared_type) {
+    std::string type = toUpper(declared_type);
+    if (type.find("INT") != std::string::npos) return Affinity::Integer;
+    if (type.find("CHAR") != std::string::npos || type.find("CLOB") != std::string::npos || type.find("TEXT") != std::string::npos) return Affinity::Text;
+    if (type.empty() || type.find("BLOB") != std::string::npos) return Affinity::Blob;
+    if (type.find("REAL") != std::string::npos || type.find("FLOA") != std::string::npos || type.find("DOUB") != std::string::npos) return Affinity::Real;
+    return Affinity::Numeric;
+}
+
+Value applyAffinity(const Value& value, Affinity affinity, std::string& scratch) {
+    switch (affinity) {
+        case Affinity::Blob:
+            return value;
+        case Affinity::Text:
+            if (!value.isNumeric()) return value;
+            scratch.clear();
+            appendValue(scratch, value);
+            return Value::makeText(reinterpret_cast<const unsigned char*>(scratch.data()), scratch.size());
+        case Affinity::Integer:
+        case Affinity::Real:
+        case Affinity::Numeric:
+            break;
+    }
+    Value number = value.type == Value::Type::Text ? numericValue(std::string_view(reinterpret_cast<const char*>(value.data), value.size)) : value;
+    if (!number.isNumeric()) return value;
+    if (affinity == Affinity::Real) return Value::makeReal(number.asReal());
+    if (number.type == Value::Type::Real && number.real > -9223372036854775808.0 && number.real < 9223372036854775808.0) {
+        // A real with an integer value is stored as the integer
+        int64_t i = static_cast<int64_t>(number.real);
+        if (static_cast<double>(i) == number.real) return Value::makeInteger(i);
+    }
+    return number;
+}
+
+bool collationForName(std::string_view name, Collation& collation) {
+    if (name.empty() || name == "BINARY") collation = Collation::Binary;
+    else if (name == "NOCASE") collation = Collation::NoCase;
+    else if (name == "RTRIM") collation = Collation::Rtrim;
+    else return false;
+    return true;
+}
+
+std::string normalizeIdentifier(std::string_view identifier) {
+    if (identifier.size() >= 2) {
+        char first = identifier.front(), last = identifier.back();
+        if ((first == '"' && last == '"') || (first == '`' && last == '`') || (first == '[' && last == ']') || (first == '\'' && last == '\'')) {
+            identifier = identifier.substr(1, identifier.size() - 2);
+        }
+    }
+    return toUpper(identifier);
+}
+
+size_t TableInfo::findColumn(std::string_view name) const {
+    auto it = column_lookup_.find(normalizeIdentifier(name));
+    return it == column_lookup_.end() ? std::string::npos : it->second;
+}
+
+bool Catalog::load(Pager& pager) {
+    std::vector<SchemaEntry> entries;
+    QueryProfile::TreeScope schema_scope(1);
+    TableCursor cursor(pager, 1);
+    Record record(pager);
+    auto text = [&](size_t i) {
+        Value v = i < record.columnCount() ? record.value(i) : Value{};
+        return v.type == Value::Type::Text ? std::string(reinterpret_cast<const char*>(v.data), v.size) : std::string();
+    };
+    for (bool ok = cursor.seekAtLeast(std::numeric_limits<int64_t>::min()); ok; ok = cursor.next()) {
+        PageView page = cursor.leaf();
+        size_t p = cursor.cellOffset();
+        auto pr = readVarint(page, p);
+        uint64_t payload_size = pr.first;
+        p += pr.second;
+        p += readVarint(page, p).second;
+        if (!record.load(page, p, payload_size, false)) return false;
+        Value root = record.columnCount() > 3 ? record.value(3) : Value{};
+        entries.push_back({text(0), text(1), text(2), text(4), root.type == Value::Type::Integer ? static_cast<uint32_t>(root.integer) : 0});
+    }
+    build(entries);
+    return loadStatistics(pager);
+}
+
+void Catalog::build(const std::vector<SchemaEntry>& entries) {
+    tables_.clear();
+    indexes_.clear();
+    table_lookup_.clear();
+    entry_count_ = entries.size();
+
+    for (const SchemaEntry& e : entries) {
+        if (e.type != "table") continue;
+        TableInfo table;
+        table.name = e.name;
+        table.root_page = e.root_page;
+        table.sql = e.sql;
+        size_t open = e.sql.find('(');
+        std::string primary_key_column;
+        if (open != std::string::npos) {
+            for (std::string_view def : splitParenthesised(e.sql, open)) {
+                ColumnInfo column;
+                bool primary_key = false;
+                std::string unsupported;
+                bool is_column = parseColumnDefinition(def, column, primary_key, primary_key_column, unsupported);
+                if (!unsupported.empty() && table.write_restriction.empty()) table.write_restriction = unsupported;
+                if (!is_column) continue;
+                if (primary_key && table.rowid_alias < 0 && toUpper(column.declared_type) == "INTEGER") {
+                    table.rowid_alias = static_cast<ssize_t>(table.columns.size());
+                }
+                table.column_lookup_.emplace(toUpper(column.name), table.columns.size());
+                table.columns.push_back(std::move(column));
+            }
+        }
+        if (table.rowid_alias < 0 && !primary_key_column.empty()) {
+            size_t col = table.findColumn(primary_key_column);
+            if (col != std::string::npos && toUpper(table.columns[col].declared_type) == "INTEGER") table.rowid_alias = static_cast<ssize_t>(col);
+        }
+        if (toUpper(e.sql).find("WITHOUT ROWID") != std::string::npos) {
+            table.rowid_alias = -1;
+            table.write_restriction = "WITHOUT ROWID tables are not supported";
+        }
+        table_lookup_.emplace(toUpper(table.name), tables_.size());
+        tables_.push_back(std::move(table));
+    }
+
+    for (const SchemaEntry& e : entries) {
+        if (e.type != "index" && e.type != "trigger") continue;
+        auto it = table_lookup_.find(toUpper(e.table_name));
+        if (it == table_lookup_.end()) continue;
+        TableInfo& table = tables_[it->second];
+        // Writes keep only indexes of plain columns up to date
+        auto restrict = [&](const char* reason) {
+            if (table.write_restriction.empty()) table.write_restriction = reason;
+        };
+        if (e.type == "trigger") {
+            restrict("triggers are not supported");
+            continue;
+        }
+        if (e.sql.empty()) {
+            restrict("UNIQUE and PRIMARY KEY constraints other than INTEGER PRIMARY KEY are not supported");
+            continue;
+        }
+        // CREATE [UNIQUE] INDEX [IF NOT EXISTS] name ON table (col [COLLATE c] [ASC|DESC], ...)
+        size_t pos = 0;
+        std::string_view tok;
+        while (!(tok = nextToken(e.sql, pos)).empty() && !isKeyword(tok, {"ON"})) {
+        }
+        nextToken(e.sql, pos);
+        size_t open = e.sql.find('(', pos);
+        if (open == std::string::npos) continue;
+        IndexInfo index;
+        index.name = e.name;
+        index.table_name = table.name;
+        index.root_page = e.root_page;
+        index.sql = e.sql;
+        size_t q = 0;
+        nextToken(e.sql, q);  // CREATE
+        index.unique = isKeyword(nextToken(e.sql, q), {"UNIQUE"});
+        bool ok = true;
+        for (std::string_view part : splitParenthesised(e.sql, open)) {
+            size_t q = 0;
+            size_t col = table.findColumn(nextToken(part, q));
+            if (col == std::string::npos) {
+                // Expression indexes are not usable here
+                ok = false;
+                break;
+            }
+            bool descending = false;
+            std::string collation = table.columns[col].collation;
+            std::string_view tok;
+            while (!(tok = nextToken(part, q)).empty()) {
+                if (isKeyword(tok, {"DESC"})) descending = true;
+                else if (isKeyword(tok, {"COLLATE"})) collation = normalizeIdentifier(nextToken(part, q));
+            }
+            if (collation.empty()) collation = "BINARY";
+            if (collation != "BINARY") restrict("collations other than BINARY are not supported");
+            index.columns.push_back(col);
+            index.descending.push_back(descending);
+            index.collations.push_back(std::move(collation));
+        }
+        if (!ok || index.columns.empty()) {
+            restrict("indexes on expressions are not supported");
+            continue;
+        }
+        size_t close = e.sql.find(')', open);
+        index.partial = close != std::string::npos && toUpper(e.sql.substr(close)).find("WHERE") != std::string::npos;
+        if (index.partial) restrict("partial indexes are not supported");
+        table.indexes.push_back(indexes_.size());
+        indexes_.push_back(std::move(index));
+    }
+}
+
+// sqlite_stat1 has one row per index (tbl, idx, stat), plus one with a NULL
+// idx for each analyzed table without indexes. stat starts with the row count.
+bool Catalog::loadStatistics(Pager& pager) {
+    const TableInfo* stat_table = findTable("sqlite_stat1");
+    if (stat_table == nullptr || stat_table->root_page == 0) return true;
+    std::unordered_map<std::string, size_t> index_lookup;
+    for (size_t i = 0; i < indexes_.size(); ++i) index_lookup.emplace(toUpper(indexes_[i].name), i);
+
+    QueryProfile::TreeScope stat_scope(stat_table->root_page);
+    TableCursor cursor(pager, stat_table->root_page);
+    Record record(pager);
+    auto text = [&](size_t i) {
+        Value v = i < record.columnCount() ? record.value(i) : Value{};
+        return v.type == Value::Type::Text ? std::string(reinterpret_cast<const char*>(v.data), v.size) : std::string();
+    };
+    for (bool ok = cursor.seekAtLeast(std::numeric_limits<int64_t>::min()); ok; ok = cursor.next()) {
+        PageView page = cursor.leaf();
+        size_t p = cursor.cellOffset();
+        auto pr = readVarint(page, p);
+        uint64_t payload_size = pr.first;
+        p += pr.second;
+        p += readVarint(page, p).second;
+        if (!record.load(page, p, payload_size, false)) return false;
+        std::vector<uint64_t> numbers;
+        // Trailing options such as "unordered" or "sz=N" are not needed
+        std::string stat = text(2);
+        const char* c = stat.c_str();
+        while (std::isdigit(static_cast<unsigned char>(*c))) {
+            char* end = nullptr;
+            numbers.push_back(std::strtoull(c, &end, 10));
+            c = end;
+            while (*c == ' ') ++c;
+        }
+        if (numbers.empty()) continue;
+        auto table_it = table_lookup_.find(toUpper(text(0)));
+        if (table_it != table_lookup_.end()) tables_[table_it->second].stat_rows = numbers[0];
+        auto index_it = index_lookup.find(toUpper(text(1)));
+        if (index_it != index_lookup.end()) indexes_[index_it->second].stat = std::move(numbers);
+    }
+    return true;
+}
+
+const TableInfo* Catalog::findTable(std::string_view name) const {
+    auto it = table_lookup_.find(normalizeIdentifier(name));
+    return it == table_lookup_.end() ? nullptr : &tables_[it->second];
+}
+
+bool IndexInfo::readable() const {
+    if (partial) return false;
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (descending[i] || collations[i] != "BINARY") return false;
+    }
+    return true;
+}
+
+const IndexInfo* Catalog::indexWithLeadingColumn(const TableInfo& table, size_t column) const {
+    for (size_t i : table.indexes) {
+        if (indexes_[i].readable() && indexes_[i].columns.front() == column) return &indexes_[i];
+    }
+    return nullptr;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Pager.hpp"
+#include "Value.hpp"
+
+// Type affinity of a column, from its declared type (SQLite's rules in
+// order: INT, then CHAR/CLOB/TEXT, then BLOB or no type, then REAL/FLOA/DOUB,
+// otherwise NUMERIC).
+enum class Affinity { Integer, Text, Blob, Real, Numeric };
+
+Affinity affinityForType(std::string_view declared_type);
+inline bool isNumericAffinity(Affinity affinity) { return affinity == Affinity::Integer || affinity == Affinity::Real || affinity == Affinity::Numeric; }
+
+// The value a column with this affinity stores for value, as INSERT converts
+// it: text that reads as a number becomes one for the numeric affinities, and
+// numbers become text for TEXT. Text made from a number goes to scratch.
+Value applyAffinity(const Value& value, Affinity affinity, std::string& scratch);
+
+// The built-in collation named by an upper-cased name, empty for BINARY;
+// false if there is no such collation.
+bool collationForName(std::string_view name, Collation& collation);
+
+// Upper-cases an identifier and strips one level of "", ``, [] or '' quoting.
+std::string normalizeIdentifier(std::string_view identifier);
+
+struct ColumnInfo {
+    std::string name;
+    std::string declared_type;
+    Affinity affinity = Affinity::Blob;
+    bool not_null = false;
+    // The DEFAULT clause's value as written, one token; empty without one.
+    std::string default_value;
+    // Upper-cased COLLATE name, empty without one.
+    std::string collation;
+};
+
+struct IndexInfo {
+    std::string name;
+    std::string table_name;
+    uint32_t root_page = 0;
+    std::string sql;
+    // Key columns in index order, as positions in the table's column list.
+    std::vector<size_t> columns;
+    // Per key column: sorted in descending order.
+    std::vector<bool> descending;
+    // Per key column: the collation keys are ordered by, upper-cased.
+    std::vector<std::string> collations;
+    bool unique = false;
+    // Has a WHERE clause, so only the rows it selects have entries.
+    bool partial = false;
+    // From sqlite_stat1 when analyzed: the number of entries, then the
+    // average number of entries sharing each leading prefix of 1, 2, ...
+    // key columns. Empty otherwise.
+    std::vector<uint64_t> stat;
+
+    // Whether queries can read rows through the index. Seeks and scans take
+    // keys to be ascending and BINARY, with an entry for every row; other
+    // indexes are only kept up to date.
+    bool readable() const;
+};
+
+struct TableInfo {
+    std::string name;
+    uint32_t root_page = 0;
+    std::string sql;
+    std::vector<ColumnInfo> columns;
+    // Column that is an alias for the rowid (INTEGER PRIMARY KEY), or -1.
+    ssize_t rowid_alias = -1;
+    // Positions in Catalog::indexes().
+    std::vector<size_t> indexes;
+    // Row count from sqlite_stat1, or 0 if the table has not been analyzed.
+    uint64_t stat_rows = 0;
+    // Why INSERT, UPDATE and DELETE refuse the table, e.g. it has an index or
+    // constraint they could not keep up to date; empty if they do not.
+    std::string write_restriction;
+
+    // Position of the column with the given name (any case/quoting), or npos.
+    size_t findColumn(std::string_view name) const;
+
+private:
+    friend class Catalog;
+    std::unordered_map<std::string, size_t> column_lookup_;
+};
+
+// One row of sqlite_schema.
+struct SchemaEntry {
+    std::string type, name, table_name, sql;
+    uint32_t root_page = 0;
+};
+
+// Every table and index in sqlite_schema, parsed once. The whole schema
+// B-tree is walked, so schemas that outgrow page 1 are covered. Statistics in
+// sqlite_stat1, if ANALYZE has been run, are attached to their tables and
+// indexes.
+class Catalog {
+public:
+    // Returns false if the schema B-tree cannot be read.
+    bool load(Pager& pager);
+    // Parses entries that are not (yet) in a database file, such as those of
+    // a bulk load. There are no statistics.
+    void build(const std::vector<SchemaEntry>& entries);
+
+    const std::vector<TableInfo>& tables() const { return tables_; }
+    const std::vector<IndexInfo>& indexes() const { return indexes_; }
+    // Number of rows in sqlite_schema, views and triggers included.
+    size_t entryCount() const { return entry_count_; }
+
+    // Lookups are case-insensitive; nullptr if there is no such object.
+    const TableInfo* findTable(std::string_view name) const;
+    // First readable index on table whose leading key column is column.
+    const IndexInfo* indexWithLeadingColumn(const TableInfo& table, size_t column) const;
+
+private:
+    bool loadStatistics(Pager& pager);
+
+    std::vector<TableInfo> tables_;
+    std::vector<IndexInfo> indexes_;
+    std::unordered_map<std::string, size_t> table_lookup_;
+    size_t entry_count_ = 0;
+};
@@ -0,0 +1,335 @@
+#include "Expression.hpp"
+
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include "Predicate.hpp"
+
+namespace {
+
+Value makeBool(bool b) { return Value::makeInteger(b ? 1 : 0); }
+
+int compareWithAffinity(const Value& a, const Value& b, Affinity affinity, Collation collation) {
+    if (affinity == Affinity::Blob) return compareValues(a, b, collation);
+    std::string a_text, b_text;
+    return compareValues(applyAffinity(a, affinity, a_text), applyAffinity(b, affinity, b_text), collation);
+}
+
+int compareOperands(const Expr& a, const Value& av, const Expr& b, const Value& bv) {
+    // A literal already has the affinity of a column it is compared with
+    if (a.isLiteral() || b.isLiteral()) return compareValues(av, bv, comparisonCollation(a, b));
+    return compareWithAffinity(av, bv, comparisonAffinity(a, b), comparisonCollation(a, b));
+}
+
+// The column expr reads as it is, through unary plus, if there is one.
+const Expr* collatedColumn(const Expr& expr) {
+    const Expr* e = &expr;
+    while (e->kind == Expr::Kind::Unary && e->op == Expr::Op::Plus) e = e->args[0].get();
+    return e->isColumn() ? e : nullptr;
+}
+
+unsigned char foldCase(unsigned char c) { return c >= 'A' && c <= 'Z' ? static_cast<unsigned char>(c + 32) : c; }
+
+// Integer value of a number for %, which works on integers.
+int64_t integerPart(const Value& value) {
+    if (value.type == Value::Type::Integer) return value.integer;
+    double d = value.real;
+    if (!(d > -9.2e18 && d < 9.2e18)) return d < 0 ? std::numeric_limits<int64_t>::min() : std::numeric_limits<int64_t>::max();
+    return static_cast<int64_t>(d);
+}
+
+}  // namespace
+
+Affinity comparisonAffinity(const Expr& a, const Expr& b) {
+    if (a.isColumn() && b.isColumn()) return isNumericAffinity(a.affinity) || isNumericAffinity(b.affinity) ? Affinity::Numeric : Affinity::Blob;
+    if (a.isColumn()) return a.affinity;
+    if (b.isColumn()) return b.affinity;
+    return Affinity::Blob;
+}
+
+Collation comparisonCollation(const Expr& a, const Expr& b) {
+    if (const Expr* column = collatedColumn(a)) return column->collation;
+    if (const Expr* column = collatedColumn(b)) return column->collation;
+    return Collation::Binary;
+}
+
+Collation collationOf(const Expr& expr) {
+    const Expr* column = collatedColumn(expr);
+    return column != nullptr ? column->collation : Collation::Binary;
+}
+
+Value toNumeric(const Value& value) {
+    if (value.isNull() || value.isNumeric()) return value;
+    const char* s = reinterpret_cast<const char*>(value.data);
+    size_t n = value.size, i = 0;
+    while (i < n && std::isspace(static_cast<unsigned char>(s[i]))) ++i;
+    size_t start = i;
+    if (i < n && (s[i] == '+' || s[i] == '-')) ++i;
+    size_t digits = 0;
+    while (i < n && std::isdigit(static_cast<unsigned char>(s[i]))) ++i, ++digits;
+    if (i < n && s[i] == '.') {
+        ++i;
+        while (i < n && std::isdigit(static_cast<unsigned char>(s[i]))) ++i, ++digits;
+    }
+    if (digits == 0) return Value::makeInteger(0);
+    if (i < n && (s[i] == 'e' || s[i] == 'E')) {
+        size_t j = i + 1;
+        if (j < n && (s[j] == '+' || s[j] == '-')) ++j;
+        if (j < n && std::isdigit(static_cast<unsigned char>(s[j]))) {
+            while (j < n && std::isdigit(static_cast<unsigned char>(s[j]))) ++j;
+            i = j;
+        }
+    }
+    Value number = numericValue(std::string_view(s + start, i - start));
+    return number.isNull() ? Value::makeInteger(0) : number;
+}
+
+bool likeMatch(const unsigned char* pattern, size_t pattern_len, const unsigned char* text, size_t text_len, int escape) {
+    constexpr size_t kNone = static_cast<size_t>(-1);
+    size_t p = 0, t = 0;
+    // Where to resume after the last '%' if the rest fails to match.
+    size_t star_p = kNone, star_t = 0;
+    while (true) {
+        if (p < pattern_len) {
+            unsigned char c = pattern[p];
+            if (escape >= 0 && c == escape) {
+                if (p + 1 < pattern_len && t < text_len && foldCase(pattern[p + 1]) == foldCase(text[t])) {
+                    p += 2;
+                    ++t;
+                    continue;
+                }
+            } else if (c == '%') {
+                star_p = ++p;
+                star_t = t;
+                continue;
+            } else if (t < text_len && c == '_') {
+                ++p;
+                // One character, however many bytes its UTF-8 form takes
+                for (++t; t < text_len && (text[t] & 0xC0) == 0x80; ++t) {}
+                continue;
+            } else if (t < text_len && foldCase(c) == foldCase(text[t])) {
+                ++p;
+                ++t;
+                continue;
+            }
+        } else if (t == text_len) {
+            return true;
+        }
+        if (star_p == kNone || star_t >= text_len) return false;
+        p = star_p;
+        t = ++star_t;
+    }
+}
+
+bool Evaluator::isTrue(const Value& value) {
+    switch (value.type) {
+        case Value::Type::Null: return false;
+        case Value::Type::Integer: return value.integer != 0;
+        case Value::Type::Real: return value.real != 0.0;
+        default: return toNumeric(value).asReal() != 0.0;
+    }
+}
+
+Value Evaluator::asText(const Value& value) {
+    if (value.type == Value::Type::Text || value.isNull()) return value;
+    if (value.type == Value::Type::Blob) {
+        Value text = value;
+        text.type = Value::Type::Text;
+        return text;
+    }
+    std::string formatted;
+    appendValue(formatted, value);
+    return arena_.copy(Value::makeText(reinterpret_cast<const unsigned char*>(formatted.data()), formatted.size()));
+}
+
+Value Evaluator::evaluate(const Expr& expr, Record* record, int64_t rowid) {
+    switch (expr.kind) {
+        case Expr::Kind::Literal:
+            return expr.literal.value();
+        case Expr::Kind::Column: {
+            if (group_slots_ != nullptr) {
+                if (expr.source >= group_slots_->size()) return Value{};
+                const std::vector<size_t>& slots = (*group_slots_)[expr.source];
+                size_t slot = slots[expr.column == Expr::kRowid ? slots.size() - 1 : expr.column];
+                return slot != std::string::npos ? group_columns_[slot] : Value{};
+            }
+            if (joined_ != nullptr) {
+                if (expr.column == Expr::kRowid) return Value::makeInteger(joined_->rowids[expr.source]);
+                const std::vector<size_t>* slots = joined_->slots[expr.source];
+                size_t slot = slots != nullptr ? (*slots)[expr.column] : std::string::npos;
+                return slot != std::string::npos ? joined_->values[expr.source][slot] : Value{};
+            }
+            if (expr.column == Expr::kRowid) return Value::makeInteger(rowid);
+            size_t position = positions_ != nullptr ? (*positions_)[expr.column] : expr.column;
+            if (record == nullptr || position >= record->columnCount()) return Value{};
+            Value value = record->value(position);
+            if (expr.real_affinity && value.type == Value::Type::Integer) value = Value::makeReal(static_cast<double>(value.integer));
+            return value;
+        }
+        case Expr::Kind::Unary: {
+            Value operand = evaluate(*expr.args[0], record, rowid);
+            if (operand.isNull() || expr.op == Expr::Op::Plus) return operand;
+            if (expr.op == Expr::Op::Not) return makeBool(!isTrue(operand));
+            Value number = toNumeric(operand);
+            if (number.type == Value::Type::Real) return Value::makeReal(-number.real);
+            if (number.integer == std::numeric_limits<int64_t>::min()) return Value::makeReal(-static_cast<double>(number.integer));
+            return Value::makeInteger(-number.integer);
+        }
+        case Expr::Kind::Binary:
+            switch (expr.op) {
+                case Expr::Op::And:
+                case Expr::Op::Or: {
+                    // The right side is skipped once the left decides the result
+                    bool is_and = expr.op == Expr::Op::And;
+                    Value lhs = evaluate(*expr.args[0], record, rowid);
+                    if (!lhs.isNull() && isTrue(lhs) != is_and) return makeBool(!is_and);
+                    Value rhs = evaluate(*expr.args[1], record, rowid);
+                    if (!rhs.isNull() && isTrue(rhs) != is_and) return makeBool(!is_and);
+                    if (lhs.isNull() || rhs.isNull()) return Value{};
+                    return makeBool(is_and);
+                }
+                case Expr::Op::Eq:
+                case Expr::Op::Ne:
+                case Expr::Op::Lt:
+                case Expr::Op::Le:
+                case Expr::Op::Gt:
+                case Expr::Op::Ge:
+                case Expr::Op::Is:
+                case Expr::Op::IsNot:
+                    return compare(expr, record, rowid);
+                case Expr::Op::Concat: {
+                    Value lhs = asText(evaluate(*expr.args[0], record, rowid));
+                    Value rhs = asText(evaluate(*expr.args[1], record, rowid));
+                    if (lhs.isNull() || rhs.isNull()) return Value{};
+                    unsigned char* bytes = arena_.allocate(lhs.size + rhs.size);
+                    if (lhs.size > 0) std::memcpy(bytes, lhs.data, lhs.size);
+                    if (rhs.size > 0) std::memcpy(bytes + lhs.size, rhs.data, rhs.size);
+                    return Value::makeText(bytes, lhs.size + rhs.size);
+                }
+                default:
+                    return arithmetic(expr.op, evaluate(*expr.args[0], record, rowid), evaluate(*expr.args[1], record, rowid));
+            }
+        case Expr::Kind::In:
+            return in(expr, record, rowid);
+        case Expr::Kind::Like:
+            return like(expr, record, rowid);
+        case Expr::Kind::Between: {
+            const Expr& operand = *expr.args[0];
+            Value value = evaluate(operand, record, rowid);
+            Value lower = evaluate(*expr.args[1], record, rowid);
+            Value upper = evaluate(*expr.args[2], record, rowid);
+            // value >= lower AND value <= upper, in three-valued logic
+            bool lower_null = value.isNull() || lower.isNull();
+            bool upper_null = value.isNull() || upper.isNull();
+            bool lower_ok = !lower_null && compareOperands(operand, value, *expr.args[1], lower) >= 0;
+            bool upper_ok = !upper_null && compareOperands(operand, value, *expr.args[2], upper) <= 0;
+            if ((!lower_null && !lower_ok) || (!upper_null && !upper_ok)) return makeBool(expr.negated);
+            if (lower_null || upper_null) return Value{};
+            return makeBool(!expr.negated);
+        }
+        case Expr::Kind::IsNull:
+            return makeBool(evaluate(*expr.args[0], record, rowid).isNull() != expr.negated);
+        case Expr::Kind::Function:
+            // Aggregates are computed by the query, not per row
+            return group_aggregates_ != nullptr ? group_aggregates_[expr.column] : Value{};
+    }
+    return Value{};
+}
+
+Value Evaluator::compare(const Expr& expr, Record* record, int64_t rowid) {
+    const Expr& a = *expr.args[0];
+    const Expr& b = *expr.args[1];
+    Value lhs = evaluate(a, record, rowid);
+    Value rhs = evaluate(b, record, rowid);
+    if (expr.op == Expr::Op::Is || expr.op == Expr::Op::IsNot) {
+        bool same = lhs.isNull() || rhs.isNull() ? lhs.isNull() == rhs.isNull() : compareOperands(a, lhs, b, rhs) == 0;
+        return makeBool(same == (expr.op == Expr::Op::Is));
+    }
+    if (lhs.isNull() || rhs.isNull()) return Value{};
+    int c = compareOperands(a, lhs, b, rhs);
+    switch (expr.op) {
+        case Expr::Op::Eq: return makeBool(c == 0);
+        case Expr::Op::Ne: return makeBool(c != 0);
+        case Expr::Op::Lt: return makeBool(c < 0);
+        case Expr::Op::Le: return makeBool(c <= 0);
+        case Expr::Op::Gt: return makeBool(c > 0);
+        default: return makeBool(c >= 0);
+    }
+}
+
+Value Evaluator::arithmetic(Expr::Op op, const Value& lhs, const Value& rhs) {
+    if (lhs.isNull() || rhs.isNull()) return Value{};
+    Value a = toNumeric(lhs), b = toNumeric(rhs);
+    if (op == Expr::Op::Remainder) {
+        int64_t x = integerPart(a), y = integerPart(b);
+        if (y == 0) return Value{};
+        int64_t r = y == -1 ? 0 : x % y;
+        if (a.type == Value::Type::Real || b.type == Value::Type::Real) return Value::makeReal(static_cast<double>(r));
+        return Value::makeInteger(r);
+    }
+    if (a.type == Value::Type::Integer && b.type == Value::Type::Integer) {
+        int64_t x = a.integer, y = b.integer, r = 0;
+        bool overflow = false;
+        switch (op) {
+            case Expr::Op::Add: overflow = __builtin_add_overflow(x, y, &r); break;
+            case Expr::Op::Subtract: overflow = __builtin_sub_overflow(x, y, &r); break;
+            case Expr::Op::Multiply: overflow = __builtin_mul_overflow(x, y, &r); break;
+            default:
+                if (y == 0) return Value{};
+                if (x == std::numeric_limits<int64_t>::min() && y == -1) {
+                    overflow = true;
+                    break;
+                }
+                r = x / y;
+                break;
+        }
+        if (!overflow) return Value::makeInteger(r);
+    }
+    double x = a.asReal(), y = b.asReal();
+    switch (op) {
+        case Expr::Op::Add: return Value::makeReal(x + y);
+        case Expr::Op::Subtract: return Value::makeReal(x - y);
+        case Expr::Op::Multiply: return Value::makeReal(x * y);
+        default:
+            if (y == 0.0) return Value{};
+            return Value::makeReal(x / y);
+    }
+}
+
+Value Evaluator::like(const Expr& expr, Record* record, int64_t rowid) {
+    Value text = asText(evaluate(*expr.args[0], record, rowid));
+    Value pattern = asText(evaluate(*expr.args[1], record, rowid));
+    int escape = -1;
+    if (expr.args.size() > 2) {
+        Value esc = asText(evaluate(*expr.args[2], record, rowid));
+        if (esc.isNull()) return Value{};
+        if (esc.size > 0) escape = esc.data[0];
+    }
+    if (text.isNull() || pattern.isNull()) return Value{};
+    return makeBool(likeMatch(pattern.data, pattern.size, text.data, text.size, escape) != expr.negated);
+}
+
+Value Evaluator::in(const Expr& expr, Record* record, int64_t rowid) {
+    if (expr.args.size() == 1) return makeBool(expr.negated);
+    const Expr& operand = *expr.args[0];
+    Value value = evaluate(operand, record, rowid);
+    if (value.isNull()) return Value{};
+    // Each item compares with the value's affinity and collation, whatever
+    // its own
+    Affinity affinity = operand.isColumn() ? operand.affinity : Affinity::Blob;
+    Collation collation = collationOf(operand);
+    bool saw_null = false;
+    for (size_t i = 1; i < expr.args.size(); ++i) {
+        Value item = evaluate(*expr.args[i], record, rowid);
+        if (item.isNull()) {
+            saw_null = true;
+        } else if ((expr.args[i]->isLiteral() ? compareValues(value, item, collation) : compareWithAffinity(value, item, affinity, collation)) == 0) {
+            return makeBool(!expr.negated);
+        }
+    }
+    if (saw_null) return Value{};
+    return makeBool(expr.negated);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Arena.hpp"
+#include "Ast.hpp"
+#include "Record.hpp"
+#include "Value.hpp"
+
+// A row of a join, as the values of the columns the query reads from each
+// FROM table: column i of table s is values[s][(*slots[s])[i]], NULL if the
+// slot is npos.
+struct JoinedRow {
+    const std::vector<size_t>* slots[2] = {nullptr, nullptr};
+    const Value* values[2] = {nullptr, nullptr};
+    int64_t rowids[2] = {0, 0};
+};
+
+// Evaluates bound expressions against one table row with SQLite's rules:
+// NULL propagates through operators, AND/OR/NOT use three-valued logic,
+// integer arithmetic that overflows becomes real, and comparisons apply
+// comparisonAffinity to both sides (literals compared with a column have the
+// column's affinity from binding) and compare text by comparisonCollation;
+// LIKE ignores collations. Text built
+// along the way (concatenation, numbers converted for LIKE) lives in the
+// evaluator's arena until reset().
+class Evaluator {
+public:
+    // record may be null when the expression references no columns.
+    Value evaluate(const Expr& expr, Record* record, int64_t rowid);
+    // True if expr is true for the row: not NULL and not zero.
+    bool test(const Expr& expr, Record* record, int64_t rowid) { return isTrue(evaluate(expr, record, rowid)); }
+    void reset() { arena_.clear(); }
+    // Reads table column i from record position (*positions)[i] instead of
+    // position i, e.g. for records of an index; nullptr restores the table
+    // layout. Columns mapped to npos read as NULL.
+    void setColumnPositions(const std::vector<size_t>* positions) { positions_ = positions; }
+    // Evaluates over a group of rows instead of one: column i of FROM table
+    // s reads columns[(*slots)[s][i]] (NULL for npos), its rowid the slot
+    // after the last column, and an aggregate call reads
+    // aggregates[expr.column]. A null slots returns to rows.
+    void setGroup(const std::vector<std::vector<size_t>>* slots, const Value* columns, const Value* aggregates) {
+        group_slots_ = slots;
+        group_columns_ = columns;
+        group_aggregates_ = aggregates;
+    }
+    // Evaluates over a row of a join instead of record; nullptr returns to
+    // records.
+    void setJoinedRow(const JoinedRow* row) { joined_ = row; }
+
+    static bool isTrue(const Value& value);
+
+private:
+    Value compare(const Expr& expr, Record* record, int64_t rowid);
+    Value arithmetic(Expr::Op op, const Value& lhs, const Value& rhs);
+    Value like(const Expr& expr, Record* record, int64_t rowid);
+    Value in(const Expr& expr, Record* record, int64_t rowid);
+    // Text form of a value for LIKE and ||, in the arena if it is a number.
+    Value asText(const Value& value);
+
+    Arena arena_{4096};
+    const std::vector<size_t>* positions_ = nullptr;
+    const std::vector<std::vector<size_t>>* group_slots_ = nullptr;
+    const Value* group_columns_ = nullptr;
+    const Value* group_aggregates_ = nullptr;
+    const JoinedRow* joined_ = nullptr;
+};
+
+// The affinity a comparison between a and b applies to both values, by
+// SQLite's rules: for two columns NUMERIC if either is numeric, otherwise
+// BLOB; for a column and anything else the column's; BLOB, which converts
+// nothing, if neither is a column.
+Affinity comparisonAffinity(const Expr& a, const Expr& b);
+// The collation a comparison between a and b orders text by: that of a if it
+// is a column (or unary plus of one), else that of b, else BINARY.
+Collation comparisonCollation(const Expr& a, const Expr& b);
+// The collation ORDER BY, GROUP BY, MIN and MAX order expr's text by: its
+// column's, through unary plus, else BINARY.
+Collation collationOf(const Expr& expr);
+
+// Numeric value of v: numbers as they are, text by its longest numeric
+// prefix (0 if there is none), NULL as NULL.
+Value toNumeric(const Value& value);
+
+// SQL LIKE: '%' matches any run of characters and '_' any one character;
+// ASCII letters match either case. escape is the escape character or -1.
+bool likeMatch(const unsigned char* pattern, size_t pattern_len, const unsigned char* text, size_t text_len, int escape);
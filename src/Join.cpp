@@ -0,0 +1,455 @@
+#include "Join.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "Arena.hpp"
+#include "Btree.hpp"
+#include "Expression.hpp"
+#include "LeafBatch.hpp"
+#include "Predicate.hpp"
+#include "Profiler.hpp"
+#include "Record.hpp"
+#include "Value.hpp"
+
+namespace {
+
+// Partitions of a hash join past its memory budget, chosen by the top bits of
+// the key hash; buckets use the low bits.
+constexpr size_t kPartitionBits = 5;
+constexpr size_t kPartitions = size_t{1} << kPartitionBits;
+
+size_t partitionOf(uint64_t hash) { return static_cast<size_t>(hash >> (64 - kPartitionBits)); }
+
+// Marks the columns of FROM table source that expr reads.
+void collectColumns(const Expr* expr, size_t source, std::vector<bool>& used) {
+    if (expr == nullptr) return;
+    if (expr->isColumn() && expr->source == source && expr->column < used.size()) used[expr->column] = true;
+    for (const ExprPtr& arg : expr->args) collectColumns(arg.get(), source, used);
+}
+
+// Reads one FROM table for a join: the rows passing its conjuncts, as the
+// values of the columns the query reads, and their key values.
+class JoinInput {
+public:
+    JoinInput(Pager& pager, const BoundSelect& query, const JoinPlan::Input& input, size_t source)
+        : pager_(pager), input_(input), source_(source), record_(pager), batch_(pager, input.filters) {
+        table_ = source == 0 ? query.table : query.join_table;
+        std::vector<bool> used(table_->columns.size(), false);
+        for (const Expr* output : query.outputs) collectColumns(output, source, used);
+        collectColumns(query.where, source, used);
+        for (const Expr* key : query.group_by) collectColumns(key, source, used);
+        collectColumns(query.having, source, used);
+        for (const SortKey& key : query.order_by) collectColumns(key.expr, source, used);
+        slots_.assign(used.size(), std::string::npos);
+        for (size_t c = 0; c < used.size(); ++c) {
+            if (!used[c]) continue;
+            slots_[c] = columns_.size();
+            columns_.push_back(c);
+        }
+        values_.resize(columns_.size());
+        keys_.resize(input_.keys.size());
+        row_.slots[source_] = &slots_;
+        row_.values[source_] = values_.data();
+    }
+
+    const std::vector<size_t>& slots() const { return slots_; }
+    size_t width() const { return columns_.size(); }
+    size_t numKeys() const { return keys_.size(); }
+    // The row last read; its text may point into the page it came from.
+    const Value* values() const { return values_.data(); }
+    int64_t rowid() const { return row_.rowids[source_]; }
+    // Key values of the row last read.
+    const Value* keys() const { return keys_.data(); }
+
+    // Reads every row of the table in rowid order, calling visit for those
+    // that pass the conjuncts and have no NULL key, until it returns false.
+    void scan(const std::function<bool()>& visit) {
+        if (table_->root_page != 0) scanPage(table_->root_page, visit);
+    }
+    // Reads the row under the cursor; false if it fails the conjuncts.
+    bool load(const TableCursor& cursor) {
+        PageView page = cursor.leaf();
+        size_t p = cursor.cellOffset();
+        auto pr = readVarint(page, p);
+        uint64_t payload_size = pr.first;
+        p += pr.second;
+        p += readVarint(page, p).second;
+        return record_.load(page, p, payload_size, false) && accept(record_, cursor.rowid(), false);
+    }
+
+private:
+    bool scanPage(uint32_t page_number, const std::function<bool()>& visit) {
+        PageRef page = pager_.page(page_number);
+        if (page.empty()) return true;
+        size_t header_offset = headerOffsetFor(page_number);
+        unsigned char flags = page[header_offset];
+        if (flags == 0x05) {
+            unsigned short num_cells = readBE16(page, header_offset + 3);
+            for (size_t i = 0; i <= num_cells; ++i) {
+                readAheadChildren(pager_, page, header_offset, i);
+                if (!scanPage(interiorChildAt(page, header_offset, i), visit)) return false;
+            }
+            return true;
+        }
+        if (flags != 0x0D) return true;
+        batch_.load(page, header_offset);
+        if (QueryProfile* profile = pager_.profile()) profile->addRowsExamined(batch_.size());
+        for (uint16_t cell : batch_.selection()) {
+            if (batch_.loadRecord(cell, record_) && accept(record_, batch_.rowid(cell), true) && !visit()) return false;
+        }
+        return true;
+    }
+
+    // Decodes the columns read and checks the conditions; with keys, also
+    // that no key is NULL, which would match nothing.
+    bool accept(Record& record, int64_t rowid, bool with_keys) {
+        evaluator_.reset();
+        for (size_t i = 0; i < columns_.size(); ++i) {
+            size_t column = columns_[i];
+            Value value = column < record.columnCount() ? record.value(column) : Value{};
+            if (table_->columns[column].affinity == Affinity::Real && value.type == Value::Type::Integer) value = Value::makeReal(static_cast<double>(value.integer));
+            values_[i] = value;
+        }
+        row_.rowids[source_] = rowid;
+        evaluator_.setJoinedRow(&row_);
+        for (const Expr* condition : input_.conditions) {
+            if (!evaluator_.test(*condition, nullptr, 0)) return false;
+        }
+        if (!with_keys) return true;
+        for (size_t k = 0; k < keys_.size(); ++k) {
+            keys_[k] = applyAffinity(evaluator_.evaluate(*input_.keys[k], nullptr, 0), input_.key_affinities[k], key_scratch_);
+            if (keys_[k].isNull()) return false;
+        }
+        return true;
+    }
+
+    Pager& pager_;
+    const JoinPlan::Input& input_;
+    size_t source_;
+    const TableInfo* table_ = nullptr;
+    Record record_;
+    LeafBatch batch_;
+    Evaluator evaluator_;
+    // Table columns read, in slot order.
+    std::vector<size_t> columns_;
+    std::vector<size_t> slots_;
+    std::vector<Value> values_;
+    std::vector<Value> keys_;
+    // For applyAffinity; keys compare under NUMERIC or BLOB, which make no
+    // text.
+    std::string key_scratch_;
+    // Only this input's side is set.
+    JoinedRow row_;
+};
+
+uint64_t hashKeys(const Value* keys, size_t n) {
+    uint64_t hash = 0;
+    for (size_t k = 0; k < n; ++k) hash = hashValue(keys[k], hash);
+    return hash;
+}
+
+bool sameKeys(const Value* a, const Value* b, size_t n) {
+    for (size_t k = 0; k < n; ++k) {
+        if (compareValues(a[k], b[k]) != 0) return false;
+    }
+    return true;
+}
+
+// The hashed input of a hash join. Each row's values, then its keys, are
+// one Value array in an arena, with their text in another. Once every row is
+// in, build() orders the rows by bucket, keeping arrival order within one,
+// so a lookup reads a contiguous run.
+class JoinTable {
+public:
+    JoinTable(size_t width, size_t num_keys) : width_(width), num_keys_(num_keys) {}
+
+    void add(uint64_t hash, int64_t rowid, const Value* values, const Value* keys) {
+        Value* copy = reinterpret_cast<Value*>(values_.allocate((width_ + num_keys_) * sizeof(Value)));
+        for (size_t i = 0; i < width_; ++i) new (copy + i) Value(text_.copy(values[i]));
+        for (size_t k = 0; k < num_keys_; ++k) new (copy + width_ + k) Value(text_.copy(keys[k]));
+        rows_.push_back({hash, rowid, copy});
+    }
+    size_t size() const { return rows_.size(); }
+    size_t memoryUsed() const { return values_.bytesUsed() + text_.bytesUsed() + rows_.size() * sizeof(Row) * 2; }
+
+    void build() {
+        size_t buckets = std::bit_ceil(std::max<size_t>(rows_.size(), 1));
+        mask_ = buckets - 1;
+        starts_.assign(buckets + 1, 0);
+        for (const Row& row : rows_) ++starts_[(row.hash & mask_) + 1];
+        for (size_t b = 0; b < buckets; ++b) starts_[b + 1] += starts_[b];
+        std::vector<size_t> next(starts_.begin(), starts_.end() - 1);
+        ordered_.resize(rows_.size());
+        for (const Row& row : rows_) ordered_[next[row.hash & mask_]++] = row;
+    }
+
+    // Calls visit(values, rowid) for each row with these keys, in arrival
+    // order, until it returns false; returns false if visit did.
+    bool find(uint64_t hash, const Value* keys, const std::function<bool(const Value*, int64_t)>& visit) const {
+        size_t bucket = hash & mask_;
+        for (size_t i = starts_[bucket]; i < starts_[bucket + 1]; ++i) {
+            const Row& row = ordered_[i];
+            if (row.hash == hash && sameKeys(row.values + width_, keys, num_keys_) && !visit(row.values, row.rowid)) return false;
+        }
+        return true;
+    }
+
+    // Hands each row to visit(hash, rowid, values, keys) in arrival order.
+    void forEach(const std::function<void(uint64_t, int64_t, const Value*, const Value*)>& visit) const {
+        for (const Row& row : rows_) visit(row.hash, row.rowid, row.values, row.values + width_);
+    }
+
+    void clear() {
+        values_.clear();
+        text_.clear();
+        rows_.clear();
+        ordered_.clear();
+    }
+
+private:
+    struct Row {
+        uint64_t hash;
+        int64_t rowid;
+        Value* values;
+    };
+
+    size_t width_;
+    size_t num_keys_;
+    Arena values_;
+    Arena text_;
+    std::vector<Row> rows_;
+    // After build(): rows_ by bucket, bucket b being [starts_[b], starts_[b + 1]).
+    std::vector<Row> ordered_;
+    std::vector<size_t> starts_;
+    size_t mask_ = 0;
+};
+
+// Partition files of one input: rows as their length, hash and rowid, then
+// their values and keys in appendEncodedValue form.
+class PartitionFiles {
+public:
+    PartitionFiles() = default;
+    ~PartitionFiles() {
+        for (std::FILE* file : files_) {
+            if (file != nullptr) std::fclose(file);
+        }
+    }
+    PartitionFiles(const PartitionFiles&) = delete;
+    PartitionFiles& operator=(const PartitionFiles&) = delete;
+
+    // False if a temporary file cannot be made.
+    bool open() {
+        files_.assign(kPartitions, nullptr);
+        for (std::FILE*& file : files_) {
+            file = std::tmpfile();
+            if (file == nullptr) return false;
+        }
+        return true;
+    }
+
+    bool write(uint64_t hash, int64_t rowid, const Value* values, size_t width, const Value* keys, size_t num_keys) {
+        encoded_.assign(sizeof(uint32_t), 0);
+        encoded_.insert(encoded_.end(), reinterpret_cast<const unsigned char*>(&hash), reinterpret_cast<const unsigned char*>(&hash) + sizeof(hash));
+        encoded_.insert(encoded_.end(), reinterpret_cast<const unsigned char*>(&rowid), reinterpret_cast<const unsigned char*>(&rowid) + sizeof(rowid));
+        for (size_t i = 0; i < width; ++i) appendEncodedValue(encoded_, values[i]);
+        for (size_t k = 0; k < num_keys; ++k) appendEncodedValue(encoded_, keys[k]);
+        uint32_t size = static_cast<uint32_t>(encoded_.size());
+        std::copy_n(reinterpret_cast<const unsigned char*>(&size), sizeof(size), encoded_.begin());
+        return std::fwrite(encoded_.data(), 1, size, files_[partitionOf(hash)]) == size;
+    }
+
+    // Reads back the rows of one partition, the values and keys as one
+    // array valid during the call.
+    void read(size_t partition, size_t count, const std::function<void(uint64_t, int64_t, const Value*)>& visit) {
+        std::FILE* file = files_[partition];
+        std::rewind(file);
+        std::vector<Value> values(count);
+        uint32_t size = 0;
+        while (std::fread(&size, sizeof(size), 1, file) == 1 && size >= sizeof(size) + 16) {
+            encoded_.resize(size - sizeof(size));
+            if (std::fread(encoded_.data(), 1, encoded_.size(), file) != encoded_.size()) return;
+            uint64_t hash = 0;
+            int64_t rowid = 0;
+            std::copy_n(encoded_.data(), sizeof(hash), reinterpret_cast<unsigned char*>(&hash));
+            std::copy_n(encoded_.data() + sizeof(hash), sizeof(rowid), reinterpret_cast<unsigned char*>(&rowid));
+            const unsigned char* p = encoded_.data() + 16;
+            for (Value& value : values) p = readEncodedValue(p, value);
+            visit(hash, rowid, values.data());
+        }
+    }
+
+private:
+    std::vector<std::FILE*> files_;
+    std::vector<unsigned char> encoded_;
+};
+
+void hashJoin(Pager& pager, const BoundSelect& query, const JoinPlan& plan, RowEmitter& rows, size_t memory_budget) {
+    size_t inner = plan.inner;
+    size_t outer = 1 - inner;
+    JoinInput build(pager, query, plan.inputs[inner], inner);
+    JoinInput probe(pager, query, plan.inputs[outer], outer);
+    size_t num_keys = build.numKeys();
+    JoinTable table(build.width(), num_keys);
+    PartitionFiles build_files;
+    PartitionFiles probe_files;
+    bool partitioned = false;
+    // Without temporary files the table stays in memory, budget or not
+    bool can_partition = true;
+    bool write_failed = false;
+
+    build.scan([&] {
+        uint64_t hash = hashKeys(build.keys(), num_keys);
+        if (partitioned) {
+            write_failed |= !build_files.write(hash, build.rowid(), build.values(), build.width(), build.keys(), num_keys);
+            return !write_failed;
+        }
+        table.add(hash, build.rowid(), build.values(), build.keys());
+        if (can_partition && table.memoryUsed() > memory_budget) {
+            can_partition = build_files.open() && probe_files.open();
+            if (!can_partition) return true;
+            // Too large to hold: move what is in so far out to the partitions
+            partitioned = true;
+            table.forEach([&](uint64_t row_hash, int64_t rowid, const Value* values, const Value* keys) {
+                write_failed |= !build_files.write(row_hash, rowid, values, build.width(), keys, num_keys);
+            });
+            table.clear();
+        }
+        return !write_failed;
+    });
+    if (write_failed) return;
+
+    JoinedRow row;
+    row.slots[inner] = &build.slots();
+    row.slots[outer] = &probe.slots();
+    auto joinRow = [&](uint64_t hash, int64_t rowid, const Value* values, const Value* keys) {
+        row.values[outer] = values;
+        row.rowids[outer] = rowid;
+        return table.find(hash, keys, [&](const Value* built, int64_t built_rowid) {
+            row.values[inner] = built;
+            row.rowids[inner] = built_rowid;
+            rows.addJoinedRow(row);
+            return !rows.done();
+        });
+    };
+    if (!partitioned) {
+        table.build();
+        probe.scan([&] { return joinRow(hashKeys(probe.keys(), num_keys), probe.rowid(), probe.values(), probe.keys()); });
+        return;
+    }
+    probe.scan([&] {
+        write_failed |= !probe_files.write(hashKeys(probe.keys(), num_keys), probe.rowid(), probe.values(), probe.width(), probe.keys(), num_keys);
+        return !write_failed;
+    });
+    if (write_failed) return;
+    for (size_t partition = 0; partition < kPartitions && !rows.done(); ++partition) {
+        table.clear();
+        build_files.read(partition, build.width() + num_keys, [&](uint64_t hash, int64_t rowid, const Value* values) {
+            table.add(hash, rowid, values, values + build.width());
+        });
+        if (table.size() == 0) continue;
+        table.build();
+        bool more = true;
+        probe_files.read(partition, probe.width() + num_keys, [&](uint64_t hash, int64_t rowid, const Value* values) {
+            if (more) more = joinRow(hash, rowid, values, values + probe.width());
+        });
+    }
+}
+
+// The literal an index is sought with for a key value; false for a blob,
+// which no literal stands for. Text gets no numeric form, so that it only
+// matches text, as compareValues does.
+bool keyLiteral(const Value& value, Literal& literal) {
+    literal = Literal{};
+    switch (value.type) {
+        case Value::Type::Integer:
+        case Value::Type::Real:
+            literal.kind = value.type == Value::Type::Integer ? Literal::Kind::Integer : Literal::Kind::Real;
+            literal.number = value;
+            appendValue(literal.text, value);
+            return true;
+        case Value::Type::Text:
+            literal.kind = Literal::Kind::Text;
+            literal.text.assign(reinterpret_cast<const char*>(value.data), value.size);
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Rowid equal to a key value under compareValues, if there is one.
+bool keyRowid(const Value& value, int64_t& rowid) {
+    if (value.type == Value::Type::Integer) {
+        rowid = value.integer;
+        return true;
+    }
+    if (value.type != Value::Type::Real) return false;
+    double d = value.real;
+    if (!(d >= -9223372036854775808.0 && d < 9223372036854775808.0)) return false;
+    rowid = static_cast<int64_t>(d);
+    return static_cast<double>(rowid) == d;
+}
+
+void nestedLoopJoin(Pager& pager, const BoundSelect& query, const JoinPlan& plan, RowEmitter& rows) {
+    size_t inner = plan.inner;
+    size_t outer = 1 - inner;
+    JoinInput scanned(pager, query, plan.inputs[outer], outer);
+    JoinInput sought(pager, query, plan.inputs[inner], inner);
+    const TableInfo& inner_table = *(inner == 0 ? query.table : query.join_table);
+    if (inner_table.root_page == 0) return;
+    TableCursor cursor(pager, inner_table.root_page);
+    IndexCursor entries(pager, plan.index != nullptr ? plan.index->root_page : 0);
+    QueryProfile* profile = pager.profile();
+    uint64_t entries_examined = 0;
+    uint64_t rows_fetched = 0;
+
+    JoinedRow row;
+    row.slots[outer] = &scanned.slots();
+    row.slots[inner] = &sought.slots();
+    auto fetch = [&](int64_t rowid) {
+        if (!cursor.seek(rowid)) return;
+        ++rows_fetched;
+        if (!sought.load(cursor)) return;
+        row.values[inner] = sought.values();
+        row.rowids[inner] = sought.rowid();
+        rows.addJoinedRow(row);
+    };
+    scanned.scan([&] {
+        row.values[outer] = scanned.values();
+        row.rowids[outer] = scanned.rowid();
+        const Value& key = scanned.keys()[0];
+        if (plan.index == nullptr) {
+            int64_t rowid = 0;
+            if (keyRowid(key, rowid)) fetch(rowid);
+            return !rows.done();
+        }
+        // The literal only narrows the entries; compareValues decides
+        KeyRange range;
+        Literal literal;
+        if (keyLiteral(key, literal)) range.equal.push_back(std::move(literal));
+        for (bool ok = entries.seek(range); ok && !rows.done(); ok = entries.next()) {
+            Record& entry = entries.record();
+            ++entries_examined;
+            if (!range.belowUpper(entry)) break;
+            if (entry.columnCount() > 1 && compareValues(entry.value(0), key) == 0) fetch(entries.rowid());
+        }
+        return !rows.done();
+    });
+    if (profile != nullptr) {
+        profile->addIndexEntriesExamined(entries_examined);
+        profile->addRowsExamined(rows_fetched);
+    }
+}
+
+}  // namespace
+
+void runJoin(Pager& pager, const BoundSelect& query, const JoinPlan& plan, RowEmitter& rows, size_t memory_budget) {
+    if (plan.kind == JoinPlan::Kind::Hash) hashJoin(pager, query, plan, rows, memory_budget);
+    else nestedLoopJoin(pager, query, plan, rows);
+}
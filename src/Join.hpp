@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+#include "Pager.hpp"
+#include "Planner.hpp"
+#include "Query.hpp"
+
+// Runs the inner join of the two FROM tables of query the way plan says,
+// handing every joined row to rows. Each input reads only the columns the
+// query uses and drops rows failing its own conjuncts before any pairing.
+//
+// A hash join copies the rows of the hashed input into arenas and lays them
+// out bucket by bucket. If they outgrow memory_budget, that input and then
+// the other are split by key hash into partitions written to temporary files
+// (a Grace hash join), and the partitions are joined pair by pair; one still
+// too large for the budget is joined in memory all the same. An index nested
+// loop join streams the outer table, seeking the inner one per row, so LIMIT
+// can stop it early.
+void runJoin(Pager& pager, const BoundSelect& query, const JoinPlan& plan, RowEmitter& rows, size_t memory_budget);
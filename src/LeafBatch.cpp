@@ -0,0 +1,178 @@
+#include "LeafBatch.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <string>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "Btree.hpp"
+
+namespace {
+
+// Length of the leading run of bytes below 0x80 among the first n: serial
+// types that each fit in a one-byte varint, which is nearly all of them.
+size_t singleByteRun(const unsigned char* bytes, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(chunk));
+        if (mask != 0) return i + static_cast<size_t>(std::countr_zero(mask));
+    }
+#endif
+    while (i < n && bytes[i] < 0x80) ++i;
+    return i;
+}
+
+// serialTypePayloadLength without the call, for the per-cell loops.
+inline size_t payloadLength(uint64_t type) {
+    static constexpr unsigned char kFixed[12] = {0, 1, 2, 3, 4, 6, 8, 8, 0, 0, 0, 0};
+    return type < 12 ? kFixed[type] : static_cast<size_t>((type - 12) / 2);
+}
+
+}  // namespace
+
+LeafBatch::LeafBatch(Pager& pager, const std::vector<ColumnFilter>& filters)
+    : pager_(pager), filters_(filters), scratch_(pager) {
+    for (const ColumnFilter& filter : filters_) columns_ = std::max(columns_, filter.column + 1);
+}
+
+void LeafBatch::load(PageView page, size_t header_off) {
+    page_ = page;
+    size_t num_cells = readBE16(page, header_off + 3);
+    rowids_.resize(num_cells);
+    payload_start_.resize(num_cells);
+    payload_size_.resize(num_cells);
+    slow_.assign(num_cells, 0);
+    types_.resize(columns_ * num_cells);
+    offsets_.resize(columns_ * num_cells);
+    // Larger table leaf payloads spill onto overflow pages
+    uint64_t max_local = pager_.usableSize() - 35;
+    for (size_t i = 0; i < num_cells; ++i) {
+        size_t p = readBE16(page, header_off + 8 + i * 2);
+        auto pr = readVarint(page, p);
+        uint64_t payload_size = pr.first;
+        p += pr.second;
+        pr = readVarint(page, p);
+        rowids_[i] = static_cast<int64_t>(pr.first);
+        p += pr.second;
+        payload_start_[i] = static_cast<uint32_t>(p);
+        payload_size_[i] = payload_size;
+        if (columns_ == 0) continue;
+        bool local = payload_size <= max_local && p + payload_size <= page.size();
+        if (!local || !decodeHeader(i)) slow_[i] = 1;
+    }
+    selection_.resize(num_cells);
+    for (size_t i = 0; i < num_cells; ++i) selection_[i] = static_cast<uint16_t>(i);
+    for (const ColumnFilter& filter : filters_) {
+        if (filter.is_like) applyLike(filter);
+        else applyRange(filter);
+    }
+}
+
+// Serial types and offsets of the first columns_ columns of a cell whose
+// payload is all on the page; columns past the end of a short record read as
+// NULL, as Record's do.
+bool LeafBatch::decodeHeader(size_t cell) {
+    size_t start = payload_start_[cell];
+    uint64_t payload_size = payload_size_[cell];
+    auto pr = readVarint(page_, start);
+    uint64_t header_size = pr.first;
+    if (header_size > payload_size || header_size < pr.second) return false;
+    const unsigned char* header = page_.data() + start;
+    size_t hp = pr.second;
+    size_t hend = static_cast<size_t>(header_size);
+    uint64_t body = start + header_size;
+    size_t num_cells = rowids_.size();
+    size_t c = 0;
+    auto take = [&](uint64_t type) {
+        types_[c * num_cells + cell] = static_cast<uint32_t>(type);
+        offsets_[c * num_cells + cell] = static_cast<uint32_t>(body);
+        body += payloadLength(type);
+        ++c;
+    };
+    while (c < columns_ && hp < hend) {
+        size_t run = singleByteRun(header + hp, std::min(hend - hp, columns_ - c));
+        for (size_t k = 0; k < run; ++k) take(header[hp + k]);
+        hp += run;
+        if (c == columns_ || hp >= hend) break;
+        auto stp = readVarint(page_, start + hp);
+        hp += stp.second;
+        take(stp.first);
+    }
+    if (body > start + payload_size) return false;
+    while (c < columns_) take(0);
+    return true;
+}
+
+Value LeafBatch::value(size_t cell, size_t column) const {
+    size_t entry = column * rowids_.size() + cell;
+    uint32_t type = types_[entry];
+    return decodeValue(type, page_.subspan(offsets_[entry], payloadLength(type)));
+}
+
+void LeafBatch::applyRange(const ColumnFilter& filter) {
+    const ColumnRange& range = filter.range;
+    // Text values equal a text literal only byte for byte, and never a number
+    bool text_equality = range.isEquality() && range.lower.kind == Literal::Kind::Text;
+    const std::string& equal_text = range.lower.text;
+    // Integer bounds compare with integer columns without building Values
+    auto isInteger = [](const Literal& bound) { return bound.kind == Literal::Kind::Integer && bound.number.type == Value::Type::Integer; };
+    bool integer_bounds = (!range.has_lower || isInteger(range.lower)) && (!range.has_upper || isInteger(range.upper));
+    int64_t lower = range.has_lower ? range.lower.number.integer : 0;
+    int64_t upper = range.has_upper ? range.upper.number.integer : 0;
+    const uint32_t* types = types_.data() + filter.column * rowids_.size();
+    const uint32_t* offsets = offsets_.data() + filter.column * rowids_.size();
+    size_t kept = 0;
+    for (uint16_t cell : selection_) {
+        bool pass;
+        uint32_t type = types[cell];
+        if (slow_[cell]) {
+            pass = loadRecord(cell, scratch_) && range.matchesColumn(scratch_, filter.column);
+        } else if (text_equality && type >= 13 && type % 2 == 1) {
+            pass = payloadLength(type) == equal_text.size() && std::memcmp(page_.data() + offsets[cell], equal_text.data(), equal_text.size()) == 0;
+        } else if (integer_bounds && type >= 1 && type <= 9 && type != 7) {
+            int64_t v = type >= 8 ? type - 8 : readBigEndianSigned(page_.data() + offsets[cell], payloadLength(type));
+            pass = (!range.has_lower || v > lower || (range.lower_inclusive && v == lower)) &&
+                   (!range.has_upper || v < upper || (range.upper_inclusive && v == upper));
+        } else {
+            pass = range.matches(value(cell, filter.column));
+        }
+        if (pass) selection_[kept++] = cell;
+    }
+    selection_.resize(kept);
+}
+
+void LeafBatch::applyLike(const ColumnFilter& filter) {
+    const LikePattern& like = filter.like;
+    const uint32_t* types = types_.data() + filter.column * rowids_.size();
+    const uint32_t* offsets = offsets_.data() + filter.column * rowids_.size();
+    // Numbers match by their text, as the evaluator gives it
+    std::string formatted;
+    auto matchesValue = [&](Value value) {
+        if (value.isNull()) return false;
+        if (filter.real_affinity && value.type == Value::Type::Integer) value = Value::makeReal(static_cast<double>(value.integer));
+        if (value.type == Value::Type::Text || value.type == Value::Type::Blob) return like.matches(value.data, value.size);
+        formatted.clear();
+        appendValue(formatted, value);
+        return like.matches(reinterpret_cast<const unsigned char*>(formatted.data()), formatted.size());
+    };
+    size_t kept = 0;
+    for (uint16_t cell : selection_) {
+        bool pass;
+        uint32_t type = types[cell];
+        if (slow_[cell]) {
+            pass = loadRecord(cell, scratch_) && filter.column < scratch_.columnCount() && matchesValue(scratch_.value(filter.column));
+        } else if (type >= 12) {
+            pass = like.matches(page_.data() + offsets[cell], payloadLength(type));
+        } else {
+            pass = matchesValue(value(cell, filter.column));
+        }
+        if (pass) selection_[kept++] = cell;
+    }
+    selection_.resize(kept);
+}
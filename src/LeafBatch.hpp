@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Pager.hpp"
+#include "Predicate.hpp"
+#include "Record.hpp"
+#include "TextMatch.hpp"
+#include "Value.hpp"
+
+// A WHERE conjunct on one table column: a range bounded by constants or,
+// if is_like, `column LIKE 'pattern'`.
+struct ColumnFilter {
+    size_t column = 0;
+    ColumnRange range;
+    bool is_like = false;
+    LikePattern like;
+    // LIKE reads integers in a REAL column as reals, e.g. 5 as "5.0".
+    bool real_affinity = false;
+};
+
+// Decodes every cell of a table leaf page at once into column-oriented
+// arrays: the rowids, and for each column the filters read, the serial type
+// and page offset of its bytes in every cell. The filters then run a column
+// at a time over the whole page, narrowing a selection of cells, so only rows
+// that pass them are decoded into a Record. Text is compared in place, and
+// the lengths in the serial types settle most comparisons before any text is
+// read. Cells whose payload spills onto overflow pages are checked through a
+// Record instead. The arrays are reused from page to page.
+class LeafBatch {
+public:
+    LeafBatch(Pager& pager, const std::vector<ColumnFilter>& filters);
+
+    // Decodes the cells of a table leaf page and applies the filters; the
+    // page must outlive the batch's use of it.
+    void load(PageView page, size_t header_off);
+
+    size_t size() const { return rowids_.size(); }
+    int64_t rowid(size_t cell) const { return rowids_[cell]; }
+    // Cells that pass every filter, in page order.
+    const std::vector<uint16_t>& selection() const { return selection_; }
+    // Loads the whole record of a cell; false if it is malformed.
+    bool loadRecord(size_t cell, Record& record) const {
+        return record.load(page_, payload_start_[cell], payload_size_[cell], false);
+    }
+
+private:
+    bool decodeHeader(size_t cell);
+    Value value(size_t cell, size_t column) const;
+    void applyRange(const ColumnFilter& filter);
+    void applyLike(const ColumnFilter& filter);
+
+    Pager& pager_;
+    const std::vector<ColumnFilter>& filters_;
+    // Columns decoded per cell: those below the highest filtered one.
+    size_t columns_ = 0;
+    Record scratch_;
+
+    PageView page_;
+    std::vector<int64_t> rowids_;
+    std::vector<uint32_t> payload_start_;
+    std::vector<uint64_t> payload_size_;
+    // Cells left to scratch_: overflow payloads and malformed headers.
+    std::vector<uint8_t> slow_;
+    // Column-major: entry column * size() + cell.
+    std::vector<uint32_t> types_;
+    std::vector<uint32_t> offsets_;
+    std::vector<uint16_t> selection_;
+};
@@ -0,0 +1,145 @@
+#include "Lexer.hpp"
+
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+bool isIdentifierStart(char c) {
+    return std::isalpha(static_cast<unsigned char>(c)) || c == '_' || static_cast<unsigned char>(c) >= 0x80;
+}
+
+bool isIdentifierChar(char c) {
+    return isIdentifierStart(c) || std::isdigit(static_cast<unsigned char>(c)) || c == '$';
+}
+
+bool isDigit(char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; }
+
+// Reads a quoted run starting at the opening quote at pos. The closing
+// character doubled stands for itself, except inside [...].
+bool readQuoted(std::string_view sql, size_t& pos, char close, std::string& text) {
+    ++pos;
+    while (pos < sql.size()) {
+        char c = sql[pos];
+        if (c == close) {
+            if (close != ']' && pos + 1 < sql.size() && sql[pos + 1] == close) {
+                text.push_back(close);
+                pos += 2;
+                continue;
+            }
+            ++pos;
+            return true;
+        }
+        text.push_back(c);
+        ++pos;
+    }
+    return false;
+}
+
+// Scans a number: digits with an optional fraction and exponent, or a
+// 0x hex integer. Returns false for things like `1e` or `12abc`.
+bool readNumber(std::string_view sql, size_t& pos, std::string& text) {
+    size_t start = pos;
+    if (sql[pos] == '0' && pos + 1 < sql.size() && (sql[pos + 1] == 'x' || sql[pos + 1] == 'X')) {
+        pos += 2;
+        uint64_t value = 0;
+        size_t digits = 0;
+        while (pos < sql.size() && std::isxdigit(static_cast<unsigned char>(sql[pos]))) {
+            char c = static_cast<char>(std::tolower(static_cast<unsigned char>(sql[pos++])));
+            value = (value << 4) | static_cast<uint64_t>(isDigit(c) ? c - '0' : c - 'a' + 10);
+            ++digits;
+        }
+        if (digits == 0 || digits > 16 || (pos < sql.size() && isIdentifierChar(sql[pos]))) return false;
+        // Hex literals are 64-bit two's complement, so 0xffffffffffffffff is -1.
+        text = std::to_string(static_cast<int64_t>(value));
+        return true;
+    }
+    while (pos < sql.size() && isDigit(sql[pos])) ++pos;
+    if (pos < sql.size() && sql[pos] == '.') {
+        ++pos;
+        while (pos < sql.size() && isDigit(sql[pos])) ++pos;
+    }
+    if (pos < sql.size() && (sql[pos] == 'e' || sql[pos] == 'E')) {
+        size_t p = pos + 1;
+        if (p < sql.size() && (sql[p] == '+' || sql[p] == '-')) ++p;
+        if (p >= sql.size() || !isDigit(sql[p])) return false;
+        while (p < sql.size() && isDigit(sql[p])) ++p;
+        pos = p;
+    }
+    if (pos < sql.size() && isIdentifierChar(sql[pos])) return false;
+    text.assign(sql.substr(start, pos - start));
+    return true;
+}
+
+}  // namespace
+
+bool Token::isKeyword(std::string_view upper_keyword) const {
+    if (kind != Kind::Identifier || text.size() != upper_keyword.size()) return false;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (std::toupper(static_cast<unsigned char>(text[i])) != upper_keyword[i]) return false;
+    }
+    return true;
+}
+
+bool tokenize(std::string_view sql, std::vector<Token>& tokens, std::string& error) {
+    tokens.clear();
+    size_t pos = 0;
+    while (true) {
+        while (pos < sql.size() && std::isspace(static_cast<unsigned char>(sql[pos]))) ++pos;
+        if (sql.substr(pos, 2) == "--") {
+            while (pos < sql.size() && sql[pos] != '\n') ++pos;
+            continue;
+        }
+        if (sql.substr(pos, 2) == "/*") {
+            size_t end = sql.find("*/", pos + 2);
+            if (end == std::string_view::npos) {
+                error = "unterminated comment";
+                return false;
+            }
+            pos = end + 2;
+            continue;
+        }
+        Token token;
+        token.offset = pos;
+        if (pos >= sql.size()) {
+            tokens.push_back(token);
+            return true;
+        }
+        char c = sql[pos];
+        bool ok = true;
+        if (c == '\'') {
+            token.kind = Token::Kind::String;
+            ok = readQuoted(sql, pos, '\'', token.text);
+        } else if (c == '"' || c == '`' || c == '[') {
+            token.kind = Token::Kind::QuotedIdentifier;
+            token.quote = c;
+            ok = readQuoted(sql, pos, c == '[' ? ']' : c, token.text);
+        } else if (isDigit(c) || (c == '.' && pos + 1 < sql.size() && isDigit(sql[pos + 1]))) {
+            token.kind = Token::Kind::Number;
+            ok = readNumber(sql, pos, token.text);
+        } else if (isIdentifierStart(c)) {
+            token.kind = Token::Kind::Identifier;
+            while (pos < sql.size() && isIdentifierChar(sql[pos])) ++pos;
+            token.text.assign(sql.substr(token.offset, pos - token.offset));
+        } else {
+            static const char* const kTwoCharOperators[] = {"||", "<=", ">=", "==", "!=", "<>", "<<", ">>"};
+            token.kind = Token::Kind::Operator;
+            for (const char* op : kTwoCharOperators) {
+                if (sql.substr(pos, 2) == op) token.text = op;
+            }
+            if (token.text.empty() && std::strchr("(),;.*+-/%=<>&|~", c) != nullptr) token.text.assign(1, c);
+            ok = !token.text.empty();
+            pos += token.text.size();
+        }
+        if (!ok) {
+            size_t end = pos;
+            while (end < sql.size() && !std::isspace(static_cast<unsigned char>(sql[end])) && end < token.offset + 20) ++end;
+            if (end == token.offset) end = token.offset + 1;
+            error = "unrecognized token: \"" + std::string(sql.substr(token.offset, end - token.offset)) + "\"";
+            return false;
+        }
+        token.length = pos - token.offset;
+        tokens.push_back(std::move(token));
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct Token {
+    enum class Kind { End, Identifier, QuotedIdentifier, String, Number, Operator };
+
+    Kind kind = Kind::End;
+    // Strings and quoted identifiers are unquoted and unescaped; hex numbers
+    // are converted to decimal; everything else is the source text.
+    std::string text;
+    // Position in the statement, for error messages.
+    size_t offset = 0;
+    size_t length = 0;
+    // The quote character of a QuotedIdentifier.
+    char quote = '\0';
+
+    // Keywords are bare identifiers compared case-insensitively; upper_keyword
+    // must be upper case.
+    bool isKeyword(std::string_view upper_keyword) const;
+    bool isOperator(std::string_view op) const { return kind == Kind::Operator && text == op; }
+};
+
+// Splits one SQL statement into tokens, ending with an End token. Comments
+// are dropped. Returns false and sets error on an unterminated string or
+// comment, or a character that starts no token.
+bool tokenize(std::string_view sql, std::vector<Token>& tokens, std::string& error);
@@ -0,0 +1,454 @@
+#include "Modify.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "BtreeWriter.hpp"
+#include "Parser.hpp"
+#include "Record.hpp"
+#include "Transaction.hpp"
+
+namespace {
+
+constexpr const char* kMalformed = "database disk image is malformed";
+
+bool isRowidName(std::string_view name) {
+    std::string upper = normalizeIdentifier(name);
+    return upper == "ROWID" || upper == "OID" || upper == "_ROWID_";
+}
+
+// An aggregate has no group of rows to fold in a value being written; any
+// other function is left for the binder to reject.
+const Expr* findAggregate(const Expr& expr) {
+    if (expr.kind == Expr::Kind::Function) {
+        for (const char* name : {"COUNT", "SUM", "TOTAL", "AVG", "MIN", "MAX"}) {
+            if (expr.name == name) return &expr;
+        }
+    }
+    for (const ExprPtr& arg : expr.args) {
+        if (const Expr* found = findAggregate(*arg)) return found;
+    }
+    return nullptr;
+}
+
+ExprPtr columnExpr(std::string name) {
+    auto expr = std::make_unique<Expr>();
+    expr->kind = Expr::Kind::Column;
+    expr->name = std::move(name);
+    return expr;
+}
+
+// Writes rows of one table and keeps its indexes in step, inside a
+// transaction. Values are the table's columns in order, with the INTEGER
+// PRIMARY KEY column holding the rowid.
+class TableWriter {
+public:
+    TableWriter(Transaction& txn, const Catalog& catalog, const TableInfo& table, const std::vector<Value>& defaults)
+        : txn_(txn), table_(table), rows_(txn, table.root_page), defaults_(defaults), scratch_(table.columns.size()) {
+        for (size_t i : table.indexes) {
+            const IndexInfo& index = catalog.indexes()[i];
+            indexes_.push_back(&index);
+            index_trees_.emplace_back(txn, index.root_page, true, index.descending);
+        }
+    }
+
+    // rowid is NULL to take the next one after the largest.
+    bool insert(std::vector<Value>& values, Value rowid, std::string& error);
+    // set holds new values for some columns; rowid is the new rowid, or
+    // NULL to keep the current one.
+    bool update(int64_t old_rowid, const std::vector<std::pair<size_t, Value>>& set, Value rowid, std::string& error);
+    bool remove(int64_t rowid, std::string& error);
+
+private:
+    std::string qualified(size_t column) const { return table_.name + "." + table_.columns[column].name; }
+    std::string rowidName() const { return table_.rowid_alias >= 0 ? qualified(static_cast<size_t>(table_.rowid_alias)) : table_.name + ".rowid"; }
+    // Reads the row into values, padded with the defaults of columns added
+    // since it was written; payload holds the bytes they point into.
+    bool readRow(int64_t rowid, std::vector<unsigned char>& payload, std::vector<Value>& values, bool& found);
+    bool checkNotNull(const std::vector<Value>& values, std::string& error) const;
+    bool checkRowid(Value& rowid, std::string& error);
+    void indexEntry(size_t i, const std::vector<Value>& values, int64_t rowid, std::vector<Value>& entry) const;
+    bool removeEntries(const std::vector<Value>& values, int64_t rowid, std::string& error);
+    // Writes the row and its index entries once its UNIQUE keys are known to
+    // be free.
+    bool store(std::vector<Value>& values, int64_t rowid, std::string& error);
+
+    Transaction& txn_;
+    const TableInfo& table_;
+    BtreeWriter rows_;
+    std::vector<const IndexInfo*> indexes_;
+    std::vector<BtreeWriter> index_trees_;
+    const std::vector<Value>& defaults_;
+    std::vector<std::string> scratch_;
+    std::string rowid_scratch_;
+};
+
+bool TableWriter::readRow(int64_t rowid, std::vector<unsigned char>& payload, std::vector<Value>& values, bool& found) {
+    if (!rows_.findRow(rowid, payload, found)) return false;
+    if (!found) return true;
+    if (!decodeRecord(PageView(payload), values)) return false;
+    values.resize(table_.columns.size());
+    for (size_t c = values.size(); c < table_.columns.size(); ++c) values[c] = defaults_[c];
+    if (table_.rowid_alias >= 0) values[static_cast<size_t>(table_.rowid_alias)] = Value::makeInteger(rowid);
+    return true;
+}
+
+bool TableWriter::checkNotNull(const std::vector<Value>& values, std::string& error) const {
+    for (size_t c = 0; c < table_.columns.size(); ++c) {
+        if (table_.columns[c].not_null && values[c].isNull() && static_cast<ssize_t>(c) != table_.rowid_alias) {
+            error = "NOT NULL constraint failed: " + qualified(c);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TableWriter::checkRowid(Value& rowid, std::string& error) {
+    rowid = applyAffinity(rowid, Affinity::Integer, rowid_scratch_);
+    if (rowid.type == Value::Type::Integer) return true;
+    error = "datatype mismatch";
+    return false;
+}
+
+void TableWriter::indexEntry(size_t i, const std::vector<Value>& values, int64_t rowid, std::vector<Value>& entry) const {
+    entry.clear();
+    for (size_t column : indexes_[i]->columns) {
+        entry.push_back(static_cast<ssize_t>(column) == table_.rowid_alias ? Value::makeInteger(rowid) : values[column]);
+    }
+    entry.push_back(Value::makeInteger(rowid));
+}
+
+bool TableWriter::removeEntries(const std::vector<Value>& values, int64_t rowid, std::string& error) {
+    std::vector<Value> entry;
+    for (size_t i = 0; i < indexes_.size(); ++i) {
+        indexEntry(i, values, rowid, entry);
+        if (!index_trees_[i].removeEntry(entry)) {
+            error = kMalformed;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TableWriter::store(std::vector<Value>& values, int64_t rowid, std::string& error) {
+    std::vector<std::vector<Value>> entries(indexes_.size());
+    for (size_t i = 0; i < indexes_.size(); ++i) {
+        std::vector<Value>& entry = entries[i];
+        indexEntry(i, values, rowid, entry);
+        if (!indexes_[i]->unique) continue;
+        // NULLs are distinct from each other, so a key holding one is free
+        bool has_null = false;
+        for (size_t k = 0; k + 1 < entry.size(); ++k) has_null = has_null || entry[k].isNull();
+        bool taken = false;
+        if (has_null) continue;
+        if (!index_trees_[i].containsKey(entry.data(), entry.size() - 1, taken)) {
+            error = kMalformed;
+            return false;
+        }
+        if (taken) {
+            error = "UNIQUE constraint failed: ";
+            for (size_t k = 0; k < indexes_[i]->columns.size(); ++k) error += (k > 0 ? ", " : "") + qualified(indexes_[i]->columns[k]);
+            return false;
+        }
+    }
+    // The INTEGER PRIMARY KEY is the rowid, and stored as NULL
+    if (table_.rowid_alias >= 0) values[static_cast<size_t>(table_.rowid_alias)] = Value{};
+    std::vector<unsigned char> payload;
+    appendRecord(payload, values.data(), values.size());
+    if (!rows_.putRow(rowid, payload)) {
+        error = kMalformed;
+        return false;
+    }
+    for (size_t i = 0; i < indexes_.size(); ++i) {
+        if (!index_trees_[i].insertEntry(entries[i])) {
+            error = kMalformed;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TableWriter::insert(std::vector<Value>& values, Value rowid, std::string& error) {
+    for (size_t c = 0; c < values.size(); ++c) values[c] = applyAffinity(values[c], table_.columns[c].affinity, scratch_[c]);
+    if (table_.rowid_alias >= 0 && !values[static_cast<size_t>(table_.rowid_alias)].isNull()) rowid = values[static_cast<size_t>(table_.rowid_alias)];
+    if (!checkNotNull(values, error)) return false;
+    if (rowid.isNull()) {
+        int64_t last = 0;
+        bool empty = true;
+        if (!rows_.lastRowid(last, empty)) {
+            error = kMalformed;
+            return false;
+        }
+        if (!empty && last == std::numeric_limits<int64_t>::max()) {
+            error = "database or disk is full";
+            return false;
+        }
+        rowid = Value::makeInteger(empty ? 1 : last + 1);
+    } else {
+        if (!checkRowid(rowid, error)) return false;
+        std::vector<unsigned char> payload;
+        bool found = false;
+        if (!rows_.findRow(rowid.integer, payload, found)) {
+            error = kMalformed;
+            return false;
+        }
+        if (found) {
+            error = "UNIQUE constraint failed: " + rowidName();
+            return false;
+        }
+    }
+    if (table_.rowid_alias >= 0) values[static_cast<size_t>(table_.rowid_alias)] = rowid;
+    return store(values, rowid.integer, error);
+}
+
+bool TableWriter::update(int64_t old_rowid, const std::vector<std::pair<size_t, Value>>& set, Value rowid, std::string& error) {
+    std::vector<unsigned char> payload;
+    std::vector<Value> old_values;
+    bool found = false;
+    if (!readRow(old_rowid, payload, old_values, found)) {
+        error = kMalformed;
+        return false;
+    }
+    if (!found) return true;
+    std::vector<Value> values = old_values;
+    for (const auto& [column, value] : set) values[column] = applyAffinity(value, table_.columns[column].affinity, scratch_[column]);
+    if (table_.rowid_alias >= 0) {
+        for (const auto& [column, value] : set) {
+            if (static_cast<ssize_t>(column) == table_.rowid_alias) rowid = values[column];
+        }
+        // Setting the INTEGER PRIMARY KEY to NULL does not pick a new rowid
+        if (rowid.isNull() && values[static_cast<size_t>(table_.rowid_alias)].isNull()) {
+            error = "datatype mismatch";
+            return false;
+        }
+    }
+    if (rowid.isNull()) rowid = Value::makeInteger(old_rowid);
+    if (!checkRowid(rowid, error) || !checkNotNull(values, error)) return false;
+    if (table_.rowid_alias >= 0) values[static_cast<size_t>(table_.rowid_alias)] = rowid;
+    if (!removeEntries(old_values, old_rowid, error)) return false;
+    if (rowid.integer != old_rowid) {
+        std::vector<unsigned char> existing;
+        if (!rows_.findRow(rowid.integer, existing, found)) {
+            error = kMalformed;
+            return false;
+        }
+        if (found) {
+            error = "UNIQUE constraint failed: " + rowidName();
+            return false;
+        }
+        if (!rows_.removeRow(old_rowid)) {
+            error = kMalformed;
+            return false;
+        }
+    }
+    return store(values, rowid.integer, error);
+}
+
+bool TableWriter::remove(int64_t rowid, std::string& error) {
+    std::vector<unsigned char> payload;
+    std::vector<Value> values;
+    bool found = false;
+    if (!readRow(rowid, payload, values, found)) {
+        error = kMalformed;
+        return false;
+    }
+    if (!found) return true;
+    if (!removeEntries(values, rowid, error)) return false;
+    if (!rows_.removeRow(rowid)) {
+        error = kMalformed;
+        return false;
+    }
+    return true;
+}
+
+// Runs statement and collects its rows, with their text and blobs copied
+// into buffers.
+bool selectRows(const SelectRunner& select, SelectStatement& statement, std::deque<std::string>& buffers, std::vector<std::vector<Value>>& rows, std::ostream& err) {
+    ResultSink sink([&](const std::vector<Value>& row) {
+        std::vector<Value>& kept = rows.emplace_back(row);
+        size_t bytes = 0;
+        for (const Value& value : row) {
+            if (value.type == Value::Type::Text || value.type == Value::Type::Blob) bytes += value.size;
+        }
+        if (bytes == 0) return;
+        // Built in place, so the values can point into it
+        unsigned char* p = reinterpret_cast<unsigned char*>(buffers.emplace_back(bytes, '\0').data());
+        for (Value& value : kept) {
+            if (value.type != Value::Type::Text && value.type != Value::Type::Blob) continue;
+            std::memcpy(p, value.data, value.size);
+            value.data = p;
+            p += value.size;
+        }
+    });
+    return select(statement, sink, err) == 0;
+}
+
+}  // namespace
+
+int runModification(Pager& pager, const Catalog& catalog, ModifyStatement& statement, const SelectRunner& select, uint64_t& sequence, std::ostream& err) {
+    sequence = 0;
+    auto fail = [&](const std::string& message) {
+        err << "Error: " << message << std::endl;
+        return 1;
+    };
+    // The schema table is not in the catalog's list, but exists all the same
+    std::string upper_name = normalizeIdentifier(statement.table);
+    if (upper_name == "SQLITE_MASTER" || upper_name == "SQLITE_SCHEMA") return fail("table " + statement.table + " may not be modified");
+    const TableInfo* found_table = catalog.findTable(statement.table);
+    if (found_table == nullptr) return fail("no such table: " + statement.table);
+    const TableInfo& table = *found_table;
+    if (!table.write_restriction.empty()) return fail("cannot modify " + table.name + ": " + table.write_restriction);
+    if (table.root_page == 0) return fail("cannot modify " + table.name + ": it has no B-tree");
+    for (const ExprPtr& value : statement.values) {
+        if (const Expr* aggregate = findAggregate(*value)) return fail("misuse of aggregate function " + aggregate->name + "()");
+    }
+    for (const std::vector<ExprPtr>& row : statement.rows) {
+        for (const ExprPtr& value : row) {
+            if (const Expr* aggregate = findAggregate(*value)) return fail("misuse of aggregate function " + aggregate->name + "()");
+        }
+    }
+    // The name the SELECTs read the rowid by, one no column has taken
+    std::string rowid_name;
+    for (const char* name : {"rowid", "_rowid_", "oid"}) {
+        if (table.findColumn(name) == std::string::npos) {
+            rowid_name = name;
+            break;
+        }
+    }
+    size_t num_columns = table.columns.size();
+
+    // Where each value of an INSERT row goes: a column, or npos for the rowid
+    std::vector<size_t> targets;
+    if (statement.kind == ModifyStatement::Kind::Insert) {
+        for (const std::string& name : statement.columns) {
+            size_t column = table.findColumn(name);
+            if (column == std::string::npos && !isRowidName(name)) return fail("table " + table.name + " has no column named " + name);
+            targets.push_back(column);
+        }
+        if (statement.columns.empty() && !statement.default_values) {
+            for (size_t c = 0; c < num_columns; ++c) targets.push_back(c);
+        }
+        if (!statement.rows.empty() && statement.rows.front().size() != targets.size()) {
+            if (statement.columns.empty()) {
+                return fail("table " + table.name + " has " + std::to_string(num_columns) + " columns but " + std::to_string(statement.rows.front().size()) + " values were supplied");
+            }
+            return fail(std::to_string(statement.rows.front().size()) + " values for " + std::to_string(targets.size()) + " columns");
+        }
+    }
+    std::vector<std::pair<size_t, size_t>> set_columns;
+    bool sets_rowid = false;
+    if (statement.kind == ModifyStatement::Kind::Update) {
+        for (size_t i = 0; i < statement.columns.size(); ++i) {
+            size_t column = table.findColumn(statement.columns[i]);
+            if (column == std::string::npos) {
+                if (!isRowidName(statement.columns[i])) return fail("no such column: " + statement.columns[i]);
+                sets_rowid = true;
+            }
+            set_columns.emplace_back(column, i);
+        }
+    }
+    if (rowid_name.empty() && statement.kind != ModifyStatement::Kind::Insert) return fail("cannot modify " + table.name + ": every name for the rowid is taken by a column");
+
+    Transaction txn(pager);
+    std::string error;
+    if (!txn.begin(error)) return fail(error);
+
+    // Every row to write is worked out before the first one changes, all
+    // from the last committed state, which no other writer can move on
+    std::deque<std::string> buffers;
+    std::vector<std::vector<Value>> rows;
+    std::vector<Value> defaults(num_columns);
+    {
+        Pager::ReadScope snapshot(pager);
+        // Rows written before a column was added read as its default too
+        std::vector<bool> given(num_columns, false);
+        if (statement.kind == ModifyStatement::Kind::Insert) {
+            for (size_t target : targets) {
+                if (target != std::string::npos) given[target] = true;
+            }
+        }
+        if (std::find(given.begin(), given.end(), false) != given.end()) {
+            for (size_t c = 0; c < num_columns; ++c) {
+                const std::string& text = table.columns[c].default_value;
+                if (text.empty()) continue;
+                SelectStatement default_select;
+                std::vector<std::vector<Value>> default_rows;
+                std::ostringstream ignored;
+                if (!parseSelect("SELECT " + text, default_select, error) || !selectRows(select, default_select, buffers, default_rows, ignored) || default_rows.size() != 1 || default_rows[0].size() != 1) {
+                    return fail("cannot modify " + table.name + ": the default value of " + table.columns[c].name + " is not supported");
+                }
+                defaults[c] = default_rows[0][0];
+            }
+        }
+        SelectStatement query;
+        switch (statement.kind) {
+            case ModifyStatement::Kind::Insert:
+                if (statement.select) {
+                    if (!selectRows(select, *statement.select, buffers, rows, err)) return 1;
+                    for (const std::vector<Value>& row : rows) {
+                        if (row.size() == targets.size()) continue;
+                        if (statement.columns.empty()) {
+                            return fail("table " + table.name + " has " + std::to_string(num_columns) + " columns but " + std::to_string(row.size()) + " values were supplied");
+                        }
+                        return fail(std::to_string(row.size()) + " values for " + std::to_string(targets.size()) + " columns");
+                    }
+                } else if (statement.default_values) {
+                    rows.emplace_back();
+                } else {
+                    for (std::vector<ExprPtr>& row : statement.rows) {
+                        SelectStatement values;
+                        for (ExprPtr& value : row) values.columns.push_back({std::move(value), {}});
+                        if (!selectRows(select, values, buffers, rows, err)) return 1;
+                    }
+                }
+                break;
+            case ModifyStatement::Kind::Update:
+            case ModifyStatement::Kind::Delete:
+                // SELECT rowid, <SET values> FROM table WHERE ...
+                query.columns.push_back({columnExpr(rowid_name), {}});
+                for (ExprPtr& value : statement.values) query.columns.push_back({std::move(value), {}});
+                query.table = statement.table;
+                query.where = std::move(statement.where);
+                if (!selectRows(select, query, buffers, rows, err)) return 1;
+                break;
+        }
+    }
+
+    TableWriter writer(txn, catalog, table, defaults);
+    for (const std::vector<Value>& row : rows) {
+        if (statement.kind == ModifyStatement::Kind::Insert) {
+            std::vector<Value> values = defaults;
+            Value rowid;
+            for (size_t i = 0; i < targets.size() && i < row.size(); ++i) {
+                if (targets[i] == std::string::npos) rowid = row[i];
+                else values[targets[i]] = row[i];
+            }
+            if (!writer.insert(values, rowid, error)) return fail(error);
+            continue;
+        }
+        if (row.empty() || row[0].type != Value::Type::Integer) return fail(kMalformed);
+        if (statement.kind == ModifyStatement::Kind::Delete) {
+            if (!writer.remove(row[0].integer, error)) return fail(error);
+            continue;
+        }
+        std::vector<std::pair<size_t, Value>> set;
+        Value rowid;
+        for (auto [column, i] : set_columns) {
+            if (i + 1 >= row.size()) return fail(kMalformed);
+            if (column == std::string::npos) rowid = row[i + 1];
+            else set.emplace_back(column, row[i + 1]);
+        }
+        if (sets_rowid && rowid.isNull()) return fail("datatype mismatch");
+        if (!writer.update(row[0].integer, set, rowid, error)) return fail(error);
+    }
+    if (!txn.commit(sequence, error)) return fail(error);
+    return 0;
+}
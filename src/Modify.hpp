@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+
+#include "Ast.hpp"
+#include "Catalog.hpp"
+#include "Pager.hpp"
+#include "ResultSink.hpp"
+
+// Runs a SELECT as a command would, writing its rows to out, which keeps
+// them as values (so the SELECT must not run as a parallel scan). Returns 0,
+// or 1 after writing an error to err.
+using SelectRunner = std::function<int(SelectStatement& statement, ResultSink& out, std::ostream& err)>;
+
+// Runs an INSERT, UPDATE or DELETE as one transaction. The rows to write are
+// worked out first by running SELECTs through select: the VALUES rows, the
+// SELECT of an INSERT, or the rowids and new values of the rows WHERE picks
+// out. Then each row goes through the table B-tree and the entries of every
+// index, checking NOT NULL and UNIQUE constraints as it goes; if one fails,
+// nothing the statement did is kept.
+//
+// sequence is set to the commit's number for Pager::sync, or 0 if nothing
+// was written. Returns 0, or 1 after writing an error to err.
+int runModification(Pager& pager, const Catalog& catalog, ModifyStatement& statement, const SelectRunner& select, uint64_t& sequence, std::ostream& err);
@@ -0,0 +1,387 @@
+#include "Pager.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <ostream>
+
+#include "Profiler.hpp"
+
+PageRef& PageRef::operator=(PageRef&& other) noexcept {
+    if (this != &other) {
+        release();
+        owned_ = std::move(other.owned_);
+        view_ = owned_.empty() ? other.view_ : PageView(owned_);
+        pool_ = other.pool_;
+        frame_ = other.frame_;
+        other.view_ = {};
+        other.pool_ = nullptr;
+        other.frame_ = BufferPool::kNoFrame;
+    }
+    return *this;
+}
+
+void PageRef::release() {
+    if (pool_ != nullptr && frame_ != BufferPool::kNoFrame) pool_->unpin(frame_);
+    pool_ = nullptr;
+    frame_ = BufferPool::kNoFrame;
+    view_ = {};
+    owned_.clear();
+}
+
+namespace {
+
+thread_local const ReadSnapshot* current_snapshot = nullptr;
+
+}  // namespace
+
+Pager::ReadScope::ReadScope(Pager& pager) : previous_(current_snapshot) {
+    if (previous_ != nullptr && previous_->pager == &pager) return;
+    owner_ = &pager;
+    {
+        std::lock_guard<std::shared_mutex> lock(pager.wal_mutex_);
+        uint32_t frames = pager.wal_.frameCount();
+        // Once every frame is in the database file the log is not needed
+        snapshot_ = {&pager, frames > pager.backfilled_ ? frames : 0, pager.pageCount()};
+        pager.reader_marks_.insert(snapshot_.mark);
+    }
+    current_snapshot = &snapshot_;
+}
+
+Pager::ReadScope::ReadScope(const ReadSnapshot* snapshot) : previous_(current_snapshot) {
+    current_snapshot = snapshot;
+}
+
+Pager::ReadScope::~ReadScope() {
+    if (owner_ != nullptr) {
+        std::lock_guard<std::shared_mutex> lock(owner_->wal_mutex_);
+        owner_->reader_marks_.erase(owner_->reader_marks_.find(snapshot_.mark));
+    }
+    current_snapshot = previous_;
+}
+
+const ReadSnapshot* Pager::ReadScope::current() {
+    return current_snapshot;
+}
+
+Pager::~Pager() {
+    close();
+}
+
+bool Pager::open(const std::string& path, const PagerOptions& options) {
+    close();
+    // Only the first write opens the file for writing
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) return false;
+    writable_ = ::access(path.c_str(), W_OK) == 0;
+    path_ = path;
+    struct stat st;
+    if (::fstat(fd_, &st) != 0 || st.st_size < 100) {
+        close();
+        return false;
+    }
+    unsigned char header[5];
+    if (!readFully(fd_, header, sizeof(header), 16)) {
+        close();
+        return false;
+    }
+    page_size_ = (static_cast<uint32_t>(header[0]) << 8) | header[1];
+    if (page_size_ == 1) page_size_ = 65536;
+    if (page_size_ < 512 || page_size_ - header[4] < 480) {
+        close();
+        return false;
+    }
+    file_format_ = header[2];
+    usable_size_ = page_size_ - header[4];
+    size_t file_size = static_cast<size_t>(st.st_size);
+    file_pages_ = static_cast<uint32_t>(file_size / page_size_);
+    page_count_ = file_pages_.load();
+    // A log only belongs to the database while the header says WAL mode
+    if (file_format_ == 2 && wal_.open(path + "-wal", page_size_, false) && wal_.frameCount() > 0) {
+        page_count_ = wal_.databaseSize(wal_.frameCount());
+    }
+    bool bounded = options.cache_pages != 0 || options.cache_bytes != 0;
+    if (options.use_mmap && !bounded) {
+        map_size_ = file_size + (writable_ ? kMapReserve : 0);
+        void* m = ::mmap(nullptr, map_size_, PROT_READ, MAP_SHARED, fd_, 0);
+        if (m != MAP_FAILED) map_ = static_cast<const unsigned char*>(m);
+    }
+    read_ahead_ = options.read_ahead;
+    // With the mapping the pool only holds pages read from the log
+    if (map_ == nullptr || writable_ || wal_.frameCount() > 0) {
+        size_t capacity = kDefaultCachePages;
+        if (options.cache_pages != 0) capacity = options.cache_pages;
+        else if (options.cache_bytes != 0) capacity = options.cache_bytes / page_size_;
+        pool_.reset(std::max<size_t>(capacity, 16), page_size_);
+    }
+    return true;
+}
+
+void Pager::close() {
+    stopPrefetchers();
+    // A session that never wrote leaves the log and the header to others
+    if (wal_.isOpen() && writing_) {
+        std::lock_guard<std::mutex> writer(writer_mutex_);
+        // The log goes away once everything in it is in the database file,
+        // and the header leaves WAL mode again if it was not in it before
+        if (checkpoint() && wal_.frameCount() == 0) {
+            ::unlink(wal_.path().c_str());
+            if (file_format_ != 2) {
+                unsigned char format[2] = {file_format_, file_format_};
+                if (::pwrite(fd_, format, sizeof(format), 18) == sizeof(format)) ::fsync(fd_);
+            }
+        }
+    }
+    wal_.close();
+    if (map_ != nullptr) {
+        ::munmap(const_cast<unsigned char*>(map_), map_size_);
+        map_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    pool_.reset(0, 0);
+    path_.clear();
+    writable_ = false;
+    writing_ = false;
+    map_size_ = 0;
+    page_size_ = 0;
+    usable_size_ = 0;
+    page_count_ = 0;
+    file_pages_ = 0;
+    backfilled_ = 0;
+    appended_ = 0;
+    synced_ = 0;
+    fetches_ = 0;
+    prefetch_requests_ = 0;
+    read_ahead_ = 0;
+}
+
+PageRef Pager::page(uint32_t page_number) {
+    const ReadSnapshot* snapshot = ReadScope::current();
+    if (snapshot != nullptr && snapshot->pager != this) snapshot = nullptr;
+    if (page_number == 0 || page_number > (snapshot != nullptr ? snapshot->page_count : pageCount())) return {};
+    fetches_.fetch_add(1, std::memory_order_relaxed);
+    QueryProfile* profile = profile_.load(std::memory_order_relaxed);
+    if (snapshot != nullptr && snapshot->mark == 0) return filePage(page_number, profile);
+    // Without a snapshot the lock is held over the read, so a checkpoint
+    // cannot start the log over under it
+    std::shared_lock<std::shared_mutex> lock(wal_mutex_);
+    if (!wal_.isOpen()) return filePage(page_number, profile);
+    uint32_t log_frame = wal_.findFrame(page_number, snapshot != nullptr ? snapshot->mark : wal_.frameCount());
+    if (log_frame == 0) return filePage(page_number, profile);
+    uint32_t frame = pool_.pinLogFrame(page_number, log_frame, wal_.fd(), wal_.pageOffset(log_frame));
+    if (frame != BufferPool::kNoFrame) {
+        if (profile != nullptr) profile->notePage(page_number, pool_.frameView(frame));
+        return PageRef(pool_.frameView(frame), &pool_, frame);
+    }
+    std::vector<unsigned char> buf(page_size_);
+    if (!wal_.readFrame(log_frame, buf.data())) return {};
+    if (profile != nullptr) profile->notePage(page_number, PageView(buf));
+    return PageRef(std::move(buf));
+}
+
+PageRef Pager::filePage(uint32_t page_number, QueryProfile* profile) {
+    if (map_ != nullptr && page_number <= file_pages_.load(std::memory_order_acquire) && page_number <= map_size_ / page_size_) {
+        PageView view(map_ + static_cast<size_t>(page_number - 1) * page_size_, page_size_);
+        if (profile != nullptr) profile->notePage(page_number, view);
+        return PageRef(view, nullptr, BufferPool::kNoFrame);
+    }
+    uint32_t frame = pool_.pin(page_number, fd_);
+    if (frame != BufferPool::kNoFrame) {
+        if (profile != nullptr) profile->notePage(page_number, pool_.frameView(frame));
+        return PageRef(pool_.frameView(frame), &pool_, frame);
+    }
+    // Every frame is pinned (or pages come from the mapping); hand out a
+    // private copy rather than failing.
+    std::vector<unsigned char> buf(page_size_);
+    if (!readFully(fd_, buf.data(), buf.size(), static_cast<uint64_t>(page_number - 1) * page_size_)) return {};
+    if (profile != nullptr) profile->notePage(page_number, PageView(buf));
+    return PageRef(std::move(buf));
+}
+
+void Pager::prefetch(uint32_t page_number) {
+    if (page_number == 0 || page_number > file_pages_.load(std::memory_order_acquire)) return;
+    prefetch_requests_.fetch_add(1, std::memory_order_relaxed);
+    if (map_ != nullptr) {
+        if (page_number > map_size_ / page_size_) return;
+        static const size_t os_page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        size_t begin = static_cast<size_t>(page_number - 1) * page_size_;
+        size_t aligned = begin - begin % os_page;
+        ::madvise(const_cast<unsigned char*>(map_) + aligned, begin + page_size_ - aligned, MADV_WILLNEED);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(prefetch_mutex_);
+    if (prefetch_queue_.size() >= kPrefetchQueueLimit) return;
+    if (prefetchers_.empty()) {
+        stop_prefetch_ = false;
+        for (size_t i = 0; i < kPrefetchThreads; ++i) prefetchers_.emplace_back(&Pager::prefetchLoop, this);
+    }
+    prefetch_queue_.push_back(page_number);
+    prefetch_cv_.notify_one();
+}
+
+bool Pager::prepareWrite(std::string& error) {
+    if (!writing_) {
+        if (!writable_ || !reopenForWriting()) {
+            error = "attempt to write a readonly database";
+            return false;
+        }
+        writing_ = true;
+    }
+    if (!wal_.isOpen()) {
+        std::lock_guard<std::shared_mutex> lock(wal_mutex_);
+        if (!wal_.open(path_ + "-wal", page_size_, true)) {
+            error = "unable to open the write-ahead log";
+            return false;
+        }
+        // Frames left over from before the file last left WAL mode are stale
+        if (file_format_ != 2) wal_.reset();
+    }
+    unsigned char format[2];
+    if (!readFully(fd_, format, sizeof(format), 18)) {
+        error = "disk I/O error";
+        return false;
+    }
+    if (format[0] != 2 || format[1] != 2) {
+        // Switch the header to WAL mode before the first frame, so sqlite3
+        // opening the file after a crash recovers the log
+        format[0] = format[1] = 2;
+        if (::pwrite(fd_, format, sizeof(format), 18) != sizeof(format) || ::fsync(fd_) != 0) {
+            error = "disk I/O error";
+            return false;
+        }
+        pool_.invalidate(1);
+    }
+    return true;
+}
+
+bool Pager::reopenForWriting() {
+    // Swapped in under the same number, like the log's, while reads go on
+    int fd = ::open(path_.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = ::dup3(fd, fd_, O_CLOEXEC) >= 0;
+    ::close(fd);
+    std::lock_guard<std::shared_mutex> lock(wal_mutex_);
+    return ok && (!wal_.isOpen() || wal_.reopenForWriting());
+}
+
+uint64_t Pager::commit(const std::vector<std::pair<uint32_t, const unsigned char*>>& pages, uint32_t page_count) {
+    if (!wal_.append(pages, page_count)) return 0;
+    {
+        std::lock_guard<std::shared_mutex> lock(wal_mutex_);
+        wal_.publish();
+        page_count_.store(page_count, std::memory_order_release);
+    }
+    uint64_t sequence = appended_.fetch_add(1, std::memory_order_acq_rel) + 1;
+    // A failed checkpoint leaves the frames in the log for the next one
+    if (wal_.frameCount() >= kCheckpointFrames) checkpoint();
+    return sequence;
+}
+
+bool Pager::sync(uint64_t sequence) {
+    std::unique_lock<std::mutex> lock(sync_mutex_);
+    while (synced_ < sequence) {
+        if (syncing_) {
+            sync_cv_.wait(lock);
+            continue;
+        }
+        // Lead one fsync for every commit appended so far; the commits that
+        // arrive meanwhile wait for the next
+        syncing_ = true;
+        uint64_t target = appended_.load(std::memory_order_acquire);
+        lock.unlock();
+        bool ok = wal_.sync();
+        lock.lock();
+        syncing_ = false;
+        sync_cv_.notify_all();
+        if (!ok) return false;
+        synced_ = std::max(synced_, target);
+    }
+    return true;
+}
+
+bool Pager::checkpoint() {
+    if (!wal_.isOpen()) return true;
+    // Frames must be durable before the database file depends on them
+    if (!sync()) return false;
+    uint32_t safe = wal_.frameCount();
+    {
+        std::shared_lock<std::shared_mutex> lock(wal_mutex_);
+        if (!reader_marks_.empty()) safe = std::min(safe, *reader_marks_.begin());
+    }
+    if (safe > backfilled_) {
+        std::vector<std::pair<uint32_t, uint32_t>> copies = wal_.framesToCopy(backfilled_, safe);
+        std::vector<unsigned char> buf(page_size_);
+        for (auto [page_number, frame] : copies) {
+            if (!wal_.readFrame(frame, buf.data())) return false;
+            if (::pwrite(fd_, buf.data(), page_size_, static_cast<off_t>(page_number - 1) * page_size_) != static_cast<ssize_t>(page_size_)) return false;
+        }
+        uint32_t size = wal_.databaseSize(safe);
+        if (size > file_pages_.load() && ::ftruncate(fd_, static_cast<off_t>(size) * page_size_) != 0) return false;
+        if (::fsync(fd_) != 0) return false;
+        for (auto [page_number, frame] : copies) pool_.invalidate(page_number);
+        file_pages_.store(std::max(file_pages_.load(), size), std::memory_order_release);
+        std::lock_guard<std::shared_mutex> lock(wal_mutex_);
+        backfilled_ = safe;
+    }
+    std::lock_guard<std::shared_mutex> lock(wal_mutex_);
+    // Readers still using frames keep the log as it is
+    if (backfilled_ == wal_.frameCount() && (reader_marks_.empty() || *reader_marks_.rbegin() == 0)) {
+        wal_.reset();
+        pool_.dropLogFrames();
+        backfilled_ = 0;
+    }
+    return true;
+}
+
+void Pager::prefetchLoop() {
+    while (true) {
+        uint32_t page_number;
+        {
+            std::unique_lock<std::mutex> lock(prefetch_mutex_);
+            prefetch_cv_.wait(lock, [&]() { return stop_prefetch_ || !prefetch_queue_.empty(); });
+            if (stop_prefetch_) return;
+            page_number = prefetch_queue_.front();
+            prefetch_queue_.pop_front();
+        }
+        pool_.prefetch(page_number, fd_);
+    }
+}
+
+void Pager::stopPrefetchers() {
+    {
+        std::lock_guard<std::mutex> lock(prefetch_mutex_);
+        stop_prefetch_ = true;
+        prefetch_queue_.clear();
+    }
+    prefetch_cv_.notify_all();
+    for (auto& t : prefetchers_) t.join();
+    prefetchers_.clear();
+}
+
+void Pager::printStats(std::ostream& out) const {
+    if (map_ != nullptr) {
+        out << "page cache: mmap, " << fetches_ << " page fetches" << std::endl;
+        out << "  read-ahead advice: " << prefetch_requests_ << " pages" << std::endl;
+        if (pool_.capacity() > 0) {
+            CacheStats s = pool_.stats();
+            out << "  log frame cache: " << s.hits << " hits, " << s.misses << " misses" << std::endl;
+        }
+        return;
+    }
+    CacheStats s = pool_.stats();
+    out << "page cache: " << pool_.capacity() << " frames of " << page_size_ << " bytes" << std::endl;
+    out << "  fetches: " << fetches_ << std::endl;
+    out << "  hits: " << s.hits << std::endl;
+    out << "  misses: " << s.misses << std::endl;
+    out << "  evictions: " << s.evictions << std::endl;
+    out << "  bytes read: " << s.bytes_read << std::endl;
+    out << "  read-ahead requests: " << prefetch_requests_ << std::endl;
+    out << "  read-ahead loads: " << s.prefetched << std::endl;
+    out << "  overlapped reads: " << s.prefetch_hits << std::endl;
+}
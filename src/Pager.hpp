@@ -0,0 +1,227 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iosfwd>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "BufferPool.hpp"
+#include "Wal.hpp"
+
+class Pager;
+class QueryProfile;
+
+// Handle to a page returned by Pager::page. While it is alive the page stays
+// resident: for buffer pool frames it holds a pin, for mmap pages it is just a
+// view into the mapping.
+class PageRef {
+public:
+    PageRef() = default;
+    PageRef(PageView view, BufferPool* pool, uint32_t frame) : view_(view), pool_(pool), frame_(frame) {}
+    explicit PageRef(std::vector<unsigned char>&& owned) : owned_(std::move(owned)) { view_ = PageView(owned_); }
+    PageRef(const PageRef&) = delete;
+    PageRef& operator=(const PageRef&) = delete;
+    PageRef(PageRef&& other) noexcept { *this = std::move(other); }
+    PageRef& operator=(PageRef&& other) noexcept;
+    ~PageRef() { release(); }
+
+    bool empty() const { return view_.empty(); }
+    size_t size() const { return view_.size(); }
+    const unsigned char* data() const { return view_.data(); }
+    const unsigned char& operator[](size_t i) const { return view_[i]; }
+
+    // Views must not outlive the handle, so temporaries cannot be converted.
+    operator PageView() const & { return view_; }
+    operator PageView() const && = delete;
+
+private:
+    void release();
+
+    PageView view_;
+    BufferPool* pool_ = nullptr;
+    uint32_t frame_ = BufferPool::kNoFrame;
+    std::vector<unsigned char> owned_;
+};
+
+struct PagerOptions {
+    bool use_mmap = true;
+    // Either limit switches the pager to the bounded buffer pool.
+    size_t cache_pages = 0;
+    size_t cache_bytes = 0;
+    // How many sibling pages B-tree scans ask to have read ahead; 0 disables.
+    size_t read_ahead = 8;
+};
+
+// The committed state of a database one reader sees: pages from the
+// write-ahead log up to frame mark (none if mark is 0), the rest from the
+// database file, and page_count pages.
+struct ReadSnapshot {
+    const Pager* pager = nullptr;
+    uint32_t mark = 0;
+    uint32_t page_count = 0;
+};
+
+// Access to the pages of a database file. By default the file is mapped with
+// mmap so page views point straight into the mapping; otherwise pages are read
+// with pread into a bounded buffer pool. page() is safe to call from several
+// threads.
+//
+// Writes go through a Transaction, which appends the pages it changed to the
+// write-ahead log ("<database>-wal") when it commits; they are copied back
+// into the database file by checkpoints, once no reader still needs the
+// older versions there. Readers inside a ReadScope keep seeing the database
+// as of the scope's start while transactions commit.
+class Pager {
+public:
+    static constexpr size_t kDefaultCachePages = 2000;
+    // Log frames after which a commit runs a checkpoint.
+    static constexpr uint32_t kCheckpointFrames = 1000;
+
+    // Pins the latest committed state for the reads of the calling thread
+    // until it ends, and keeps checkpoints from overwriting the pages that
+    // state reads from the database file. A scope opened inside another for
+    // the same pager reuses the outer snapshot.
+    class ReadScope {
+    public:
+        explicit ReadScope(Pager& pager);
+        // Reads on this thread use a snapshot taken on another one, e.g. by
+        // the thread that started a worker; null leaves them unscoped.
+        explicit ReadScope(const ReadSnapshot* snapshot);
+        ReadScope(const ReadScope&) = delete;
+        ReadScope& operator=(const ReadScope&) = delete;
+        ~ReadScope();
+
+        // The snapshot the calling thread reads, or nullptr.
+        static const ReadSnapshot* current();
+
+    private:
+        Pager* owner_ = nullptr;
+        ReadSnapshot snapshot_;
+        const ReadSnapshot* previous_ = nullptr;
+    };
+
+    Pager() = default;
+    Pager(const Pager&) = delete;
+    Pager& operator=(const Pager&) = delete;
+    ~Pager();
+
+    // Opens the file read-only; the first write reopens it, and the log, for
+    // writing if permissions allow. Frames committed to an existing log are
+    // read as part of the database.
+    bool open(const std::string& path, const PagerOptions& options = PagerOptions{});
+    // Checkpoints the whole log and removes it if this session wrote;
+    // otherwise the files stay as they are.
+    void close();
+
+    uint32_t pageSize() const { return page_size_; }
+    // Page size minus the per-page reserved region from header byte 20.
+    uint32_t usableSize() const { return usable_size_; }
+    // Pages in the latest committed state.
+    uint32_t pageCount() const { return page_count_.load(std::memory_order_acquire); }
+    bool isMapped() const { return map_ != nullptr; }
+    bool writable() const { return writable_; }
+
+    // Returns an empty handle if page_number is outside the database. Reads
+    // the calling thread's snapshot inside a ReadScope, and the latest
+    // committed state otherwise.
+    PageRef page(uint32_t page_number);
+
+    // Waits until the commit Transaction::commit numbered sequence is on
+    // disk. Commits waiting at the same time share one fsync of the log.
+    bool sync(uint64_t sequence);
+    // Waits for every commit so far.
+    bool sync() { return sync(appended_.load(std::memory_order_acquire)); }
+
+    // Hints that page_number will be read soon. With mmap this is an
+    // madvise(WILLNEED); with the buffer pool the page is loaded by a
+    // background reader thread. Never blocks on I/O.
+    void prefetch(uint32_t page_number);
+    size_t readAheadWindow() const { return read_ahead_; }
+
+    const BufferPool& pool() const { return pool_; }
+    uint64_t pageFetches() const { return fetches_; }
+    // While set, every page handed out is reported to the profile.
+    void setProfile(QueryProfile* profile) { profile_.store(profile, std::memory_order_relaxed); }
+    QueryProfile* profile() const { return profile_.load(std::memory_order_relaxed); }
+    void printStats(std::ostream& out) const;
+
+private:
+    friend class Transaction;
+
+    // For Transaction, which holds writer_mutex_ around these. Creates the
+    // log and switches the file to WAL mode on the first write.
+    bool prepareWrite(std::string& error);
+    // Appends one transaction's pages to the log and makes them visible to
+    // new readers; returns its sequence number for sync(), or 0.
+    uint64_t commit(const std::vector<std::pair<uint32_t, const unsigned char*>>& pages, uint32_t page_count);
+    // Copies the log frames no reader still needs into the database file,
+    // and starts the log over once all of it is copied.
+    bool checkpoint();
+
+    PageRef filePage(uint32_t page_number, QueryProfile* profile);
+    // Swaps the read-only descriptors of the file and the log for writable
+    // ones.
+    bool reopenForWriting();
+    void prefetchLoop();
+    void stopPrefetchers();
+
+    static constexpr size_t kPrefetchThreads = 2;
+    static constexpr size_t kPrefetchQueueLimit = 256;
+    // Address space mapped past the end of a writable file, so checkpoints
+    // can grow it without remapping.
+    static constexpr size_t kMapReserve = size_t{1} << 30;
+
+    int fd_ = -1;
+    std::string path_;
+    // The file permits writing, and a write has opened it for that.
+    bool writable_ = false;
+    bool writing_ = false;
+    // Header byte 18 (file format write version) as opened: 2 in WAL mode.
+    unsigned char file_format_ = 1;
+    const unsigned char* map_ = nullptr;
+    size_t map_size_ = 0;
+    uint32_t page_size_ = 0;
+    uint32_t usable_size_ = 0;
+    std::atomic<uint32_t> page_count_{0};
+    // Pages in the database file itself.
+    std::atomic<uint32_t> file_pages_{0};
+    std::atomic<uint64_t> fetches_{0};
+    std::atomic<uint64_t> prefetch_requests_{0};
+    std::atomic<QueryProfile*> profile_{nullptr};
+    size_t read_ahead_ = 0;
+    BufferPool pool_;
+
+    std::mutex prefetch_mutex_;
+    std::condition_variable prefetch_cv_;
+    std::deque<uint32_t> prefetch_queue_;
+    std::vector<std::thread> prefetchers_;
+    bool stop_prefetch_ = false;
+
+    Wal wal_;
+    // Guards the log's frame index, backfilled_ and reader_marks_ against
+    // commits and checkpoints.
+    mutable std::shared_mutex wal_mutex_;
+    // Frames already copied into the database file.
+    uint32_t backfilled_ = 0;
+    // The mark of every open ReadScope.
+    std::multiset<uint32_t> reader_marks_;
+    // Held by the open Transaction.
+    std::mutex writer_mutex_;
+
+    // Commits appended and commits known durable, by sequence number.
+    std::atomic<uint64_t> appended_{0};
+    std::mutex sync_mutex_;
+    std::condition_variable sync_cv_;
+    uint64_t synced_ = 0;
+    bool syncing_ = false;
+};
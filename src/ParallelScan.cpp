@@ -0,0 +1,147 @@
+#include "ParallelScan.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Btree.hpp"
+
+namespace {
+
+struct TaskQueue {
+    std::mutex mutex;
+    std::deque<size_t> tasks;
+};
+
+bool takeTask(std::vector<std::unique_ptr<TaskQueue>>& queues, size_t worker, size_t& task) {
+    {
+        TaskQueue& own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    for (size_t k = 1; k < queues.size(); ++k) {
+        TaskQueue& victim = *queues[(worker + k) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+void runWorkStealing(size_t num_tasks, size_t threads, const std::function<void(size_t, size_t)>& task) {
+    if (threads <= 1 || num_tasks <= 1) {
+        for (size_t i = 0; i < num_tasks; ++i) task(i, 0);
+        return;
+    }
+    threads = std::min(threads, num_tasks);
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    for (size_t w = 0; w < threads; ++w) queues.push_back(std::make_unique<TaskQueue>());
+    size_t per_worker = (num_tasks + threads - 1) / threads;
+    for (size_t i = 0; i < num_tasks; ++i) queues[i / per_worker]->tasks.push_back(i);
+    // Workers read the pages the calling thread would
+    const ReadSnapshot* snapshot = Pager::ReadScope::current();
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < threads; ++w) {
+        workers.emplace_back([&, w]() {
+            Pager::ReadScope scope(snapshot);
+            size_t t;
+            while (takeTask(queues, w, t)) task(t, w);
+        });
+    }
+    for (auto& worker : workers) worker.join();
+}
+
+std::vector<uint32_t> partitionBtree(Pager& pager, uint32_t root_page, size_t target_tasks) {
+    std::vector<uint32_t> subtrees{root_page};
+    while (subtrees.size() < target_tasks) {
+        std::vector<uint32_t> next;
+        bool expanded = false;
+        for (uint32_t page_number : subtrees) {
+            PageRef page = pager.page(page_number);
+            size_t header_off = headerOffsetFor(page_number);
+            if (page.empty() || page[header_off] != 0x05) {
+                next.push_back(page_number);
+                continue;
+            }
+            uint16_t num_cells = readBE16(page, header_off + 3);
+            for (size_t i = 0; i <= num_cells; ++i) next.push_back(interiorChildAt(page, header_off, i));
+            expanded = true;
+        }
+        subtrees.swap(next);
+        if (!expanded) break;
+    }
+    return subtrees;
+}
+
+uint64_t parallelScan(Pager& pager,
+                      uint32_t root_page,
+                      const ParallelScanOptions& options,
+                      const SubtreeScanFn& scan,
+                      ResultSink& out) {
+    std::vector<uint32_t> subtrees = partitionBtree(pager, root_page, options.threads * 4);
+    std::vector<std::string> outputs(subtrees.size());
+    std::vector<uint64_t> counts(subtrees.size(), 0);
+    std::vector<char> done(subtrees.size(), 0);
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    // Workers run in the background while this thread writes finished
+    // buffers, so output starts before the whole scan is complete.
+    const ReadSnapshot* snapshot = Pager::ReadScope::current();
+    std::thread scanner([&]() {
+        Pager::ReadScope scope(snapshot);
+        runWorkStealing(subtrees.size(), options.threads, [&](size_t task, size_t) {
+            ResultSink buffer(out.format());
+            buffer.setProfile(pager.profile());
+            uint64_t count = 0;
+            scan(subtrees[task], buffer, count);
+            std::lock_guard<std::mutex> lock(mutex);
+            outputs[task] = buffer.takeBuffer();
+            counts[task] = count;
+            done[task] = 1;
+            cv.notify_one();
+        });
+    });
+
+    std::vector<char> written(subtrees.size(), 0);
+    size_t next_ordered = 0;
+    for (size_t remaining = subtrees.size(); remaining > 0; --remaining) {
+        std::string chunk;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            size_t pick = subtrees.size();
+            cv.wait(lock, [&]() {
+                if (options.ordered) {
+                    if (done[next_ordered]) pick = next_ordered;
+                } else {
+                    for (size_t i = 0; i < done.size() && pick == subtrees.size(); ++i) {
+                        if (done[i] && !written[i]) pick = i;
+                    }
+                }
+                return pick != subtrees.size();
+            });
+            written[pick] = 1;
+            if (pick == next_ordered) ++next_ordered;
+            chunk.swap(outputs[pick]);
+        }
+        out.writeRaw(chunk);
+    }
+    scanner.join();
+
+    uint64_t total = 0;
+    for (uint64_t c : counts) total += c;
+    return total;
+}
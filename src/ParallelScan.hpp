@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "Pager.hpp"
+#include "ResultSink.hpp"
+
+// Runs task(task_index, worker_index) for every task on `threads` workers.
+// Each worker starts with a contiguous slice of the tasks and takes from the
+// front of its own queue; a worker that runs dry steals from the back of the
+// others'.
+void runWorkStealing(size_t num_tasks, size_t threads, const std::function<void(size_t, size_t)>& task);
+
+// Splits a table B-tree into subtree root pages, in key order, by expanding
+// interior pages level by level until there are at least target_tasks
+// subtrees or only leaves remain.
+std::vector<uint32_t> partitionBtree(Pager& pager, uint32_t root_page, size_t target_tasks);
+
+struct ParallelScanOptions {
+    size_t threads = 1;
+    // When false, subtree outputs are written as soon as each one finishes
+    // instead of in rowid order.
+    bool ordered = true;
+};
+
+// Scans one subtree, appending its rows to out and adding to count.
+using SubtreeScanFn = std::function<void(uint32_t page_number, ResultSink& out, uint64_t& count)>;
+
+// Scans the table B-tree under root_page with options.threads workers, each
+// subtree into its own in-memory sink, and writes the buffers to out. Returns the sum
+// of the per-subtree counts.
+uint64_t parallelScan(Pager& pager,
+                      uint32_t root_page,
+                      const ParallelScanOptions& options,
+                      const SubtreeScanFn& scan,
+                      ResultSink& out);
@@ -0,0 +1,594 @@
+#include "Parser.hpp"
+
+#include <cctype>
+#include <utility>
+#include <vector>
+
+#include "Lexer.hpp"
+
+namespace {
+
+// Words that end or join clauses, so they cannot be used as bare column
+// names or aliases.
+constexpr std::string_view kReservedWords[] = {
+    "ALL", "AND", "AS", "ASC", "BETWEEN", "BY", "CASE", "COLLATE", "DESC", "DISTINCT", "ELSE", "END", "ESCAPE",
+    "EXISTS", "FROM", "GROUP", "HAVING", "IN", "IS", "ISNULL", "JOIN", "LIKE", "LIMIT", "NOT", "NOTNULL", "NULL",
+    "OFFSET", "ON", "OR", "ORDER", "SELECT", "THEN", "UNION", "USING", "WHEN", "WHERE",
+};
+
+bool isReserved(const Token& token) {
+    for (std::string_view word : kReservedWords) {
+        if (token.isKeyword(word)) return true;
+    }
+    return false;
+}
+
+// Words of a join operator, which a FROM table name is not followed by as an
+// alias.
+constexpr std::string_view kJoinWords[] = {"CROSS", "FULL", "INNER", "LEFT", "NATURAL", "OUTER", "RIGHT"};
+
+bool isJoinWord(const Token& token) {
+    for (std::string_view word : kJoinWords) {
+        if (token.isKeyword(word)) return true;
+    }
+    return false;
+}
+
+ExprPtr makeExpr(Expr::Kind kind, Expr::Op op = Expr::Op::None) {
+    auto expr = std::make_unique<Expr>();
+    expr->kind = kind;
+    expr->op = op;
+    return expr;
+}
+
+ExprPtr makeBinary(Expr::Op op, ExprPtr lhs, ExprPtr rhs) {
+    ExprPtr expr = makeExpr(Expr::Kind::Binary, op);
+    expr->args.push_back(std::move(lhs));
+    expr->args.push_back(std::move(rhs));
+    return expr;
+}
+
+// What the error helpers return: a null expression or false, whichever the
+// parsing function returns.
+struct Failure {
+    operator ExprPtr() const { return nullptr; }
+    operator bool() const { return false; }
+};
+
+class Parser {
+public:
+    Parser(std::string_view sql, std::vector<Token> tokens) : sql_(sql), tokens_(std::move(tokens)) {}
+
+    bool parseSelect(SelectStatement& statement);
+    bool parseModification(ModifyStatement& statement);
+    const std::string& error() const { return error_; }
+
+private:
+    const Token& peek(size_t ahead = 0) const {
+        size_t i = pos_ + ahead;
+        return i < tokens_.size() ? tokens_[i] : tokens_.back();
+    }
+    const Token& advance() {
+        const Token& token = peek();
+        if (pos_ + 1 < tokens_.size()) ++pos_;
+        return token;
+    }
+    bool acceptKeyword(std::string_view keyword) {
+        if (!peek().isKeyword(keyword)) return false;
+        advance();
+        return true;
+    }
+    bool acceptOperator(std::string_view op) {
+        if (!peek().isOperator(op)) return false;
+        advance();
+        return true;
+    }
+    // Record a syntax error at the current token, or the given message, unless
+    // an earlier error was recorded.
+    Failure syntaxError() {
+        if (error_.empty()) {
+            const Token& token = peek();
+            if (token.kind == Token::Kind::End) error_ = "incomplete input";
+            else error_ = "near \"" + std::string(sql_.substr(token.offset, token.length)) + "\": syntax error";
+        }
+        return {};
+    }
+    Failure fail(std::string message) {
+        if (error_.empty()) error_ = std::move(message);
+        return {};
+    }
+    bool expectKeyword(std::string_view keyword) { return acceptKeyword(keyword) || syntaxError(); }
+    bool expectOperator(std::string_view op) { return acceptOperator(op) || syntaxError(); }
+
+    // Name of a table, column or alias at the current token, if there is one.
+    bool acceptName(std::string& name, bool allow_string = false);
+    // A FROM table and its optional alias.
+    bool parseTable(std::string& name, std::string& alias);
+
+    ExprPtr parseExpr() { return parseOr(); }
+    ExprPtr parseOr();
+    ExprPtr parseAnd();
+    ExprPtr parseNot();
+    ExprPtr parseEquality();
+    ExprPtr parseRelational();
+    ExprPtr parseAdditive();
+    ExprPtr parseMultiplicative();
+    ExprPtr parseConcat();
+    ExprPtr parseUnary();
+    ExprPtr parsePrimary();
+    ExprPtr parseColumnOrFunction();
+
+    std::string_view sql_;
+    std::vector<Token> tokens_;
+    size_t pos_ = 0;
+    std::string error_;
+};
+
+bool Parser::acceptName(std::string& name, bool allow_string) {
+    const Token& token = peek();
+    bool ok = (token.kind == Token::Kind::Identifier && !isReserved(token)) || token.kind == Token::Kind::QuotedIdentifier ||
+              (allow_string && token.kind == Token::Kind::String);
+    if (!ok) return false;
+    name = advance().text;
+    return true;
+}
+
+bool Parser::parseTable(std::string& name, std::string& alias) {
+    if (!acceptName(name)) return syntaxError();
+    if (acceptKeyword("AS")) return acceptName(alias) || syntaxError();
+    if (!isJoinWord(peek())) acceptName(alias);
+    return true;
+}
+
+ExprPtr Parser::parseOr() {
+    ExprPtr lhs = parseAnd();
+    while (lhs && acceptKeyword("OR")) {
+        ExprPtr rhs = parseAnd();
+        if (!rhs) return nullptr;
+        lhs = makeBinary(Expr::Op::Or, std::move(lhs), std::move(rhs));
+    }
+    return lhs;
+}
+
+ExprPtr Parser::parseAnd() {
+    ExprPtr lhs = parseNot();
+    while (lhs && acceptKeyword("AND")) {
+        ExprPtr rhs = parseNot();
+        if (!rhs) return nullptr;
+        lhs = makeBinary(Expr::Op::And, std::move(lhs), std::move(rhs));
+    }
+    return lhs;
+}
+
+ExprPtr Parser::parseNot() {
+    if (!acceptKeyword("NOT")) return parseEquality();
+    ExprPtr operand = parseNot();
+    if (!operand) return nullptr;
+    ExprPtr expr = makeExpr(Expr::Kind::Unary, Expr::Op::Not);
+    expr->args.push_back(std::move(operand));
+    return expr;
+}
+
+ExprPtr Parser::parseEquality() {
+    ExprPtr lhs = parseRelational();
+    while (lhs) {
+        const Token& token = peek();
+        Expr::Op op = Expr::Op::None;
+        if (token.isOperator("=") || token.isOperator("==")) op = Expr::Op::Eq;
+        else if (token.isOperator("!=") || token.isOperator("<>")) op = Expr::Op::Ne;
+        if (op != Expr::Op::None) {
+            advance();
+            ExprPtr rhs = parseRelational();
+            if (!rhs) return nullptr;
+            lhs = makeBinary(op, std::move(lhs), std::move(rhs));
+            continue;
+        }
+        if (acceptKeyword("ISNULL") || acceptKeyword("NOTNULL")) {
+            ExprPtr expr = makeExpr(Expr::Kind::IsNull);
+            expr->negated = tokens_[pos_ - 1].isKeyword("NOTNULL");
+            expr->args.push_back(std::move(lhs));
+            lhs = std::move(expr);
+            continue;
+        }
+        if (acceptKeyword("IS")) {
+            bool negated = acceptKeyword("NOT");
+            if (acceptKeyword("NULL")) {
+                ExprPtr expr = makeExpr(Expr::Kind::IsNull);
+                expr->negated = negated;
+                expr->args.push_back(std::move(lhs));
+                lhs = std::move(expr);
+                continue;
+            }
+            ExprPtr rhs = parseRelational();
+            if (!rhs) return nullptr;
+            lhs = makeBinary(negated ? Expr::Op::IsNot : Expr::Op::Is, std::move(lhs), std::move(rhs));
+            continue;
+        }
+        bool negated = false;
+        if (token.isKeyword("NOT")) {
+            const Token& next = peek(1);
+            if (!next.isKeyword("IN") && !next.isKeyword("LIKE") && !next.isKeyword("BETWEEN") && !next.isKeyword("NULL")) break;
+            advance();
+            negated = true;
+            if (acceptKeyword("NULL")) {
+                ExprPtr expr = makeExpr(Expr::Kind::IsNull);
+                expr->negated = true;
+                expr->args.push_back(std::move(lhs));
+                lhs = std::move(expr);
+                continue;
+            }
+        }
+        if (acceptKeyword("IN")) {
+            ExprPtr expr = makeExpr(Expr::Kind::In);
+            expr->negated = negated;
+            expr->args.push_back(std::move(lhs));
+            if (!expectOperator("(")) return nullptr;
+            if (peek().isKeyword("SELECT")) return fail("subqueries are not supported");
+            if (!peek().isOperator(")")) {
+                do {
+                    ExprPtr item = parseExpr();
+                    if (!item) return nullptr;
+                    expr->args.push_back(std::move(item));
+                } while (acceptOperator(","));
+            }
+            if (!expectOperator(")")) return nullptr;
+            lhs = std::move(expr);
+        } else if (acceptKeyword("LIKE")) {
+            ExprPtr expr = makeExpr(Expr::Kind::Like);
+            expr->negated = negated;
+            expr->args.push_back(std::move(lhs));
+            ExprPtr pattern = parseRelational();
+            if (!pattern) return nullptr;
+            expr->args.push_back(std::move(pattern));
+            if (acceptKeyword("ESCAPE")) {
+                ExprPtr escape = parseRelational();
+                if (!escape) return nullptr;
+                expr->args.push_back(std::move(escape));
+            }
+            lhs = std::move(expr);
+        } else if (acceptKeyword("BETWEEN")) {
+            ExprPtr expr = makeExpr(Expr::Kind::Between);
+            expr->negated = negated;
+            expr->args.push_back(std::move(lhs));
+            ExprPtr lower = parseRelational();
+            if (!lower || !expectKeyword("AND")) return nullptr;
+            ExprPtr upper = parseRelational();
+            if (!upper) return nullptr;
+            expr->args.push_back(std::move(lower));
+            expr->args.push_back(std::move(upper));
+            lhs = std::move(expr);
+        } else if (negated) {
+            return syntaxError();
+        } else {
+            break;
+        }
+    }
+    return lhs;
+}
+
+ExprPtr Parser::parseRelational() {
+    ExprPtr lhs = parseAdditive();
+    while (lhs) {
+        const Token& token = peek();
+        Expr::Op op = token.isOperator("<")    ? Expr::Op::Lt
+                      : token.isOperator("<=") ? Expr::Op::Le
+                      : token.isOperator(">")  ? Expr::Op::Gt
+                      : token.isOperator(">=") ? Expr::Op::Ge
+                                               : Expr::Op::None;
+        if (op == Expr::Op::None) break;
+        advance();
+        ExprPtr rhs = parseAdditive();
+        if (!rhs) return nullptr;
+        lhs = makeBinary(op, std::move(lhs), std::move(rhs));
+    }
+    return lhs;
+}
+
+ExprPtr Parser::parseAdditive() {
+    ExprPtr lhs = parseMultiplicative();
+    while (lhs) {
+        Expr::Op op = peek().isOperator("+") ? Expr::Op::Add : peek().isOperator("-") ? Expr::Op::Subtract : Expr::Op::None;
+        if (op == Expr::Op::None) break;
+        advance();
+        ExprPtr rhs = parseMultiplicative();
+        if (!rhs) return nullptr;
+        lhs = makeBinary(op, std::move(lhs), std::move(rhs));
+    }
+    return lhs;
+}
+
+ExprPtr Parser::parseMultiplicative() {
+    ExprPtr lhs = parseConcat();
+    while (lhs) {
+        const Token& token = peek();
+        Expr::Op op = token.isOperator("*")   ? Expr::Op::Multiply
+                      : token.isOperator("/") ? Expr::Op::Divide
+                      : token.isOperator("%") ? Expr::Op::Remainder
+                                              : Expr::Op::None;
+        if (op == Expr::Op::None) break;
+        advance();
+        ExprPtr rhs = parseConcat();
+        if (!rhs) return nullptr;
+        lhs = makeBinary(op, std::move(lhs), std::move(rhs));
+    }
+    return lhs;
+}
+
+ExprPtr Parser::parseConcat() {
+    ExprPtr lhs = parseUnary();
+    while (lhs && acceptOperator("||")) {
+        ExprPtr rhs = parseUnary();
+        if (!rhs) return nullptr;
+        lhs = makeBinary(Expr::Op::Concat, std::move(lhs), std::move(rhs));
+    }
+    return lhs;
+}
+
+ExprPtr Parser::parseUnary() {
+    bool minus = peek().isOperator("-");
+    if (!minus && !peek().isOperator("+")) return parsePrimary();
+    advance();
+    ExprPtr operand = parseUnary();
+    if (!operand) return nullptr;
+    // Fold signs into numeric literals so `x > -5` still compares a column
+    // with a constant.
+    if (operand->isLiteral() && operand->literal.isNumeric()) {
+        if (!minus) return operand;
+        const std::string& text = operand->literal.text;
+        operand->literal = parseLiteral(text[0] == '-' ? text.substr(1) : "-" + text, false);
+        return operand;
+    }
+    ExprPtr expr = makeExpr(Expr::Kind::Unary, minus ? Expr::Op::Negate : Expr::Op::Plus);
+    expr->args.push_back(std::move(operand));
+    return expr;
+}
+
+ExprPtr Parser::parsePrimary() {
+    const Token& token = peek();
+    switch (token.kind) {
+        case Token::Kind::Number:
+        case Token::Kind::String: {
+            ExprPtr expr = makeExpr(Expr::Kind::Literal);
+            expr->literal = parseLiteral(token.text, token.kind == Token::Kind::String);
+            advance();
+            return expr;
+        }
+        case Token::Kind::Identifier:
+            if (token.isKeyword("NULL")) {
+                advance();
+                return makeExpr(Expr::Kind::Literal);
+            }
+            if (isReserved(token)) return syntaxError();
+            return parseColumnOrFunction();
+        case Token::Kind::QuotedIdentifier:
+            return parseColumnOrFunction();
+        case Token::Kind::Operator:
+            if (token.isOperator("(")) {
+                advance();
+                if (peek().isKeyword("SELECT")) return fail("subqueries are not supported");
+                ExprPtr expr = parseExpr();
+                if (!expr || !expectOperator(")")) return nullptr;
+                return expr;
+            }
+            return syntaxError();
+        case Token::Kind::End:
+            return syntaxError();
+    }
+    return syntaxError();
+}
+
+ExprPtr Parser::parseColumnOrFunction() {
+    const Token& first = advance();
+    if (first.kind == Token::Kind::Identifier && acceptOperator("(")) {
+        ExprPtr expr = makeExpr(Expr::Kind::Function);
+        for (char c : first.text) expr->name.push_back(static_cast<char>(std::toupper(static_cast<unsigned char>(c))));
+        if (peek().isKeyword("DISTINCT")) return fail("DISTINCT is not supported");
+        if (acceptOperator("*")) {
+            expr->star = true;
+        } else if (!peek().isOperator(")")) {
+            do {
+                ExprPtr arg = parseExpr();
+                if (!arg) return nullptr;
+                expr->args.push_back(std::move(arg));
+            } while (acceptOperator(","));
+        }
+        if (!expectOperator(")")) return nullptr;
+        return expr;
+    }
+    ExprPtr expr = makeExpr(Expr::Kind::Column);
+    expr->name = first.text;
+    expr->double_quoted = first.quote == '"';
+    if (acceptOperator(".")) {
+        expr->table = std::move(expr->name);
+        expr->double_quoted = false;
+        if (!acceptName(expr->name)) return syntaxError();
+    }
+    return expr;
+}
+
+bool Parser::parseSelect(SelectStatement& statement) {
+    if (acceptKeyword("EXPLAIN")) {
+        if (!acceptKeyword("QUERY")) return fail("only EXPLAIN QUERY PLAN is supported");
+        if (!expectKeyword("PLAN")) return false;
+        statement.explain = true;
+    }
+    if (!expectKeyword("SELECT")) return false;
+    if (peek().isKeyword("DISTINCT")) return fail("DISTINCT is not supported");
+    acceptKeyword("ALL");
+    do {
+        ResultColumn column;
+        if (!acceptOperator("*")) {
+            column.expr = parseExpr();
+            if (!column.expr) return false;
+            if (acceptKeyword("AS") && !acceptName(column.alias, true)) return syntaxError();
+            if (column.alias.empty()) acceptName(column.alias, true);
+        }
+        statement.columns.push_back(std::move(column));
+    } while (acceptOperator(","));
+
+    ExprPtr on;
+    if (acceptKeyword("FROM")) {
+        if (!parseTable(statement.table, statement.table_alias)) return false;
+        if (acceptOperator(",")) {
+            if (!parseTable(statement.join_table, statement.join_alias)) return false;
+        } else if (peek().isKeyword("JOIN") || isJoinWord(peek())) {
+            if (peek().isKeyword("NATURAL")) return fail("NATURAL joins are not supported");
+            if (!acceptKeyword("INNER") && !acceptKeyword("CROSS") && !peek().isKeyword("JOIN")) return fail("only inner joins are supported");
+            if (!expectKeyword("JOIN") || !parseTable(statement.join_table, statement.join_alias)) return false;
+            if (acceptKeyword("ON")) {
+                on = parseExpr();
+                if (!on) return false;
+            } else if (peek().isKeyword("USING")) {
+                return fail("JOIN ... USING is not supported");
+            }
+        }
+        if (peek().isOperator(",") || peek().isKeyword("JOIN") || isJoinWord(peek())) return fail("joins of more than two tables are not supported");
+    }
+    if (acceptKeyword("WHERE")) {
+        statement.where = parseExpr();
+        if (!statement.where) return false;
+    }
+    // An inner join's ON condition filters like WHERE, and goes first
+    if (on) statement.where = statement.where ? makeBinary(Expr::Op::And, std::move(on), std::move(statement.where)) : std::move(on);
+    if (acceptKeyword("GROUP")) {
+        if (!expectKeyword("BY")) return false;
+        do {
+            ExprPtr term = parseExpr();
+            if (!term) return false;
+            statement.group_by.push_back(std::move(term));
+        } while (acceptOperator(","));
+    }
+    if (acceptKeyword("HAVING")) {
+        statement.having = parseExpr();
+        if (!statement.having) return false;
+    }
+    if (acceptKeyword("ORDER")) {
+        if (!expectKeyword("BY")) return false;
+        do {
+            OrderingTerm term;
+            term.expr = parseExpr();
+            if (!term.expr) return false;
+            if (acceptKeyword("DESC")) term.descending = true;
+            else acceptKeyword("ASC");
+            statement.order_by.push_back(std::move(term));
+        } while (acceptOperator(","));
+    }
+    if (acceptKeyword("LIMIT")) {
+        statement.limit = parseExpr();
+        if (!statement.limit) return false;
+        if (acceptKeyword("OFFSET")) {
+            statement.offset = parseExpr();
+            if (!statement.offset) return false;
+        } else if (acceptOperator(",")) {
+            // LIMIT offset, count
+            statement.offset = std::move(statement.limit);
+            statement.limit = parseExpr();
+            if (!statement.limit) return false;
+        }
+    }
+    acceptOperator(";");
+    if (peek().kind != Token::Kind::End) return syntaxError();
+    return true;
+}
+
+bool Parser::parseModification(ModifyStatement& statement) {
+    if (acceptKeyword("INSERT")) {
+        statement.kind = ModifyStatement::Kind::Insert;
+        if (peek().isKeyword("OR")) return fail("INSERT OR ... is not supported");
+        if (!expectKeyword("INTO") || !acceptName(statement.table)) return syntaxError();
+        if (acceptOperator("(")) {
+            do {
+                std::string column;
+                if (!acceptName(column)) return syntaxError();
+                statement.columns.push_back(std::move(column));
+            } while (acceptOperator(","));
+            if (!expectOperator(")")) return false;
+        }
+        if (peek().isKeyword("SELECT")) {
+            statement.select = std::make_unique<SelectStatement>();
+            return parseSelect(*statement.select);
+        }
+        if (acceptKeyword("DEFAULT")) {
+            if (!statement.columns.empty()) return syntaxError();
+            if (!expectKeyword("VALUES")) return false;
+            statement.default_values = true;
+        } else {
+            if (!expectKeyword("VALUES")) return false;
+            do {
+                if (!expectOperator("(")) return false;
+                std::vector<ExprPtr> row;
+                do {
+                    ExprPtr value = parseExpr();
+                    if (!value) return false;
+                    row.push_back(std::move(value));
+                } while (acceptOperator(","));
+                if (!expectOperator(")")) return false;
+                // Every row has as many values as the first
+                if (!statement.rows.empty() && row.size() != statement.rows.front().size()) return fail("all VALUES must have the same number of terms");
+                statement.rows.push_back(std::move(row));
+            } while (acceptOperator(","));
+        }
+        if (peek().isKeyword("ON") || peek().isKeyword("RETURNING")) return fail("upsert and RETURNING are not supported");
+    } else if (acceptKeyword("UPDATE")) {
+        statement.kind = ModifyStatement::Kind::Update;
+        if (peek().isKeyword("OR")) return fail("UPDATE OR ... is not supported");
+        if (!acceptName(statement.table)) return syntaxError();
+        if (!expectKeyword("SET")) return false;
+        do {
+            std::string column;
+            if (!acceptName(column)) return syntaxError();
+            if (!expectOperator("=")) return false;
+            ExprPtr value = parseExpr();
+            if (!value) return false;
+            statement.columns.push_back(std::move(column));
+            statement.values.push_back(std::move(value));
+        } while (acceptOperator(","));
+        if (peek().isKeyword("FROM")) return fail("UPDATE ... FROM is not supported");
+        if (acceptKeyword("WHERE")) {
+            statement.where = parseExpr();
+            if (!statement.where) return false;
+        }
+    } else if (acceptKeyword("DELETE")) {
+        statement.kind = ModifyStatement::Kind::Delete;
+        if (!expectKeyword("FROM") || !acceptName(statement.table)) return syntaxError();
+        if (acceptKeyword("WHERE")) {
+            statement.where = parseExpr();
+            if (!statement.where) return false;
+        }
+    } else {
+        return syntaxError();
+    }
+    if (peek().isKeyword("RETURNING")) return fail("RETURNING is not supported");
+    acceptOperator(";");
+    if (peek().kind != Token::Kind::End) return syntaxError();
+    return true;
+}
+
+}  // namespace
+
+bool parseSelect(std::string_view sql, SelectStatement& statement, std::string& error) {
+    std::vector<Token> tokens;
+    if (!tokenize(sql, tokens, error)) return false;
+    Parser parser(sql, std::move(tokens));
+    statement = SelectStatement{};
+    if (parser.parseSelect(statement)) return true;
+    error = parser.error();
+    return false;
+}
+
+bool isModification(std::string_view sql) {
+    std::vector<Token> tokens;
+    std::string error;
+    if (!tokenize(sql, tokens, error) || tokens.empty()) return false;
+    return tokens.front().isKeyword("INSERT") || tokens.front().isKeyword("UPDATE") || tokens.front().isKeyword("DELETE");
+}
+
+bool parseModification(std::string_view sql, ModifyStatement& statement, std::string& error) {
+    std::vector<Token> tokens;
+    if (!tokenize(sql, tokens, error)) return false;
+    Parser parser(sql, std::move(tokens));
+    statement = ModifyStatement{};
+    if (parser.parseModification(statement)) return true;
+    error = parser.error();
+    return false;
+}
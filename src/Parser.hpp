@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "Ast.hpp"
+
+// Parses one SELECT statement; a trailing ';' is allowed. On failure returns
+// false and sets error to a message worded like sqlite3's, e.g.
+// `near "FROM": syntax error`.
+//
+//   [EXPLAIN QUERY PLAN]
+//   SELECT [ALL] (* | expr [[AS] alias]), ...
+//     [FROM table [[AS] alias]]
+//     [WHERE expr]
+//     [ORDER BY expr [ASC | DESC], ...]
+//     [LIMIT expr [OFFSET expr | , expr]]
+//
+// Expressions cover literals, [table.]column, function calls, unary - + NOT,
+// || * / % + -, comparisons, IS [NOT], [NOT] IN (list), [NOT] LIKE with
+// ESCAPE, [NOT] BETWEEN, ISNULL/NOTNULL/IS NULL, AND and OR, with SQLite's
+// precedence.
+bool parseSelect(std::string_view sql, SelectStatement& statement, std::string& error);
+
+// Whether sql starts like an INSERT, UPDATE or DELETE statement.
+bool isModification(std::string_view sql);
+
+// Parses one INSERT, UPDATE or DELETE statement, with errors as parseSelect
+// reports them.
+//
+//   INSERT INTO table [(column, ...)]
+//     (VALUES (expr, ...), ... | SELECT ... | DEFAULT VALUES)
+//   UPDATE table SET column = expr, ... [WHERE expr]
+//   DELETE FROM table [WHERE expr]
+bool parseModification(std::string_view sql, ModifyStatement& statement, std::string& error);
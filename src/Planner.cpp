@@ -0,0 +1,593 @@
+#include "Planner.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#include "Btree.hpp"
+#include "Expression.hpp"
+
+namespace {
+
+// Cost of filtering or projecting one row, relative to reading one page.
+constexpr double kRowCost = 0.01;
+// Cost of comparing two normalized sort keys.
+constexpr double kCompareCost = 0.001;
+// Rows an equality on an un-analyzed, non-unique index is assumed to match,
+// and the fraction of rows each bound of a range is assumed to keep; the
+// guesses SQLite makes without sqlite_stat1.
+constexpr double kDefaultRowsPerKey = 10;
+constexpr double kRangeBoundSelectivity = 0.25;
+
+// A WHERE conjunct that bounds one column by constants.
+struct RangeTerm {
+    const Expr* expr = nullptr;
+    // Table column, or Expr::kRowid.
+    size_t column = 0;
+    ColumnRange range;
+};
+
+void collectConjuncts(const Expr* expr, std::vector<const Expr*>& terms) {
+    if (expr == nullptr) return;
+    if (expr->kind == Expr::Kind::Binary && expr->op == Expr::Op::And) {
+        collectConjuncts(expr->args[0].get(), terms);
+        collectConjuncts(expr->args[1].get(), terms);
+        return;
+    }
+    terms.push_back(expr);
+}
+
+// Recognises `col op literal` (op one of = == < <= > >=, either side) and
+// `col BETWEEN literal AND literal`. Comparisons with NULL match nothing and
+// are left to the residual filter, as are columns with a collation other
+// than BINARY, whose bounds compare folded text.
+bool rangeTermFor(const Expr& expr, RangeTerm& term) {
+    term.expr = &expr;
+    term.range = ColumnRange{};
+    ColumnRange& range = term.range;
+    if (expr.kind == Expr::Kind::Between) {
+        const Expr& col = *expr.args[0];
+        const Expr& lower = *expr.args[1];
+        const Expr& upper = *expr.args[2];
+        if (expr.negated || !col.isColumn() || col.collation != Collation::Binary || !lower.isLiteral() || !upper.isLiteral()) return false;
+        if (lower.literal.kind == Literal::Kind::Null || upper.literal.kind == Literal::Kind::Null) return false;
+        term.column = col.column;
+        range.has_lower = range.has_upper = true;
+        range.lower = lower.literal;
+        range.upper = upper.literal;
+        return true;
+    }
+    if (expr.kind != Expr::Kind::Binary) return false;
+    const Expr* col = expr.args[0].get();
+    const Expr* lit = expr.args[1].get();
+    Expr::Op op = expr.op;
+    if (col->isLiteral() && lit->isColumn()) {
+        std::swap(col, lit);
+        // 5 < x is x > 5
+        if (op == Expr::Op::Lt) op = Expr::Op::Gt;
+        else if (op == Expr::Op::Le) op = Expr::Op::Ge;
+        else if (op == Expr::Op::Gt) op = Expr::Op::Lt;
+        else if (op == Expr::Op::Ge) op = Expr::Op::Le;
+    }
+    if (!col->isColumn() || col->collation != Collation::Binary || !lit->isLiteral() || lit->literal.kind == Literal::Kind::Null) return false;
+    term.column = col->column;
+    switch (op) {
+        case Expr::Op::Eq:
+            range.has_lower = range.has_upper = true;
+            range.lower = range.upper = lit->literal;
+            return true;
+        case Expr::Op::Lt:
+        case Expr::Op::Le:
+            range.has_upper = true;
+            range.upper_inclusive = op == Expr::Op::Le;
+            range.upper = lit->literal;
+            return true;
+        case Expr::Op::Gt:
+        case Expr::Op::Ge:
+            range.has_lower = true;
+            range.lower_inclusive = op == Expr::Op::Ge;
+            range.lower = lit->literal;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Marks the table columns expr reads; the rowid is in every record.
+void collectColumns(const Expr* expr, std::vector<bool>& used) {
+    if (expr == nullptr) return;
+    if (expr->isColumn() && expr->column < used.size()) used[expr->column] = true;
+    for (const ExprPtr& arg : expr->args) collectColumns(arg.get(), used);
+}
+
+// Recognises `col LIKE 'pattern'` without ESCAPE.
+bool likeFilterFor(const Expr& expr, ColumnFilter& filter) {
+    if (expr.kind != Expr::Kind::Like || expr.negated || expr.args.size() != 2) return false;
+    const Expr& col = *expr.args[0];
+    const Expr& pattern = *expr.args[1];
+    if (!col.isColumn() || col.column == Expr::kRowid || !pattern.isLiteral() || pattern.literal.kind != Literal::Kind::Text) return false;
+    filter.column = col.column;
+    filter.is_like = true;
+    filter.like = LikePattern::parse(pattern.literal.text);
+    filter.real_affinity = col.real_affinity;
+    return true;
+}
+
+double rangeSelectivity(const ColumnRange& range) {
+    double s = 1;
+    if (range.has_lower) s *= kRangeBoundSelectivity;
+    if (range.has_upper) s *= kRangeBoundSelectivity;
+    return s;
+}
+
+// Entries per leaf page, at least 1.
+double entriesPerLeaf(const TreeEstimate& tree) {
+    return tree.leaf_pages > 0 ? std::max(1.0, tree.entries / tree.leaf_pages) : 1.0;
+}
+
+// Rows a full scan keeps after its LeafBatch filters, each assumed to keep
+// what one range bound does.
+double filteredRows(double rows, const std::vector<ColumnFilter>& filters) {
+    for (const ColumnFilter& filter : filters) rows *= filter.is_like ? kRangeBoundSelectivity : rangeSelectivity(filter.range);
+    return rows;
+}
+
+// The path yields rows in ORDER BY order: a table B-tree in rowid order, an
+// index in the order of its columns after those fixed by equality, then of
+// the rowid. Only ascending BINARY terms qualify, as no path runs backwards
+// or folds text, and groups come out in an order of their own. An index that is not readable()
+// (DESC, another collation, partial) gives no order to rely on.
+bool providesOrder(const AccessPath& path, const BoundSelect& query) {
+    if (query.aggregated()) return false;
+    if (path.isIndex() && !path.index->readable()) return false;
+    size_t position = path.key.equal.size();
+    for (const SortKey& key : query.order_by) {
+        if (key.descending || !key.expr->isColumn() || key.expr->collation != Collation::Binary) return false;
+        size_t column = key.expr->column;
+        if (path.isIndex() && position < path.index->columns.size()) {
+            if (column != path.index->columns[position]) return false;
+            ++position;
+            continue;
+        }
+        // Rowids are unique, so later terms never decide anything
+        return column == Expr::kRowid;
+    }
+    return true;
+}
+
+// The indexes of table that seeks and scans can read; see
+// IndexInfo::readable().
+std::vector<const IndexInfo*> readableIndexes(const Catalog& catalog, const TableInfo& table) {
+    std::vector<const IndexInfo*> indexes;
+    for (size_t index_pos : table.indexes) {
+        const IndexInfo& index = catalog.indexes()[index_pos];
+        if (index.readable()) indexes.push_back(&index);
+    }
+    return indexes;
+}
+
+// Encoding every row, then about log2 of the rows kept comparisons each: all
+// of them, or with a LIMIT the heap of the first `wanted` (-1 for no limit).
+double sortCost(double rows, double wanted) {
+    double kept = wanted >= 0 ? std::min(rows, wanted) : rows;
+    return rows * (kRowCost + std::log2(std::max(kept, 2.0)) * kCompareCost);
+}
+
+// Bit s is set if expr reads a column of FROM table s.
+unsigned sourcesOf(const Expr* expr) {
+    unsigned sources = expr->isColumn() ? 1u << expr->source : 0u;
+    for (const ExprPtr& arg : expr->args) sources |= sourcesOf(arg.get());
+    return sources;
+}
+
+// Fraction of rows a conjunct on one table is assumed to keep.
+double conjunctSelectivity(const Expr& conjunct) {
+    RangeTerm term;
+    return rangeTermFor(conjunct, term) ? rangeSelectivity(term.range) : kRangeBoundSelectivity;
+}
+
+// A join input checking conjuncts, all on its table, of a table with `rows`
+// rows; only a scanned input hands them to LeafBatch.
+JoinPlan::Input joinInput(const std::vector<const Expr*>& conjuncts, double rows, bool scanned) {
+    JoinPlan::Input input;
+    input.estimated_rows = rows;
+    for (const Expr* conjunct : conjuncts) {
+        RangeTerm term;
+        ColumnFilter filter;
+        // One rowid matches at most one row
+        if (rangeTermFor(*conjunct, term) && term.column == Expr::kRowid && term.range.isEquality()) input.estimated_rows = std::min(input.estimated_rows, 1.0);
+        else input.estimated_rows *= conjunctSelectivity(*conjunct);
+        if (scanned && rangeTermFor(*conjunct, term) && term.column != Expr::kRowid) {
+            filter.column = term.column;
+            filter.range = term.range;
+            input.filters.push_back(std::move(filter));
+        } else if (scanned && likeFilterFor(*conjunct, filter)) {
+            input.filters.push_back(std::move(filter));
+        } else {
+            input.conditions.push_back(conjunct);
+        }
+    }
+    return input;
+}
+
+}  // namespace
+
+std::string AccessPath::describe(const TableInfo& table) const {
+    std::string description;
+    switch (kind) {
+        case Kind::FullScan:
+            description = "full scan of " + table.name;
+            break;
+        case Kind::RowidSeek:
+            description = "rowid seek on " + table.name;
+            break;
+        case Kind::RowidRange:
+            description = "rowid range seek on " + table.name;
+            break;
+        case Kind::IndexScan:
+            description = std::string(covering ? "covering " : "") + "index scan of " + index->name;
+            break;
+        case Kind::IndexEquality:
+        case Kind::IndexRange: {
+            std::string terms;
+            for (size_t i = 0; i < key.equal.size(); ++i) {
+                if (!terms.empty()) terms += ", ";
+                terms += table.columns[index->columns[i]].name + "=?";
+            }
+            if (key.hasRange()) {
+                const std::string& name = table.columns[index->columns[key.equal.size()]].name;
+                if (!terms.empty()) terms += ", ";
+                if (key.last.has_lower) terms += name + (key.last.lower_inclusive ? ">=?" : ">?");
+                if (key.last.has_lower && key.last.has_upper) terms += " AND ";
+                if (key.last.has_upper) terms += name + (key.last.upper_inclusive ? "<=?" : "<?");
+            }
+            description = std::string(covering ? "covering " : "") + (kind == Kind::IndexEquality ? "index equality search" : "index range search") +
+                          " on " + index->name + " (" + terms + ")";
+            break;
+        }
+    }
+    return needs_sort ? description + ", then sort" : description;
+}
+
+AccessPath planAccess(Pager& pager, const Catalog& catalog, const BoundSelect& query, std::vector<AccessPath>* considered) {
+    const TableInfo& table = *query.table;
+    TreeEstimate table_tree = estimateTree(pager, table.root_page);
+    double table_rows = table.stat_rows > 0 ? static_cast<double>(table.stat_rows) : table_tree.entries;
+    double rows_per_leaf = entriesPerLeaf(table_tree);
+
+    std::vector<const Expr*> conjuncts;
+    collectConjuncts(query.where, conjuncts);
+    std::vector<RangeTerm> terms;
+    for (const Expr* conjunct : conjuncts) {
+        RangeTerm term;
+        if (rangeTermFor(*conjunct, term)) terms.push_back(term);
+    }
+    auto residualAfter = [&](size_t consumed) { return consumed == conjuncts.size() ? nullptr : query.where; };
+    // Every path but a plain COUNT(*) reads the rows it finds
+    auto rowsNeeded = [&](const AccessPath& path) { return !query.is_count || path.residual != nullptr; };
+    std::vector<bool> read_columns(table.columns.size(), false);
+    for (const Expr* output : query.outputs) collectColumns(output, read_columns);
+    collectColumns(query.where, read_columns);
+    for (const Expr* key : query.group_by) collectColumns(key, read_columns);
+    collectColumns(query.having, read_columns);
+    for (const SortKey& key : query.order_by) collectColumns(key.expr, read_columns);
+    auto covers = [&](const IndexInfo& index) {
+        for (size_t c = 0; c < read_columns.size(); ++c) {
+            if (read_columns[c] && std::find(index.columns.begin(), index.columns.end(), c) == index.columns.end()) return false;
+        }
+        return true;
+    };
+
+    std::vector<AccessPath> candidates;
+
+    // All rowid terms intersect into one range
+    size_t rowid_terms = 0;
+    AccessPath rowid_path;
+    rowid_path.min_rowid = std::numeric_limits<int64_t>::min();
+    rowid_path.max_rowid = std::numeric_limits<int64_t>::max();
+    for (const RangeTerm& term : terms) {
+        if (term.column != Expr::kRowid) continue;
+        ++rowid_terms;
+        int64_t lo = 0, hi = 0;
+        if (!term.range.rowidBounds(lo, hi)) {
+            rowid_path.min_rowid = 1;
+            rowid_path.max_rowid = 0;
+            continue;
+        }
+        rowid_path.min_rowid = std::max(rowid_path.min_rowid, lo);
+        rowid_path.max_rowid = std::min(rowid_path.max_rowid, hi);
+    }
+    if (rowid_terms > 0) {
+        AccessPath& path = rowid_path;
+        path.kind = path.min_rowid == path.max_rowid ? AccessPath::Kind::RowidSeek : AccessPath::Kind::RowidRange;
+        path.residual = residualAfter(rowid_terms);
+        if (path.min_rowid > path.max_rowid) {
+            path.estimated_rows = 0;
+        } else if (path.min_rowid == path.max_rowid) {
+            path.estimated_rows = 1;
+        } else {
+            // Rowids are usually dense from 1, so the width of the range
+            // within [1, row count] is a fair guess
+            double lo = std::max<double>(static_cast<double>(path.min_rowid), 1);
+            double hi = std::min<double>(static_cast<double>(path.max_rowid), table_rows);
+            path.estimated_rows = std::clamp(hi - lo + 1, 1.0, std::max(table_rows, 1.0));
+        }
+        path.cost = static_cast<double>(table_tree.depth) + path.estimated_rows / rows_per_leaf;
+        if (rowsNeeded(path)) path.cost += path.estimated_rows * kRowCost;
+        candidates.push_back(std::move(path));
+    }
+
+    for (const IndexInfo* readable : readableIndexes(catalog, table)) {
+        const IndexInfo& index = *readable;
+        AccessPath path;
+        path.index = &index;
+        std::vector<bool> used(terms.size(), false);
+        size_t consumed = 0;
+        for (size_t column : index.columns) {
+            size_t eq = terms.size();
+            for (size_t t = 0; t < terms.size() && eq == terms.size(); ++t) {
+                if (!used[t] && terms[t].column == column && terms[t].range.isEquality()) eq = t;
+            }
+            if (eq != terms.size()) {
+                used[eq] = true;
+                ++consumed;
+                path.key.equal.push_back(terms[eq].range.lower);
+                continue;
+            }
+            // One lower and one upper bound, possibly from different terms
+            ColumnRange& last = path.key.last;
+            for (size_t t = 0; t < terms.size(); ++t) {
+                const ColumnRange& range = terms[t].range;
+                if (used[t] || terms[t].column != column) continue;
+                if ((range.has_lower && last.has_lower) || (range.has_upper && last.has_upper)) continue;
+                if (range.has_lower) {
+                    last.has_lower = true;
+                    last.lower_inclusive = range.lower_inclusive;
+                    last.lower = range.lower;
+                }
+                if (range.has_upper) {
+                    last.has_upper = true;
+                    last.upper_inclusive = range.upper_inclusive;
+                    last.upper = range.upper;
+                }
+                used[t] = true;
+                ++consumed;
+            }
+            break;
+        }
+        TreeEstimate index_tree = estimateTree(pager, index.root_page);
+        bool covering = covers(index);
+        // Index entries are smaller than table rows, so reading them all can
+        // beat a full scan; but a plain COUNT(*) counts table leaf cells
+        // without decoding them, which no index scan beats
+        if (covering && !(query.is_count && query.where == nullptr)) {
+            AccessPath index_scan;
+            index_scan.kind = AccessPath::Kind::IndexScan;
+            index_scan.index = &index;
+            index_scan.covering = true;
+            index_scan.residual = query.where;
+            index_scan.estimated_rows = table_rows;
+            index_scan.cost = static_cast<double>(index_tree.depth) + index_tree.leaf_pages;
+            if (rowsNeeded(index_scan)) index_scan.cost += table_rows * kRowCost;
+            candidates.push_back(std::move(index_scan));
+        } else if (!covering && query.sorted()) {
+            // Without covering, reading a whole index only pays when its order
+            // saves the sort, above all under a LIMIT
+            AccessPath index_scan;
+            index_scan.kind = AccessPath::Kind::IndexScan;
+            index_scan.index = &index;
+            index_scan.residual = query.where;
+            index_scan.estimated_rows = table_rows;
+            if (providesOrder(index_scan, query)) {
+                // Lookups in index order land on table leaves at random
+                index_scan.cost = static_cast<double>(index_tree.depth) + index_tree.leaf_pages +
+                                  table_rows * (static_cast<double>(table_tree.depth) * kRowCost + 2 * kRowCost);
+                candidates.push_back(std::move(index_scan));
+            }
+        }
+        if (path.key.equal.empty() && !path.key.hasRange()) continue;
+        path.covering = covering;
+        path.kind = path.key.hasRange() ? AccessPath::Kind::IndexRange : AccessPath::Kind::IndexEquality;
+        path.residual = residualAfter(consumed);
+
+        size_t k = path.key.equal.size();
+        double rows = table_rows;
+        if (k > 0) {
+            if (k < index.stat.size()) rows = static_cast<double>(index.stat[k]);
+            else if (index.unique && k == index.columns.size()) rows = 1;
+            else rows = std::min(table_rows, kDefaultRowsPerKey / static_cast<double>(k));
+        }
+        path.estimated_rows = std::max(1.0, rows * rangeSelectivity(path.key.last));
+
+        path.cost = static_cast<double>(index_tree.depth) + path.estimated_rows / entriesPerLeaf(index_tree);
+        if (covering) {
+            if (rowsNeeded(path)) path.cost += path.estimated_rows * kRowCost;
+        } else if (rowsNeeded(path)) {
+            // Lookups in index order revisit table leaves, but from the cache
+            // after the first read
+            path.cost += static_cast<double>(table_tree.depth) + std::min(path.estimated_rows, table_tree.leaf_pages) + 2 * path.estimated_rows * kRowCost;
+        }
+        candidates.push_back(std::move(path));
+    }
+
+    AccessPath scan;
+    size_t filtered = 0;
+    for (const RangeTerm& term : terms) {
+        if (term.column == Expr::kRowid) continue;
+        ColumnFilter filter;
+        filter.column = term.column;
+        filter.range = term.range;
+        scan.filters.push_back(std::move(filter));
+        ++filtered;
+    }
+    for (const Expr* conjunct : conjuncts) {
+        ColumnFilter filter;
+        if (!likeFilterFor(*conjunct, filter)) continue;
+        scan.filters.push_back(std::move(filter));
+        ++filtered;
+    }
+    scan.residual = residualAfter(filtered);
+    scan.estimated_rows = filteredRows(table_rows, scan.filters);
+    scan.cost = static_cast<double>(table_tree.depth) + table_tree.leaf_pages;
+    if (rowsNeeded(scan)) scan.cost += table_rows * kRowCost;
+    candidates.push_back(std::move(scan));
+
+    if (query.sorted()) {
+        // In order, only the first OFFSET + LIMIT rows need be read
+        double wanted = query.limit >= 0 ? static_cast<double>(query.offset) + static_cast<double>(query.limit) : -1;
+        for (AccessPath& path : candidates) {
+            if (!providesOrder(path, query)) {
+                path.needs_sort = true;
+                path.cost += sortCost(path.estimated_rows, wanted);
+            } else if (wanted >= 0 && path.residual == nullptr && path.estimated_rows > wanted) {
+                path.cost = std::max(1.0, path.cost * wanted / path.estimated_rows);
+            }
+        }
+    }
+
+    size_t best = 0;
+    for (size_t i = 1; i < candidates.size(); ++i) {
+        if (candidates[i].cost < candidates[best].cost) best = i;
+    }
+    AccessPath chosen = candidates[best];
+    if (considered != nullptr) *considered = std::move(candidates);
+    return chosen;
+}
+
+std::string JoinPlan::describe(const BoundSelect& query) const {
+    const std::string& inner_name = (inner == 0 ? query.table : query.join_table)->name;
+    const std::string& outer_name = (inner == 0 ? query.join_table : query.table)->name;
+    std::string description;
+    if (kind == Kind::Hash) description = "hash join of " + outer_name + " with " + inner_name + " hashed";
+    else description = "index nested loop join of " + outer_name + " with " + inner_name + (index != nullptr ? " by index " + index->name : " by rowid");
+    return query.sorted() ? description + ", then sort" : description;
+}
+
+JoinPlan planJoin(Pager& pager, const Catalog& catalog, const BoundSelect& query, size_t memory_budget, std::vector<JoinPlan>* considered) {
+    const TableInfo* tables[2] = {query.table, query.join_table};
+    TreeEstimate trees[2];
+    double rows[2] = {0, 0};
+    for (size_t s = 0; s < 2; ++s) {
+        if (tables[s]->root_page != 0) trees[s] = estimateTree(pager, tables[s]->root_page);
+        rows[s] = tables[s]->stat_rows > 0 ? static_cast<double>(tables[s]->stat_rows) : trees[s].entries;
+    }
+    auto scanCost = [&](size_t s) { return static_cast<double>(trees[s].depth) + trees[s].leaf_pages + rows[s] * kRowCost; };
+
+    // Conjuncts on one table filter its input; BINARY equalities between a
+    // column of each are keys; anything else is checked on joined rows
+    std::vector<const Expr*> conjuncts;
+    collectConjuncts(query.where, conjuncts);
+    std::vector<const Expr*> local[2];
+    std::vector<const Expr*> keys[2];
+    std::vector<Affinity> key_affinities;
+    bool cross_terms = false;
+    for (const Expr* conjunct : conjuncts) {
+        unsigned sources = sourcesOf(conjunct);
+        if (sources == 1 || sources == 2) {
+            local[sources - 1].push_back(conjunct);
+            continue;
+        }
+        if (sources == 3 && conjunct->kind == Expr::Kind::Binary && conjunct->op == Expr::Op::Eq && conjunct->args[0]->isColumn() &&
+            conjunct->args[1]->isColumn() && comparisonCollation(*conjunct->args[0], *conjunct->args[1]) == Collation::Binary) {
+            const Expr* a = conjunct->args[0].get();
+            const Expr* b = conjunct->args[1].get();
+            if (a->source != 0) std::swap(a, b);
+            keys[0].push_back(a);
+            keys[1].push_back(b);
+            key_affinities.push_back(comparisonAffinity(*a, *b));
+            continue;
+        }
+        cross_terms = true;
+    }
+    // Without ORDER BY or aggregates, LIMIT stops the join once enough rows
+    // are out
+    double wanted = query.limit >= 0 && !query.sorted() && !query.aggregated() && !query.is_count ? static_cast<double>(query.offset) + static_cast<double>(query.limit) : -1;
+
+    std::vector<JoinPlan> candidates;
+    for (size_t inner = 0; inner < 2; ++inner) {
+        size_t outer = 1 - inner;
+        JoinPlan plan;
+        plan.kind = JoinPlan::Kind::Hash;
+        plan.inner = inner;
+        for (size_t s = 0; s < 2; ++s) {
+            plan.inputs[s] = joinInput(local[s], rows[s], true);
+            plan.inputs[s].keys = keys[s];
+            plan.inputs[s].key_affinities = key_affinities;
+        }
+        plan.residual = cross_terms ? query.where : nullptr;
+        double built = plan.inputs[inner].estimated_rows;
+        double probes = plan.inputs[outer].estimated_rows;
+        // Assume each row matches a row of the larger input, as along a
+        // foreign key
+        plan.estimated_rows = keys[0].empty() ? built * probes : std::max(built, probes);
+        double probe_cost = scanCost(outer) + probes * kRowCost + plan.estimated_rows * kRowCost;
+        if (wanted >= 0 && plan.residual == nullptr && plan.estimated_rows > wanted) probe_cost *= wanted / plan.estimated_rows;
+        plan.cost = scanCost(inner) + 2 * built * kRowCost + probe_cost;
+        // The hash table is about as large as the pages its rows came from;
+        // past the budget both inputs go out to partitions and back
+        double built_pages = rows[inner] > 0 ? trees[inner].leaf_pages * built / rows[inner] : 0;
+        if (built_pages * pager.pageSize() > static_cast<double>(memory_budget)) {
+            double probe_pages = rows[outer] > 0 ? trees[outer].leaf_pages * probes / rows[outer] : 0;
+            plan.cost += 2 * (built_pages + probe_pages);
+        }
+        candidates.push_back(std::move(plan));
+    }
+
+    for (size_t inner = 0; inner < 2; ++inner) {
+        size_t outer = 1 - inner;
+        for (size_t k = 0; k < keys[inner].size(); ++k) {
+            size_t column = keys[inner][k]->column;
+            std::vector<const IndexInfo*> seeks;
+            if (column == Expr::kRowid) seeks.push_back(nullptr);
+            // A numeric comparison matches numeric-looking text too, which
+            // an index on a column that keeps it as text orders elsewhere
+            bool index_usable = key_affinities[k] == Affinity::Blob || isNumericAffinity(keys[inner][k]->affinity);
+            for (const IndexInfo* index : readableIndexes(catalog, *tables[inner])) {
+                if (index_usable && index->columns[0] == column) seeks.push_back(index);
+            }
+            for (const IndexInfo* index : seeks) {
+                JoinPlan plan;
+                plan.kind = JoinPlan::Kind::IndexNestedLoop;
+                plan.inner = inner;
+                plan.index = index;
+                plan.inputs[outer] = joinInput(local[outer], rows[outer], true);
+                plan.inputs[inner] = joinInput(local[inner], rows[inner], false);
+                // The key sought goes first
+                for (size_t s = 0; s < 2; ++s) {
+                    plan.inputs[s].keys = keys[s];
+                    std::rotate(plan.inputs[s].keys.begin(), plan.inputs[s].keys.begin() + static_cast<std::ptrdiff_t>(k), plan.inputs[s].keys.begin() + static_cast<std::ptrdiff_t>(k) + 1);
+                    plan.inputs[s].key_affinities = key_affinities;
+                    std::rotate(plan.inputs[s].key_affinities.begin(), plan.inputs[s].key_affinities.begin() + static_cast<std::ptrdiff_t>(k),
+                                plan.inputs[s].key_affinities.begin() + static_cast<std::ptrdiff_t>(k) + 1);
+                }
+                plan.residual = cross_terms || keys[0].size() > 1 ? query.where : nullptr;
+                double probes = plan.inputs[outer].estimated_rows;
+                double lookups = probes;
+                double probe_cost = probes * kRowCost;
+                if (index != nullptr) {
+                    TreeEstimate index_tree = estimateTree(pager, index->root_page);
+                    double per_key = index->stat.size() > 1 ? static_cast<double>(index->stat[1])
+                                     : index->unique && index->columns.size() == 1 ? 1
+                                                                                    : kDefaultRowsPerKey;
+                    // Index pages are read once, then come from the cache
+                    probe_cost += probes * static_cast<double>(index_tree.depth) * kRowCost + std::min(probes, index_tree.leaf_pages);
+                    lookups = probes * per_key;
+                }
+                probe_cost += lookups * (static_cast<double>(trees[inner].depth) * kRowCost + 2 * kRowCost) + std::min(lookups, trees[inner].leaf_pages);
+                plan.estimated_rows = rows[inner] > 0 ? lookups * plan.inputs[inner].estimated_rows / rows[inner] : 0;
+                plan.cost = scanCost(outer) + probe_cost + plan.estimated_rows * kRowCost;
+                if (wanted >= 0 && plan.residual == nullptr && plan.estimated_rows > wanted) plan.cost = std::max(1.0, plan.cost * wanted / plan.estimated_rows);
+                candidates.push_back(std::move(plan));
+            }
+        }
+    }
+
+    size_t best = 0;
+    for (size_t i = 1; i < candidates.size(); ++i) {
+        if (candidates[i].cost < candidates[best].cost) best = i;
+    }
+    JoinPlan chosen = candidates[best];
+    if (considered != nullptr) *considered = std::move(candidates);
+    return chosen;
+}
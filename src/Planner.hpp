@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Catalog.hpp"
+#include "LeafBatch.hpp"
+#include "Pager.hpp"
+#include "Predicate.hpp"
+#include "Query.hpp"
+
+// How rows of the FROM table are found.
+struct AccessPath {
+    enum class Kind {
+        FullScan,
+        // One rowid, or a rowid range, from WHERE terms on the rowid or its
+        // INTEGER PRIMARY KEY alias.
+        RowidSeek,
+        RowidRange,
+        // Equality on some leading index columns (a prefix if not all of
+        // them), then table lookups by rowid.
+        IndexEquality,
+        // As IndexEquality, with a range on the next index column.
+        IndexRange,
+        // Every entry of an index, in index order: a covering index, or one
+        // whose order serves ORDER BY.
+        IndexScan,
+    };
+
+    Kind kind = Kind::FullScan;
+    const IndexInfo* index = nullptr;
+    // RowidSeek/RowidRange: inclusive bounds; min_rowid > max_rowid if no
+    // rowid can match.
+    int64_t min_rowid = 0;
+    int64_t max_rowid = 0;
+    // IndexEquality/IndexRange; empty for IndexScan.
+    KeyRange key;
+    // The index holds every column the query reads, so rows come straight
+    // from index entries without table lookups.
+    bool covering = false;
+    // The rows do not come out in ORDER BY order, so they must be sorted.
+    bool needs_sort = false;
+    // FullScan: WHERE terms checked a leaf page at a time by LeafBatch,
+    // before rows are decoded.
+    std::vector<ColumnFilter> filters;
+    // Part of the WHERE clause each row must still be checked against;
+    // nullptr if the path only yields matching rows.
+    const Expr* residual = nullptr;
+    double estimated_rows = 0;
+    // In page reads; row-at-a-time work counts as a fraction of a page.
+    double cost = 0;
+
+    bool isRowid() const { return kind == Kind::RowidSeek || kind == Kind::RowidRange; }
+    bool isIndex() const { return kind == Kind::IndexEquality || kind == Kind::IndexRange || kind == Kind::IndexScan; }
+    // E.g. "index range search on idx_ts (country=?, ts>?)" or
+    // "covering index scan of idx_country, then sort".
+    std::string describe(const TableInfo& table) const;
+};
+
+// Enumerates the rowid, index, covering index and full scan paths the WHERE clause allows,
+// estimates each one's cost from B-tree sizes (sampled from one root-to-leaf
+// path) and sqlite_stat1 statistics when present, and returns the cheapest.
+// Paths that yield rows in ORDER BY order save the sort and, under a LIMIT,
+// stop early; the others pay for sorting what they find.
+// considered, if given, receives every candidate in the order tried.
+AccessPath planAccess(Pager& pager, const Catalog& catalog, const BoundSelect& query, std::vector<AccessPath>* considered = nullptr);
+
+// How the two tables of a join are matched up. WHERE equalities (ON folds
+// into WHERE) between a column of each table are the join keys.
+struct JoinPlan {
+    enum class Kind {
+        // Load the rows of one table into a hash table on their keys, then
+        // look up each row of the other. Without keys every row of one
+        // table pairs with every row of the other.
+        Hash,
+        // Scan the outer table and, for each row, seek the inner one by
+        // rowid or through an index on its key column.
+        IndexNestedLoop,
+    };
+
+    // What the join reads of one FROM table.
+    struct Input {
+        // Conjuncts on this table alone, checked as its rows are read: a
+        // scanned table leaves what it can to LeafBatch, a sought one checks
+        // them all row by row.
+        std::vector<ColumnFilter> filters;
+        std::vector<const Expr*> conditions;
+        // Key columns, pairwise equal to those of the other input.
+        std::vector<const Expr*> keys;
+        // The affinity each key pair compares under, the same on both
+        // inputs; key values are converted to it as they are read.
+        std::vector<Affinity> key_affinities;
+        // Rows that pass the conjuncts.
+        double estimated_rows = 0;
+    };
+
+    Kind kind = Kind::Hash;
+    // By FROM table: 0, then 1.
+    Input inputs[2];
+    // Hash: the table hashed, the smaller one. IndexNestedLoop: the table
+    // sought, by its first key only.
+    size_t inner = 1;
+    // IndexNestedLoop: an index whose first column is the inner key, or
+    // nullptr to seek the rowid.
+    const IndexInfo* index = nullptr;
+    // Part of the WHERE clause joined rows must still be checked against, or
+    // nullptr.
+    const Expr* residual = nullptr;
+    double estimated_rows = 0;
+    // In page reads, as AccessPath::cost.
+    double cost = 0;
+
+    // E.g. "hash join of orders with customers hashed" or "index nested loop
+    // join of orders with customers by rowid, then sort".
+    std::string describe(const BoundSelect& query) const;
+};
+
+// Enumerates hash joins building on either table and index nested loop joins
+// seeking either table by rowid or an index on a key column, costs them from
+// B-tree sizes as planAccess does, and returns the cheapest. A hash table
+// larger than memory_budget pays for writing and reading back partitions.
+JoinPlan planJoin(Pager& pager, const Catalog& catalog, const BoundSelect& query, size_t memory_budget, std::vector<JoinPlan>* considered = nullptr);
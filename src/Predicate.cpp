@@ -0,0 +1,115 @@
+#include "Predicate.hpp"
+
+#include <cctype>
+#include <cmath>
+#include <limits>
+
+Literal parseLiteral(const std::string& token, bool quoted) {
+    Literal lit;
+    lit.text = token;
+    lit.number = numericValue(token);
+    if (!quoted) {
+        if (lit.number.type == Value::Type::Integer) {
+            lit.kind = Literal::Kind::Integer;
+            return lit;
+        }
+        if (lit.number.type == Value::Type::Real) {
+            lit.kind = Literal::Kind::Real;
+            return lit;
+        }
+        std::string upper = token;
+        for (char& c : upper) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        if (upper == "NULL") return Literal{};
+    }
+    lit.kind = Literal::Kind::Text;
+    return lit;
+}
+
+Literal applyAffinity(const Literal& lit, Affinity affinity) {
+    if (lit.kind == Literal::Kind::Null) return lit;
+    std::string scratch;
+    Value value = applyAffinity(lit.value(), affinity, scratch);
+    Literal converted;
+    switch (value.type) {
+        case Value::Type::Integer:
+        case Value::Type::Real:
+            if (lit.isNumeric() && value.type == lit.number.type) return lit;
+            converted.kind = value.type == Value::Type::Integer ? Literal::Kind::Integer : Literal::Kind::Real;
+            converted.number = value;
+            appendValue(converted.text, value);
+            return converted;
+        case Value::Type::Text:
+            if (lit.kind == Literal::Kind::Text) return lit;
+            // The number's canonical text, "1.5" for 1.50
+            converted.kind = Literal::Kind::Text;
+            converted.text.assign(reinterpret_cast<const char*>(value.data), value.size);
+            converted.number = numericValue(converted.text);
+            return converted;
+        default:
+            return lit;
+    }
+}
+
+bool ColumnRange::matches(const Value& value) const {
+    if (value.isNull()) return false;
+    if (has_lower && (lower.kind == Literal::Kind::Null || !aboveLower(compareValueToLiteral(value, lower)))) return false;
+    if (has_upper && (upper.kind == Literal::Kind::Null || !belowUpper(compareValueToLiteral(value, upper)))) return false;
+    return true;
+}
+
+bool ColumnRange::rowidBounds(int64_t& min_rowid, int64_t& max_rowid) const {
+    constexpr int64_t kMin = std::numeric_limits<int64_t>::min();
+    constexpr int64_t kMax = std::numeric_limits<int64_t>::max();
+    min_rowid = kMin;
+    max_rowid = kMax;
+    if (has_lower) {
+        const Value& num = lower.number;
+        if (lower.kind == Literal::Kind::Null || num.isNull()) return false;
+        if (num.type == Value::Type::Integer) {
+            if (!lower_inclusive && num.integer == kMax) return false;
+            min_rowid = lower_inclusive ? num.integer : num.integer + 1;
+        } else {
+            double b = lower_inclusive ? std::ceil(num.real) : std::floor(num.real) + 1;
+            if (b > 9.2e18) return false;
+            if (b > -9.2e18) min_rowid = static_cast<int64_t>(b);
+        }
+    }
+    if (has_upper) {
+        if (upper.kind == Literal::Kind::Null) return false;
+        // A text bound that is not a number sorts after every integer.
+        const Value& num = upper.number;
+        if (num.type == Value::Type::Integer) {
+            if (!upper_inclusive && num.integer == kMin) return false;
+            max_rowid = upper_inclusive ? num.integer : num.integer - 1;
+        } else if (num.type == Value::Type::Real) {
+            double b = upper_inclusive ? std::floor(num.real) : std::ceil(num.real) - 1;
+            if (b < -9.2e18) return false;
+            if (b < 9.2e18) max_rowid = static_cast<int64_t>(b);
+        }
+    }
+    return min_rowid <= max_rowid;
+}
+
+bool KeyRange::aboveLower(Record& record) const {
+    for (size_t i = 0; i < equal.size(); ++i) {
+        int c = compareColumnToLiteral(record, i, equal[i]);
+        if (c != 0) return c > 0;
+    }
+    return !last.has_lower || last.aboveLower(compareColumnToLiteral(record, equal.size(), last.lower));
+}
+
+bool KeyRange::belowUpper(Record& record) const {
+    for (size_t i = 0; i < equal.size(); ++i) {
+        int c = compareColumnToLiteral(record, i, equal[i]);
+        if (c != 0) return c < 0;
+    }
+    return !last.has_upper || last.belowUpper(compareColumnToLiteral(record, equal.size(), last.upper));
+}
+
+bool KeyRange::matches(Record& record) const {
+    for (size_t i = 0; i < equal.size(); ++i) {
+        // NULL equals nothing, and compares below every literal
+        if (equal[i].kind == Literal::Kind::Null || compareColumnToLiteral(record, i, equal[i]) != 0) return false;
+    }
+    return !hasRange() || last.matchesColumn(record, equal.size());
+}
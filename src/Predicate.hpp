@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Catalog.hpp"
+#include "Record.hpp"
+#include "Value.hpp"
+
+// A constant from a WHERE clause. Bare tokens that parse as numbers become
+// Integer or Real; quoted strings stay Text but keep their numeric form if
+// they look like a number. A literal compared with a column takes the
+// column's affinity when the query is bound, so comparisons use value() as
+// it is.
+struct Literal {
+    enum class Kind { Null, Integer, Real, Text };
+
+    Kind kind = Kind::Null;
+    std::string text;
+    // Integer/Real interpretation of the literal, NULL if it has none.
+    Value number;
+
+    bool isNumeric() const { return kind == Kind::Integer || kind == Kind::Real; }
+    Value textValue() const { return Value::makeText(reinterpret_cast<const unsigned char*>(text.data()), text.size()); }
+    Value value() const {
+        if (kind == Kind::Text) return textValue();
+        return number;
+    }
+};
+
+Literal parseLiteral(const std::string& token, bool quoted);
+// The literal a comparison with a column of this affinity uses: numbers
+// become their text for TEXT, text that reads as a number becomes one for
+// INTEGER, REAL and NUMERIC, and BLOB (or no declared type) keeps it as is.
+Literal applyAffinity(const Literal& lit, Affinity affinity);
+
+// Three-way comparison of a stored value against a literal following SQLite's
+// ordering: NULL < numbers < text < blob. The literal must already have the
+// column's affinity; nothing is converted here.
+inline int compareValueToLiteral(const Value& value, const Literal& lit) { return compareValues(value, lit.value()); }
+inline int compareColumnToLiteral(Record& record, size_t col_idx, const Literal& lit) {
+    return compareValueToLiteral(col_idx < record.columnCount() ? record.value(col_idx) : Value{}, lit);
+}
+
+// Conjunction of an optional lower and an optional upper bound on one column;
+// `col = v` is the range [v, v].
+struct ColumnRange {
+    bool has_lower = false;
+    bool lower_inclusive = true;
+    Literal lower;
+    bool has_upper = false;
+    bool upper_inclusive = true;
+    Literal upper;
+
+    bool isEquality() const {
+        return has_lower && has_upper && lower_inclusive && upper_inclusive && lower.text == upper.text && lower.kind == upper.kind;
+    }
+    // cmp_lower / cmp_upper are the value compared against each bound.
+    bool aboveLower(int cmp_lower) const { return !has_lower || cmp_lower > 0 || (lower_inclusive && cmp_lower == 0); }
+    bool belowUpper(int cmp_upper) const { return !has_upper || cmp_upper < 0 || (upper_inclusive && cmp_upper == 0); }
+
+    // NULL never satisfies a comparison.
+    bool matches(const Value& value) const;
+    bool matchesColumn(Record& record, size_t col_idx) const {
+        return col_idx < record.columnCount() && matches(record.value(col_idx));
+    }
+    bool matchesInteger(int64_t value) const { return matches(Value::makeInteger(value)); }
+
+    // Inclusive rowid bounds for a range on an INTEGER PRIMARY KEY column.
+    // Returns false if no integer can satisfy the range.
+    bool rowidBounds(int64_t& min_rowid, int64_t& max_rowid) const;
+};
+
+// Bounds on the leading columns of an index key: equality on the first
+// equal.size() columns, then optionally a range on the next one. Keys are
+// compared column by column, so the matching entries are contiguous.
+struct KeyRange {
+    std::vector<Literal> equal;
+    ColumnRange last;
+
+    bool hasRange() const { return last.has_lower || last.has_upper; }
+    // The key of an index record does not sort before every match.
+    bool aboveLower(Record& record) const;
+    // The key does not sort after every match.
+    bool belowUpper(Record& record) const;
+    bool matches(Record& record) const;
+};
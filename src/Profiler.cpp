@@ -0,0 +1,170 @@
+#include "Profiler.hpp"
+
+#include <cstdio>
+#include <ostream>
+
+#include "Btree.hpp"
+#include "Pager.hpp"
+
+namespace {
+
+// The B-tree and page role the current thread is reading on behalf of.
+thread_local uint32_t current_tree = 0;
+thread_local bool reading_overflow = false;
+
+const char* const kPhaseNames[] = {"parse", "schema", "index_probe", "row_fetch", "output"};
+const char* const kPageKindNames[] = {"table_interior", "table_leaf", "index_interior", "index_leaf", "overflow", "other"};
+
+std::string formatMs(std::chrono::nanoseconds ns) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.3f", static_cast<double>(ns.count()) / 1e6);
+    return buf;
+}
+
+void writeJsonString(std::ostream& out, const std::string& s) {
+    out << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out << buf;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+}  // namespace
+
+QueryProfile::PhaseTimer::PhaseTimer(QueryProfile* profile, Phase phase) : profile_(profile), phase_(phase) {
+    if (profile_ != nullptr) start_ = std::chrono::steady_clock::now();
+}
+
+QueryProfile::PhaseTimer::~PhaseTimer() { stop(); }
+
+void QueryProfile::PhaseTimer::stop() {
+    if (profile_ != nullptr) profile_->addPhaseTime(phase_, std::chrono::steady_clock::now() - start_);
+    profile_ = nullptr;
+}
+
+QueryProfile::TreeScope::TreeScope(uint32_t root) : saved_(current_tree) { current_tree = root; }
+QueryProfile::TreeScope::~TreeScope() { current_tree = saved_; }
+
+QueryProfile::OverflowScope::OverflowScope() : saved_(reading_overflow) { reading_overflow = true; }
+QueryProfile::OverflowScope::~OverflowScope() { reading_overflow = saved_; }
+
+void QueryProfile::begin(const Pager& pager) {
+    start_ = std::chrono::steady_clock::now();
+    mapped_ = pager.isMapped();
+    fetches_ = pager.pageFetches();
+    cache_ = pager.pool().stats();
+}
+
+void QueryProfile::finish(const Pager& pager) {
+    total_ = std::chrono::steady_clock::now() - start_;
+    fetches_ = pager.pageFetches() - fetches_;
+    CacheStats now = pager.pool().stats();
+    cache_.hits = now.hits - cache_.hits;
+    cache_.misses = now.misses - cache_.misses;
+    cache_.evictions = now.evictions - cache_.evictions;
+    cache_.bytes_read = now.bytes_read - cache_.bytes_read;
+    cache_.prefetched = now.prefetched - cache_.prefetched;
+    cache_.prefetch_hits = now.prefetch_hits - cache_.prefetch_hits;
+}
+
+void QueryProfile::setAccessPath(std::string path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!access_path_.empty()) access_path_ += ", then ";
+    access_path_ += path;
+}
+
+void QueryProfile::nameTree(uint32_t root, std::string name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tree_names_[root] = std::move(name);
+}
+
+void QueryProfile::notePage(uint32_t page_number, PageView page) {
+    PageKind kind = PageKind::Other;
+    if (reading_overflow) {
+        kind = PageKind::Overflow;
+    } else {
+        size_t header_off = headerOffsetFor(page_number);
+        if (header_off < page.size()) {
+            switch (page[header_off]) {
+                case 0x05: kind = PageKind::TableInterior; break;
+                case 0x0D: kind = PageKind::TableLeaf; break;
+                case 0x02: kind = PageKind::IndexInterior; break;
+                case 0x0A: kind = PageKind::IndexLeaf; break;
+                default: break;
+            }
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++pages_[current_tree][static_cast<size_t>(kind)];
+}
+
+void QueryProfile::addPhaseTime(Phase phase, std::chrono::nanoseconds elapsed) {
+    phase_ns_[static_cast<size_t>(phase)].fetch_add(elapsed.count(), std::memory_order_relaxed);
+}
+
+void QueryProfile::printTable(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    out << "access path: " << (access_path_.empty() ? "none" : access_path_) << std::endl;
+    out << "phase          ms" << std::endl;
+    for (size_t i = 0; i < static_cast<size_t>(Phase::kCount); ++i) {
+        char line[64];
+        std::snprintf(line, sizeof(line), "  %-12s %s", kPhaseNames[i], formatMs(std::chrono::nanoseconds(phase_ns_[i].load())).c_str());
+        out << line << (i == static_cast<size_t>(Phase::Output) ? " (part of row_fetch)" : "") << std::endl;
+    }
+    out << "  total        " << formatMs(total_) << std::endl;
+    out << "pages read by b-tree (root page):" << std::endl;
+    for (const auto& [root, counts] : pages_) {
+        auto name = tree_names_.find(root);
+        std::string label = root == 0 ? std::string("(unattributed)") : (name != tree_names_.end() ? name->second : std::string("?")) + " (" + std::to_string(root) + ")";
+        out << "  " << label << ":";
+        for (size_t k = 0; k < counts.size(); ++k) {
+            if (counts[k] != 0) out << ' ' << kPageKindNames[k] << '=' << counts[k];
+        }
+        out << std::endl;
+    }
+    if (mapped_) {
+        out << "page cache: mmap, " << fetches_ << " page fetches" << std::endl;
+    } else {
+        out << "page cache: " << fetches_ << " fetches, " << cache_.hits << " hits, " << cache_.misses << " misses, "
+            << cache_.evictions << " evictions, " << cache_.bytes_read << " bytes read" << std::endl;
+    }
+    out << "rows examined: " << rows_examined_ << std::endl;
+    out << "index entries examined: " << index_entries_examined_ << std::endl;
+    out << "rows emitted: " << rows_emitted_ << std::endl;
+    out << "bytes decoded: " << bytes_decoded_ << std::endl;
+}
+
+void QueryProfile::printJson(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    out << "{\"access_path\":";
+    writeJsonString(out, access_path_);
+    out << ",\"phases_ms\":{";
+    for (size_t i = 0; i < static_cast<size_t>(Phase::kCount); ++i) {
+        out << '"' << kPhaseNames[i] << "\":" << formatMs(std::chrono::nanoseconds(phase_ns_[i].load())) << ',';
+    }
+    out << "\"total\":" << formatMs(total_) << "},\"pages\":[";
+    bool first = true;
+    for (const auto& [root, counts] : pages_) {
+        if (!first) out << ',';
+        first = false;
+        auto name = tree_names_.find(root);
+        out << "{\"root\":" << root << ",\"name\":";
+        writeJsonString(out, name != tree_names_.end() ? name->second : std::string());
+        for (size_t k = 0; k < counts.size(); ++k) out << ",\"" << kPageKindNames[k] << "\":" << counts[k];
+        out << '}';
+    }
+    out << "],\"cache\":{\"mode\":\"" << (mapped_ ? "mmap" : "pool") << "\",\"fetches\":" << fetches_;
+    if (!mapped_) {
+        out << ",\"hits\":" << cache_.hits << ",\"misses\":" << cache_.misses << ",\"evictions\":" << cache_.evictions
+            << ",\"bytes_read\":" << cache_.bytes_read;
+    }
+    out << "},\"rows_examined\":" << rows_examined_ << ",\"index_entries_examined\":" << index_entries_examined_
+        << ",\"rows_emitted\":" << rows_emitted_ << ",\"bytes_decoded\":" << bytes_decoded_ << '}' << std::endl;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "BufferPool.hpp"
+
+class Pager;
+
+// Execution statistics for one query, collected when profiling is switched
+// on (--profile). The pager reports every page it hands out; query code
+// reports the access path, row counts and phase timings. Counters may be
+// bumped from several scan threads at once.
+class QueryProfile {
+public:
+    // Output is the time spent writing rows, which happens inside RowFetch.
+    enum class Phase { Parse, Schema, IndexProbe, RowFetch, Output, kCount };
+    enum class PageKind { TableInterior, TableLeaf, IndexInterior, IndexLeaf, Overflow, Other, kCount };
+
+    // Measures the time until it goes out of scope; a no-op without a profile.
+    class PhaseTimer {
+    public:
+        PhaseTimer(QueryProfile* profile, Phase phase);
+        ~PhaseTimer();
+        PhaseTimer(const PhaseTimer&) = delete;
+        PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+        // Records the elapsed time now instead of at scope exit.
+        void stop();
+
+    private:
+        QueryProfile* profile_;
+        Phase phase_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    // Attributes the pages this thread reads to the B-tree rooted at root
+    // until it goes out of scope.
+    class TreeScope {
+    public:
+        explicit TreeScope(uint32_t root);
+        ~TreeScope();
+        TreeScope(const TreeScope&) = delete;
+        TreeScope& operator=(const TreeScope&) = delete;
+
+    private:
+        uint32_t saved_;
+    };
+
+    // Marks the pages this thread reads as overflow pages while in scope.
+    class OverflowScope {
+    public:
+        OverflowScope();
+        ~OverflowScope();
+        OverflowScope(const OverflowScope&) = delete;
+        OverflowScope& operator=(const OverflowScope&) = delete;
+
+    private:
+        bool saved_;
+    };
+
+    // Snapshots the pager counters that the profile reports as deltas.
+    void begin(const Pager& pager);
+    void finish(const Pager& pager);
+
+    void setAccessPath(std::string path);
+    void nameTree(uint32_t root, std::string name);
+    void notePage(uint32_t page_number, PageView page);
+    void addPhaseTime(Phase phase, std::chrono::nanoseconds elapsed);
+
+    void addRowsExamined(uint64_t n) { rows_examined_.fetch_add(n, std::memory_order_relaxed); }
+    void addIndexEntriesExamined(uint64_t n) { index_entries_examined_.fetch_add(n, std::memory_order_relaxed); }
+    void addRowsEmitted(uint64_t n) { rows_emitted_.fetch_add(n, std::memory_order_relaxed); }
+    void addBytesDecoded(uint64_t n) { bytes_decoded_.fetch_add(n, std::memory_order_relaxed); }
+
+    void printTable(std::ostream& out) const;
+    void printJson(std::ostream& out) const;
+
+private:
+    using PageCounts = std::array<uint64_t, static_cast<size_t>(PageKind::kCount)>;
+
+    std::string access_path_;
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::nanoseconds total_{0};
+    std::array<std::atomic<int64_t>, static_cast<size_t>(Phase::kCount)> phase_ns_{};
+    std::atomic<uint64_t> rows_examined_{0};
+    std::atomic<uint64_t> index_entries_examined_{0};
+    std::atomic<uint64_t> rows_emitted_{0};
+    std::atomic<uint64_t> bytes_decoded_{0};
+
+    mutable std::mutex mutex_;
+    std::map<uint32_t, PageCounts> pages_;
+    std::map<uint32_t, std::string> tree_names_;
+
+    bool mapped_ = false;
+    uint64_t fetches_ = 0;
+    CacheStats cache_{};
+};
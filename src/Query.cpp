@@ -0,0 +1,444 @@
+#include "Query.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+namespace {
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    return normalizeIdentifier(a) == normalizeIdentifier(b);
+}
+
+bool isRowidName(std::string_view name) {
+    std::string upper = normalizeIdentifier(name);
+    return upper == "ROWID" || upper == "OID" || upper == "_ROWID_";
+}
+
+bool isCountStar(const Expr& expr) { return expr.kind == Expr::Kind::Function && expr.name == "COUNT" && expr.star; }
+
+const char* ordinalSuffix(size_t n) {
+    if (n % 100 >= 11 && n % 100 <= 13) return "th";
+    switch (n % 10) {
+        case 1: return "st";
+        case 2: return "nd";
+        case 3: return "rd";
+        default: return "th";
+    }
+}
+
+// Gives a column reference bound to table the affinity and collation of its
+// column.
+bool setColumnType(Expr& expr, const TableInfo& table, std::string& error) {
+    if (expr.column == Expr::kRowid) {
+        expr.affinity = Affinity::Integer;
+        expr.collation = Collation::Binary;
+    } else {
+        const ColumnInfo& column = table.columns[expr.column];
+        expr.affinity = column.affinity;
+        if (!collationForName(column.collation, expr.collation)) {
+            error = "no such collation sequence: " + column.collation;
+            return false;
+        }
+    }
+    expr.real_affinity = expr.affinity == Affinity::Real;
+    return true;
+}
+
+// A FROM table and the name columns qualified with it use.
+struct Source {
+    const TableInfo* table;
+    std::string_view alias;
+};
+
+class Binder {
+public:
+    Binder(std::vector<Source> sources, std::string& error) : sources_(std::move(sources)), error_(error) {}
+
+    // aggregate_allowed: expr may call aggregate functions, as result
+    // columns, HAVING and ORDER BY may.
+    bool bind(Expr& expr, bool aggregate_allowed = false);
+
+private:
+    bool bindColumn(Expr& expr);
+    // Gives the literals a column is compared with the column's affinity.
+    void convertComparedLiterals(Expr& expr);
+
+    std::vector<Source> sources_;
+    std::string& error_;
+};
+
+bool Binder::bindColumn(Expr& expr) {
+    std::string qualified = expr.table.empty() ? expr.name : expr.table + "." + expr.name;
+    // The column must name exactly one column (or rowid) of the FROM tables
+    // its qualifier allows
+    bool found = false;
+    for (size_t s = 0; s < sources_.size(); ++s) {
+        const TableInfo& table = *sources_[s].table;
+        if (!expr.table.empty() && !equalsIgnoreCase(expr.table, sources_[s].alias.empty() ? std::string_view(table.name) : sources_[s].alias)) continue;
+        size_t idx = table.findColumn(expr.name);
+        if (idx == std::string::npos && !isRowidName(expr.name)) continue;
+        if (found) {
+            error_ = "ambiguous column name: " + qualified;
+            return false;
+        }
+        found = true;
+        expr.source = s;
+        expr.column = idx == std::string::npos || static_cast<ssize_t>(idx) == table.rowid_alias ? Expr::kRowid : idx;
+    }
+    if (found) return setColumnType(expr, *sources_[expr.source].table, error_);
+    if (expr.double_quoted) {
+        // SQLite's fallback for "..." that names no column
+        expr.kind = Expr::Kind::Literal;
+        expr.literal = parseLiteral(expr.name, true);
+        return true;
+    }
+    error_ = "no such column: " + qualified;
+    return false;
+}
+
+bool Binder::bind(Expr& expr, bool aggregate_allowed) {
+    switch (expr.kind) {
+        case Expr::Kind::Column:
+            return bindColumn(expr);
+        case Expr::Kind::Function: {
+            const std::string& name = expr.name;
+            bool count = name == "COUNT";
+            if (!count && name != "SUM" && name != "TOTAL" && name != "AVG" && name != "MIN" && name != "MAX") {
+                error_ = "no such function: " + name;
+                return false;
+            }
+            // COUNT() is COUNT(*)
+            if (count && expr.args.empty()) expr.star = true;
+            if (expr.star ? !count : expr.args.size() != 1) {
+                error_ = "wrong number of arguments to function " + name + "()";
+                return false;
+            }
+            if (!aggregate_allowed) {
+                error_ = "misuse of aggregate function " + name + "()";
+                return false;
+            }
+            // Aggregates do not nest
+            for (ExprPtr& arg : expr.args) {
+                if (!bind(*arg, false)) return false;
+            }
+            return true;
+        }
+        default:
+            for (ExprPtr& arg : expr.args) {
+                if (!bind(*arg, aggregate_allowed)) return false;
+            }
+            convertComparedLiterals(expr);
+            return true;
+    }
+}
+
+void Binder::convertComparedLiterals(Expr& expr) {
+    auto convert = [](const Expr& column, Expr& operand) {
+        if (column.isColumn() && operand.isLiteral()) operand.literal = applyAffinity(operand.literal, column.affinity);
+    };
+    switch (expr.kind) {
+        case Expr::Kind::Binary:
+            switch (expr.op) {
+                case Expr::Op::Eq:
+                case Expr::Op::Ne:
+                case Expr::Op::Lt:
+                case Expr::Op::Le:
+                case Expr::Op::Gt:
+                case Expr::Op::Ge:
+                case Expr::Op::Is:
+                case Expr::Op::IsNot:
+                    convert(*expr.args[0], *expr.args[1]);
+                    convert(*expr.args[1], *expr.args[0]);
+                    return;
+                default:
+                    return;
+            }
+        case Expr::Kind::In:
+        case Expr::Kind::Between:
+            // x BETWEEN a AND b and x IN (a, b) compare x with each of them
+            for (size_t i = 1; i < expr.args.size(); ++i) convert(*expr.args[0], *expr.args[i]);
+            return;
+        default:
+            return;
+    }
+}
+
+bool containsAggregate(const Expr& expr) {
+    if (expr.kind == Expr::Kind::Function) return true;
+    for (const ExprPtr& arg : expr.args) {
+        if (containsAggregate(*arg)) return true;
+    }
+    return false;
+}
+
+// Numbers the aggregate calls in expr and records the columns it reads
+// outside them.
+void collectGroupTerms(Expr& expr, BoundSelect& query) {
+    if (expr.kind == Expr::Kind::Function) {
+        if (expr.column == Expr::kUnbound) {
+            expr.column = query.aggregates.size();
+            query.aggregates.push_back(&expr);
+        }
+        return;
+    }
+    if (expr.isColumn() && expr.source < query.group_slots.size()) {
+        std::vector<size_t>& slots = query.group_slots[expr.source];
+        size_t& slot = slots[expr.column == Expr::kRowid ? slots.size() - 1 : expr.column];
+        if (slot == std::string::npos) {
+            slot = query.group_columns.size();
+            query.group_columns.push_back(&expr);
+        }
+        return;
+    }
+    for (ExprPtr& arg : expr.args) collectGroupTerms(*arg, query);
+}
+
+// A GROUP BY or ORDER BY term that names a result column: an integer n names
+// the nth, a bare name an alias. key stays nullptr for any other term.
+bool resultColumnTerm(const SelectStatement& statement, const BoundSelect& query, const Expr& term, std::string_view clause, size_t i,
+                      const Expr*& key, std::string& error) {
+    key = nullptr;
+    if (term.isLiteral() && term.literal.kind == Literal::Kind::Integer) {
+        // ORDER BY 2 sorts by the second result column
+        int64_t n = term.literal.number.integer;
+        if (n < 1 || n > static_cast<int64_t>(query.outputs.size())) {
+            error = std::to_string(i + 1) + ordinalSuffix(i + 1) + " " + std::string(clause) + " term out of range - should be between 1 and " +
+                    std::to_string(query.outputs.size());
+            return false;
+        }
+        key = query.outputs[static_cast<size_t>(n - 1)];
+    } else if (term.isColumn() && term.table.empty()) {
+        for (size_t c = 0; c < statement.columns.size() && key == nullptr; ++c) {
+            const ResultColumn& column = statement.columns[c];
+            if (!column.alias.empty() && equalsIgnoreCase(column.alias, term.name)) key = column.expr.get();
+        }
+    }
+    return true;
+}
+
+// LIMIT and OFFSET must be integers (or text that reads as one).
+bool evaluateInteger(const Expr& expr, int64_t& result, std::string& error) {
+    Evaluator evaluator;
+    Value value = evaluator.evaluate(expr, nullptr, 0);
+    if (value.type == Value::Type::Text) {
+        value = numericValue(std::string_view(reinterpret_cast<const char*>(value.data), value.size));
+    }
+    if (value.type != Value::Type::Integer) {
+        error = "datatype mismatch";
+        return false;
+    }
+    result = value.integer;
+    return true;
+}
+
+}  // namespace
+
+bool bindSelect(SelectStatement& statement, const Catalog& catalog, BoundSelect& query, std::string& error) {
+    query = BoundSelect{};
+    std::vector<Source> sources;
+    if (!statement.table.empty()) {
+        query.table = catalog.findTable(statement.table);
+        if (query.table == nullptr) {
+            error = "no such table: " + statement.table;
+            return false;
+        }
+        sources.push_back({query.table, statement.table_alias});
+    }
+    if (!statement.join_table.empty()) {
+        query.join_table = catalog.findTable(statement.join_table);
+        if (query.join_table == nullptr) {
+            error = "no such table: " + statement.join_table;
+            return false;
+        }
+        sources.push_back({query.join_table, statement.join_alias});
+    }
+    Binder binder(sources, error);
+    for (ResultColumn& column : statement.columns) {
+        if (column.expr == nullptr) {
+            if (sources.empty()) {
+                error = "no tables specified";
+                return false;
+            }
+            for (size_t s = 0; s < sources.size(); ++s) {
+                const TableInfo& table = *sources[s].table;
+                for (size_t i = 0; i < table.columns.size(); ++i) {
+                    auto expr = std::make_unique<Expr>();
+                    expr->kind = Expr::Kind::Column;
+                    expr->name = table.columns[i].name;
+                    expr->source = s;
+                    expr->column = static_cast<ssize_t>(i) == table.rowid_alias ? Expr::kRowid : i;
+                    if (!setColumnType(*expr, table, error)) return false;
+                    query.outputs.push_back(expr.get());
+                    query.expanded.push_back(std::move(expr));
+                }
+            }
+            continue;
+        }
+        if (!binder.bind(*column.expr, true)) return false;
+        query.outputs.push_back(column.expr.get());
+    }
+
+    if (statement.where) {
+        if (!binder.bind(*statement.where)) return false;
+        query.where = statement.where.get();
+    }
+
+    for (size_t i = 0; i < statement.group_by.size(); ++i) {
+        Expr& term = *statement.group_by[i];
+        const Expr* key = nullptr;
+        if (!resultColumnTerm(statement, query, term, "GROUP BY", i, key, error)) return false;
+        if (containsAggregate(key != nullptr ? *key : term)) {
+            error = "aggregate functions are not allowed in the GROUP BY clause";
+            return false;
+        }
+        if (key == nullptr) {
+            if (!binder.bind(term)) return false;
+            key = &term;
+        }
+        query.group_by.push_back(key);
+    }
+    if (statement.having) {
+        if (!binder.bind(*statement.having, true)) return false;
+        query.having = statement.having.get();
+    }
+
+    for (size_t i = 0; i < statement.order_by.size(); ++i) {
+        OrderingTerm& term = statement.order_by[i];
+        const Expr* key = nullptr;
+        if (!resultColumnTerm(statement, query, *term.expr, "ORDER BY", i, key, error)) return false;
+        if (key == nullptr) {
+            if (!binder.bind(*term.expr, true)) return false;
+            key = term.expr.get();
+        }
+        query.order_by.push_back({key, term.descending});
+    }
+
+    for (const Source& source : sources) query.group_slots.emplace_back(source.table->columns.size() + 1, std::string::npos);
+    for (ResultColumn& column : statement.columns) {
+        if (column.expr) collectGroupTerms(*column.expr, query);
+    }
+    for (ExprPtr& expr : query.expanded) collectGroupTerms(*expr, query);
+    if (statement.having) collectGroupTerms(*statement.having, query);
+    for (OrderingTerm& term : statement.order_by) collectGroupTerms(*term.expr, query);
+    query.is_count = query.outputs.size() == 1 && isCountStar(*query.outputs[0]) && query.group_by.empty() && query.having == nullptr;
+    if (query.having != nullptr && !query.aggregated()) {
+        error = "HAVING clause on a non-aggregate query";
+        return false;
+    }
+
+    // LIMIT and OFFSET cannot refer to columns
+    Binder constant_binder({}, error);
+    if (statement.limit) {
+        if (!constant_binder.bind(*statement.limit) || !evaluateInteger(*statement.limit, query.limit, error)) return false;
+        if (query.limit < 0) query.limit = -1;
+    }
+    if (statement.offset) {
+        if (!constant_binder.bind(*statement.offset) || !evaluateInteger(*statement.offset, query.offset, error)) return false;
+        if (query.offset < 0) query.offset = 0;
+    }
+    return true;
+}
+
+RowEmitter::RowEmitter(const BoundSelect& query, const Expr* filter, ResultSink& out, const SortOptions& sort)
+    : query_(query), filter_(filter), out_(out) {
+    if (query_.aggregated()) aggregator_ = std::make_unique<Aggregator>(query_);
+    if (!query_.sorted() || sort.presorted) return;
+    std::vector<bool> descending;
+    for (const SortKey& key : query_.order_by) {
+        descending.push_back(key.descending);
+        sort_collations_.push_back(collationOf(*key.expr));
+    }
+    // Only the first OFFSET + LIMIT rows in order can be emitted
+    int64_t keep = -1;
+    if (query_.limit >= 0) {
+        keep = query_.offset > std::numeric_limits<int64_t>::max() - query_.limit ? std::numeric_limits<int64_t>::max() : query_.offset + query_.limit;
+    }
+    sorter_ = std::make_unique<Sorter>(std::move(descending), query_.outputs.size(), keep, sort.memory_budget);
+    sort_keys_.resize(query_.order_by.size());
+    sort_scratch_.resize(query_.order_by.size());
+    sort_values_.resize(query_.outputs.size());
+}
+
+void RowEmitter::readFromIndex(const IndexInfo& index, const TableInfo& table) {
+    index_positions_.assign(table.columns.size(), std::string::npos);
+    for (size_t i = 0; i < index.columns.size(); ++i) index_positions_[index.columns[i]] = i;
+    evaluator_.setColumnPositions(&index_positions_);
+}
+
+void RowEmitter::addRow(Record* record, int64_t rowid) {
+    evaluator_.reset();
+    if (filter_ != nullptr && !evaluator_.test(*filter_, record, rowid)) return;
+    ++matches_;
+    if (query_.is_count) return;
+    if (aggregator_ != nullptr) {
+        aggregator_->add(evaluator_, record, rowid);
+        return;
+    }
+    project(record, rowid);
+}
+
+void RowEmitter::addJoinedRow(const JoinedRow& row) {
+    evaluator_.setJoinedRow(&row);
+    addRow(nullptr, 0);
+    evaluator_.setJoinedRow(nullptr);
+}
+
+void RowEmitter::mergeGroups(const RowEmitter& other) {
+    matches_ += other.matches_;
+    if (aggregator_ != nullptr && other.aggregator_ != nullptr) aggregator_->merge(*other.aggregator_);
+}
+
+void RowEmitter::project(Record* record, int64_t rowid) {
+    if (sorter_ != nullptr) {
+        for (size_t k = 0; k < sort_keys_.size(); ++k) {
+            sort_keys_[k] = collationKey(evaluator_.evaluate(*query_.order_by[k].expr, record, rowid), sort_collations_[k], sort_scratch_[k]);
+        }
+        for (size_t i = 0; i < sort_values_.size(); ++i) sort_values_[i] = evaluator_.evaluate(*query_.outputs[i], record, rowid);
+        sorter_->add(sort_keys_.data(), sort_values_.data());
+        return;
+    }
+    if (skipped_ < static_cast<uint64_t>(query_.offset)) {
+        ++skipped_;
+        return;
+    }
+    if (query_.limit >= 0 && emitted_ >= static_cast<uint64_t>(query_.limit)) return;
+    ++emitted_;
+    out_.beginRow();
+    for (const Expr* output : query_.outputs) out_.addValue(evaluator_.evaluate(*output, record, rowid));
+    out_.endRow();
+}
+
+bool RowEmitter::emit(const Value* values) {
+    if (skipped_ < static_cast<uint64_t>(query_.offset)) {
+        ++skipped_;
+        return true;
+    }
+    if (query_.limit >= 0 && emitted_ >= static_cast<uint64_t>(query_.limit)) return false;
+    ++emitted_;
+    out_.beginRow();
+    for (size_t i = 0; i < query_.outputs.size(); ++i) out_.addValue(values[i]);
+    out_.endRow();
+    return true;
+}
+
+void RowEmitter::finish() {
+    if (query_.is_count) {
+        Value count = Value::makeInteger(static_cast<int64_t>(matches_));
+        emit(&count);
+        return;
+    }
+    if (aggregator_ != nullptr) {
+        // Each group is evaluated as a row whose columns come from the group
+        aggregator_->finish();
+        std::vector<Value> results(query_.aggregates.size());
+        for (size_t group = 0; group < aggregator_->size() && !done(); ++group) {
+            evaluator_.reset();
+            aggregator_->results(group, results.data());
+            evaluator_.setGroup(&query_.group_slots, aggregator_->columns(group), results.data());
+            if (query_.having == nullptr || evaluator_.test(*query_.having, nullptr, 0)) project(nullptr, 0);
+        }
+        evaluator_.setGroup(nullptr, nullptr, nullptr);
+    }
+    if (sorter_ != nullptr) sorter_->finish([this](const Value* values) { return emit(values); });
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Aggregator.hpp"
+#include "Ast.hpp"
+#include "Catalog.hpp"
+#include "Expression.hpp"
+#include "Record.hpp"
+#include "ResultSink.hpp"
+#include "Sorter.hpp"
+
+struct SortKey {
+    const Expr* expr;
+    bool descending;
+};
+
+// A SELECT with its names resolved against the catalog. The expressions point
+// into the statement, which must outlive this.
+struct BoundSelect {
+    // nullptr without a FROM clause.
+    const TableInfo* table = nullptr;
+    // The second FROM table of a join, or nullptr.
+    const TableInfo* join_table = nullptr;
+    // Result columns with `*` expanded.
+    std::vector<const Expr*> outputs;
+    const Expr* where = nullptr;
+    std::vector<const Expr*> group_by;
+    const Expr* having = nullptr;
+    std::vector<SortKey> order_by;
+    // The statement is SELECT COUNT(*).
+    bool is_count = false;
+    // Aggregate calls in the result columns, HAVING and ORDER BY.
+    std::vector<const Expr*> aggregates;
+    // Column references outside aggregate calls, one per table column, whose
+    // values a group keeps from its first row, or from the row that set the
+    // value of the query's only MIN or MAX call. group_slots[s] maps each column
+    // of FROM table s, then its rowid, to a position here, or npos.
+    std::vector<const Expr*> group_columns;
+    std::vector<std::vector<size_t>> group_slots;
+    // -1 for no limit.
+    int64_t limit = -1;
+    int64_t offset = 0;
+
+    // Column references made for `*`.
+    std::vector<ExprPtr> expanded;
+
+    bool joined() const { return join_table != nullptr; }
+    bool sorted() const { return !order_by.empty() && !is_count; }
+    // Rows are folded into groups, one output row each.
+    bool aggregated() const { return !is_count && (!group_by.empty() || !aggregates.empty()); }
+};
+
+// Resolves table and column names, expands `*`, matches GROUP BY and ORDER BY
+// terms to result columns by alias or position, numbers the aggregate calls
+// and evaluates LIMIT and OFFSET. On failure returns false and sets error,
+// e.g. "no such column: x".
+bool bindSelect(SelectStatement& statement, const Catalog& catalog, BoundSelect& query, std::string& error);
+
+// How RowEmitter puts rows in ORDER BY order.
+struct SortOptions {
+    // The access path yields rows in ORDER BY order already.
+    bool presorted = false;
+    // Bytes of rows held in memory before sorted runs spill to temporary
+    // files.
+    size_t memory_budget = size_t{64} << 20;
+};
+
+// Takes the rows an access path produces for a bound SELECT: filters them,
+// then counts them for COUNT(*), folds them into groups for GROUP BY and
+// aggregates, or projects them, sorting for ORDER BY unless they come
+// presorted, and applies HAVING and LIMIT/OFFSET before they reach the sink.
+class RowEmitter {
+public:
+    // filter is the part of WHERE the access path does not already
+    // guarantee, or nullptr.
+    RowEmitter(const BoundSelect& query, const Expr* filter, ResultSink& out, const SortOptions& sort = {});
+
+    // record holds the table row with the given rowid; it is null for a
+    // SELECT without FROM.
+    void addRow(Record* record, int64_t rowid);
+    // A row of a join, in place of addRow.
+    void addJoinedRow(const JoinedRow& row);
+    // Rows will come as records of index rather than of the table; the
+    // index must hold every column the query reads.
+    void readFromIndex(const IndexInfo& index, const TableInfo& table);
+    // Rows the access path knows to match without reading them.
+    void addMatches(uint64_t n) { matches_ += n; }
+    uint64_t matches() const { return matches_; }
+    // Folds in the groups of an emitter for the same query that took other
+    // rows, e.g. on another thread.
+    void mergeGroups(const RowEmitter& other);
+    // LIMIT has been reached, so no further row can change the output and
+    // the access path can stop.
+    bool done() const {
+        return query_.limit >= 0 && sorter_ == nullptr && aggregator_ == nullptr && !query_.is_count && emitted_ >= static_cast<uint64_t>(query_.limit);
+    }
+
+    // Writes the count, the groups, or the rows held for sorting in ORDER BY
+    // order.
+    void finish();
+
+private:
+    // Sends a row that passed the filter, or a group, on to the sorter or
+    // the sink.
+    void project(Record* record, int64_t rowid);
+    // False once LIMIT is reached.
+    bool emit(const Value* values);
+
+    const BoundSelect& query_;
+    const Expr* filter_;
+    ResultSink& out_;
+    Evaluator evaluator_;
+    std::vector<size_t> index_positions_;
+    uint64_t matches_ = 0;
+    uint64_t skipped_ = 0;
+    uint64_t emitted_ = 0;
+    // Set when the rows need sorting; the key and output values of the row
+    // being added, keys as collationKey() of their collation.
+    std::unique_ptr<Aggregator> aggregator_;
+    std::unique_ptr<Sorter> sorter_;
+    std::vector<Value> sort_keys_;
+    std::vector<Value> sort_values_;
+    std::vector<Collation> sort_collations_;
+    std::vector<std::string> sort_scratch_;
+};
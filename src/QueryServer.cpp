@@ -0,0 +1,307 @@
+#include "QueryServer.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+std::atomic<bool> stop_requested{false};
+
+void requestStop(int) { stop_requested.store(true); }
+
+bool writeAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool readAll(int fd, char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::recv(fd, data, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void appendU32(std::string& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+}
+
+uint32_t loadU32(const char* p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; --i) v = (v << 8) | static_cast<unsigned char>(p[i]);
+    return v;
+}
+
+bool sendFrame(int fd, char type, std::string_view payload) {
+    std::string header(1, type);
+    appendU32(header, static_cast<uint32_t>(payload.size()));
+    return writeAll(fd, header.data(), header.size()) && writeAll(fd, payload.data(), payload.size());
+}
+
+// Limit on a single statement, to keep a confused peer from making the
+// server allocate without bound.
+constexpr uint32_t kMaxStatementBytes = 16 << 20;
+// Result chunks are sent once this much is buffered, so large results stream
+// back while the query is still running.
+constexpr size_t kChunkBytes = 64 << 10;
+
+// Creates a listening or connected socket for address.
+int openSocket(const std::string& address, bool listening) {
+    int fd = -1;
+    if (address.rfind("tcp:", 0) == 0) {
+        char* end = nullptr;
+        unsigned long port = std::strtoul(address.c_str() + 4, &end, 10);
+        if (end == address.c_str() + 4 || *end != '\0' || port > 65535) {
+            std::cerr << "Invalid port in " << address << std::endl;
+            return -1;
+        }
+        fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int one = 1;
+        if (listening) ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        int rc = listening ? ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))
+                           : ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        if (rc != 0) {
+            ::close(fd);
+            return -1;
+        }
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    } else {
+        sockaddr_un addr{};
+        if (address.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "Socket path too long: " << address << std::endl;
+            return -1;
+        }
+        fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, address.c_str(), address.size() + 1);
+        if (listening) ::unlink(address.c_str());
+        int rc = listening ? ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))
+                           : ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        if (rc != 0) {
+            ::close(fd);
+            return -1;
+        }
+    }
+    if (listening && ::listen(fd, 128) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+double percentile(std::vector<double>& sorted_values, double p) {
+    if (sorted_values.empty()) return 0;
+    size_t i = static_cast<size_t>(p * static_cast<double>(sorted_values.size() - 1) + 0.5);
+    return sorted_values[std::min(i, sorted_values.size() - 1)];
+}
+
+// Latencies in milliseconds over a span of wall time.
+std::string latencySummary(std::vector<double> latencies_ms, uint64_t bytes, double elapsed_s) {
+    std::sort(latencies_ms.begin(), latencies_ms.end());
+    double sum = 0;
+    for (double l : latencies_ms) sum += l;
+    size_t n = latencies_ms.size();
+    char line[256];
+    std::snprintf(line, sizeof(line),
+                  "%zu statements, %llu bytes, latency avg %.3f ms p50 %.3f ms p99 %.3f ms max %.3f ms, %.1f statements/s, %.2f MB/s",
+                  n, static_cast<unsigned long long>(bytes), n == 0 ? 0.0 : sum / static_cast<double>(n),
+                  percentile(latencies_ms, 0.50), percentile(latencies_ms, 0.99), n == 0 ? 0.0 : latencies_ms.back(),
+                  elapsed_s > 0 ? static_cast<double>(n) / elapsed_s : 0.0, elapsed_s > 0 ? static_cast<double>(bytes) / 1e6 / elapsed_s : 0.0);
+    return line;
+}
+
+void serveConnection(int fd, uint64_t connection_id, const ServerOptions& options, const StatementFn& run) {
+    auto opened = std::chrono::steady_clock::now();
+    std::vector<double> latencies_ms;
+    uint64_t bytes_sent = 0;
+    std::string statement;
+    char header[4];
+    while (readAll(fd, header, sizeof(header))) {
+        uint32_t len = loadU32(header);
+        if (len > kMaxStatementBytes) break;
+        statement.resize(len);
+        if (!readAll(fd, statement.data(), len)) break;
+
+        auto start = std::chrono::steady_clock::now();
+        ResultSink out(options.format, [&](std::string_view chunk) {
+            bytes_sent += chunk.size();
+            return sendFrame(fd, 'D', chunk);
+        }, kChunkBytes);
+        std::ostringstream err;
+        int rc = run(statement, out, err);
+        out.flush();
+        std::string error = err.str();
+        bool sent = out.ok() && (error.empty() || sendFrame(fd, 'E', error)) && sendFrame(fd, 'Z', std::string(1, static_cast<char>(rc)));
+        latencies_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        if (!sent) break;
+    }
+    double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - opened).count();
+    std::cerr << "connection " << connection_id << ": " << latencySummary(std::move(latencies_ms), bytes_sent, elapsed_s) << std::endl;
+}
+
+}  // namespace
+
+int runServer(const ServerOptions& options, const StatementFn& run) {
+    int listen_fd = openSocket(options.address, true);
+    if (listen_fd < 0) {
+        std::cerr << "Failed to listen on " << options.address << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    struct sigaction sa {};
+    sa.sa_handler = requestStop;
+    ::sigaction(SIGINT, &sa, nullptr);
+    ::sigaction(SIGTERM, &sa, nullptr);
+    std::cerr << "listening on " << options.address << " with " << options.workers << " workers" << std::endl;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::pair<int, uint64_t>> pending;
+    std::set<int> active;
+    bool closing = false;
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < std::max<size_t>(options.workers, 1); ++w) {
+        workers.emplace_back([&]() {
+            for (;;) {
+                std::pair<int, uint64_t> conn;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [&]() { return closing || !pending.empty(); });
+                    if (pending.empty()) return;
+                    conn = pending.front();
+                    pending.pop_front();
+                    active.insert(conn.first);
+                }
+                serveConnection(conn.first, conn.second, options, run);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    active.erase(conn.first);
+                }
+                ::close(conn.first);
+            }
+        });
+    }
+
+    uint64_t next_id = 1;
+    while (!stop_requested.load()) {
+        pollfd pfd{listen_fd, POLLIN, 0};
+        int ready = ::poll(&pfd, 1, 200);
+        if (ready <= 0) continue;
+        int client = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) continue;
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.emplace_back(client, next_id++);
+        cv.notify_one();
+    }
+
+    ::close(listen_fd);
+    if (options.address.rfind("tcp:", 0) != 0) ::unlink(options.address.c_str());
+    {
+        // Wake workers blocked reading from idle clients; queued clients are dropped.
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+        for (int fd : active) ::shutdown(fd, SHUT_RDWR);
+        for (auto& conn : pending) ::close(conn.first);
+        pending.clear();
+    }
+    cv.notify_all();
+    for (auto& worker : workers) worker.join();
+    return 0;
+}
+
+int runClient(const std::string& address, const std::vector<std::string>& statements, bool timing) {
+    int fd = openSocket(address, false);
+    if (fd < 0) {
+        std::cerr << "Failed to connect to " << address << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    auto opened = std::chrono::steady_clock::now();
+    std::vector<double> latencies_ms;
+    uint64_t bytes_received = 0;
+    int rc = 0;
+    std::string payload;
+    for (size_t n = 0; n < statements.size(); ++n) {
+        auto start = std::chrono::steady_clock::now();
+        std::string request;
+        appendU32(request, static_cast<uint32_t>(statements[n].size()));
+        request += statements[n];
+        if (!writeAll(fd, request.data(), request.size())) {
+            std::cerr << "Connection closed by server" << std::endl;
+            ::close(fd);
+            return 1;
+        }
+        for (;;) {
+            char header[5];
+            if (!readAll(fd, header, sizeof(header))) {
+                std::cerr << "Connection closed by server" << std::endl;
+                ::close(fd);
+                return 1;
+            }
+            payload.resize(loadU32(header + 1));
+            if (!readAll(fd, payload.data(), payload.size())) {
+                std::cerr << "Connection closed by server" << std::endl;
+                ::close(fd);
+                return 1;
+            }
+            if (header[0] == 'D') {
+                bytes_received += payload.size();
+                std::cout.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+            } else if (header[0] == 'E') {
+                std::cout.flush();
+                std::cerr << payload;
+            } else if (header[0] == 'Z') {
+                if (!payload.empty() && payload[0] != 0) rc = static_cast<unsigned char>(payload[0]);
+                break;
+            }
+        }
+        std::cout.flush();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        latencies_ms.push_back(ms);
+        if (timing) {
+            char line[64];
+            std::snprintf(line, sizeof(line), "Run Time: statement %zu: %.3f ms", n + 1, ms);
+            std::cerr << line << std::endl;
+        }
+    }
+    ::close(fd);
+    if (timing) {
+        double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - opened).count();
+        std::cerr << latencySummary(std::move(latencies_ms), bytes_received, elapsed_s) << std::endl;
+    }
+    return rc;
+}
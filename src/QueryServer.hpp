@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "ResultSink.hpp"
+
+// Wire protocol between runServer and runClient. The client sends each
+// statement as a little-endian u32 length and the statement text. The server
+// answers with frames of a one-byte type, a little-endian u32 length and the
+// payload:
+//   'D'  a chunk of result rows in the server's output format
+//   'E'  an error message
+//   'Z'  end of the statement; the payload is one byte, the exit status
+// Addresses are a filesystem path for a Unix domain socket or "tcp:PORT" for
+// TCP on 127.0.0.1.
+
+// Runs one statement; rows go to out and error text to err.
+using StatementFn = std::function<int(const std::string& statement, ResultSink& out, std::ostream& err)>;
+
+struct ServerOptions {
+    std::string address;
+    // Connections served at once; further clients wait to be picked up.
+    size_t workers = 4;
+    OutputFormat format = OutputFormat::Pipe;
+};
+
+// Serves statements until SIGINT or SIGTERM. run must be safe to call from
+// several worker threads at once. Each connection's statement count, bytes
+// sent, latency percentiles and throughput are logged to stderr when it
+// closes. Returns non-zero if the address cannot be bound.
+int runServer(const ServerOptions& options, const StatementFn& run);
+
+// Sends the statements one at a time and copies the results to stdout and
+// errors to stderr. With timing, prints each round trip and a latency and
+// throughput summary to stderr.
+int runClient(const std::string& address, const std::vector<std::string>& statements, bool timing);
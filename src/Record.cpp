@@ -0,0 +1,246 @@
+#include "Record.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#include "Btree.hpp"
+#include "Profiler.hpp"
+
+size_t serialTypePayloadLength(uint64_t serial_type_code) {
+    switch (serial_type_code) {
+        case 0: return 0;
+        case 1: return 1;
+        case 2: return 2;
+        case 3: return 3;
+        case 4: return 4;
+        case 5: return 6;
+        case 6: return 8;
+        case 7: return 8;
+        case 8: return 0;
+        case 9: return 0;
+        case 10: return 0;
+        case 11: return 0;
+        default:
+            if (serial_type_code >= 12) {
+                if ((serial_type_code % 2) == 0) {
+                    return static_cast<size_t>((serial_type_code - 12) / 2);
+                } else {
+                    return static_cast<size_t>((serial_type_code - 13) / 2);
+                }
+            }
+            return 0;
+    }
+}
+
+int64_t readBigEndianSigned(const unsigned char* bytes, size_t len) {
+    int64_t value = 0;
+    for (size_t i = 0; i < len; ++i) {
+        value = (value << 8) | bytes[i];
+    }
+    size_t total_bits = len * 8;
+    if (len > 0 && (bytes[0] & 0x80u)) {
+        if (total_bits < 64) {
+            int64_t mask = -1;
+            mask <<= total_bits;
+            value |= mask;
+        }
+    }
+    return value;
+}
+
+size_t localPayloadSize(uint64_t payload_size, uint32_t usable_size, bool index_page) {
+    uint64_t max_local = index_page ? ((usable_size - 12) * 64 / 255) - 23 : usable_size - 35;
+    if (payload_size <= max_local) return static_cast<size_t>(payload_size);
+    uint64_t min_local = ((usable_size - 12) * 32 / 255) - 23;
+    uint64_t k = min_local + ((payload_size - min_local) % (usable_size - 4));
+    return static_cast<size_t>(k <= max_local ? k : min_local);
+}
+
+size_t varintLength(uint64_t v) {
+    if ((v >> 56) != 0) return 9;
+    size_t n = 1;
+    while ((v >>= 7) != 0) ++n;
+    return n;
+}
+
+void appendVarint(std::vector<unsigned char>& out, uint64_t v) {
+    if ((v >> 56) != 0) {
+        // Eight 7-bit groups, then a whole byte
+        unsigned char bytes[9];
+        bytes[8] = static_cast<unsigned char>(v);
+        v >>= 8;
+        for (int i = 7; i >= 0; --i, v >>= 7) bytes[i] = static_cast<unsigned char>((v & 0x7F) | 0x80);
+        out.insert(out.end(), bytes, bytes + 9);
+        return;
+    }
+    unsigned char groups[8];
+    size_t n = 0;
+    do {
+        groups[n++] = static_cast<unsigned char>(v & 0x7F);
+        v >>= 7;
+    } while (v != 0);
+    for (size_t i = n; i-- > 0;) out.push_back(static_cast<unsigned char>(groups[i] | (i > 0 ? 0x80 : 0)));
+}
+
+uint64_t serialTypeOf(const Value& value) {
+    switch (value.type) {
+        case Value::Type::Null:
+            return 0;
+        case Value::Type::Integer: {
+            int64_t i = value.integer;
+            if (i == 0) return 8;
+            if (i == 1) return 9;
+            uint64_t u = static_cast<uint64_t>(i < 0 ? ~i : i);
+            if (u <= 0x7F) return 1;
+            if (u <= 0x7FFF) return 2;
+            if (u <= 0x7FFFFF) return 3;
+            if (u <= 0x7FFFFFFF) return 4;
+            if (u <= 0x7FFFFFFFFFFF) return 5;
+            return 6;
+        }
+        case Value::Type::Real:
+            return 7;
+        case Value::Type::Text:
+            return 13 + 2 * static_cast<uint64_t>(value.size);
+        case Value::Type::Blob:
+            return 12 + 2 * static_cast<uint64_t>(value.size);
+    }
+    return 0;
+}
+
+void appendRecord(std::vector<unsigned char>& out, const Value* values, size_t n) {
+    size_t types_size = 0;
+    for (size_t i = 0; i < n; ++i) types_size += varintLength(serialTypeOf(values[i]));
+    // The header size counts its own varint
+    size_t header_size = types_size + 1;
+    while (types_size + varintLength(header_size) != header_size) header_size = types_size + varintLength(header_size);
+    appendVarint(out, header_size);
+    for (size_t i = 0; i < n; ++i) appendVarint(out, serialTypeOf(values[i]));
+    for (size_t i = 0; i < n; ++i) {
+        const Value& value = values[i];
+        uint64_t serial_type = serialTypeOf(value);
+        if (value.type == Value::Type::Integer || value.type == Value::Type::Real) {
+            uint64_t bits = value.type == Value::Type::Real ? std::bit_cast<uint64_t>(value.real) : static_cast<uint64_t>(value.integer);
+            for (size_t b = serialTypePayloadLength(serial_type); b-- > 0;) out.push_back(static_cast<unsigned char>(bits >> (8 * b)));
+        } else if (value.size > 0) {
+            out.insert(out.end(), value.data, value.data + value.size);
+        }
+    }
+}
+
+bool decodeRecord(PageView payload, std::vector<Value>& values) {
+    values.clear();
+    if (payload.empty()) return false;
+    auto [header_size, n] = readVarint(payload, 0);
+    if (header_size > payload.size()) return false;
+    size_t body = static_cast<size_t>(header_size);
+    for (size_t p = n; p < header_size;) {
+        // A varint cut short by the end of the header is malformed
+        size_t end = p;
+        while (end < header_size && end - p < 8 && (payload[end] & 0x80) != 0) ++end;
+        if (end == header_size) return false;
+        auto [serial_type, len] = readVarint(payload, p);
+        p += len;
+        size_t size = serialTypePayloadLength(serial_type);
+        if (body + size > payload.size()) return false;
+        values.push_back(decodeValue(serial_type, payload.subspan(body, size)));
+        body += size;
+    }
+    return true;
+}
+
+bool Record::load(PageView page, size_t payload_start, uint64_t payload_size, bool index_page) {
+    serial_types_.clear();
+    offsets_.clear();
+    chain_.clear();
+    size_t local_size = localPayloadSize(payload_size, pager_.usableSize(), index_page);
+    size_t pointer_size = local_size < payload_size ? 4 : 0;
+    if (payload_start + local_size + pointer_size > page.size() || local_size == 0) return false;
+    local_ = page.subspan(payload_start, local_size);
+    payload_size_ = payload_size;
+    first_overflow_ = pointer_size != 0 ? readBE32(page, payload_start + local_size) : 0;
+
+    auto pr = readVarint(local_, 0);
+    uint64_t header_size = pr.first;
+    if (header_size > payload_size || header_size < pr.second) return false;
+    PageView header = local_;
+    if (header_size > local_size) {
+        header_scratch_.resize(static_cast<size_t>(header_size) + 9);
+        if (!readPayload(0, static_cast<size_t>(header_size), header_scratch_.data())) return false;
+        header = PageView(header_scratch_);
+    }
+    size_t hp = pr.second;
+    size_t hend = static_cast<size_t>(header_size);
+    uint64_t body_off = header_size;
+    while (hp < hend) {
+        auto stp = readVarint(header, hp);
+        hp += stp.second;
+        serial_types_.push_back(stp.first);
+        offsets_.push_back(body_off);
+        body_off += serialTypePayloadLength(stp.first);
+    }
+    if (spill_.size() < serial_types_.size()) spill_.resize(serial_types_.size());
+    return true;
+}
+
+PageView Record::column(size_t i) {
+    uint64_t off = offsets_[i];
+    size_t len = columnLength(i);
+    if (off + len > payload_size_) return {};
+    if (off + len <= local_.size()) return local_.subspan(static_cast<size_t>(off), len);
+    std::vector<unsigned char>& buf = spill_[i];
+    buf.resize(len);
+    if (!readPayload(off, len, buf.data())) return {};
+    return PageView(buf.data(), len);
+}
+
+Value Record::value(size_t i) {
+    uint64_t serial_type = serial_types_[i];
+    if (serialTypePayloadLength(serial_type) == 0) return decodeValue(serial_type, {});
+    PageView bytes = column(i);
+    if (bytes.size() != columnLength(i)) return Value{};
+    if (QueryProfile* profile = pager_.profile()) profile->addBytesDecoded(bytes.size());
+    return decodeValue(serial_type, bytes);
+}
+
+std::string Record::columnText(size_t i) {
+    PageView bytes = column(i);
+    return std::string(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+bool Record::readPayload(uint64_t offset, size_t len, unsigned char* dst) {
+    if (offset < local_.size()) {
+        size_t n = std::min<size_t>(len, local_.size() - static_cast<size_t>(offset));
+        std::memcpy(dst, local_.data() + offset, n);
+        dst += n;
+        len -= n;
+        offset += n;
+    }
+    const size_t chunk = pager_.usableSize() - 4;
+    QueryProfile::OverflowScope overflow_scope;
+    while (len > 0) {
+        uint64_t overflow_off = offset - local_.size();
+        size_t index = static_cast<size_t>(overflow_off / chunk);
+        size_t within = static_cast<size_t>(overflow_off % chunk);
+        if (chain_.empty()) {
+            if (first_overflow_ == 0) return false;
+            chain_.push_back(first_overflow_);
+        }
+        while (chain_.size() <= index) {
+            PageRef prev = pager_.page(chain_.back());
+            if (prev.empty()) return false;
+            uint32_t next = readBE32(prev, 0);
+            if (next == 0) return false;
+            chain_.push_back(next);
+        }
+        PageRef page = pager_.page(chain_[index]);
+        if (page.empty()) return false;
+        size_t n = std::min(len, chunk - within);
+        std::memcpy(dst, page.data() + 4 + within, n);
+        dst += n;
+        len -= n;
+        offset += n;
+    }
+    return true;
+}
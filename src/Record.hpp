@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Pager.hpp"
+#include "Value.hpp"
+
+size_t serialTypePayloadLength(uint64_t serial_type_code);
+int64_t readBigEndianSigned(const unsigned char* bytes, size_t len);
+
+// Number of payload bytes stored on the B-tree page itself; the rest lives on
+// the overflow chain whose first page number follows the local bytes.
+size_t localPayloadSize(uint64_t payload_size, uint32_t usable_size, bool index_page);
+
+size_t varintLength(uint64_t v);
+void appendVarint(std::vector<unsigned char>& out, uint64_t v);
+// The smallest serial type that holds the value.
+uint64_t serialTypeOf(const Value& value);
+// Appends the record of n values: the header of serial types, then the
+// bodies.
+void appendRecord(std::vector<unsigned char>& out, const Value* values, size_t n);
+// Decodes a whole record held in memory; text and blobs point into payload.
+// Returns false if the record is malformed.
+bool decodeRecord(PageView payload, std::vector<Value>& values);
+
+// Lazily decoded view of one record payload. Columns stored on the cell's own
+// page are returned in place; only columns that reach into the overflow chain
+// are assembled into scratch buffers, and only when asked for. A Record can
+// be reused across cells so its buffers are allocated once per scan.
+class Record {
+public:
+    explicit Record(Pager& pager) : pager_(pager) {}
+
+    // payload_start is the offset of the payload in page (after the size and
+    // rowid varints). Returns false if the record header is malformed.
+    bool load(PageView page, size_t payload_start, uint64_t payload_size, bool index_page);
+
+    Pager& pager() const { return pager_; }
+    size_t columnCount() const { return serial_types_.size(); }
+    uint64_t serialType(size_t i) const { return serial_types_[i]; }
+    size_t columnLength(size_t i) const { return serialTypePayloadLength(serial_types_[i]); }
+
+    // Bytes of column i, or an empty view if they cannot be read.
+    PageView column(size_t i);
+    // Typed view of column i; NULL if its bytes cannot be read.
+    Value value(size_t i);
+    std::string columnText(size_t i);
+
+private:
+    bool readPayload(uint64_t offset, size_t len, unsigned char* dst);
+
+    Pager& pager_;
+    PageView local_;
+    uint64_t payload_size_ = 0;
+    uint32_t first_overflow_ = 0;
+    std::vector<uint64_t> serial_types_;
+    std::vector<uint64_t> offsets_;
+    std::vector<uint32_t> chain_;
+    std::vector<std::vector<unsigned char>> spill_;
+    std::vector<unsigned char> header_scratch_;
+};
@@ -0,0 +1,168 @@
+#include "ResultSink.hpp"
+
+#include <unistd.h>
+
+#include <bit>
+#include <cerrno>
+#include <utility>
+
+#include "Profiler.hpp"
+
+namespace {
+
+template <typename T>
+void storeLittleEndian(std::string& out, size_t pos, T value) {
+    for (size_t i = 0; i < sizeof(T); ++i) out[pos + i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+}
+
+template <typename T>
+void appendLittleEndian(std::string& out, T value) {
+    size_t pos = out.size();
+    out.resize(pos + sizeof(T));
+    storeLittleEndian(out, pos, value);
+}
+
+void appendCsvValue(std::string& out, const Value& value) {
+    if (value.type != Value::Type::Text && value.type != Value::Type::Blob) {
+        appendValue(out, value);
+        return;
+    }
+    std::string_view text(reinterpret_cast<const char*>(value.data), value.size);
+    if (text.find_first_of(",\"\r\n") == std::string_view::npos) {
+        out.append(text);
+        return;
+    }
+    out.push_back('"');
+    for (char c : text) {
+        if (c == '"') out.push_back('"');
+        out.push_back(c);
+    }
+    out.push_back('"');
+}
+
+void appendBinaryValue(std::string& out, const Value& value) {
+    switch (value.type) {
+        case Value::Type::Null:
+            out.push_back(0);
+            return;
+        case Value::Type::Integer:
+            out.push_back(1);
+            appendLittleEndian(out, static_cast<uint64_t>(value.integer));
+            return;
+        case Value::Type::Real:
+            out.push_back(2);
+            appendLittleEndian(out, std::bit_cast<uint64_t>(value.real));
+            return;
+        case Value::Type::Text:
+        case Value::Type::Blob:
+            out.push_back(value.type == Value::Type::Text ? 3 : 4);
+            appendLittleEndian(out, static_cast<uint32_t>(value.size));
+            out.append(reinterpret_cast<const char*>(value.data), value.size);
+            return;
+    }
+}
+
+}  // namespace
+
+bool parseOutputFormat(std::string_view name, OutputFormat& format) {
+    if (name == "pipe" || name == "list") format = OutputFormat::Pipe;
+    else if (name == "csv") format = OutputFormat::Csv;
+    else if (name == "binary") format = OutputFormat::Binary;
+    else return false;
+    return true;
+}
+
+ResultSink::ResultSink(OutputFormat format, int fd, size_t flush_threshold)
+    : format_(format), fd_(fd), flush_threshold_(flush_threshold) {
+    buffer_.reserve(fd_ >= 0 ? flush_threshold_ + flush_threshold_ / 4 : 4096);
+}
+
+ResultSink::ResultSink(OutputFormat format, Writer writer, size_t flush_threshold)
+    : format_(format), fd_(-1), writer_(std::move(writer)), flush_threshold_(flush_threshold) {
+    buffer_.reserve(flush_threshold_ + flush_threshold_ / 4);
+}
+
+ResultSink::ResultSink(RowHandler handler)
+    : format_(OutputFormat::Pipe), fd_(-1), row_handler_(std::move(handler)), flush_threshold_(kDefaultFlushThreshold) {}
+
+void ResultSink::beginRow() {
+    if (row_handler_) {
+        row_values_.clear();
+        return;
+    }
+    row_start_ = buffer_.size();
+    row_columns_ = 0;
+    if (format_ == OutputFormat::Binary) {
+        appendLittleEndian(buffer_, uint32_t{0});
+        appendLittleEndian(buffer_, uint16_t{0});
+    }
+}
+
+void ResultSink::addValue(const Value& value) {
+    if (row_handler_) {
+        row_values_.push_back(value);
+        return;
+    }
+    switch (format_) {
+        case OutputFormat::Pipe:
+            if (row_columns_ > 0) buffer_.push_back('|');
+            appendValue(buffer_, value);
+            break;
+        case OutputFormat::Csv:
+            if (row_columns_ > 0) buffer_.push_back(',');
+            appendCsvValue(buffer_, value);
+            break;
+        case OutputFormat::Binary:
+            appendBinaryValue(buffer_, value);
+            break;
+    }
+    ++row_columns_;
+}
+
+void ResultSink::endRow() {
+    if (row_handler_) {
+        row_handler_(row_values_);
+        if (profile_ != nullptr) profile_->addRowsEmitted(1);
+        return;
+    }
+    if (format_ == OutputFormat::Binary) {
+        storeLittleEndian(buffer_, row_start_, static_cast<uint32_t>(buffer_.size() - row_start_ - sizeof(uint32_t)));
+        storeLittleEndian(buffer_, row_start_ + sizeof(uint32_t), row_columns_);
+    } else {
+        buffer_.push_back('\n');
+    }
+    if (profile_ != nullptr) profile_->addRowsEmitted(1);
+    maybeFlush();
+}
+
+void ResultSink::writeRaw(std::string_view bytes) {
+    buffer_.append(bytes);
+    maybeFlush();
+}
+
+void ResultSink::flush() {
+    if ((fd_ < 0 && !writer_) || buffer_.empty()) return;
+    QueryProfile::PhaseTimer output_timer(profile_, QueryProfile::Phase::Output);
+    if (writer_) {
+        if (ok_ && !writer_(buffer_)) ok_ = false;
+        buffer_.clear();
+        return;
+    }
+    size_t done = 0;
+    while (ok_ && done < buffer_.size()) {
+        ssize_t n = ::write(fd_, buffer_.data() + done, buffer_.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ok_ = false;
+            break;
+        }
+        done += static_cast<size_t>(n);
+    }
+    buffer_.clear();
+}
+
+std::string ResultSink::takeBuffer() {
+    std::string out;
+    out.swap(buffer_);
+    return out;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Value.hpp"
+
+class QueryProfile;
+
+enum class OutputFormat {
+    // Columns separated by '|', one row per line, as the sqlite3 shell prints.
+    Pipe,
+    // Like the shell's csv mode: text containing a comma, quote or line break
+    // is quoted, with quotes doubled; rows end in '\n'.
+    Csv,
+    // Length-prefixed rows for piping into other tools. Each row is a
+    // little-endian u32 byte count followed by that many bytes holding a u16
+    // column count and, per column, a one-byte tag (0 null, 1 integer,
+    // 2 real, 3 text, 4 blob) and its body: integers as i64, reals as f64,
+    // text and blobs as a u32 length and the bytes, all little-endian.
+    Binary,
+};
+
+bool parseOutputFormat(std::string_view name, OutputFormat& format);
+
+// Formats result rows into one large buffer instead of writing each row
+// separately. A sink bound to a file descriptor or a writer callback hands the
+// buffer over whenever it grows past the flush threshold and when flushed or
+// destroyed; an unbound sink just accumulates, for callers that collect rows
+// and pass the bytes to another sink (see takeBuffer/writeRaw).
+class ResultSink {
+public:
+    static constexpr size_t kDefaultFlushThreshold = 1 << 20;
+    // Receives each flushed chunk; returns false if it could not be delivered.
+    using Writer = std::function<bool(std::string_view bytes)>;
+
+    // Receives each row of a sink that keeps rows as values; text and blobs
+    // are only valid during the call.
+    using RowHandler = std::function<void(const std::vector<Value>& row)>;
+
+    explicit ResultSink(OutputFormat format, int fd = -1, size_t flush_threshold = kDefaultFlushThreshold);
+    ResultSink(OutputFormat format, Writer writer, size_t flush_threshold = kDefaultFlushThreshold);
+    // Hands each row to handler instead of formatting it, for statements that
+    // use a query's rows themselves. Such a sink has no bytes to take or
+    // append to, so its query must not run as a parallel scan.
+    explicit ResultSink(RowHandler handler);
+    ResultSink(const ResultSink&) = delete;
+    ResultSink& operator=(const ResultSink&) = delete;
+    ~ResultSink() { flush(); }
+
+    OutputFormat format() const { return format_; }
+    // Rows are counted and write time is reported as the output phase.
+    void setProfile(QueryProfile* profile) { profile_ = profile; }
+
+    void beginRow();
+    void addValue(const Value& value);
+    void endRow();
+    void writeRow(const Value& value) {
+        beginRow();
+        addValue(value);
+        endRow();
+    }
+
+    // Appends bytes that are already formatted, e.g. another sink's buffer or
+    // the text of a dot command.
+    void writeRaw(std::string_view bytes);
+
+    void flush();
+    std::string takeBuffer();
+    // False once a write has failed (e.g. a closed pipe); later output is
+    // dropped.
+    bool ok() const { return ok_; }
+
+private:
+    void maybeFlush() {
+        if ((fd_ >= 0 || writer_) && buffer_.size() >= flush_threshold_) flush();
+    }
+
+    OutputFormat format_;
+    int fd_;
+    Writer writer_;
+    RowHandler row_handler_;
+    std::vector<Value> row_values_;
+    size_t flush_threshold_;
+    std::string buffer_;
+    size_t row_start_ = 0;
+    uint16_t row_columns_ = 0;
+    bool ok_ = true;
+    QueryProfile* profile_ = nullptr;
+};
@@ -0,0 +1,66 @@
+#include "Script.hpp"
+
+#include <cctype>
+
+namespace {
+
+bool isBlank(const std::string& s) {
+    for (char c : s) {
+        if (!std::isspace(static_cast<unsigned char>(c))) return false;
+    }
+    return true;
+}
+
+std::string trimmed(std::string_view s) {
+    size_t b = 0, e = s.size();
+    while (b < e && std::isspace(static_cast<unsigned char>(s[b]))) ++b;
+    while (e > b && std::isspace(static_cast<unsigned char>(s[e - 1]))) --e;
+    return std::string(s.substr(b, e - b));
+}
+
+}  // namespace
+
+std::vector<std::string> splitStatements(std::string_view script) {
+    std::vector<std::string> statements;
+    std::string current;
+    char quote = '\0';
+    size_t i = 0;
+    auto finish = [&]() {
+        std::string statement = trimmed(current);
+        if (!statement.empty()) statements.push_back(std::move(statement));
+        current.clear();
+    };
+    while (i < script.size()) {
+        char c = script[i];
+        if (quote != '\0') {
+            current.push_back(c);
+            if (c == quote) quote = '\0';
+            ++i;
+            continue;
+        }
+        if (c == '.' && isBlank(current)) {
+            size_t eol = script.find_first_of(";\n", i);
+            if (eol == std::string_view::npos) eol = script.size();
+            current = std::string(script.substr(i, eol - i));
+            finish();
+            i = eol + 1;
+            continue;
+        }
+        if (c == '-' && i + 1 < script.size() && script[i + 1] == '-') {
+            size_t eol = script.find('\n', i);
+            i = eol == std::string_view::npos ? script.size() : eol;
+            continue;
+        }
+        if (c == ';') {
+            finish();
+            ++i;
+            continue;
+        }
+        if (c == '\'' || c == '"' || c == '`') quote = c;
+        else if (c == '[') quote = ']';
+        current.push_back(c);
+        ++i;
+    }
+    finish();
+    return statements;
+}
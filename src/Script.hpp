@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Splits a script into statements. SQL statements end at a ';' outside
+// quotes and are returned without it; `--` comments are dropped. A line that
+// starts with '.' where a statement would begin is a dot command and ends at
+// the end of the line or a ';'. Empty statements are skipped.
+std::vector<std::string> splitStatements(std::string_view script);
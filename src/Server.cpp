@@ -1,65 +1,40 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
-#include <iostream>
 #include <fstream>
+#include <iterator>
+#include <iostream>
+#include <memory>
 #include <vector>
 #include <string>
 #include <utility>
 #include <cstdint>
 #include <algorithm>
 #include <cctype>
-#include <functional>
 #include <set>
 #include <unordered_map>
+#include <unistd.h>
 
-static std::pair<uint64_t, size_t> readVarint(const std::vector<unsigned char>& data, size_t start_index) {
-    uint64_t value = 0;
-    size_t i = 0;
-    for (; i < 9; ++i) {
-        unsigned char byte = data[start_index + i];
-        if (i == 8) {
-            value = (value << 8) | byte;
-            ++i;
-            break;
-        }
-        value = (value << 7) | (byte & 0x7Fu);
-        if ((byte & 0x80u) == 0) {
-            ++i;
-            break;
-        }
-    }
-    return {value, i};
-}
-
-static size_t serialTypePayloadLength(uint64_t serial_type_code) {
-    switch (serial_type_code) {
-        case 0: return 0;
-        case 1: return 1;
-        case 2: return 2;
-        case 3: return 3;
-        case 4: return 4;
-        case 5: return 6;
-        case 6: return 8;
-        case 7: return 8;
-        case 8: return 0;
-        case 9: return 0;
-        case 10: return 0;
-        case 11: return 0;
-        default:
-            if (serial_type_code >= 12) {
-                if ((serial_type_code % 2) == 0) {
-                    return static_cast<size_t>((serial_type_code - 12) / 2);
-                } else {
-                    return static_cast<size_t>((serial_type_code - 13) / 2);
-                }
-            }
-            return 0;
-    }
-}
-
-static std::string rstrip_semicolon(const std::string& s) {
-    if (!s.empty() && s.back() == ';') return s.substr(0, s.size() - 1);
-    return s;
-}
+#include "Btree.hpp"
+#include "BulkLoad.hpp"
+#include "Catalog.hpp"
+#include "Join.hpp"
+#include "LeafBatch.hpp"
+#include "Modify.hpp"
+#include "Pager.hpp"
+#include "ParallelScan.hpp"
+#include "Parser.hpp"
+#include "Planner.hpp"
+#include "Predicate.hpp"
+#include "Profiler.hpp"
+#include "Query.hpp"
+#include "Record.hpp"
+#include "QueryServer.hpp"
+#include "ResultSink.hpp"
+#include "Script.hpp"
+#include "Value.hpp"
 
 static std::string to_upper(std::string s) {
     std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c){ return static_cast<char>(std::toupper(c)); });
@@ -74,856 +49,526 @@ static std::string trim(const std::string& s) {
     return s.substr(b, e - b);
 }
 
-static int64_t readBigEndianSigned(const unsigned char* bytes, size_t len) {
-    int64_t value = 0;
-    for (size_t i = 0; i < len; ++i) {
-        value = (value << 8) | bytes[i];
-    }
-    size_t total_bits = len * 8;
-    if (len > 0 && (bytes[0] & 0x80u)) {
-        if (total_bits < 64) {
-            int64_t mask = -1;
-            mask <<= total_bits;
-            value |= mask;
-        }
-    }
-    return value;
-}
-
-static std::string decodeValueToString(const std::vector<unsigned char>& buf, size_t start, uint64_t serial_type_code, size_t len) {
-    switch (serial_type_code) {
-        case 0: return "";
-        case 1: return std::to_string(readBigEndianSigned(&buf[start], 1));
-        case 2: return std::to_string(readBigEndianSigned(&buf[start], 2));
-        case 3: return std::to_string(readBigEndianSigned(&buf[start], 3));
-        case 4: return std::to_string(readBigEndianSigned(&buf[start], 4));
-        case 5: return std::to_string(readBigEndianSigned(&buf[start], 6));
-        case 6: return std::to_string(readBigEndianSigned(&buf[start], 8));
-        case 7: {
-            uint64_t u = 0;
-            for (size_t i = 0; i < 8; ++i) u = (u << 8) | buf[start + i];
-            double d;
-            std::memcpy(&d, &u, sizeof(double));
-            return std::to_string(d);
-        }
-        case 8: return "0";
-        case 9: return "1";
-        default: {
-            if (serial_type_code >= 12 && (serial_type_code % 2) == 1) {
-                return std::string(reinterpret_cast<const char*>(&buf[start]), len);
-            } else {
-                return std::string(reinterpret_cast<const char*>(&buf[start]), len);
-            }
-        }
-    }
-}
-
-static std::unordered_map<uint32_t, std::vector<unsigned char>> g_pageCache;
-
-static const std::vector<unsigned char>& getPage(std::ifstream& file, unsigned short page_size, uint32_t page_number) {
-    auto it = g_pageCache.find(page_number);
-    if (it != g_pageCache.end()) return it->second;
-    std::vector<unsigned char> page(page_size);
-    std::streamoff offset = static_cast<std::streamoff>((static_cast<uint64_t>(page_number) - 1) * static_cast<uint64_t>(page_size));
-    file.seekg(offset);
-    file.read(reinterpret_cast<char*>(page.data()), page.size());
-    auto res = g_pageCache.emplace(page_number, std::move(page));
-    return res.first->second;
-}
-
-static size_t headerOffsetFor(uint32_t page_number) {
-    return (page_number == 1 ? 100 : 0);
-}
-
-static uint16_t readBE16(const std::vector<unsigned char>& p, size_t pos) {
-    return static_cast<uint16_t>((p[pos] << 8) | p[pos + 1]);
-}
-
-static uint32_t readBE32(const std::vector<unsigned char>& p, size_t pos) {
-    return (static_cast<uint32_t>(p[pos]) << 24) | (static_cast<uint32_t>(p[pos + 1]) << 16) | (static_cast<uint32_t>(p[pos + 2]) << 8) | static_cast<uint32_t>(p[pos + 3]);
-}
-
-static uint64_t getLeafRowidAt(const std::vector<unsigned char>& page, size_t header_off, size_t cell_index) {
-    uint16_t num_cells = readBE16(page, header_off + 3);
-    size_t cell_ptr_array_off = header_off + 8;
-    size_t ptr_pos = cell_ptr_array_off + cell_index * 2;
-    uint16_t cell_off = readBE16(page, ptr_pos);
-    size_t p = cell_off;
+// Hands the row under the cursor to rows.
+static bool emitCursorRow(const TableCursor& cursor, Record& record, RowEmitter& rows) {
+    PageView page = cursor.leaf();
+    size_t p = cursor.cellOffset();
     auto pr = readVarint(page, p);
+    uint64_t payload_size = pr.first;
     p += pr.second;
     pr = readVarint(page, p);
-    return pr.first;
-}
-
-static int64_t lowerBoundLeafByRowid(const std::vector<unsigned char>& page, size_t header_off, uint64_t target_rowid) {
-    uint16_t num_cells = readBE16(page, header_off + 3);
-    int64_t lo = 0, hi = static_cast<int64_t>(num_cells) - 1, ans = num_cells;
-    while (lo <= hi) {
-        int64_t mid = (lo + hi) / 2;
-        uint64_t rid = getLeafRowidAt(page, header_off, static_cast<size_t>(mid));
-        if (rid >= target_rowid) {
-            ans = mid;
-            hi = mid - 1;
-        } else {
-            lo = mid + 1;
-        }
-    }
-    return ans;
+    p += pr.second;
+    if (!record.load(page, p, payload_size, false)) return false;
+    rows.addRow(&record, static_cast<int64_t>(pr.first));
+    return true;
 }
 
-static uint64_t getInteriorKeyAt(const std::vector<unsigned char>& page, size_t header_off, size_t cell_index) {
-    size_t cell_ptr_array_off = header_off + 12;
-    size_t ptr_pos = cell_ptr_array_off + cell_index * 2;
-    uint16_t cell_off = readBE16(page, ptr_pos);
-    size_t p = cell_off + 4;
-    auto pr = readVarint(page, p);
-    return pr.first;
-}
+// State one table traversal reuses from leaf to leaf.
+struct LeafScan {
+    LeafScan(Pager& pager, const std::vector<ColumnFilter>& filters) : record(pager), batch(pager, filters) {}
 
-static int64_t firstChildIntersectingRange(const std::vector<unsigned char>& page, size_t header_off, uint64_t min_rowid) {
-    uint16_t num_cells = readBE16(page, header_off + 3);
-    int64_t lo = 0, hi = static_cast<int64_t>(num_cells) - 1, ans = num_cells; 
-    while (lo <= hi) {
-        int64_t mid = (lo + hi) / 2;
-        uint64_t key = getInteriorKeyAt(page, header_off, static_cast<size_t>(mid));
-        if (min_rowid <= key) {
-            ans = mid;
-            hi = mid - 1;
-        } else {
-            lo = mid + 1;
-        }
-    }
-    return ans;
-}
+    Record record;
+    LeafBatch batch;
+    // Rows that pass the batch filters need no decoding: COUNT(*) with
+    // nothing else to check.
+    bool count_only = false;
+};
 
-static bool fetchRowByRowId(std::ifstream& database_file,
-                            unsigned short page_size,
-                            uint32_t page_number,
-                            uint64_t target_rowid,
-                            const std::vector<size_t>& target_col_indices,
-                            ssize_t rowid_alias_index) {
-    const auto& page = getPage(database_file, page_size, page_number);
+static void traverseTableBtree(Pager& pager, LeafScan& scan, uint32_t page_number, RowEmitter& rows) {
+    PageRef page = pager.page(page_number);
+    if (page.empty()) return;
     size_t header_offset = headerOffsetFor(page_number);
     unsigned char flags = page[header_offset + 0];
-    
     if (flags == 0x05) {
-        unsigned short num_cells = static_cast<unsigned short>((page[header_offset + 3] << 8) | page[header_offset + 4]);
-        size_t cell_ptr_array_offset = header_offset + 12;
-        
-        for (unsigned short i = 0; i < num_cells; ++i) {
-            size_t ptr_pos = cell_ptr_array_offset + (i * 2);
-            unsigned short cell_offset = static_cast<unsigned short>((page[ptr_pos] << 8) | page[ptr_pos + 1]);
-            uint32_t left_child = (static_cast<uint32_t>(page[cell_offset + 0]) << 24) | (static_cast<uint32_t>(page[cell_offset + 1]) << 16) | (static_cast<uint32_t>(page[cell_offset + 2]) << 8) | static_cast<uint32_t>(page[cell_offset + 3]);
-            size_t p = cell_offset + 4;
-            auto pr = readVarint(page, p);
-            uint64_t key_rowid = pr.first;
-            
-            if (target_rowid <= key_rowid) {
-                return fetchRowByRowId(database_file, page_size, left_child, target_rowid, target_col_indices, rowid_alias_index);
-            }
+        unsigned short num_cells = readBE16(page, header_offset + 3);
+        for (size_t i = 0; i <= num_cells && !rows.done(); ++i) {
+            readAheadChildren(pager, page, header_offset, i);
+            uint32_t child = interiorChildAt(page, header_offset, i);
+            traverseTableBtree(pager, scan, child, rows);
         }
-        
-        uint32_t right_child = (static_cast<uint32_t>(page[header_offset + 8]) << 24) | (static_cast<uint32_t>(page[header_offset + 9]) << 16) | (static_cast<uint32_t>(page[header_offset + 10]) << 8) | static_cast<uint32_t>(page[header_offset + 11]);
-        return fetchRowByRowId(database_file, page_size, right_child, target_rowid, target_col_indices, rowid_alias_index);
-        
-    } else if (flags == 0x0D) {
-        unsigned short num_cells = static_cast<unsigned short>((page[header_offset + 3] << 8) | page[header_offset + 4]);
-        size_t btree_header_size = 8;
-        size_t cell_ptr_array_offset = header_offset + btree_header_size;
-        
-        for (unsigned short i = 0; i < num_cells; ++i) {
-            size_t ptr_pos = cell_ptr_array_offset + (i * 2);
-            unsigned short cell_offset = static_cast<unsigned short>((page[ptr_pos] << 8) | page[ptr_pos + 1]);
-            size_t p = cell_offset;
-            auto pr = readVarint(page, p);
-            p += pr.second;
-            pr = readVarint(page, p);
-            uint64_t rowid_value = pr.first;
-            p += pr.second;
-            
-            if (rowid_value == target_rowid) {
-                size_t record_start = p;
-                pr = readVarint(page, record_start);
-                uint64_t header_size = pr.first;
-                size_t header_size_len = pr.second;
-                size_t header_varints_pos = record_start + header_size_len;
-                size_t header_end = record_start + static_cast<size_t>(header_size);
-                
-                std::vector<uint64_t> serial_types;
-                size_t hp = header_varints_pos;
-                while (hp < header_end) {
-                    auto stp = readVarint(page, hp);
-                    serial_types.push_back(stp.first);
-                    hp += stp.second;
-                }
-                
-                std::vector<size_t> col_lengths(serial_types.size());
-                for (size_t k = 0; k < serial_types.size(); ++k) col_lengths[k] = serialTypePayloadLength(serial_types[k]);
-                
-                std::vector<size_t> col_offsets(serial_types.size());
-                size_t acc = 0;
-                for (size_t k = 0; k < serial_types.size(); ++k) { 
-                    col_offsets[k] = acc; 
-                    acc += col_lengths[k]; 
-                }
-                
-                size_t body_pos = header_end;
-                for (size_t j = 0; j < target_col_indices.size(); ++j) {
-                    size_t col_idx = target_col_indices[j];
-                    std::string out;
-                    if (static_cast<ssize_t>(col_idx) == rowid_alias_index) {
-                        out = std::to_string(static_cast<long long>(rowid_value));
-                    } else {
-                        size_t start = body_pos + (col_idx < col_offsets.size() ? col_offsets[col_idx] : 0);
-                        size_t len = (col_idx < col_lengths.size() ? col_lengths[col_idx] : 0);
-                        out = decodeValueToString(page, start, col_idx < serial_types.size() ? serial_types[col_idx] : 0, len);
-                    }
-                    if (j > 0) std::cout << '|';
-                    std::cout << out;
-                }
-                std::cout << std::endl;
-                return true;
-            }
-        }
-        return false;
-    } else {
-        return false;
+        return;
+    } else if (flags != 0x0D) {
+        return;
+    }
+    LeafBatch& batch = scan.batch;
+    batch.load(page, header_offset);
+    if (QueryProfile* profile = pager.profile()) profile->addRowsExamined(batch.size());
+    if (scan.count_only) {
+        rows.addMatches(batch.selection().size());
+        return;
+    }
+    for (uint16_t cell : batch.selection()) {
+        if (rows.done()) break;
+        if (batch.loadRecord(cell, scan.record)) rows.addRow(&scan.record, batch.rowid(cell));
     }
 }
 
+struct QueryOptions {
+    size_t threads = 1;
+    bool ordered_output = true;
+    // Bounds both sorting and the hash table of a hash join.
+    size_t sort_memory = SortOptions{}.memory_budget;
+    // Wait for each write to reach the disk before answering. A batch of
+    // statements turns this off and syncs once at the end.
+    bool sync_commits = true;
+};
 
-
-static void traverseTableBtree(std::ifstream& database_file,
-                               unsigned short page_size,
-                               uint32_t page_number,
-                               const std::vector<std::string>& column_names,
-                               const std::vector<size_t>& target_col_indices,
-                               bool has_where,
-                               size_t where_col_idx,
-                               const std::string& where_value,
-                               ssize_t rowid_alias_index) {
-    std::vector<unsigned char> page(page_size);
-    std::streamoff offset = static_cast<std::streamoff>((static_cast<uint64_t>(page_number) - 1) * static_cast<uint64_t>(page_size));
-    database_file.seekg(offset);
-    database_file.read(reinterpret_cast<char*>(page.data()), page.size());
-    size_t header_offset = (page_number == 1 ? 100 : 0);
-    unsigned char flags = page[header_offset + 0];
-    if (flags == 0x05) {
-        unsigned short num_cells = static_cast<unsigned short>((page[header_offset + 3] << 8) | page[header_offset + 4]);
-        size_t cell_ptr_array_offset = header_offset + 12;
-        for (unsigned short i = 0; i < num_cells; ++i) {
-            size_t ptr_pos = cell_ptr_array_offset + (i * 2);
-            unsigned short cell_offset = static_cast<unsigned short>((page[ptr_pos] << 8) | page[ptr_pos + 1]);
-            uint32_t left_child = (static_cast<uint32_t>(page[cell_offset + 0]) << 24) | (static_cast<uint32_t>(page[cell_offset + 1]) << 16) | (static_cast<uint32_t>(page[cell_offset + 2]) << 8) | static_cast<uint32_t>(page[cell_offset + 3]);
-            traverseTableBtree(database_file, page_size, left_child, column_names, target_col_indices, has_where, where_col_idx, where_value, rowid_alias_index);
-        }
-        uint32_t right_child = (static_cast<uint32_t>(page[header_offset + 8]) << 24) | (static_cast<uint32_t>(page[header_offset + 9]) << 16) | (static_cast<uint32_t>(page[header_offset + 10]) << 8) | static_cast<uint32_t>(page[header_offset + 11]);
-        traverseTableBtree(database_file, page_size, right_child, column_names, target_col_indices, has_where, where_col_idx, where_value, rowid_alias_index);
-        return;
-    } else if (flags != 0x0D) {
-        return;
+// Rows go to out; error messages go to err. Reads one snapshot of the
+// database throughout, even while a writer commits.
+static int runSelect(Pager& pager, const Catalog& catalog, SelectStatement& statement, const QueryOptions& query_options, ResultSink& out, std::ostream& err) {
+    Pager::ReadScope snapshot(pager);
+    QueryProfile* profile = pager.profile();
+    std::string error;
+    QueryProfile::PhaseTimer schema_timer(profile, QueryProfile::Phase::Schema);
+    BoundSelect query;
+    if (!bindSelect(statement, catalog, query, error)) {
+        err << "Error: " << error << std::endl;
+        return 1;
     }
-    unsigned short num_cells = static_cast<unsigned short>((page[header_offset + 3] << 8) | page[header_offset + 4]);
-    size_t btree_header_size = 8;
-    size_t cell_ptr_array_offset = header_offset + btree_header_size;
-    for (unsigned short i = 0; i < num_cells; ++i) {
-        size_t ptr_pos = cell_ptr_array_offset + (i * 2);
-        unsigned short cell_offset = static_cast<unsigned short>((page[ptr_pos] << 8) | page[ptr_pos + 1]);
-        size_t p = cell_offset;
-        auto pr = readVarint(page, p);
-        uint64_t payload_size = pr.first;
-        p += pr.second;
-        pr = readVarint(page, p);
-        uint64_t rowid_value = pr.first;
-        p += pr.second;
-        size_t record_start = p;
-        pr = readVarint(page, record_start);
-        uint64_t header_size = pr.first;
-        size_t header_size_len = pr.second;
-        size_t header_varints_pos = record_start + header_size_len;
-        size_t header_end = record_start + static_cast<size_t>(header_size);
-        std::vector<uint64_t> serial_types;
-        size_t hp = header_varints_pos;
-        while (hp < header_end) {
-            auto stp = readVarint(page, hp);
-            serial_types.push_back(stp.first);
-            hp += stp.second;
-        }
-        std::vector<size_t> col_lengths(serial_types.size());
-        for (size_t k = 0; k < serial_types.size(); ++k) col_lengths[k] = serialTypePayloadLength(serial_types[k]);
-        std::vector<size_t> col_offsets(serial_types.size());
-        size_t acc = 0;
-        for (size_t k = 0; k < serial_types.size(); ++k) { col_offsets[k] = acc; acc += col_lengths[k]; }
-        size_t body_pos = header_end;
-        if (has_where) {
-            if (where_col_idx == static_cast<size_t>(rowid_alias_index)) {
-                std::string wval = std::to_string(static_cast<long long>(rowid_value));
-                if (wval != where_value) continue;
-            } else {
-                if (where_col_idx >= col_offsets.size()) continue;
-                size_t w_start = body_pos + col_offsets[where_col_idx];
-                size_t w_len = col_lengths[where_col_idx];
-                std::string wval = decodeValueToString(page, w_start, serial_types[where_col_idx], w_len);
-                if (wval != where_value) continue;
+    const TableInfo* table = query.table;
+    if (table == nullptr || table->root_page == 0) {
+        // No FROM clause: one row of constants
+        RowEmitter rows(query, query.where, out);
+        if (table == nullptr) rows.addRow(nullptr, 0);
+        rows.finish();
+        return 0;
+    }
+    if (query.joined()) {
+        std::vector<JoinPlan> candidates;
+        JoinPlan plan = planJoin(pager, catalog, query, query_options.sort_memory, statement.explain ? &candidates : nullptr);
+        if (statement.explain) {
+            for (const JoinPlan& candidate : candidates) {
+                bool chosen = candidate.kind == plan.kind && candidate.inner == plan.inner && candidate.index == plan.index;
+                std::string description = candidate.describe(query);
+                out.beginRow();
+                out.addValue(Value::makeText(reinterpret_cast<const unsigned char*>("*"), chosen ? 1 : 0));
+                out.addValue(Value::makeText(reinterpret_cast<const unsigned char*>(description.data()), description.size()));
+                out.addValue(Value::makeInteger(std::llround(candidate.estimated_rows)));
+                out.addValue(Value::makeReal(std::round(candidate.cost * 10) / 10));
+                out.endRow();
             }
+            return 0;
         }
-        for (size_t j = 0; j < target_col_indices.size(); ++j) {
-            size_t col_idx = target_col_indices[j];
-            std::string out;
-            if (static_cast<ssize_t>(col_idx) == rowid_alias_index) {
-                out = std::to_string(static_cast<long long>(rowid_value));
-            } else {
-                size_t start = body_pos + (col_idx < col_offsets.size() ? col_offsets[col_idx] : 0);
-                size_t len = (col_idx < col_lengths.size() ? col_lengths[col_idx] : 0);
-                out = decodeValueToString(page, start, col_idx < serial_types.size() ? serial_types[col_idx] : 0, len);
+        schema_timer.stop();
+        SortOptions sort_options;
+        sort_options.memory_budget = query_options.sort_memory;
+        RowEmitter rows(query, plan.residual, out, sort_options);
+        if (profile != nullptr) profile->setAccessPath(plan.describe(query));
+        QueryProfile::PhaseTimer fetch_timer(profile, QueryProfile::Phase::RowFetch);
+        runJoin(pager, query, plan, rows, query_options.sort_memory);
+        rows.finish();
+        return 0;
+    }
+    uint32_t table_rootpage = table->root_page;
+    std::vector<AccessPath> candidates;
+    AccessPath path = planAccess(pager, catalog, query, statement.explain ? &candidates : nullptr);
+    if (statement.explain) {
+        for (const AccessPath& candidate : candidates) {
+            // chosen|description|estimated rows|cost
+            bool chosen = candidate.kind == path.kind && candidate.index == path.index;
+            std::string description = candidate.describe(*table);
+            out.beginRow();
+            out.addValue(Value::makeText(reinterpret_cast<const unsigned char*>("*"), chosen ? 1 : 0));
+            out.addValue(Value::makeText(reinterpret_cast<const unsigned char*>(description.data()), description.size()));
+            out.addValue(Value::makeInteger(std::llround(candidate.estimated_rows)));
+            out.addValue(Value::makeReal(std::round(candidate.cost * 10) / 10));
+            out.endRow();
+        }
+        return 0;
+    }
+    const Expr* residual = path.residual;
+    const IndexInfo* index = path.index;
+    uint32_t index_rootpage = index != nullptr ? index->root_page : 0;
+    schema_timer.stop();
+    QueryProfile::TreeScope table_scope(table_rootpage);
+    if (profile != nullptr) {
+        profile->nameTree(table_rootpage, table->name);
+        if (index != nullptr) profile->nameTree(index_rootpage, index->name);
+    }
+    SortOptions sort_options;
+    sort_options.presorted = !path.needs_sort;
+    sort_options.memory_budget = query_options.sort_memory;
+    RowEmitter rows(query, residual, out, sort_options);
+    if (profile != nullptr) profile->setAccessPath(path.describe(*table));
+    if (path.isRowid()) {
+        // Rowid or INTEGER PRIMARY KEY: seek the table B-tree to the lower bound and stop after the upper one
+        QueryProfile::PhaseTimer fetch_timer(profile, QueryProfile::Phase::RowFetch);
+        uint64_t row_count = 0;
+        if (path.min_rowid <= path.max_rowid) {
+            TableCursor cursor(pager, table_rootpage);
+            Record record(pager);
+            for (bool ok = cursor.seekAtLeast(path.min_rowid); ok && cursor.rowid() <= path.max_rowid && !rows.done(); ok = cursor.next()) {
+                ++row_count;
+                if (query.is_count && residual == nullptr) rows.addMatches(1);
+                else emitCursorRow(cursor, record, rows);
             }
-            if (j > 0) std::cout << '|';
-            std::cout << out;
         }
-        std::cout << std::endl;
+        if (profile != nullptr) profile->addRowsExamined(row_count);
+        rows.finish();
+        return 0;
+    }
+    if (path.isIndex()) {
+        // Stream the index entries from the lower bound to the first one past
+        // the upper bound. Each match goes out as soon as it is found: from the
+        // entry itself for a covering index, otherwise after a table lookup by
+        // its rowid, so LIMIT can stop the scan early.
+        const KeyRange& key = path.key;
+        if (path.covering) rows.readFromIndex(*index, *table);
+        IndexCursor entries(pager, index_rootpage);
+        TableCursor table_cursor(pager, table_rootpage);
+        Record record(pager);
+        uint64_t entries_examined = 0;
+        uint64_t rows_fetched = 0;
+        auto step = [&](bool first) {
+            QueryProfile::TreeScope index_scope(index_rootpage);
+            return first ? entries.seek(key) : entries.next();
+        };
+        QueryProfile::PhaseTimer scan_timer(profile, path.covering ? QueryProfile::Phase::IndexProbe : QueryProfile::Phase::RowFetch);
+        for (bool ok = step(true); ok && !rows.done(); ok = step(false)) {
+            Record& entry = entries.record();
+            ++entries_examined;
+            if (!key.belowUpper(entry)) break;
+            if (!key.matches(entry)) continue;
+            if (path.covering) rows.addRow(&entry, entries.rowid());
+            else if (table_cursor.seek(entries.rowid()) && emitCursorRow(table_cursor, record, rows)) ++rows_fetched;
+        }
+        if (profile != nullptr) {
+            profile->addIndexEntriesExamined(entries_examined);
+            profile->addRowsExamined(rows_fetched);
+        }
+        rows.finish();
+        return 0;
     }
+    QueryProfile::PhaseTimer fetch_timer(profile, QueryProfile::Phase::RowFetch);
+    bool count_only = query.is_count && residual == nullptr;
+    if (query_options.threads > 1 && query.aggregated()) {
+        // Each subtree is folded into groups of its own, merged in table order
+        // once all are done so that bare columns come from the rows a serial
+        // scan would keep
+        std::vector<uint32_t> subtrees = partitionBtree(pager, table_rootpage, query_options.threads * 4);
+        SortOptions partial_options;
+        partial_options.presorted = true;
+        std::vector<std::unique_ptr<LeafScan>> scans;
+        std::vector<std::unique_ptr<RowEmitter>> partials;
+        for (size_t w = 0; w < query_options.threads; ++w) scans.push_back(std::make_unique<LeafScan>(pager, path.filters));
+        for (size_t task = 0; task < subtrees.size(); ++task) partials.push_back(std::make_unique<RowEmitter>(query, residual, out, partial_options));
+        if (profile != nullptr) profile->setAccessPath("parallel " + path.describe(*table) + " on " + std::to_string(query_options.threads) + " threads");
+        runWorkStealing(subtrees.size(), query_options.threads, [&](size_t task, size_t worker) {
+            QueryProfile::TreeScope subtree_scope(table_rootpage);
+            traverseTableBtree(pager, *scans[worker], subtrees[task], *partials[task]);
+        });
+        for (const std::unique_ptr<RowEmitter>& partial : partials) rows.mergeGroups(*partial);
+        rows.finish();
+        return 0;
+    }
+    // Sorted or limited output needs every row in one place, so only plain scans go parallel
+    if (query_options.threads > 1 && !query.sorted() && query.limit < 0 && query.offset == 0) {
+        // Each subtree is scanned with its own Record into its own buffer
+        ParallelScanOptions scan_options;
+        scan_options.threads = query_options.threads;
+        scan_options.ordered = query_options.ordered_output;
+        if (profile != nullptr) profile->setAccessPath("parallel full scan of " + table->name + " on " + std::to_string(query_options.threads) + " threads");
+        uint64_t row_count = parallelScan(pager, table_rootpage, scan_options,
+            [&](uint32_t subtree, ResultSink& subtree_out, uint64_t& count) {
+                LeafScan subtree_scan(pager, path.filters);
+                subtree_scan.count_only = count_only;
+                RowEmitter subtree_rows(query, residual, subtree_out);
+                QueryProfile::TreeScope subtree_scope(table_rootpage);
+                traverseTableBtree(pager, subtree_scan, subtree, subtree_rows);
+                count += subtree_rows.matches();
+            }, out);
+        rows.addMatches(row_count);
+        rows.finish();
+        return 0;
+    }
+    if (query.is_count && query.where == nullptr) {
+        if (profile != nullptr) profile->setAccessPath("leaf cell count of " + table->name);
+        uint64_t row_count = countTableRows(pager, table_rootpage);
+        if (profile != nullptr) profile->addRowsExamined(row_count);
+        rows.addMatches(row_count);
+        rows.finish();
+        return 0;
+    }
+    LeafScan scan(pager, path.filters);
+    scan.count_only = count_only;
+    traverseTableBtree(pager, scan, table_rootpage, rows);
+    rows.finish();
+    return 0;
 }
 
-int main(int argc, char* argv[]) {
-    std::cout << std::unitbuf;
-    std::cerr << std::unitbuf;
-    std::cerr << "Logs from your program will appear here" << std::endl;
-    if (argc != 3) {
-        std::cerr << "Expected two arguments" << std::endl;
-        return 1;
-    }
-    std::string database_file_path = argv[1];
-    std::string command = argv[2];
-    std::string command_upper = to_upper(command);
+// Rows go to out; error messages go to err.
+static int runCommand(Pager& pager, const Catalog& catalog, const std::string& command, const QueryOptions& query_options, ResultSink& out, std::ostream& err) {
     if (command == ".dbinfo") {
-        std::ifstream database_file(database_file_path, std::ios::binary);
-        if (!database_file) {
-            std::cerr << "Failed to open the database file" << std::endl;
-            return 1;
-        }
-        database_file.seekg(16);
-        char buffer[2];
-        database_file.read(buffer, 2);
-        unsigned short page_size = (static_cast<unsigned char>(buffer[1]) | (static_cast<unsigned char>(buffer[0]) << 8));
-        std::cout << "database page size: " << page_size << std::endl;
-        database_file.seekg(100 + 3);
-        char cell_count_bytes[2];
-        database_file.read(cell_count_bytes, 2);
-        unsigned short number_of_tables = (static_cast<unsigned char>(cell_count_bytes[1]) |
-                                           (static_cast<unsigned char>(cell_count_bytes[0]) << 8));
-        std::cout << "number of tables: " << number_of_tables << std::endl;
+        out.writeRaw("database page size: " + std::to_string(pager.pageSize()) + "\n");
+        out.writeRaw("number of tables: " + std::to_string(catalog.tables().size()) + "\n");
     } else if (command == ".tables") {
-        std::ifstream database_file(database_file_path, std::ios::binary);
-        if (!database_file) {
-            std::cerr << "Failed to open the database file" << std::endl;
+        // Like the shell, internal sqlite_ tables are not listed
+        bool first = true;
+        for (const TableInfo& table : catalog.tables()) {
+            if (to_upper(table.name).rfind("SQLITE_", 0) == 0) continue;
+            if (!first) out.writeRaw(" ");
+            out.writeRaw(table.name);
+            first = false;
+        }
+        out.writeRaw("\n");
+    } else if (isModification(command)) {
+        ModifyStatement statement;
+        std::string error;
+        if (!parseModification(command, statement, error)) {
+            err << "Error: " << error << std::endl;
             return 1;
         }
-        database_file.seekg(16);
-        char ps_bytes[2];
-        database_file.read(ps_bytes, 2);
-        unsigned short page_size = (static_cast<unsigned char>(ps_bytes[1]) | (static_cast<unsigned char>(ps_bytes[0]) << 8));
-        database_file.seekg(0);
-        std::vector<unsigned char> page(page_size);
-        database_file.read(reinterpret_cast<char*>(page.data()), page.size());
-        unsigned char flags = page[100];
-        size_t btree_header_size = (flags == 0x0D) ? 8 : ((flags == 0x05) ? 12 : 8);
-        unsigned short num_cells = static_cast<unsigned short>((page[100 + 3] << 8) | page[100 + 4]);
-        size_t cell_ptr_array_offset = 100 + btree_header_size;
-        std::vector<std::string> table_names;
-        table_names.reserve(num_cells);
-        for (unsigned short i = 0; i < num_cells; ++i) {
-            size_t ptr_pos = cell_ptr_array_offset + (i * 2);
-            unsigned short cell_offset = static_cast<unsigned short>((page[ptr_pos] << 8) | page[ptr_pos + 1]);
-            size_t p = cell_offset;
-            auto pr = readVarint(page, p);
-            p += pr.second;
-            pr = readVarint(page, p);
-            p += pr.second;
-            size_t record_start = p;
-            pr = readVarint(page, record_start);
-            uint64_t header_size = pr.first;
-            size_t header_size_len = pr.second;
-            size_t header_varints_pos = record_start + header_size_len;
-            size_t header_end = record_start + static_cast<size_t>(header_size);
-            std::vector<uint64_t> serial_types;
-            size_t hp = header_varints_pos;
-            while (hp < header_end) {
-                auto stp = readVarint(page, hp);
-                serial_types.push_back(stp.first);
-                hp += stp.second;
-            }
-            size_t body_pos = header_end;
-            size_t target_index = 2;
-            size_t body_offset = 0;
-            for (size_t col_index = 0; col_index < target_index && col_index < serial_types.size(); ++col_index) {
-                body_offset += serialTypePayloadLength(serial_types[col_index]);
-            }
-            uint64_t tbl_name_serial_type = (target_index < serial_types.size()) ? serial_types[target_index] : 0;
-            size_t tbl_name_len = serialTypePayloadLength(tbl_name_serial_type);
-            std::string tbl_name;
-            tbl_name.reserve(tbl_name_len);
-            size_t tbl_name_start = body_pos + body_offset;
-            for (size_t j = 0; j < tbl_name_len; ++j) {
-                tbl_name.push_back(static_cast<char>(page[tbl_name_start + j]));
-            }
-            table_names.push_back(tbl_name);
-        }
-        for (size_t i = 0; i < table_names.size(); ++i) {
-            if (i > 0) std::cout << " ";
-            std::cout << table_names[i];
-        }
-        std::cout << std::endl;
-    } else if (command_upper.rfind("SELECT", 0) == 0) {
-        std::vector<std::string> tokens;
-        {
-            std::string cur;
-            for (char c : command) {
-                if (std::isspace(static_cast<unsigned char>(c))) {
-                    if (!cur.empty()) { tokens.push_back(cur); cur.clear(); }
-                } else {
-                    cur.push_back(c);
-                }
-            }
-            if (!cur.empty()) tokens.push_back(cur);
-        }
-        if (tokens.size() < 4) {
-            std::cout << std::endl;
-            return 0;
-        }
-        size_t from_index = std::string::npos;
-        for (size_t i = 0; i < tokens.size(); ++i) {
-            if (to_upper(tokens[i]) == "FROM") { from_index = i; break; }
-        }
-        if (from_index == std::string::npos || from_index >= tokens.size() - 1) {
-            std::cout << std::endl;
-            return 0;
-        }
-        std::string select_list_str;
-        for (size_t i = 1; i < from_index; ++i) {
-            if (!select_list_str.empty()) select_list_str.push_back(' ');
-            select_list_str += tokens[i];
-        }
-        std::vector<std::string> select_cols_upper;
-        {
-            std::string cur;
-            for (char c : select_list_str) {
-                if (c == ',') {
-                    std::string part = trim(cur);
-                    if (!part.empty()) select_cols_upper.push_back(to_upper(part));
-                    cur.clear();
-                } else {
-                    cur.push_back(c);
-                }
-            }
-            std::string last = trim(cur);
-            if (!last.empty()) select_cols_upper.push_back(to_upper(last));
-        }
-        std::string table_name = rstrip_semicolon(tokens[from_index + 1]);
-        bool has_where = false;
-        std::string where_col_upper;
-        std::string where_value;
-        size_t where_pos_ci = to_upper(command).find("WHERE");
-        if (where_pos_ci != std::string::npos) {
-            size_t i2 = where_pos_ci + 5;
-            while (i2 < command.size() && std::isspace(static_cast<unsigned char>(command[i2]))) ++i2;
-            size_t col_start = i2;
-            while (i2 < command.size() && command[i2] != '=' && !std::isspace(static_cast<unsigned char>(command[i2]))) ++i2;
-            std::string col_tok = command.substr(col_start, i2 - col_start);
-            while (i2 < command.size() && std::isspace(static_cast<unsigned char>(command[i2]))) ++i2;
-            if (i2 < command.size() && command[i2] == '=') ++i2;
-            while (i2 < command.size() && std::isspace(static_cast<unsigned char>(command[i2]))) ++i2;
-            std::string val_tok;
-            if (i2 < command.size() && (command[i2] == '\'' || command[i2] == '"')) {
-                char q = command[i2++];
-                size_t start = i2;
-                while (i2 < command.size() && command[i2] != q) ++i2;
-                val_tok = command.substr(start, i2 - start);
-            } else {
-                size_t start = i2;
-                while (i2 < command.size() && !std::isspace(static_cast<unsigned char>(command[i2])) && command[i2] != ';') ++i2;
-                val_tok = command.substr(start, i2 - start);
-            }
-            where_col_upper = to_upper(col_tok);
-            where_value = val_tok;
-            has_where = true;
-        }
-        bool is_count = (select_cols_upper.size() == 1 && select_cols_upper[0] == "COUNT(*)");
-        std::ifstream database_file(database_file_path, std::ios::binary);
-        if (!database_file) {
-            std::cerr << "Failed to open the database file" << std::endl;
+        // The rows come back as values, which a parallel scan cannot merge
+        QueryOptions select_options = query_options;
+        select_options.threads = 1;
+        SelectRunner select = [&](SelectStatement& query, ResultSink& rows, std::ostream& select_err) {
+            return runSelect(pager, catalog, query, select_options, rows, select_err);
+        };
+        uint64_t sequence = 0;
+        if (runModification(pager, catalog, statement, select, sequence, err) != 0) return 1;
+        if (query_options.sync_commits && !pager.sync(sequence)) {
+            err << "Error: disk I/O error" << std::endl;
             return 1;
         }
-        database_file.seekg(16);
-        char ps_bytes[2];
-        database_file.read(ps_bytes, 2);
-        unsigned short page_size = (static_cast<unsigned char>(ps_bytes[1]) | (static_cast<unsigned char>(ps_bytes[0]) << 8));
-        database_file.seekg(0);
-        std::vector<unsigned char> schema_page(page_size);
-        database_file.read(reinterpret_cast<char*>(schema_page.data()), schema_page.size());
-        unsigned char flags = schema_page[100];
-        size_t btree_header_size = (flags == 0x0D) ? 8 : ((flags == 0x05) ? 12 : 8);
-        unsigned short num_cells = static_cast<unsigned short>((schema_page[100 + 3] << 8) | schema_page[100 + 4]);
-        size_t cell_ptr_array_offset = 100 + btree_header_size;
-        uint64_t table_rootpage = 0;
-        std::string create_sql;
-        for (unsigned short i = 0; i < num_cells; ++i) {
-            size_t ptr_pos = cell_ptr_array_offset + (i * 2);
-            unsigned short cell_offset = static_cast<unsigned short>((schema_page[ptr_pos] << 8) | schema_page[ptr_pos + 1]);
-            size_t p = cell_offset;
-            auto pr = readVarint(schema_page, p);
-            p += pr.second;
-            pr = readVarint(schema_page, p);
-            p += pr.second;
-            size_t record_start = p;
-            pr = readVarint(schema_page, record_start);
-            uint64_t header_size = pr.first;
-            size_t header_size_len = pr.second;
-            size_t header_varints_pos = record_start + header_size_len;
-            size_t header_end = record_start + static_cast<size_t>(header_size);
-            std::vector<uint64_t> serial_types;
-            size_t hp = header_varints_pos;
-            while (hp < header_end) {
-                auto stp = readVarint(schema_page, hp);
-                serial_types.push_back(stp.first);
-                hp += stp.second;
-            }
-            size_t body_pos = header_end;
-            size_t type_index = 0;
-            size_t name_index = 1;
-            size_t tbl_index = 2;
-            size_t root_index = 3;
-            size_t sql_index = 4;
-            size_t off = 0;
-            for (size_t col_index = 0; col_index < type_index && col_index < serial_types.size(); ++col_index) off += serialTypePayloadLength(serial_types[col_index]);
-            size_t type_len = serialTypePayloadLength(serial_types.size() > type_index ? serial_types[type_index] : 0);
-            std::string typ;
-            typ.reserve(type_len);
-            size_t type_start = body_pos + off;
-            for (size_t j = 0; j < type_len; ++j) typ.push_back(static_cast<char>(schema_page[type_start + j]));
-            off = 0;
-            for (size_t col_index = 0; col_index < tbl_index && col_index < serial_types.size(); ++col_index) off += serialTypePayloadLength(serial_types[col_index]);
-            size_t tbl_len = serialTypePayloadLength(serial_types.size() > tbl_index ? serial_types[tbl_index] : 0);
-            std::string tbl;
-            tbl.reserve(tbl_len);
-            size_t tbl_start = body_pos + off;
-            for (size_t j = 0; j < tbl_len; ++j) tbl.push_back(static_cast<char>(schema_page[tbl_start + j]));
-            if (to_upper(typ) == "TABLE" && tbl == table_name) {
-                size_t off2 = 0;
-                for (size_t col_index = 0; col_index < root_index && col_index < serial_types.size(); ++col_index) off2 += serialTypePayloadLength(serial_types[col_index]);
-                size_t root_len = serialTypePayloadLength(serial_types.size() > root_index ? serial_types[root_index] : 0);
-                size_t root_start = body_pos + off2;
-                uint64_t root_val = 0;
-                for (size_t j = 0; j < root_len; ++j) root_val = (root_val << 8) | schema_page[root_start + j];
-                table_rootpage = root_val;
-                size_t off3 = 0;
-                for (size_t col_index = 0; col_index < sql_index && col_index < serial_types.size(); ++col_index) off3 += serialTypePayloadLength(serial_types[col_index]);
-                size_t sql_len = serialTypePayloadLength(serial_types.size() > sql_index ? serial_types[sql_index] : 0);
-                size_t sql_start = body_pos + off3;
-                create_sql.clear();
-                create_sql.reserve(sql_len);
-                for (size_t j = 0; j < sql_len; ++j) create_sql.push_back(static_cast<char>(schema_page[sql_start + j]));
-            }
-        }
-        if (table_rootpage == 0) {
-            if (is_count) { std::cout << 0 << std::endl; } else { std::cout << std::endl; }
-            return 0;
-        }
-        if (is_count) {
-            std::vector<unsigned char> table_page(page_size);
-            std::streamoff root_offset = static_cast<std::streamoff>((table_rootpage - 1) * static_cast<uint64_t>(page_size));
-            database_file.seekg(root_offset);
-            database_file.read(reinterpret_cast<char*>(table_page.data()), table_page.size());
-            size_t page_header_offset = (table_rootpage == 1 ? 100 : 0);
-            unsigned short row_count = static_cast<unsigned short>((table_page[page_header_offset + 3] << 8) | table_page[page_header_offset + 4]);
-            std::cout << row_count << std::endl;
-            return 0;
-        }
-        std::vector<std::string> column_names;
-        std::vector<std::string> column_defs_upper;
-        {
-            std::string sql = create_sql;
-            size_t lpar = sql.find('(');
-            size_t rpar = sql.rfind(')');
-            if (lpar != std::string::npos && rpar != std::string::npos && rpar > lpar) {
-                std::string cols = sql.substr(lpar + 1, rpar - lpar - 1);
-                std::string cur;
-                int paren_depth = 0;
-                for (char c : cols) {
-                    if (c == '(') { ++paren_depth; cur.push_back(c); }
-                    else if (c == ')') { --paren_depth; cur.push_back(c); }
-                    else if (c == ',' && paren_depth == 0) {
-                        std::string part = trim(cur);
-                        if (!part.empty()) {
-                            size_t sp = part.find_first_of(" \t\r\n");
-                            column_names.push_back(to_upper(trim(sp == std::string::npos ? part : part.substr(0, sp))));
-                            column_defs_upper.push_back(to_upper(part));
-                        }
-                        cur.clear();
-                    } else {
-                        cur.push_back(c);
-                    }
-                }
-                std::string last = trim(cur);
-                if (!last.empty()) {
-                    size_t sp = last.find_first_of(" \t\r\n");
-                    column_names.push_back(to_upper(trim(sp == std::string::npos ? last : last.substr(0, sp))));
-                    column_defs_upper.push_back(to_upper(last));
-                }
-            }
+    } else {
+        QueryProfile::PhaseTimer parse_timer(pager.profile(), QueryProfile::Phase::Parse);
+        SelectStatement statement;
+        std::string error;
+        if (!parseSelect(command, statement, error)) {
+            err << "Error: " << error << std::endl;
+            return 1;
         }
-        ssize_t rowid_alias_index = -1;
-        for (size_t i = 0; i < column_defs_upper.size(); ++i) {
-            const std::string& def = column_defs_upper[i];
-            if (def.find("PRIMARY KEY") != std::string::npos && (def.find("INTEGER") != std::string::npos || def.find(" INT") != std::string::npos)) {
-                rowid_alias_index = static_cast<ssize_t>(i);
-                break;
-            }
+        parse_timer.stop();
+        return runSelect(pager, catalog, statement, query_options, out, err);
+    }
+    return 0;
+}
+
+static void printUsage() {
+    std::cerr << "Usage: exe [options] <database> <command>" << std::endl;
+    std::cerr << "       exe [options] (-c <statements>)... [-f <script> | -f -] <database>" << std::endl;
+    std::cerr << "       exe [options] --serve <socket path | tcp:PORT> [--workers N] <database>" << std::endl;
+    std::cerr << "       exe --connect <socket path | tcp:PORT> [--timing] (-c <statements>)... [-f <script> | -f -]" << std::endl;
+    std::cerr << "       exe --load <input | -> --schema <CREATE TABLE ...; CREATE INDEX ...> [--input-format csv|binary] [--page-size N] [--sort-mb N] <new database>" << std::endl;
+    std::cerr << "Options: [--no-mmap] [--cache-pages N | --cache-mb N] [--cache-stats] [--readahead K] [--threads N [--unordered]]" << std::endl;
+    std::cerr << "         [--sort-mb N] [--profile | --profile-json] [--format pipe|csv|binary] [--timing]" << std::endl;
+}
+
+enum class ProfileOutput { None, Table, Json };
+
+// Settings that dot commands can change between statements of one session.
+struct SessionSettings {
+    ProfileOutput profile_output = ProfileOutput::None;
+    bool timing = false;
+};
+
+// Handles `.stats on|json|off` and `.timer on|off`; returns false for any
+// other statement.
+static bool applySessionCommand(const std::string& statement, SessionSettings& settings) {
+    std::string upper = to_upper(trim(statement));
+    if (upper == ".STATS ON") settings.profile_output = ProfileOutput::Table;
+    else if (upper == ".STATS JSON") settings.profile_output = ProfileOutput::Json;
+    else if (upper == ".STATS OFF") settings.profile_output = ProfileOutput::None;
+    else if (upper == ".TIMER ON") settings.timing = true;
+    else if (upper == ".TIMER OFF") settings.timing = false;
+    else return false;
+    return true;
+}
+
+static bool readScript(const std::string& path, std::string& script) {
+    if (path == "-") {
+        script.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+        return true;
+    }
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    script.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Runs the statements in order against one open database, so they share the
+// page cache and the catalog. A failing statement does not stop the rest; the
+// result is that of the last failure. Their writes share one sync at the end.
+static int runStatements(Pager& pager,
+                         const Catalog& catalog,
+                         const std::vector<std::string>& statements,
+                         const QueryOptions& query_options,
+                         SessionSettings settings,
+                         ResultSink& out) {
+    QueryOptions batch_options = query_options;
+    batch_options.sync_commits = false;
+    int rc = 0;
+    for (size_t n = 0; n < statements.size(); ++n) {
+        const std::string& statement = statements[n];
+        if (applySessionCommand(statement, settings)) continue;
+        QueryProfile profile;
+        bool profiling = settings.profile_output != ProfileOutput::None;
+        if (profiling) {
+            pager.setProfile(&profile);
+            out.setProfile(&profile);
+            profile.begin(pager);
+        }
+        auto start = std::chrono::steady_clock::now();
+        int statement_rc = runCommand(pager, catalog, statement, batch_options, out, std::cerr);
+        out.flush();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        if (statement_rc != 0) rc = statement_rc;
+        if (profiling) {
+            profile.finish(pager);
+            pager.setProfile(nullptr);
+            out.setProfile(nullptr);
+            if (settings.profile_output == ProfileOutput::Json) profile.printJson(std::cerr);
+            else profile.printTable(std::cerr);
+        }
+        if (settings.timing) {
+            char line[64];
+            std::snprintf(line, sizeof(line), "Run Time: statement %zu: %.3f ms", n + 1, std::chrono::duration<double, std::milli>(elapsed).count());
+            std::cerr << line << std::endl;
         }
-        std::vector<size_t> target_col_indices;
-        target_col_indices.reserve(select_cols_upper.size());
-        for (std::string col : select_cols_upper) {
-            if (!col.empty() && (col.front() == '"' || col.front() == '\'' || col.front() == '`')) {
-                if (col.size() >= 2) {
-                    col = col.substr(1, col.size() - 2);
-                    col = to_upper(col);
-                }
-            }
-            size_t idx = std::string::npos;
-            for (size_t i = 0; i < column_names.size(); ++i) {
-                if (column_names[i] == col) { idx = i; break; }
-            }
-            if (idx == std::string::npos) {
-                std::cout << std::endl;
-                return 0;
+    }
+    if (!pager.sync()) {
+        std::cerr << "Error: disk I/O error" << std::endl;
+        rc = 1;
+    }
+    return rc;
+}
+
+int main(int argc, char* argv[]) {
+    std::cerr << std::unitbuf;
+    std::cerr << "Logs from your program will appear here" << std::endl;
+    PagerOptions pager_options;
+    bool print_cache_stats = false;
+    SessionSettings settings;
+    QueryOptions query_options;
+    OutputFormat output_format = OutputFormat::Pipe;
+    std::vector<std::string> statements;
+    std::string script_path;
+    bool batch = false;
+    ServerOptions server_options;
+    std::string connect_address;
+    BulkLoadOptions load_options;
+    bool loading = false;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--no-mmap") {
+            pager_options.use_mmap = false;
+        } else if (arg == "--cache-stats") {
+            print_cache_stats = true;
+        } else if (arg == "--profile") {
+            settings.profile_output = ProfileOutput::Table;
+        } else if (arg == "--profile-json") {
+            settings.profile_output = ProfileOutput::Json;
+        } else if (arg == "--timing") {
+            settings.timing = true;
+        } else if (arg == "--unordered") {
+            query_options.ordered_output = false;
+        } else if (arg == "-c" && i + 1 < argc) {
+            for (std::string& statement : splitStatements(argv[++i])) statements.push_back(std::move(statement));
+            batch = true;
+        } else if ((arg == "-f" || arg == "--file") && i + 1 < argc) {
+            script_path = argv[++i];
+            batch = true;
+        } else if (arg == "--serve" && i + 1 < argc) {
+            server_options.address = argv[++i];
+        } else if (arg == "--connect" && i + 1 < argc) {
+            connect_address = argv[++i];
+        } else if (arg == "--format" && i + 1 < argc) {
+            if (!parseOutputFormat(argv[++i], output_format)) {
+                std::cerr << "Invalid value for " << arg << ": " << argv[i] << std::endl;
+                return 1;
             }
-            target_col_indices.push_back(idx);
-        }
-        size_t where_col_idx = std::string::npos;
-        if (has_where) {
-            for (size_t i = 0; i < column_names.size(); ++i) {
-                if (column_names[i] == where_col_upper) { where_col_idx = i; break; }
+        } else if (arg == "--load" && i + 1 < argc) {
+            load_options.input_path = argv[++i];
+            loading = true;
+        } else if (arg == "--schema" && i + 1 < argc) {
+            load_options.schema = argv[++i];
+        } else if (arg == "--input-format" && i + 1 < argc) {
+            if (!parseOutputFormat(argv[++i], load_options.input_format) || load_options.input_format == OutputFormat::Pipe) {
+                std::cerr << "Invalid value for " << arg << ": " << argv[i] << std::endl;
+                return 1;
             }
-            if (where_col_idx == std::string::npos) {
-                return 0;
+        } else if (arg == "--page-size" && i + 1 < argc) {
+            char* end = nullptr;
+            unsigned long long n = std::strtoull(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || n < 512 || n > 65536 || (n & (n - 1)) != 0) {
+                std::cerr << "Invalid value for " << arg << ": " << argv[i] << std::endl;
+                return 1;
             }
-        }
-        uint64_t index_rootpage = 0;
-        size_t index_col_count = 0;
-        for (unsigned short i = 0; i < num_cells; ++i) {
-            size_t ptr_pos = cell_ptr_array_offset + (i * 2);
-            unsigned short cell_offset = static_cast<unsigned short>((schema_page[ptr_pos] << 8) | schema_page[ptr_pos + 1]);
-            size_t p = cell_offset;
-            auto pr = readVarint(schema_page, p);
-            p += pr.second;
-            pr = readVarint(schema_page, p);
-            p += pr.second;
-            size_t record_start = p;
-            pr = readVarint(schema_page, record_start);
-            uint64_t header_size = pr.first;
-            size_t header_size_len = pr.second;
-            size_t header_varints_pos = record_start + header_size_len;
-            size_t header_end = record_start + static_cast<size_t>(header_size);
-            std::vector<uint64_t> serial_types;
-            size_t hp = header_varints_pos;
-            while (hp < header_end) {
-                auto stp = readVarint(schema_page, hp);
-                serial_types.push_back(stp.first);
-                hp += stp.second;
+            load_options.page_size = static_cast<uint32_t>(n);
+        } else if (arg == "--readahead" && i + 1 < argc) {
+            char* end = nullptr;
+            unsigned long long n = std::strtoull(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0') {
+                std::cerr << "Invalid value for " << arg << ": " << argv[i] << std::endl;
+                return 1;
             }
-            size_t body_pos = record_start + header_size;
-            size_t type_index = 0;
-            size_t name_index = 1;
-            size_t tbl_index = 2;
-            size_t root_index = 3;
-            size_t sql_index = 4;
-            size_t off0 = 0;
-            for (size_t col_index = 0; col_index < type_index && col_index < serial_types.size(); ++col_index) off0 += serialTypePayloadLength(serial_types[col_index]);
-            size_t type_len = serialTypePayloadLength(serial_types.size() > type_index ? serial_types[type_index] : 0);
-            std::string typ;
-            typ.reserve(type_len);
-            size_t type_start = body_pos + off0;
-            for (size_t j = 0; j < type_len; ++j) typ.push_back(static_cast<char>(schema_page[type_start + j]));
-            off0 = 0;
-            for (size_t col_index = 0; col_index < tbl_index && col_index < serial_types.size(); ++col_index) off0 += serialTypePayloadLength(serial_types[col_index]);
-            size_t tbl_len = serialTypePayloadLength(serial_types.size() > tbl_index ? serial_types[tbl_index] : 0);
-            std::string tbl2;
-            tbl2.reserve(tbl_len);
-            size_t tbl_start2 = body_pos + off0;
-            for (size_t j = 0; j < tbl_len; ++j) tbl2.push_back(static_cast<char>(schema_page[tbl_start2 + j]));
-            if (to_upper(typ) == "INDEX" && tbl2 == table_name) {
-                size_t off3 = 0;
-                for (size_t col_index = 0; col_index < sql_index && col_index < serial_types.size(); ++col_index) off3 += serialTypePayloadLength(serial_types[col_index]);
-                size_t sql_len = serialTypePayloadLength(serial_types.size() > sql_index ? serial_types[sql_index] : 0);
-                size_t sql_start = body_pos + off3;
-                std::string idx_sql;
-                idx_sql.reserve(sql_len);
-                for (size_t j = 0; j < sql_len; ++j) idx_sql.push_back(static_cast<char>(schema_page[sql_start + j]));
-                std::string idx_upper = to_upper(idx_sql);
-                size_t on_pos = idx_upper.find(" ON ");
-                size_t lpar = idx_upper.find('(', on_pos == std::string::npos ? 0 : on_pos);
-                size_t rpar = idx_upper.find(')', lpar == std::string::npos ? 0 : lpar);
-                if (lpar != std::string::npos && rpar != std::string::npos && rpar > lpar) {
-                    std::string cols = idx_upper.substr(lpar + 1, rpar - lpar - 1);
-                    std::vector<std::string> idx_cols;
-                    std::string curc;
-                    for (char c : cols) {
-                        if (c == ',') {
-                            std::string part = trim(curc);
-                            if (!part.empty()) {
-                                size_t sp = part.find_first_of(" \t\r\n");
-                                idx_cols.push_back(trim(sp == std::string::npos ? part : part.substr(0, sp)));
-                            }
-                            curc.clear();
-                        } else {
-                            curc.push_back(c);
-                        }
-                    }
-                    std::string lastc = trim(curc);
-                    if (!lastc.empty()) {
-                        size_t sp = lastc.find_first_of(" \t\r\n");
-                        idx_cols.push_back(trim(sp == std::string::npos ? lastc : lastc.substr(0, sp)));
-                    }
-                    if (!idx_cols.empty() && idx_cols[0] == where_col_upper) {
-                        size_t offr = 0;
-                        for (size_t col_index = 0; col_index < root_index && col_index < serial_types.size(); ++col_index) offr += serialTypePayloadLength(serial_types[col_index]);
-                        size_t root_len = serialTypePayloadLength(serial_types.size() > root_index ? serial_types[root_index] : 0);
-                        size_t root_start = body_pos + offr;
-                        uint64_t root_val = 0;
-                        for (size_t j = 0; j < root_len; ++j) root_val = (root_val << 8) | schema_page[root_start + j];
-                        index_rootpage = root_val;
-                        index_col_count = idx_cols.size();
-                        break;
-                    }
-                }
+            pager_options.read_ahead = static_cast<size_t>(n);
+        } else if ((arg == "--cache-pages" || arg == "--cache-mb" || arg == "--sort-mb" || arg == "--threads" || arg == "--workers") && i + 1 < argc) {
+            char* end = nullptr;
+            unsigned long long n = std::strtoull(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || n == 0) {
+                std::cerr << "Invalid value for " << arg << ": " << argv[i] << std::endl;
+                return 1;
             }
+            if (arg == "--cache-pages") pager_options.cache_pages = static_cast<size_t>(n);
+            else if (arg == "--cache-mb") pager_options.cache_bytes = static_cast<size_t>(n) * 1024 * 1024;
+            else if (arg == "--sort-mb") query_options.sort_memory = static_cast<size_t>(n) * 1024 * 1024;
+            else if (arg == "--workers") server_options.workers = static_cast<size_t>(n);
+            else query_options.threads = static_cast<size_t>(n);
+        } else {
+            positional.push_back(arg);
         }
-        if (has_where && index_rootpage != 0) {
-            std::vector<uint64_t> rowids;
-            rowids.reserve(1000);
-
-            // Efficient targeted index search - only traverse relevant parts of B-tree
-            std::function<void(uint32_t)> searchIndexForValue;
-            searchIndexForValue = [&](uint32_t page_number) {
-                const auto& page = getPage(database_file, page_size, page_number);
-                size_t header_off = headerOffsetFor(page_number);
-                unsigned char pflags = page[header_off + 0];
-                
-                if (pflags == 0x02) {
-                    // Interior index page - find relevant children to search
-                    uint16_t num_cells = readBE16(page, header_off + 3);
-                    size_t cell_ptr = header_off + 12;
-                    
-                    std::vector<uint32_t> children_to_search;
-                    
-                    for (uint16_t i = 0; i < num_cells; ++i) {
-                        uint16_t cell_off = readBE16(page, cell_ptr + i * 2);
-                        uint32_t left_child = readBE32(page, cell_off);
-                        
-                        // Read the key for this cell
-                        size_t p = cell_off + 4;
-                        auto pr = readVarint(page, p);
-                        p += pr.second;
-                        size_t rec_start = p;
-                        pr = readVarint(page, rec_start);
-                        uint64_t hsize = pr.first;
-                        size_t hlen = pr.second;
-                        size_t hpos = rec_start + hlen;
-                        size_t hend = rec_start + static_cast<size_t>(hsize);
-                        std::vector<uint64_t> st;
-                        size_t hp = hpos;
-                        while (hp < hend && st.size() < 2) { 
-                            auto t = readVarint(page, hp); 
-                            st.push_back(t.first); 
-                            hp += t.second; 
-                        }
-                        size_t bpos = hend;
-                        size_t first_len = st.empty() ? 0 : serialTypePayloadLength(st[0]);
-                        std::string key_val(reinterpret_cast<const char*>(&page[bpos]), first_len);
-                        
-                        // If our target could be in this left child
-                        if (where_value <= key_val) {
-                            children_to_search.push_back(left_child);
-                        }
-                        
-                        // If target is less than this key, no need to check further
-                        if (where_value < key_val) {
-                            break;
-                        }
-                    }
-                    
-                    // If we haven't found a key > target, check rightmost child
-                    if (children_to_search.empty()) {
-                        uint32_t right_child = readBE32(page, header_off + 8);
-                        if (right_child != 0) {
-                            children_to_search.push_back(right_child);
-                        }
-                    }
-                    
-                    // Search identified children (avoid invalid page numbers)
-                    for (uint32_t child : children_to_search) {
-                        if (child > 0 && child != page_number) {
-                            searchIndexForValue(child);
-                        }
-                    }
-                    
-                } else if (pflags == 0x0A) {
-                    // Leaf page - collect matching entries
-                    uint16_t num_cells = readBE16(page, header_off + 3);
-                    size_t cell_ptr = header_off + 8;
-                    
-                    for (uint16_t i = 0; i < num_cells; ++i) {
-                        uint16_t cell_off = readBE16(page, cell_ptr + i * 2);
-                        size_t p = cell_off;
-                        auto pr = readVarint(page, p);
-                        p += pr.second;
-                        size_t rec_start = p;
-                        pr = readVarint(page, rec_start);
-                        uint64_t hsize = pr.first;
-                        size_t hlen = pr.second;
-                        size_t hpos = rec_start + hlen;
-                        size_t hend = rec_start + static_cast<size_t>(hsize);
-                        std::vector<uint64_t> st;
-                        size_t hp = hpos;
-                        while (hp < hend) { 
-                            auto t = readVarint(page, hp); 
-                            st.push_back(t.first); 
-                            hp += t.second; 
-                        }
-                        size_t bpos = hend;
-                        size_t first_len = st.empty() ? 0 : serialTypePayloadLength(st[0]);
-                        std::string first_val(reinterpret_cast<const char*>(&page[bpos]), first_len);
-                        
-                        if (first_val == where_value) {
-                            size_t rowid_pos = bpos + first_len;
-                            if (st.size() > 1) {
-                                uint64_t rowid_serial = st[1];
-                                size_t rowid_len = serialTypePayloadLength(rowid_serial);
-                                std::string rowid_str = decodeValueToString(page, rowid_pos, rowid_serial, rowid_len);
-                                uint64_t rowid_value = static_cast<uint64_t>(std::stoll(rowid_str));
-                                rowids.push_back(rowid_value);
-                            } else {
-                                auto rv = readVarint(page, rowid_pos);
-                                rowids.push_back(rv.first);
-                            }
-                        }
-                    }
-                }
-            };
-            
-            searchIndexForValue(static_cast<uint32_t>(index_rootpage));
-            if (rowids.empty()) return 0;
-            
-            // Sort and remove duplicates
-            std::sort(rowids.begin(), rowids.end());
-            rowids.erase(std::unique(rowids.begin(), rowids.end()), rowids.end());
-            
-            // Fetch each row by its rowid from the main table
-            for (uint64_t rowid : rowids) {
-                fetchRowByRowId(database_file, page_size, static_cast<uint32_t>(table_rootpage), rowid, target_col_indices, rowid_alias_index);
-            }
-            return 0;
+    }
+    bool serving = !server_options.address.empty();
+    size_t expected_args = !connect_address.empty() ? 0u : (batch || serving || loading ? 1u : 2u);
+    if (positional.size() != expected_args || (serving && (batch || !connect_address.empty())) || (loading && (batch || serving || load_options.schema.empty()))) {
+        std::cerr << "Expected " << expected_args << (expected_args == 1 ? " argument" : " arguments") << std::endl;
+        printUsage();
+        return 1;
+    }
+    if (loading) {
+        load_options.memory_budget = query_options.sort_memory;
+        auto start = std::chrono::steady_clock::now();
+        int rc = bulkLoad(positional[0], load_options, std::cerr);
+        if (rc == 0 && settings.timing) {
+            char line[64];
+            std::snprintf(line, sizeof(line), "Run Time: load: %.3f ms", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            std::cerr << line << std::endl;
+        }
+        return rc;
+    }
+    if (!script_path.empty()) {
+        std::string script;
+        if (!readScript(script_path, script)) {
+            std::cerr << "Failed to read " << script_path << std::endl;
+            return 1;
         }
-        traverseTableBtree(database_file, page_size, static_cast<uint32_t>(table_rootpage), column_names, target_col_indices, has_where, where_col_idx, where_value, rowid_alias_index);
+        for (std::string& statement : splitStatements(script)) statements.push_back(std::move(statement));
     }
-    return 0;
+    if (!connect_address.empty()) return runClient(connect_address, statements, settings.timing);
+    if (!batch && !serving) statements.push_back(positional[1]);
+    Pager pager;
+    if (!pager.open(positional[0], pager_options)) {
+        std::cerr << "Failed to open the database file" << std::endl;
+        return 1;
+    }
+    Catalog catalog;
+    if (!catalog.load(pager)) {
+        std::cerr << "Failed to read the database schema" << std::endl;
+        return 1;
+    }
+    if (serving) {
+        // Statements from all connections share the pager's cache and the catalog
+        server_options.format = output_format;
+        int rc = runServer(server_options, [&](const std::string& statement, ResultSink& out, std::ostream& err) {
+            return runCommand(pager, catalog, statement, query_options, out, err);
+        });
+        if (print_cache_stats) pager.printStats(std::cerr);
+        return rc;
+    }
+    ResultSink out(output_format, STDOUT_FILENO);
+    int rc = runStatements(pager, catalog, statements, query_options, settings, out);
+    if (print_cache_stats) pager.printStats(std::cerr);
+    return rc;
 }
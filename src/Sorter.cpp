@@ -0,0 +1,216 @@
+#include "Sorter.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+namespace {
+
+// Type ranks in key bytes, in compareValues order.
+enum KeyTag : unsigned char { kNullKey = 1, kNumberKey = 2, kTextKey = 3, kBlobKey = 4 };
+
+void appendBE64(std::vector<unsigned char>& out, uint64_t v) {
+    for (int shift = 56; shift >= 0; shift -= 8) out.push_back(static_cast<unsigned char>(v >> shift));
+}
+
+uint64_t loadBE64(const unsigned char* bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v = (v << 8) | bytes[i];
+    return v;
+}
+
+// Flips the sign bit so that signed order becomes unsigned order.
+uint64_t orderedInteger(int64_t v) { return static_cast<uint64_t>(v) ^ (uint64_t{1} << 63); }
+
+// IEEE bits that order as the doubles do: negatives have every bit flipped,
+// positives only the sign bit.
+uint64_t orderedReal(double d) {
+    if (d == 0) d = 0;  // -0.0 sorts with 0.0
+    uint64_t bits = std::bit_cast<uint64_t>(d);
+    return (bits >> 63) != 0 ? ~bits : bits | (uint64_t{1} << 63);
+}
+
+// Appends a sort key that memcmp orders as compareValues does. Numbers are
+// their value as a double, then, for integers too large for a double to tell
+// apart, the exact integer. Text and blobs end in 00 00, with 00 bytes inside
+// written as 00 FF, so a shorter string sorts before any it is a prefix of.
+void appendKey(std::vector<unsigned char>& out, const Value& value, bool descending) {
+    size_t start = out.size();
+    switch (value.type) {
+        case Value::Type::Null:
+            out.push_back(kNullKey);
+            break;
+        case Value::Type::Integer:
+        case Value::Type::Real: {
+            double d = value.asReal();
+            int64_t exact = value.integer;
+            if (value.type == Value::Type::Real) {
+                constexpr double kLimit = 9223372036854775808.0;
+                exact = d >= kLimit ? std::numeric_limits<int64_t>::max()
+                        : d < -kLimit ? std::numeric_limits<int64_t>::min()
+                                      : static_cast<int64_t>(d);
+            }
+            out.push_back(kNumberKey);
+            appendBE64(out, orderedReal(d));
+            appendBE64(out, orderedInteger(exact));
+            break;
+        }
+        case Value::Type::Text:
+        case Value::Type::Blob:
+            out.push_back(value.type == Value::Type::Text ? kTextKey : kBlobKey);
+            for (size_t i = 0; i < value.size; ++i) {
+                out.push_back(value.data[i]);
+                if (value.data[i] == 0) out.push_back(0xFF);
+            }
+            out.push_back(0);
+            out.push_back(0);
+            break;
+    }
+    if (descending) {
+        for (size_t i = start; i < out.size(); ++i) out[i] = static_cast<unsigned char>(~out[i]);
+    }
+}
+
+}  // namespace
+
+bool Sorter::Less::operator()(const Row& a, const Row& b) const {
+    if (a.prefix != b.prefix) return a.prefix < b.prefix;
+    // Keys hold at least the 8-byte arrival number, so both pass the prefix
+    uint32_t n = std::min(a.key_size, b.key_size);
+    int c = std::memcmp(a.bytes + 8, b.bytes + 8, n - 8);
+    if (c != 0) return c < 0;
+    return a.key_size < b.key_size;
+}
+
+Sorter::Sorter(std::vector<bool> descending, size_t width, int64_t keep, size_t memory_budget)
+    : descending_(std::move(descending)), width_(width), keep_(keep), memory_budget_(memory_budget) {}
+
+Sorter::~Sorter() {
+    for (std::FILE* run : runs_) std::fclose(run);
+}
+
+Sorter::Row Sorter::store(Arena& arena, const unsigned char* bytes, uint32_t key_size, uint32_t size) {
+    unsigned char* copy = arena.allocate(size);
+    std::memcpy(copy, bytes, size);
+    return Row{loadBE64(copy), copy, key_size, size};
+}
+
+void Sorter::add(const Value* keys, const Value* values) {
+    if (keep_ == 0) return;
+    encoded_.clear();
+    for (size_t k = 0; k < descending_.size(); ++k) appendKey(encoded_, keys[k], descending_[k]);
+    appendBE64(encoded_, sequence_++);
+    uint32_t key_size = static_cast<uint32_t>(encoded_.size());
+    for (size_t i = 0; i < width_; ++i) appendEncodedValue(encoded_, values[i]);
+    uint32_t size = static_cast<uint32_t>(encoded_.size());
+
+    if (keep_ < 0) {
+        rows_.push_back(store(arena(), encoded_.data(), key_size, size));
+        if (memoryUsed() > memory_budget_) spill();
+        return;
+    }
+    if (rows_.size() == static_cast<uint64_t>(keep_)) {
+        // Full: the row replaces the heap's largest only if it sorts before it
+        Row candidate{loadBE64(encoded_.data()), encoded_.data(), key_size, size};
+        if (!Less()(candidate, rows_.front())) return;
+        std::pop_heap(rows_.begin(), rows_.end(), Less());
+        heap_bytes_ -= rows_.back().size;
+        rows_.pop_back();
+    }
+    rows_.push_back(store(arena(), encoded_.data(), key_size, size));
+    std::push_heap(rows_.begin(), rows_.end(), Less());
+    heap_bytes_ += size;
+    if (arena().bytesUsed() > 2 * heap_bytes_ + (64 << 10)) compact();
+    if (memoryUsed() > memory_budget_) {
+        // Even the rows worth keeping do not fit: sort everything, spilling
+        keep_ = -1;
+        spill();
+    }
+}
+
+void Sorter::compact() {
+    Arena& fresh = arenas_[1 - current_];
+    fresh.clear();
+    for (Row& row : rows_) row = store(fresh, row.bytes, row.key_size, row.size);
+    arena().clear();
+    current_ = 1 - current_;
+}
+
+void Sorter::spill() {
+    std::FILE* file = std::tmpfile();
+    bool ok = file != nullptr;
+    std::sort(rows_.begin(), rows_.end(), Less());
+    for (size_t i = 0; ok && i < rows_.size(); ++i) {
+        const Row& row = rows_[i];
+        uint32_t header[2] = {row.key_size, row.size};
+        ok = std::fwrite(header, sizeof(header), 1, file) == 1 && std::fwrite(row.bytes, 1, row.size, file) == row.size;
+    }
+    if (!ok) {
+        // Without a temporary file the rows stay in memory, budget or not
+        if (file != nullptr) std::fclose(file);
+        memory_budget_ = std::numeric_limits<size_t>::max();
+        return;
+    }
+    std::rewind(file);
+    runs_.push_back(file);
+    rows_.clear();
+    arena().clear();
+}
+
+void Sorter::decode(const Row& row, std::vector<Value>& values) const {
+    const unsigned char* p = row.bytes + row.key_size;
+    for (size_t i = 0; i < width_; ++i) p = readEncodedValue(p, values[i]);
+}
+
+void Sorter::finish(const std::function<bool(const Value*)>& emit) {
+    if (keep_ >= 0) std::sort_heap(rows_.begin(), rows_.end(), Less());
+    else std::sort(rows_.begin(), rows_.end(), Less());
+    std::vector<Value> values(width_);
+    if (runs_.empty()) {
+        for (const Row& row : rows_) {
+            decode(row, values);
+            if (!emit(values.data())) return;
+        }
+        return;
+    }
+
+    // k-way merge of the runs and the rows still in memory
+    struct Source {
+        std::FILE* file = nullptr;
+        size_t next = 0;
+        std::vector<unsigned char> bytes;
+        Row row{};
+    };
+    std::vector<Source> sources(runs_.size() + 1);
+    for (size_t i = 0; i < runs_.size(); ++i) sources[i].file = runs_[i];
+    auto advance = [&](Source& source) {
+        if (source.file == nullptr) {
+            if (source.next == rows_.size()) return false;
+            source.row = rows_[source.next++];
+            return true;
+        }
+        uint32_t header[2];
+        if (std::fread(header, sizeof(header), 1, source.file) != 1) return false;
+        source.bytes.resize(header[1]);
+        if (std::fread(source.bytes.data(), 1, header[1], source.file) != header[1]) return false;
+        source.row = Row{loadBE64(source.bytes.data()), source.bytes.data(), header[0], header[1]};
+        return true;
+    };
+    // A min-heap of sources by their current row
+    auto later = [&](size_t a, size_t b) { return Less()(sources[b].row, sources[a].row); };
+    std::vector<size_t> heap;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (advance(sources[i])) heap.push_back(i);
+    }
+    std::make_heap(heap.begin(), heap.end(), later);
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        Source& source = sources[heap.back()];
+        decode(source.row, values);
+        if (!emit(values.data())) return;
+        if (advance(source)) std::push_heap(heap.begin(), heap.end(), later);
+        else heap.pop_back();
+    }
+}
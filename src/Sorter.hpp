@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+#include "Arena.hpp"
+#include "Value.hpp"
+
+// Sorts result rows for ORDER BY. Each row is kept as one byte string: its
+// sort keys in a normalized form that orders correctly under memcmp (type
+// rank, then value; DESC keys inverted), an arrival number that makes the
+// order stable, then the result values. Comparisons are then plain memcmp,
+// usually settled by an 8-byte prefix held beside each row.
+//
+// With a limit only the first `keep` rows are wanted, so the rows form a
+// bounded max-heap and memory stays proportional to keep. Otherwise rows are
+// buffered until they pass the memory budget, then sorted and written to a
+// temporary file as one run; finish() merges the runs with what is left in
+// memory.
+class Sorter {
+public:
+    // descending has one entry per sort key; width is the number of result
+    // values per row; keep is OFFSET + LIMIT, or -1 without a limit.
+    Sorter(std::vector<bool> descending, size_t width, int64_t keep, size_t memory_budget);
+    ~Sorter();
+    Sorter(const Sorter&) = delete;
+    Sorter& operator=(const Sorter&) = delete;
+
+    // Copies the row; keys and values may be invalid once this returns.
+    void add(const Value* keys, const Value* values);
+    // Hands the rows to emit in order until it returns false. The values
+    // are only valid during the call.
+    void finish(const std::function<bool(const Value*)>& emit);
+
+    size_t runsSpilled() const { return runs_.size(); }
+
+private:
+    struct Row {
+        // The first 8 key bytes, big-endian, so most comparisons need no
+        // memcmp.
+        uint64_t prefix;
+        const unsigned char* bytes;
+        uint32_t key_size;
+        uint32_t size;
+    };
+    struct Less {
+        bool operator()(const Row& a, const Row& b) const;
+    };
+
+    Row store(Arena& arena, const unsigned char* bytes, uint32_t key_size, uint32_t size);
+    Arena& arena() { return arenas_[current_]; }
+    size_t memoryUsed() const { return arenas_[current_].bytesUsed() + rows_.size() * sizeof(Row); }
+    // Copies the rows still in the heap into a fresh arena, dropping the
+    // bytes of rows evicted from it.
+    void compact();
+    void spill();
+    void decode(const Row& row, std::vector<Value>& values) const;
+
+    std::vector<bool> descending_;
+    size_t width_;
+    int64_t keep_;
+    size_t memory_budget_;
+    uint64_t sequence_ = 0;
+    // The row being encoded.
+    std::vector<unsigned char> encoded_;
+    // Row bytes live in arenas_[current_]; compact() copies them to the
+    // other one.
+    Arena arenas_[2];
+    size_t current_ = 0;
+    // A max-heap while keep_ >= 0, otherwise in arrival order.
+    std::vector<Row> rows_;
+    // Bytes of the rows in the heap, as opposed to evicted ones.
+    size_t heap_bytes_ = 0;
+    // Sorted runs written to temporary files.
+    std::vector<std::FILE*> runs_;
+};
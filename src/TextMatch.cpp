@@ -0,0 +1,98 @@
+#include "TextMatch.hpp"
+
+#include <bit>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "Expression.hpp"
+
+namespace {
+
+unsigned char foldByte(unsigned char c) { return c >= 'A' && c <= 'Z' ? static_cast<unsigned char>(c + 32) : c; }
+
+#if defined(__SSE2__)
+// foldByte on 16 bytes. Bytes from 0x80 up compare as negative, so they are
+// never taken for letters.
+inline __m128i foldBytes(__m128i v) {
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+inline __m128i load16(const unsigned char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+#endif
+
+}  // namespace
+
+bool equalsFolded(const unsigned char* a, const unsigned char* lower, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(foldBytes(load16(a + i)), load16(lower + i))) != 0xFFFF) return false;
+    }
+#endif
+    for (; i < n; ++i) {
+        if (foldByte(a[i]) != lower[i]) return false;
+    }
+    return true;
+}
+
+size_t findFolded(const unsigned char* text, size_t len, std::string_view lower) {
+    size_t m = lower.size();
+    if (m == 0) return 0;
+    if (m > len) return std::string_view::npos;
+    const unsigned char* needle = reinterpret_cast<const unsigned char*>(lower.data());
+    size_t last_start = len - m;
+    size_t i = 0;
+#if defined(__SSE2__)
+    // Candidates are the starts where both the first and the last byte of
+    // the needle match; only those are compared in full
+    __m128i first = _mm_set1_epi8(static_cast<char>(needle[0]));
+    __m128i last = _mm_set1_epi8(static_cast<char>(needle[m - 1]));
+    for (; i + 16 <= last_start + 1; i += 16) {
+        __m128i first_eq = _mm_cmpeq_epi8(foldBytes(load16(text + i)), first);
+        __m128i last_eq = _mm_cmpeq_epi8(foldBytes(load16(text + i + m - 1)), last);
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(first_eq, last_eq)));
+        for (; mask != 0; mask &= mask - 1) {
+            size_t start = i + static_cast<size_t>(std::countr_zero(mask));
+            if (equalsFolded(text + start, needle, m)) return start;
+        }
+    }
+#endif
+    for (; i <= last_start; ++i) {
+        if (foldByte(text[i]) == needle[0] && equalsFolded(text + i, needle, m)) return i;
+    }
+    return std::string_view::npos;
+}
+
+LikePattern LikePattern::parse(std::string_view pattern) {
+    LikePattern result;
+    result.pattern = pattern;
+    size_t begin = 0, end = pattern.size();
+    while (begin < end && pattern[begin] == '%') ++begin;
+    while (end > begin && pattern[end - 1] == '%') --end;
+    std::string_view middle = pattern.substr(begin, end - begin);
+    if (middle.find_first_of("%_") != std::string_view::npos) return result;
+    bool leading = begin > 0, trailing = end < pattern.size();
+    if (leading && trailing) result.shape = Shape::Contains;
+    else if (leading) result.shape = Shape::Suffix;
+    else if (trailing) result.shape = Shape::Prefix;
+    else result.shape = Shape::Exact;
+    result.literal.reserve(middle.size());
+    for (char c : middle) result.literal += static_cast<char>(foldByte(static_cast<unsigned char>(c)));
+    return result;
+}
+
+bool LikePattern::matches(const unsigned char* text, size_t len) const {
+    const unsigned char* lower = reinterpret_cast<const unsigned char*>(literal.data());
+    size_t m = literal.size();
+    switch (shape) {
+        case Shape::Exact: return len == m && equalsFolded(text, lower, m);
+        case Shape::Prefix: return len >= m && equalsFolded(text, lower, m);
+        case Shape::Suffix: return len >= m && equalsFolded(text + len - m, lower, m);
+        case Shape::Contains: return findFolded(text, len, literal) != std::string_view::npos;
+        case Shape::General: break;
+    }
+    return likeMatch(reinterpret_cast<const unsigned char*>(pattern.data()), pattern.size(), text, len, -1);
+}
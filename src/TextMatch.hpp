@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// LIKE patterns of the common shapes, matched without the general
+// backtracking matcher. Letters match either case, as in likeMatch; only
+// ASCII is folded.
+struct LikePattern {
+    enum class Shape {
+        // 'abc': the whole text.
+        Exact,
+        // 'abc%'
+        Prefix,
+        // '%abc'
+        Suffix,
+        // '%abc%', and '%' alone.
+        Contains,
+        // Anything with '_' or a '%' inside; only likeMatch handles it.
+        General,
+    };
+
+    Shape shape = Shape::General;
+    // The pattern without its leading and trailing '%'s, lower-cased.
+    std::string literal;
+    // The pattern as written, for General.
+    std::string pattern;
+
+    static LikePattern parse(std::string_view pattern);
+    // Shapes other than General settle most texts by length alone.
+    bool matches(const unsigned char* text, size_t len) const;
+};
+
+// a[0, n) equals lower[0, n) with ASCII letters in a folded to lower case.
+bool equalsFolded(const unsigned char* a, const unsigned char* lower, size_t n);
+// Offset of the first occurrence of lower (already lower-cased) in text,
+// folding text as equalsFolded does; npos if there is none.
+size_t findFolded(const unsigned char* text, size_t len, std::string_view lower);
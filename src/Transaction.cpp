@@ -0,0 +1,146 @@
+#include "Transaction.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "Btree.hpp"
+
+bool Transaction::begin(std::string& error) {
+    lock_ = std::unique_lock<std::mutex>(pager_.writer_mutex_);
+    if (!pager_.prepareWrite(error)) {
+        lock_.unlock();
+        return false;
+    }
+    page_count_ = pager_.pageCount();
+    PageView header = page(1);
+    if (header.empty()) {
+        error = "database disk image is malformed";
+        lock_.unlock();
+        return false;
+    }
+    // Pointer maps would have to follow every page that moves
+    if (readBE32(header, 52) != 0) {
+        error = "writes to auto-vacuum databases are not supported";
+        lock_.unlock();
+        return false;
+    }
+    return true;
+}
+
+Transaction::CachedPage* Transaction::load(uint32_t page_number) {
+    auto it = pages_.find(page_number);
+    if (it != pages_.end()) return &it->second;
+    if (page_number == 0 || page_number > page_count_) return nullptr;
+    PageRef ref = pager_.page(page_number);
+    if (ref.empty()) return nullptr;
+    CachedPage& cached = pages_[page_number];
+    cached.bytes.assign(ref.data(), ref.data() + ref.size());
+    return &cached;
+}
+
+unsigned char* Transaction::fresh(uint32_t page_number) {
+    CachedPage& cached = pages_[page_number];
+    cached.bytes.assign(pager_.pageSize(), 0);
+    cached.dirty = true;
+    return cached.bytes.data();
+}
+
+PageView Transaction::page(uint32_t page_number) {
+    CachedPage* cached = load(page_number);
+    return cached != nullptr ? PageView(cached->bytes) : PageView();
+}
+
+unsigned char* Transaction::write(uint32_t page_number) {
+    CachedPage* cached = load(page_number);
+    if (cached == nullptr) return nullptr;
+    cached->dirty = true;
+    return cached->bytes.data();
+}
+
+uint32_t Transaction::allocate() {
+    unsigned char* header = write(1);
+    if (header == nullptr) return 0;
+    uint32_t trunk = readBE32(PageView(header, 100), 32);
+    uint32_t free_pages = readBE32(PageView(header, 100), 36);
+    if (trunk != 0 && free_pages > 0) {
+        unsigned char* trunk_page = write(trunk);
+        if (trunk_page == nullptr) return 0;
+        PageView view(trunk_page, pager_.pageSize());
+        uint32_t leaves = readBE32(view, 4);
+        uint32_t page_number;
+        if (leaves > 0) {
+            // The last leaf, so the trunk's list just gets shorter
+            if (leaves > pager_.usableSize() / 4 - 2) return 0;
+            page_number = readBE32(view, 8 + 4 * (leaves - 1));
+            storeBE32(trunk_page + 4, leaves - 1);
+        } else {
+            page_number = trunk;
+            storeBE32(header + 32, readBE32(view, 0));
+        }
+        if (page_number < 2 || page_number > page_count_) return 0;
+        storeBE32(header + 36, free_pages - 1);
+        fresh(page_number);
+        return page_number;
+    }
+    uint32_t page_number = page_count_ + 1;
+    // The page holding the lock bytes at 1 GiB is never used
+    if (page_number == (uint32_t{1} << 30) / pager_.pageSize() + 1) ++page_number;
+    page_count_ = page_number;
+    fresh(page_number);
+    return page_number;
+}
+
+bool Transaction::release(uint32_t page_number) {
+    unsigned char* header = write(1);
+    if (header == nullptr) return false;
+    uint32_t trunk = readBE32(PageView(header, 100), 32);
+    uint32_t free_pages = readBE32(PageView(header, 100), 36);
+    storeBE32(header + 36, free_pages + 1);
+    if (trunk != 0) {
+        unsigned char* trunk_page = write(trunk);
+        if (trunk_page == nullptr) return false;
+        uint32_t leaves = readBE32(PageView(trunk_page, 8), 4);
+        // SQLite leaves the last few slots of a trunk unused
+        if (leaves < pager_.usableSize() / 4 - 8) {
+            storeBE32(trunk_page + 8 + 4 * leaves, page_number);
+            storeBE32(trunk_page + 4, leaves + 1);
+            return true;
+        }
+    }
+    // The page becomes the first trunk, in front of the full one
+    unsigned char* new_trunk = fresh(page_number);
+    storeBE32(new_trunk, trunk);
+    storeBE32(header + 32, page_number);
+    return true;
+}
+
+bool Transaction::commit(uint64_t& sequence, std::string& error) {
+    sequence = 0;
+    std::vector<std::pair<uint32_t, const unsigned char*>> dirty;
+    for (auto& [page_number, cached] : pages_) {
+        if (cached.dirty) dirty.emplace_back(page_number, cached.bytes.data());
+    }
+    if (!dirty.empty()) {
+        auto it = pages_.find(1);
+        if (it != pages_.end() && it->second.dirty) {
+            // File change counter, the version-valid-for number that vouches
+            // for the size in the header, and the size
+            unsigned char* header = it->second.bytes.data();
+            uint32_t change_counter = readBE32(PageView(header, 100), 24) + 1;
+            storeBE32(header + 24, change_counter);
+            storeBE32(header + 92, change_counter);
+            storeBE32(header + 28, page_count_);
+        }
+        std::sort(dirty.begin(), dirty.end());
+        sequence = pager_.commit(dirty, page_count_);
+        if (sequence == 0) {
+            error = "disk I/O error";
+            pages_.clear();
+            lock_.unlock();
+            return false;
+        }
+    }
+    pages_.clear();
+    lock_.unlock();
+    return true;
+}
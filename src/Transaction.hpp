@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Pager.hpp"
+
+// One write transaction on a pager. Pages are copied in as it reads them and
+// edited in memory; commit() hands the changed ones to the pager, which
+// appends them to the write-ahead log in one go. Only one transaction is open
+// at a time: begin() waits for the one before to finish. A transaction that
+// is destroyed without committing is rolled back, which just drops its
+// copies.
+class Transaction {
+public:
+    explicit Transaction(Pager& pager) : pager_(pager) {}
+    Transaction(const Transaction&) = delete;
+    Transaction& operator=(const Transaction&) = delete;
+
+    // Takes the pager's write lock. Returns false with error set if the
+    // database cannot be written.
+    bool begin(std::string& error);
+
+    uint32_t pageSize() const { return pager_.pageSize(); }
+    uint32_t usableSize() const { return pager_.usableSize(); }
+    uint32_t pageCount() const { return page_count_; }
+
+    // The page as this transaction sees it; empty if it is outside the
+    // database or cannot be read. Valid until the transaction ends.
+    PageView page(uint32_t page_number);
+    // The page's bytes for editing, or nullptr.
+    unsigned char* write(uint32_t page_number);
+    // A zeroed page taken from the freelist, or else added at the end of the
+    // file; 0 if the freelist is corrupt.
+    uint32_t allocate();
+    // Puts page_number on the freelist.
+    bool release(uint32_t page_number);
+
+    // Appends the changed pages to the log. sequence is the commit's number
+    // for Pager::sync, or 0 if nothing changed.
+    bool commit(uint64_t& sequence, std::string& error);
+
+private:
+    struct CachedPage {
+        std::vector<unsigned char> bytes;
+        bool dirty = false;
+    };
+
+    CachedPage* load(uint32_t page_number);
+    unsigned char* fresh(uint32_t page_number);
+
+    Pager& pager_;
+    std::unique_lock<std::mutex> lock_;
+    uint32_t page_count_ = 0;
+    std::unordered_map<uint32_t, CachedPage> pages_;
+};
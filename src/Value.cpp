@@ -0,0 +1,250 @@
+#include "Value.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <string_view>
+
+#include "Record.hpp"
+
+Value decodeValue(uint64_t serial_type, PageView bytes) {
+    switch (serial_type) {
+        case 0:
+        case 10:
+        case 11:
+            return Value{};
+        case 1:
+        case 2:
+        case 3:
+        case 4:
+        case 5:
+        case 6:
+            return Value::makeInteger(readBigEndianSigned(bytes.data(), bytes.size()));
+        case 7: {
+            uint64_t u = 0;
+            for (size_t i = 0; i < 8; ++i) u = (u << 8) | bytes[i];
+            double d;
+            std::memcpy(&d, &u, sizeof(double));
+            return Value::makeReal(d);
+        }
+        case 8: return Value::makeInteger(0);
+        case 9: return Value::makeInteger(1);
+        default: {
+            Value value = Value::makeText(bytes.data(), bytes.size());
+            if (serial_type % 2 == 0) value.type = Value::Type::Blob;
+            return value;
+        }
+    }
+}
+
+static int typeRank(Value::Type type) {
+    switch (type) {
+        case Value::Type::Null: return 0;
+        case Value::Type::Integer:
+        case Value::Type::Real: return 1;
+        case Value::Type::Text: return 2;
+        case Value::Type::Blob: return 3;
+    }
+    return 0;
+}
+
+Value numericValue(std::string_view text) {
+    const char* begin = text.data();
+    const char* end = begin + text.size();
+    auto space = [](char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; };
+    while (begin < end && space(*begin)) ++begin;
+    while (end > begin && space(end[-1])) --end;
+    if (end - begin > 1 && *begin == '+' && begin[1] != '-') ++begin;
+    // from_chars would also take inf and nan
+    if (begin == end || std::string_view(begin, end).find_first_not_of("0123456789+-.eE") != std::string_view::npos) return Value{};
+    int64_t i = 0;
+    auto [int_end, int_error] = std::from_chars(begin, end, i);
+    if (int_end == end && int_error == std::errc()) return Value::makeInteger(i);
+    double d = 0;
+    auto [real_end, real_error] = std::from_chars(begin, end, d);
+    if (real_end != end || real_error != std::errc()) return Value{};
+    return Value::makeReal(d);
+}
+
+int compareValues(const Value& a, const Value& b) {
+    int ra = typeRank(a.type), rb = typeRank(b.type);
+    if (ra != rb) return ra < rb ? -1 : 1;
+    if (ra == 0) return 0;
+    if (ra == 1) {
+        if (a.type == Value::Type::Integer && b.type == Value::Type::Integer) {
+            return a.integer < b.integer ? -1 : (a.integer > b.integer ? 1 : 0);
+        }
+        double x = a.asReal(), y = b.asReal();
+        return x < y ? -1 : (x > y ? 1 : 0);
+    }
+    size_t n = std::min(a.size, b.size);
+    int c = n == 0 ? 0 : std::memcmp(a.data, b.data, n);
+    if (c != 0) return c < 0 ? -1 : 1;
+    return a.size < b.size ? -1 : (a.size > b.size ? 1 : 0);
+}
+
+int compareValues(const Value& a, const Value& b, Collation collation) {
+    if (collation == Collation::Binary || a.type != Value::Type::Text || b.type != Value::Type::Text) return compareValues(a, b);
+    std::string a_key, b_key;
+    return compareValues(collationKey(a, collation, a_key), collationKey(b, collation, b_key));
+}
+
+Value collationKey(const Value& value, Collation collation, std::string& scratch) {
+    if (collation == Collation::Binary || value.type != Value::Type::Text) return value;
+    const unsigned char* end = value.data + value.size;
+    if (collation == Collation::Rtrim) {
+        while (end > value.data && end[-1] == ' ') --end;
+        return Value::makeText(value.data, static_cast<size_t>(end - value.data));
+    }
+    const unsigned char* upper = std::find_if(value.data, end, [](unsigned char c) { return c >= 'A' && c <= 'Z'; });
+    if (upper == end) return value;
+    scratch.assign(reinterpret_cast<const char*>(value.data), value.size);
+    for (char& c : scratch) {
+        if (c >= 'A' && c <= 'Z') c = static_cast<char>(c + 32);
+    }
+    return Value::makeText(reinterpret_cast<const unsigned char*>(scratch.data()), scratch.size());
+}
+
+void appendValue(std::string& out, const Value& value) {
+    char buf[32];
+    switch (value.type) {
+        case Value::Type::Null:
+            return;
+        case Value::Type::Integer: {
+            auto res = std::to_chars(buf, buf + sizeof(buf), value.integer);
+            out.append(buf, res.ptr);
+            return;
+        }
+        case Value::Type::Real: {
+            auto res = std::to_chars(buf, buf + sizeof(buf), value.real, std::chars_format::general, 15);
+            std::string_view text(buf, static_cast<size_t>(res.ptr - buf));
+            // Like the shell's %!.15g: 1 prints as 1.0 and 1e+20 as 1.0e+20.
+            if (text.find_first_of(".ni") != std::string_view::npos) {
+                out.append(text);
+            } else {
+                size_t e = text.find('e');
+                out.append(text.substr(0, e));
+                out.append(".0");
+                if (e != std::string_view::npos) out.append(text.substr(e));
+            }
+            return;
+        }
+        case Value::Type::Text:
+        case Value::Type::Blob:
+            out.append(reinterpret_cast<const char*>(value.data), value.size);
+            return;
+    }
+}
+
+namespace {
+
+constexpr uint64_t kHashSeed = 0x9E3779B97F4A7C15ULL;
+
+// Value tags of the encoded form.
+enum EncodedTag : unsigned char { kNullTag, kIntegerTag, kRealTag, kTextTag, kBlobTag };
+
+uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t hashBytes(const unsigned char* bytes, size_t n) {
+    uint64_t h = kHashSeed ^ n;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        h = (h ^ word) * 0x100000001B3ULL;
+        h ^= h >> 29;
+    }
+    uint64_t tail = 0;
+    for (size_t shift = 0; i < n; ++i, shift += 8) tail |= static_cast<uint64_t>(bytes[i]) << shift;
+    return mix(h ^ tail);
+}
+
+void appendRaw(std::vector<unsigned char>& out, const void* data, size_t n) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    out.insert(out.end(), bytes, bytes + n);
+}
+
+}  // namespace
+
+uint64_t hashValue(const Value& value, uint64_t seed) {
+    uint64_t h = kHashSeed;
+    switch (value.type) {
+        case Value::Type::Null:
+            break;
+        case Value::Type::Integer:
+            h = mix(static_cast<uint64_t>(value.integer));
+            break;
+        case Value::Type::Real: {
+            double d = value.real;
+            if (d >= -9223372036854775808.0 && d < 9223372036854775808.0 && d == std::trunc(d)) h = mix(static_cast<uint64_t>(static_cast<int64_t>(d)));
+            else h = mix(std::bit_cast<uint64_t>(d));
+            break;
+        }
+        case Value::Type::Text:
+            h = hashBytes(value.data, value.size);
+            break;
+        case Value::Type::Blob:
+            h = ~hashBytes(value.data, value.size);
+            break;
+    }
+    return mix(seed ^ h);
+}
+
+void appendEncodedValue(std::vector<unsigned char>& out, const Value& value) {
+    switch (value.type) {
+        case Value::Type::Null:
+            out.push_back(kNullTag);
+            return;
+        case Value::Type::Integer:
+            out.push_back(kIntegerTag);
+            appendRaw(out, &value.integer, sizeof(value.integer));
+            return;
+        case Value::Type::Real:
+            out.push_back(kRealTag);
+            appendRaw(out, &value.real, sizeof(value.real));
+            return;
+        case Value::Type::Text:
+        case Value::Type::Blob: {
+            out.push_back(value.type == Value::Type::Text ? kTextTag : kBlobTag);
+            uint32_t size = static_cast<uint32_t>(value.size);
+            appendRaw(out, &size, sizeof(size));
+            appendRaw(out, value.data, value.size);
+            return;
+        }
+    }
+}
+
+const unsigned char* readEncodedValue(const unsigned char* p, Value& value) {
+    value = Value();
+    switch (*p++) {
+        case kIntegerTag:
+            value.type = Value::Type::Integer;
+            std::memcpy(&value.integer, p, sizeof(value.integer));
+            return p + sizeof(value.integer);
+        case kRealTag:
+            value.type = Value::Type::Real;
+            std::memcpy(&value.real, p, sizeof(value.real));
+            return p + sizeof(value.real);
+        case kTextTag:
+        case kBlobTag: {
+            value.type = p[-1] == kTextTag ? Value::Type::Text : Value::Type::Blob;
+            uint32_t size = 0;
+            std::memcpy(&size, p, sizeof(size));
+            p += sizeof(size);
+            value.data = p;
+            value.size = size;
+            return p + size;
+        }
+        default:
+            return p;
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Pager.hpp"
+
+// One column value as stored in a record. Text and blob values point into the
+// page (or the record's overflow scratch) they were decoded from, so a Value
+// is only valid as long as that Record/PageRef is.
+struct Value {
+    enum class Type : uint8_t { Null, Integer, Real, Text, Blob };
+
+    Type type = Type::Null;
+    union {
+        int64_t integer;
+        double real;
+    };
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+
+    Value() : integer(0) {}
+
+    static Value makeInteger(int64_t v) {
+        Value value;
+        value.type = Type::Integer;
+        value.integer = v;
+        return value;
+    }
+    static Value makeReal(double v) {
+        Value value;
+        value.type = Type::Real;
+        value.real = v;
+        return value;
+    }
+    static Value makeText(const unsigned char* bytes, size_t len) {
+        Value value;
+        value.type = Type::Text;
+        value.data = bytes;
+        value.size = len;
+        return value;
+    }
+
+    bool isNull() const { return type == Type::Null; }
+    bool isNumeric() const { return type == Type::Integer || type == Type::Real; }
+    double asReal() const { return type == Type::Integer ? static_cast<double>(integer) : real; }
+};
+
+// Decodes the body bytes of a column with the given serial type. bytes must
+// hold serialTypePayloadLength(serial_type) bytes.
+Value decodeValue(uint64_t serial_type, PageView bytes);
+
+// The number text reads as when a numeric affinity converts it: a decimal
+// integer or real, with spaces around it allowed. Integers too large for 64
+// bits read as reals. NULL for anything else, hex and inf included.
+Value numericValue(std::string_view text);
+
+// SQLite's ordering without affinity: NULL < numbers < text < blob; numbers
+// compare by value, text and blobs bytewise.
+int compareValues(const Value& a, const Value& b);
+
+// The collating sequences SQLite builds in, which order text: BINARY by its
+// bytes, NOCASE with ASCII letters folded to lower case, RTRIM ignoring
+// trailing spaces.
+enum class Collation : uint8_t { Binary, NoCase, Rtrim };
+
+// compareValues with two text values compared under collation.
+int compareValues(const Value& a, const Value& b, Collation collation);
+// A value that compares bytewise as value does under collation, for sort and
+// group keys: value itself unless it is text that folding or trimming
+// changes, then text in scratch or a prefix of value.
+Value collationKey(const Value& value, Collation collation, std::string& scratch);
+
+// Appends the value the way the sqlite3 shell prints it: NULL as nothing,
+// reals with 15 significant digits and always a decimal point.
+void appendValue(std::string& out, const Value& value);
+
+// Hash of a value chained onto seed, so that several values hash as a tuple.
+// Values that compareValues finds equal hash alike: a real with an integer
+// value hashes as that integer.
+uint64_t hashValue(const Value& value, uint64_t seed = 0);
+
+// Appends a self-describing form of the value for temporary files: a type
+// tag, then the integer or real, or a 4-byte length and the bytes.
+void appendEncodedValue(std::vector<unsigned char>& out, const Value& value);
+// Reads a value appendEncodedValue wrote at p; text and blobs point into the
+// bytes. Returns the position after it.
+const unsigned char* readEncodedValue(const unsigned char* p, Value& value);
@@ -0,0 +1,224 @@
+#include "Wal.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <random>
+
+#include "Btree.hpp"
+#include "BufferPool.hpp"
+
+namespace {
+
+constexpr uint32_t kMagic = 0x377f0682;
+constexpr uint32_t kVersion = 3007000;
+
+// SQLite's log checksum: over 32-bit word pairs, each sum feeding the other.
+// size is a multiple of 8.
+void addChecksum(bool big_endian, const unsigned char* data, size_t size, uint32_t checksum[2]) {
+    PageView bytes(data, size);
+    uint32_t s0 = checksum[0], s1 = checksum[1];
+    for (size_t i = 0; i < size; i += 8) {
+        uint32_t x0 = big_endian ? readBE32(bytes, i) : static_cast<uint32_t>(data[i]) | (data[i + 1] << 8) | (data[i + 2] << 16) | (static_cast<uint32_t>(data[i + 3]) << 24);
+        uint32_t x1 = big_endian ? readBE32(bytes, i + 4) : static_cast<uint32_t>(data[i + 4]) | (data[i + 5] << 8) | (data[i + 6] << 16) | (static_cast<uint32_t>(data[i + 7]) << 24);
+        s0 += x0 + s1;
+        s1 += x1 + s0;
+    }
+    checksum[0] = s0;
+    checksum[1] = s1;
+}
+
+bool writeFully(int fd, const unsigned char* bytes, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t n = ::pwrite(fd, bytes, size, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        bytes += n;
+        size -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+}  // namespace
+
+bool Wal::open(const std::string& path, uint32_t page_size, bool create) {
+    close();
+    fd_ = create ? ::open(path.c_str(), O_RDWR | O_CLOEXEC | O_CREAT, 0644) : ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) return false;
+    path_ = path;
+    page_size_ = page_size;
+    std::random_device random;
+    salt_[0] = random();
+    salt_[1] = random();
+
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) {
+        close();
+        return false;
+    }
+    unsigned char header[kHeaderSize];
+    if (static_cast<uint64_t>(st.st_size) < kHeaderSize) return true;
+    if (!readFully(fd_, header, kHeaderSize, 0)) {
+        close();
+        return false;
+    }
+    PageView header_view(header, kHeaderSize);
+    uint32_t magic = readBE32(header_view, 0);
+    if ((magic & ~1u) != kMagic || readBE32(header_view, 4) != kVersion || readBE32(header_view, 8) != page_size) return true;
+    big_endian_ = (magic & 1) != 0;
+    uint32_t checksum[2] = {0, 0};
+    addChecksum(big_endian_, header, 24, checksum);
+    if (checksum[0] != readBE32(header_view, 24) || checksum[1] != readBE32(header_view, 28)) return true;
+    checkpoint_sequence_ = readBE32(header_view, 12);
+    salt_[0] = readBE32(header_view, 16);
+    salt_[1] = readBE32(header_view, 20);
+    checksum_[0] = checksum[0];
+    checksum_[1] = checksum[1];
+    header_written_ = true;
+
+    // Frames count up to the last commit whose frames all carry this log's
+    // salts and a running checksum that matches
+    size_t frame_size = kFrameHeaderSize + page_size;
+    uint64_t available = (static_cast<uint64_t>(st.st_size) - kHeaderSize) / frame_size;
+    std::vector<unsigned char> frame(frame_size);
+    std::vector<std::pair<uint32_t, uint32_t>> uncommitted;
+    for (uint64_t i = 0; i < available && i < UINT32_MAX; ++i) {
+        if (!readFully(fd_, frame.data(), frame_size, kHeaderSize + i * frame_size)) break;
+        uint32_t page_number = readBE32(frame, 0);
+        if (page_number == 0 || readBE32(frame, 8) != salt_[0] || readBE32(frame, 12) != salt_[1]) break;
+        addChecksum(big_endian_, frame.data(), 8, checksum);
+        addChecksum(big_endian_, frame.data() + kFrameHeaderSize, page_size, checksum);
+        if (checksum[0] != readBE32(frame, 16) || checksum[1] != readBE32(frame, 20)) break;
+        uint32_t number = static_cast<uint32_t>(i + 1);
+        uncommitted.emplace_back(page_number, number);
+        uint32_t database_size = readBE32(frame, 4);
+        if (database_size == 0) continue;
+        for (auto [page, f] : uncommitted) index_[page].push_back(f);
+        uncommitted.clear();
+        frames_ = number;
+        commits_.emplace_back(number, database_size);
+        checksum_[0] = checksum[0];
+        checksum_[1] = checksum[1];
+    }
+    return true;
+}
+
+bool Wal::reopenForWriting() {
+    // The new descriptor takes the old one's number, so readers never see
+    // it closed
+    int fd = ::open(path_.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = ::dup3(fd, fd_, O_CLOEXEC) >= 0;
+    ::close(fd);
+    return ok;
+}
+
+void Wal::close() {
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+    path_.clear();
+    frames_ = 0;
+    header_written_ = false;
+    index_.clear();
+    commits_.clear();
+    pending_pages_.clear();
+}
+
+uint32_t Wal::databaseSize(uint32_t frame) const {
+    auto it = std::lower_bound(commits_.begin(), commits_.end(), std::make_pair(frame, uint32_t{0}));
+    return it != commits_.end() && it->first == frame ? it->second : 0;
+}
+
+uint32_t Wal::findFrame(uint32_t page_number, uint32_t limit) const {
+    auto it = index_.find(page_number);
+    if (it == index_.end()) return 0;
+    const std::vector<uint32_t>& frames = it->second;
+    auto after = std::upper_bound(frames.begin(), frames.end(), limit);
+    return after == frames.begin() ? 0 : *(after - 1);
+}
+
+bool Wal::readFrame(uint32_t frame, unsigned char* page) const {
+    return readFully(fd_, page, page_size_, pageOffset(frame));
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> Wal::framesToCopy(uint32_t after, uint32_t upto) const {
+    std::vector<std::pair<uint32_t, uint32_t>> copies;
+    for (const auto& [page, frames] : index_) {
+        auto end = std::upper_bound(frames.begin(), frames.end(), upto);
+        if (end != frames.begin() && *(end - 1) > after) copies.emplace_back(page, *(end - 1));
+    }
+    std::sort(copies.begin(), copies.end());
+    return copies;
+}
+
+bool Wal::append(const std::vector<std::pair<uint32_t, const unsigned char*>>& pages, uint32_t database_size) {
+    pending_pages_.clear();
+    if (pages.empty()) return true;
+    if (!header_written_) {
+        unsigned char header[kHeaderSize];
+        big_endian_ = false;
+        storeBE32(header, kMagic);
+        storeBE32(header + 4, kVersion);
+        storeBE32(header + 8, page_size_);
+        storeBE32(header + 12, checkpoint_sequence_);
+        storeBE32(header + 16, salt_[0]);
+        storeBE32(header + 20, salt_[1]);
+        uint32_t checksum[2] = {0, 0};
+        addChecksum(big_endian_, header, 24, checksum);
+        storeBE32(header + 24, checksum[0]);
+        storeBE32(header + 28, checksum[1]);
+        if (!writeFully(fd_, header, kHeaderSize, 0)) return false;
+        checksum_[0] = checksum[0];
+        checksum_[1] = checksum[1];
+        header_written_ = true;
+    }
+    size_t frame_size = kFrameHeaderSize + page_size_;
+    std::vector<unsigned char> frames(pages.size() * frame_size);
+    uint32_t checksum[2] = {checksum_[0], checksum_[1]};
+    for (size_t i = 0; i < pages.size(); ++i) {
+        unsigned char* frame = frames.data() + i * frame_size;
+        storeBE32(frame, pages[i].first);
+        storeBE32(frame + 4, i + 1 == pages.size() ? database_size : 0);
+        storeBE32(frame + 8, salt_[0]);
+        storeBE32(frame + 12, salt_[1]);
+        std::copy(pages[i].second, pages[i].second + page_size_, frame + kFrameHeaderSize);
+        addChecksum(big_endian_, frame, 8, checksum);
+        addChecksum(big_endian_, frame + kFrameHeaderSize, page_size_, checksum);
+        storeBE32(frame + 16, checksum[0]);
+        storeBE32(frame + 20, checksum[1]);
+    }
+    if (!writeFully(fd_, frames.data(), frames.size(), kHeaderSize + static_cast<uint64_t>(frames_) * frame_size)) return false;
+    for (const auto& page : pages) pending_pages_.push_back(page.first);
+    pending_checksum_[0] = checksum[0];
+    pending_checksum_[1] = checksum[1];
+    pending_size_ = database_size;
+    return true;
+}
+
+void Wal::publish() {
+    if (pending_pages_.empty()) return;
+    for (uint32_t page : pending_pages_) index_[page].push_back(++frames_);
+    commits_.emplace_back(frames_, pending_size_);
+    checksum_[0] = pending_checksum_[0];
+    checksum_[1] = pending_checksum_[1];
+    pending_pages_.clear();
+}
+
+bool Wal::sync() {
+    return fd_ >= 0 && ::fdatasync(fd_) == 0;
+}
+
+void Wal::reset() {
+    frames_ = 0;
+    index_.clear();
+    commits_.clear();
+    pending_pages_.clear();
+    header_written_ = false;
+    ++checkpoint_sequence_;
+    ++salt_[0];
+    salt_[1] = std::random_device{}();
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// The write-ahead log beside a database, "<database>-wal", in SQLite's
+// format: a 32-byte header (magic, version, page size, checkpoint sequence,
+// two salts and a checksum), then frames of a 24-byte header (page number,
+// database size in pages for the last frame of a transaction, the salts and
+// a running checksum) and one page. Frames are numbered from 1; a frame
+// counts only once the frame that commits its transaction is in the log.
+//
+// The index from pages to frames lives in memory and is rebuilt from the file
+// on open, the way SQLite recovers a log without its -shm file. The caller
+// serializes appends and guards the index against concurrent readers.
+class Wal {
+public:
+    static constexpr size_t kHeaderSize = 32;
+    static constexpr size_t kFrameHeaderSize = 24;
+
+    Wal() = default;
+    Wal(const Wal&) = delete;
+    Wal& operator=(const Wal&) = delete;
+    ~Wal() { close(); }
+
+    // Opens the log at path, for writing and creating it if create is set,
+    // read-only otherwise, and reads the committed frames of an existing one.
+    // A log with a bad header or for another page size has no frames.
+    // Returns false if the file cannot be opened or read, or is missing and
+    // create is not set.
+    bool open(const std::string& path, uint32_t page_size, bool create);
+    // Lets a log opened read-only be written from now on; false if the file
+    // cannot be opened for writing.
+    bool reopenForWriting();
+    void close();
+    bool isOpen() const { return fd_ >= 0; }
+    const std::string& path() const { return path_; }
+
+    // Committed frames are 1 to frameCount().
+    uint32_t frameCount() const { return frames_; }
+    // Database size in pages as of the transaction that frame commits; 0 if
+    // frame is not a commit frame.
+    uint32_t databaseSize(uint32_t frame) const;
+    // The last frame at or before limit that holds page_number, or 0.
+    uint32_t findFrame(uint32_t page_number, uint32_t limit) const;
+    bool readFrame(uint32_t frame, unsigned char* page) const;
+    // Where the page bytes of frame sit in fd().
+    uint64_t pageOffset(uint32_t frame) const { return kHeaderSize + static_cast<uint64_t>(frame - 1) * (kFrameHeaderSize + page_size_) + kFrameHeaderSize; }
+    int fd() const { return fd_; }
+    // For each page written in frames (after, upto], its last frame up to
+    // upto, in page order.
+    std::vector<std::pair<uint32_t, uint32_t>> framesToCopy(uint32_t after, uint32_t upto) const;
+
+    // Writes one transaction's pages as frames after the committed ones,
+    // the last marked as the commit with database_size. They are not in the
+    // index until publish(), and not durable until sync().
+    bool append(const std::vector<std::pair<uint32_t, const unsigned char*>>& pages, uint32_t database_size);
+    // Makes the frames of the last append part of the log.
+    void publish();
+    bool sync();
+    // Forgets every frame: the next append writes a new header, with the
+    // checkpoint sequence and first salt moved on, over the old frames, so
+    // those no longer pass as part of the log.
+    void reset();
+
+private:
+    // Whether checksums read the words big-endian, from the magic number.
+    bool big_endian_ = false;
+    int fd_ = -1;
+    std::string path_;
+    uint32_t page_size_ = 0;
+    uint32_t frames_ = 0;
+    uint32_t checkpoint_sequence_ = 0;
+    uint32_t salt_[2] = {0, 0};
+    // Running checksum after the last committed frame.
+    uint32_t checksum_[2] = {0, 0};
+    bool header_written_ = false;
+    // page -> frames holding it, ascending.
+    std::unordered_map<uint32_t, std::vector<uint32_t>> index_;
+    // Commit frames and the database size each recorded, ascending.
+    std::vector<std::pair<uint32_t, uint32_t>> commits_;
+
+    // An append waiting for publish().
+    std::vector<uint32_t> pending_pages_;
+    uint32_t pending_checksum_[2] = {0, 0};
+    uint32_t pending_size_ = 0;
+};
@@ -0,0 +1,56 @@
+#!/bin/sh
+# Comparisons between columns and literals, checked against what sqlite3
+# returns for the same data. Usage: affinity_test.sh <path to exe>
+exe="$1"
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+failed=0
+
+# c has no declared type and holds 10, 9, '10' and 5
+printf '1,x,1.5,5\n2,x,x,7\n3,x,10,11\n4,x,9,z\n' > "$dir/t.csv"
+"$exe" --load "$dir/t.csv" --schema "CREATE TABLE t(id INTEGER PRIMARY KEY, c, name TEXT, n INTEGER); CREATE INDEX tn ON t(name)" "$dir/t.db" ||
+    exit 1
+"$exe" -c "UPDATE t SET c = 10 WHERE id = 1" -c "UPDATE t SET c = 9 WHERE id = 2" -c "UPDATE t SET c = '10' WHERE id = 3" \
+    -c "UPDATE t SET c = 5 WHERE id = 4" "$dir/t.db" > /dev/null || exit 1
+
+check() {
+    actual=$("$exe" "$dir/t.db" "$1" 2>/dev/null | tr '\n' ' ')
+    if [ "$actual" != "$2" ]; then
+        echo "FAIL: $1: got '$actual', expected '$2'"
+        failed=1
+    fi
+}
+
+# No declared type: nothing is converted, and numbers sort before text
+check "SELECT id FROM t WHERE c = 10" "1 "
+check "SELECT id FROM t WHERE 10 = c" "1 "
+check "SELECT id FROM t WHERE c = '10'" "3 "
+check "SELECT id FROM t WHERE c > '5'" ""
+check "SELECT id FROM t WHERE c >= 9 ORDER BY id" "1 2 3 "
+check "SELECT id FROM t WHERE c IN (10, 'abc')" "1 "
+
+# TEXT: a number compares as its text
+check "SELECT id FROM t WHERE name = 1.50" "1 "
+check "SELECT id FROM t WHERE name = 10" "3 "
+check "SELECT id FROM t WHERE name IN (1.5, 9) ORDER BY id" "1 4 "
+check "SELECT id FROM t WHERE +name = 1.50" ""
+
+# INTEGER: text that reads as a number compares as the number
+check "SELECT id FROM t WHERE n = '5'" "1 "
+check "SELECT id FROM t WHERE n > '6' ORDER BY id" "2 3 4 "
+check "SELECT id FROM t WHERE n BETWEEN '6' AND '11' ORDER BY id" "2 3 "
+check "SELECT id FROM t WHERE n = 'z'" "4 "
+check "SELECT id FROM t WHERE id > '2' ORDER BY id" "3 4 "
+# Only decimal text is a number: spaces around it are allowed, hex is not
+check "SELECT id FROM t WHERE n = ' 5 '" "1 "
+check "SELECT id FROM t WHERE id = '0x2'" ""
+check "SELECT id FROM t WHERE n = '5e0'" "1 "
+
+# Columns compared with each other or with expressions: NUMERIC if either
+# column is numeric, otherwise the column's own affinity
+check "SELECT id FROM t WHERE name = c" "3 "
+check "SELECT id FROM t WHERE c = n + 5 ORDER BY id" "1 4 "
+check "SELECT id FROM t WHERE n > c ORDER BY id" "3 4 "
+check "SELECT id FROM t WHERE c IN (n + 5, '10') ORDER BY id" "1 3 4 "
+
+exit $failed
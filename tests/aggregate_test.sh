@@ -0,0 +1,39 @@
+#!/bin/sh
+# Bare columns next to aggregates, checked against sqlite3: with exactly one
+# MIN or MAX they come from the row that produced its value. Usage:
+# aggregate_test.sh <path to exe>
+exe="$1"
+command -v sqlite3 > /dev/null || exit 77
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+failed=0
+
+# Every 11th v is NULL, and all of group 99's are
+sqlite3 "$dir/t.db" "CREATE TABLE g(id INTEGER PRIMARY KEY, grp INTEGER, v INTEGER, w TEXT COLLATE NOCASE);
+WITH RECURSIVE s(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM s WHERE i < 3000)
+INSERT INTO g SELECT i, i % 7, CASE WHEN i % 11 = 0 THEN NULL ELSE (i * 37) % 1001 END,
+    CASE i % 2 WHEN 0 THEN 'w' ELSE 'W' END || (i * 13 % 3001) FROM s;
+INSERT INTO g VALUES (5000, 99, NULL, 'a'), (5001, 99, NULL, 'b');" || exit 1
+
+check() {
+    expected=$(sqlite3 "$dir/t.db" "$1")
+    for threads in 1 4; do
+        actual=$("$exe" --threads $threads "$dir/t.db" "$1" 2>/dev/null)
+        if [ "$actual" != "$expected" ]; then
+            echo "FAIL: $1 (--threads $threads): got '$actual', expected '$expected'"
+            failed=1
+        fi
+    done
+}
+
+check "SELECT MAX(v), id FROM g"
+check "SELECT MIN(v), id, w FROM g"
+check "SELECT id, MAX(v), COUNT(*), SUM(v) FROM g"
+check "SELECT MAX(w), id FROM g"
+check "SELECT MIN(v), id FROM g WHERE grp = 99"
+check "SELECT grp, MAX(v), id, w FROM g GROUP BY grp"
+check "SELECT grp, MIN(v), id FROM g GROUP BY grp"
+check "SELECT grp, MAX(v) FROM g GROUP BY grp HAVING id > 100"
+check "SELECT id FROM g GROUP BY grp ORDER BY MIN(v), id"
+
+exit $failed
@@ -0,0 +1,59 @@
+#!/bin/sh
+# Columns declared COLLATE NOCASE or RTRIM compare, sort and group text by
+# their collation, checked against sqlite3. Usage: collation_test.sh <path to exe>
+exe="$1"
+command -v sqlite3 > /dev/null || exit 77
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+failed=0
+
+# n and b hold the same text, 'abc0' to 'ABC6' in both cases; r is 'x0' to
+# 'x4' with up to two trailing spaces
+sqlite3 "$dir/t.db" "CREATE TABLE t(id INTEGER PRIMARY KEY, n TEXT COLLATE NOCASE, r TEXT COLLATE RTRIM, b TEXT);
+WITH RECURSIVE s(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM s WHERE i < 5000)
+INSERT INTO t SELECT i, CASE i % 2 WHEN 0 THEN 'abc' ELSE 'ABC' END || (i % 7), 'x' || (i % 5) || substr('  ', 1, i % 3),
+    CASE i % 2 WHEN 0 THEN 'abc' ELSE 'ABC' END || (i % 7) FROM s;
+CREATE INDEX nb ON t(n COLLATE BINARY);
+CREATE TABLE k(n TEXT, r TEXT);
+INSERT INTO k VALUES ('ABC1', 'x1'), ('abc2', 'x2  ');" || exit 1
+
+check() {
+    expected=$(sqlite3 "$dir/t.db" "$1")
+    for threads in 1 4; do
+        actual=$("$exe" --threads $threads "$dir/t.db" "$1" 2>/dev/null)
+        if [ "$actual" != "$expected" ]; then
+            echo "FAIL: $1 (--threads $threads): got '$actual', expected '$expected'"
+            failed=1
+        fi
+    done
+}
+
+# The column's collation decides, from either side
+check "SELECT COUNT(*) FROM t WHERE n = 'ABC1'"
+check "SELECT COUNT(*) FROM t WHERE 'ABC1' = n"
+check "SELECT COUNT(*) FROM t WHERE n > 'abc4'"
+check "SELECT COUNT(*) FROM t WHERE n BETWEEN 'ABC2' AND 'abc3'"
+check "SELECT COUNT(*) FROM t WHERE n IN ('abc1', 'ABC2')"
+check "SELECT COUNT(*) FROM t WHERE +n = 'abc1'"
+check "SELECT COUNT(*) FROM t WHERE r = 'x1'"
+check "SELECT COUNT(*) FROM t WHERE n IS 'ABC1'"
+# Two columns: the left one's collation
+check "SELECT COUNT(*) FROM t WHERE n = b"
+check "SELECT COUNT(*) FROM t WHERE b = n"
+# LIKE has no collation
+check "SELECT COUNT(*) FROM t WHERE n LIKE 'abc1'"
+
+# Sorting and grouping
+check "SELECT id FROM t ORDER BY n, id LIMIT 5"
+check "SELECT id FROM t ORDER BY r DESC, id LIMIT 5"
+check "SELECT COUNT(*) FROM t GROUP BY n"
+check "SELECT COUNT(*) FROM t GROUP BY r"
+check "SELECT MIN(n), MAX(r) FROM t"
+
+# Join keys
+check "SELECT COUNT(*) FROM k JOIN t ON k.n = t.n"
+check "SELECT COUNT(*) FROM k JOIN t ON k.n = t.b"
+check "SELECT COUNT(*) FROM k JOIN t ON t.b = k.n"
+check "SELECT COUNT(*) FROM k JOIN t ON k.r = t.r"
+
+exit $failed
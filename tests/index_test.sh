@@ -0,0 +1,46 @@
+#!/bin/sh
+# Queries on a table whose indexes are DESC, partial or NOCASE, which reads
+# cannot use as ascending BINARY indexes over every row, checked against
+# sqlite3. Usage: index_test.sh <path to exe>
+exe="$1"
+command -v sqlite3 > /dev/null || exit 77
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+failed=0
+
+sqlite3 "$dir/t.db" "CREATE TABLE t(id INTEGER PRIMARY KEY, s INTEGER, m TEXT);
+WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 5000)
+INSERT INTO t SELECT i, i % 100, CASE i % 3 WHEN 0 THEN 'Q' ELSE 'q' END || (i % 6) FROM n;
+CREATE INDEX ds ON t(s DESC);
+CREATE INDEX ps ON t(s) WHERE s > 50;
+CREATE INDEX mn ON t(m COLLATE NOCASE);
+CREATE TABLE k(s INTEGER, m TEXT);
+INSERT INTO k VALUES (7, 'q1'), (60, 'Q3'), (99, 'x');" || exit 1
+
+check() {
+    expected=$(sqlite3 "$dir/t.db" "$1")
+    actual=$("$exe" "$dir/t.db" "$1" 2>/dev/null)
+    if [ "$actual" != "$expected" ]; then
+        echo "FAIL: $1: got '$actual', expected '$expected'"
+        failed=1
+    fi
+}
+
+check "SELECT COUNT(*) FROM t WHERE s > 95"
+check "SELECT COUNT(*) FROM t WHERE s = 7"
+check "SELECT COUNT(*) FROM t WHERE s BETWEEN 40 AND 60"
+check "SELECT COUNT(*) FROM t WHERE m = 'q1'"
+check "SELECT COUNT(*) FROM t WHERE m = 'Q3'"
+check "SELECT id FROM t WHERE s = 99 AND id < 500"
+
+# ORDER BY takes no order from these indexes
+check "SELECT s FROM t ORDER BY s LIMIT 3"
+check "SELECT s, id FROM t ORDER BY s, id LIMIT 5"
+check "SELECT s FROM t WHERE s > 40 ORDER BY s LIMIT 3"
+check "SELECT m, id FROM t ORDER BY m, id LIMIT 4"
+
+# Nor do joins seek them for each outer row
+check "SELECT k.s, COUNT(*) FROM k JOIN t ON t.s = k.s GROUP BY k.s"
+check "SELECT k.m, COUNT(*) FROM k JOIN t ON t.m = k.m GROUP BY k.m"
+
+exit $failed
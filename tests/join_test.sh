@@ -0,0 +1,57 @@
+#!/bin/sh
+# Two-table joins by each strategy the planner has: a hash join on the keys,
+# a hash join without keys for cross joins, and index nested loops seeking
+# an index or the rowid. Each query must pick the strategy named and return
+# the rows sqlite3 returns, as a set unless it has ORDER BY. Usage:
+# join_test.sh <path to exe>
+exe="$1"
+command -v sqlite3 > /dev/null || exit 77
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+failed=0
+
+# o.cid is NULL for every 17th order and names missing customers for some
+sqlite3 "$dir/t.db" "CREATE TABLE c(id INTEGER PRIMARY KEY, name TEXT, grp INTEGER);
+CREATE TABLE o(id INTEGER PRIMARY KEY, cid INTEGER, amount REAL, code TEXT);
+CREATE INDEX oc ON o(cid);
+CREATE TABLE g(code TEXT, label TEXT);
+WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 3000)
+INSERT INTO c SELECT i, 'c' || i, i % 13 FROM n;
+WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 30000)
+INSERT INTO o SELECT i, CASE WHEN i % 17 = 0 THEN NULL ELSE i * 7919 % 3100 END, (i % 1000) / 10.0, 'k' || (i % 40) FROM n;
+WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 60)
+INSERT INTO g SELECT 'k' || (i % 45), 'l' || i FROM n;" || exit 1
+
+# check <strategy> <sql>
+check() {
+    plan=$("$exe" "$dir/t.db" "EXPLAIN QUERY PLAN $2" 2>/dev/null | grep '^\*')
+    case "$plan" in
+        *"$1"*) ;;
+        *)
+            echo "FAIL: $2: planned '$plan', expected $1"
+            failed=1
+            ;;
+    esac
+    case "$2" in
+        *"ORDER BY"*) sorted=cat ;;
+        *) sorted=sort ;;
+    esac
+    expected=$(sqlite3 "$dir/t.db" "$2" | $sorted | md5sum)
+    actual=$("$exe" "$dir/t.db" "$2" 2>/dev/null | $sorted | md5sum)
+    if [ "$actual" != "$expected" ]; then
+        echo "FAIL: $2: rows differ from sqlite3's"
+        failed=1
+    fi
+}
+
+check "hash join" "SELECT o.id, c.name FROM o JOIN c ON c.id = o.cid WHERE o.amount > 99.5"
+check "hash join" "SELECT c.grp, COUNT(*), SUM(o.amount) FROM o JOIN c ON c.id = o.cid GROUP BY c.grp"
+check "hash join" "SELECT o.id, g.label FROM o JOIN g ON g.code = o.code WHERE o.id < 500"
+check "hash join" "SELECT COUNT(*) FROM o JOIN g ON o.code = g.code"
+check "hash join" "SELECT a.label, b.label FROM g a JOIN g b ON a.label < b.label AND a.code = 'k3'"
+check "hash join" "SELECT COUNT(*) FROM g a, g b"
+check "by index oc" "SELECT c.name, o.id FROM c JOIN o ON o.cid = c.id WHERE c.id < 20"
+check "by index oc" "SELECT c.name, o.id, o.amount FROM c JOIN o ON o.cid = c.id WHERE c.id = 7"
+check "by rowid" "SELECT o.id, c.name FROM o JOIN c ON c.id = o.cid WHERE o.id BETWEEN 100 AND 130 ORDER BY o.id"
+
+exit $failed
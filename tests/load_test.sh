@@ -0,0 +1,36 @@
+#!/bin/sh
+# The bulk loader: a CSV loaded by exe --load must hold what sqlite3's .import
+# of the same file holds, in a file that passes integrity_check, also when
+# its indexes are sorted in runs spilled to disk. Usage: load_test.sh <path to exe>
+exe="$1"
+command -v sqlite3 > /dev/null || exit 77
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+failed=0
+
+fail() {
+    echo "FAIL: $1"
+    failed=1
+}
+
+schema="CREATE TABLE t(id INTEGER PRIMARY KEY, k INTEGER, r REAL, s TEXT, v);
+CREATE INDEX tk ON t(k, s);
+CREATE UNIQUE INDEX ts ON t(s);"
+
+# Quoted fields with commas, quotes and long text, numbers in several forms
+sqlite3 -csv :memory: "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 60000)
+SELECT i, i * 7919 % 1000, i / 8.0, 's' || (i * 104729 % 60000) || CASE i % 50 WHEN 0 THEN ',\"q\"' ELSE '' END,
+    CASE i % 4 WHEN 0 THEN i WHEN 1 THEN printf('%.*c', i % 900, 'v') WHEN 2 THEN '' ELSE i || '.5' END FROM n" > "$dir/t.csv" || exit 1
+
+sqlite3 "$dir/expected.db" "$schema" || exit 1
+sqlite3 "$dir/expected.db" ".import --csv $dir/t.csv t" || exit 1
+
+dump="SELECT id, k, r, s, v, typeof(v) FROM t ORDER BY id; SELECT k, s FROM t ORDER BY k, s;"
+for sort_mb in 64 1; do
+    rm -f "$dir/t.db"
+    "$exe" --load "$dir/t.csv" --schema "$schema" --sort-mb $sort_mb "$dir/t.db" 2>/dev/null || fail "--load --sort-mb $sort_mb"
+    [ "$(sqlite3 "$dir/t.db" "PRAGMA integrity_check")" = "ok" ] || fail "integrity_check after --sort-mb $sort_mb"
+    [ "$(sqlite3 "$dir/t.db" "$dump" | md5sum)" = "$(sqlite3 "$dir/expected.db" "$dump" | md5sum)" ] || fail "rows differ after --sort-mb $sort_mb"
+done
+
+exit $failed
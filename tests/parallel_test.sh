@@ -0,0 +1,36 @@
+#!/bin/sh
+# Scans split across threads: with --threads N, in table order and with
+# --unordered, a query must return the rows sqlite3 returns, compared as sets
+# where the order is not fixed. Usage: parallel_test.sh <path to exe>
+exe="$1"
+command -v sqlite3 > /dev/null || exit 77
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+failed=0
+
+# Enough rows, some with overflow pages, for many subtrees to split
+sqlite3 "$dir/t.db" "CREATE TABLE t(id INTEGER PRIMARY KEY, k INTEGER, r REAL, s TEXT);
+WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 50000)
+INSERT INTO t SELECT i, i * 7919 % 1000, i / 3.0,
+    CASE WHEN i % 1000 = 0 THEN printf('%.*c', 5000, 'o') ELSE 's' || (i % 777) END FROM n;" || exit 1
+
+check() {
+    expected=$(sqlite3 "$dir/t.db" "$1" | sort)
+    for options in "--threads 2" "--threads 4" "--threads 4 --unordered" "--threads 16"; do
+        actual=$("$exe" $options "$dir/t.db" "$1" 2>/dev/null | sort)
+        if [ "$actual" != "$expected" ]; then
+            echo "FAIL: $1 ($options): $(echo "$actual" | wc -l) rows, expected $(echo "$expected" | wc -l)"
+            failed=1
+        fi
+    done
+}
+
+check "SELECT * FROM t WHERE k < 10"
+check "SELECT id, s FROM t WHERE s LIKE 'o%'"
+check "SELECT id FROM t WHERE s = 's5' OR r > 16600"
+check "SELECT COUNT(*), SUM(k), MIN(s), MAX(r) FROM t"
+check "SELECT k % 10, COUNT(*), AVG(r) FROM t GROUP BY k % 10"
+check "SELECT s, MAX(k), id FROM t WHERE k > 500 GROUP BY s"
+check "SELECT COUNT(*) FROM t WHERE k BETWEEN 100 AND 199"
+
+exit $failed
@@ -0,0 +1,59 @@
+#!/bin/sh
+# The query server: clients connected at once must each get what sqlite3
+# returns, a write through the server must be visible to later clients, and
+# the database must pass integrity_check once the server stops. Usage:
+# server_test.sh <path to exe>
+exe="$1"
+command -v sqlite3 > /dev/null || exit 77
+dir=$(mktemp -d)
+server=
+trap '[ -n "$server" ] && kill $server 2>/dev/null; rm -rf "$dir"' EXIT
+failed=0
+
+fail() {
+    echo "FAIL: $1"
+    failed=1
+}
+
+sqlite3 "$dir/t.db" "CREATE TABLE t(id INTEGER PRIMARY KEY, k INTEGER, s TEXT);
+CREATE INDEX tk ON t(k);
+WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 20000)
+INSERT INTO t SELECT i, i % 101, 's' || (i * 7 % 20000) FROM n;" || exit 1
+
+"$exe" --serve "$dir/sock" --workers 4 "$dir/t.db" 2>/dev/null &
+server=$!
+tries=0
+while [ ! -S "$dir/sock" ]; do
+    tries=$((tries + 1))
+    [ $tries -gt 100 ] && { echo "FAIL: the server did not start"; exit 1; }
+    sleep 0.1
+done
+
+set -- "SELECT COUNT(*), SUM(k) FROM t" \
+    "SELECT id, s FROM t WHERE k = 42 ORDER BY id" \
+    "SELECT k, COUNT(*) FROM t GROUP BY k" \
+    "SELECT s FROM t ORDER BY s LIMIT 20 OFFSET 100" \
+    "SELECT id FROM t WHERE s LIKE 's19%' ORDER BY id" \
+    "SELECT nosuch FROM t"
+# Every query from four clients at once, each client's answers in one file
+clients=
+for client in 1 2 3 4; do
+    (for sql in "$@"; do "$exe" --connect "$dir/sock" -c "$sql" 2>&1 | grep -v '^Logs from\|statements/s'; done) > "$dir/client$client" &
+    clients="$clients $!"
+done
+wait $clients
+for sql in "$@"; do sqlite3 "$dir/t.db" "$sql" 2>&1 | sed 's/^Error: in prepare, /Error: /; /^  /d'; done > "$dir/expected"
+for client in 1 2 3 4; do
+    cmp -s "$dir/client$client" "$dir/expected" || fail "client $client: $(diff "$dir/client$client" "$dir/expected" | head -5)"
+done
+
+# A write through the server, seen by the next client and by sqlite3
+"$exe" --connect "$dir/sock" -c "UPDATE t SET s = 'changed' WHERE k = 7" -c "DELETE FROM t WHERE id > 19990" > /dev/null 2>&1
+[ "$("$exe" --connect "$dir/sock" -c "SELECT COUNT(*) FROM t WHERE s = 'changed'" 2>/dev/null)" = "198" ] || fail "write not visible to clients"
+kill $server
+wait $server
+server=
+[ "$(sqlite3 "$dir/t.db" "SELECT COUNT(*) FROM t; SELECT COUNT(*) FROM t WHERE s = 'changed'; PRAGMA integrity_check" | tr '\n' ' ')" = "19990 198 ok " ] ||
+    fail "database after the server stopped"
+
+exit $failed
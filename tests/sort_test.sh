@@ -0,0 +1,33 @@
+#!/bin/sh
+# ORDER BY with --sort-mb 1, which spills sorted runs to disk and merges
+# them, checked row for row against sqlite3. Usage: sort_test.sh <path to exe>
+exe="$1"
+command -v sqlite3 > /dev/null || exit 77
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+failed=0
+
+# Several megabytes of keys and values, v of every type
+sqlite3 "$dir/t.db" "CREATE TABLE t(id INTEGER PRIMARY KEY, k INTEGER, s TEXT, v);
+WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 80000)
+INSERT INTO t SELECT i, i * 7919 % 5000, 'text-' || (i * 104729 % 80000) || '-' || printf('%.*c', i % 40, 'p'),
+    CASE i % 5 WHEN 0 THEN NULL WHEN 1 THEN i % 300 WHEN 2 THEN (i % 300) + 0.5 WHEN 3 THEN 'v' || (i % 300) ELSE CAST('b' || (i % 9) AS BLOB) END
+FROM n;" || exit 1
+
+check() {
+    expected=$(sqlite3 "$dir/t.db" "$1" | md5sum)
+    actual=$("$exe" --sort-mb 1 "$dir/t.db" "$1" 2>/dev/null | md5sum)
+    if [ "$actual" != "$expected" ]; then
+        echo "FAIL: $1"
+        failed=1
+    fi
+}
+
+check "SELECT id, s FROM t ORDER BY s"
+check "SELECT id, k, s FROM t ORDER BY k DESC, s"
+check "SELECT id, v FROM t ORDER BY v, id DESC"
+check "SELECT * FROM t WHERE k < 2500 ORDER BY s DESC"
+check "SELECT id, s FROM t ORDER BY k, id LIMIT 20 OFFSET 30000"
+check "SELECT k, COUNT(*), MAX(s) FROM t GROUP BY k ORDER BY 3 DESC, 1"
+
+exit $failed
@@ -0,0 +1,55 @@
+#!/bin/sh
+# INSERT, UPDATE and DELETE through the write-ahead log: the same script run
+# by exe and by sqlite3 on copies of one database must leave the same rows
+# and a file that passes integrity_check, and a session that only reads must
+# leave a log it finds untouched. Usage: wal_test.sh <path to exe>
+exe="$1"
+command -v sqlite3 > /dev/null || exit 77
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+failed=0
+
+fail() {
+    echo "FAIL: $1"
+    failed=1
+}
+
+sqlite3 "$dir/a.db" "CREATE TABLE t(id INTEGER PRIMARY KEY, k INTEGER, s TEXT);
+CREATE INDEX tk ON t(k);
+CREATE TABLE u(x, y TEXT);
+WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 2000)
+INSERT INTO t SELECT i, i % 37, 'r' || i FROM n;" || exit 1
+cp "$dir/a.db" "$dir/b.db"
+
+# Inserts that split leaves and spill long text onto overflow pages, updates
+# that move rows between index keys, and deletes that empty whole leaves
+sqlite3 "$dir/a.db" "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 400)
+SELECT CASE i % 5
+    WHEN 0 THEN 'INSERT INTO t(k, s) VALUES (' || (i % 11) || ', ''' || printf('%.*c', i * 13, 'w') || ''');'
+    WHEN 1 THEN 'INSERT INTO u VALUES (' || i || ', ''y' || i || '''), (NULL, ''z'');'
+    WHEN 2 THEN 'UPDATE t SET k = k + 100, s = s || ''u'' WHERE k = ' || (i % 37) || ';'
+    WHEN 3 THEN 'DELETE FROM t WHERE id BETWEEN ' || (i * 4) || ' AND ' || (i * 4 + 30) || ';'
+    ELSE 'INSERT INTO u SELECT k, s FROM t WHERE id % 97 = ' || (i % 97) || ';'
+END FROM n;" > "$dir/script.sql"
+
+"$exe" -f "$dir/script.sql" "$dir/a.db" > /dev/null 2>&1 || fail "exe -f script.sql"
+sqlite3 "$dir/b.db" < "$dir/script.sql" || exit 1
+
+dump="SELECT * FROM t ORDER BY id; SELECT rowid, * FROM u ORDER BY rowid; SELECT k, id FROM t ORDER BY k, id;"
+[ "$(sqlite3 "$dir/a.db" "$dump" | md5sum)" = "$(sqlite3 "$dir/b.db" "$dump" | md5sum)" ] || fail "rows differ from sqlite3's"
+[ "$(sqlite3 "$dir/a.db" "PRAGMA integrity_check")" = "ok" ] || fail "integrity_check"
+[ -e "$dir/a.db-wal" ] && fail "the log outlived the session that wrote it"
+
+# A log sqlite3 left behind: reading it neither checkpoints nor removes it
+sqlite3 "$dir/c.db" > /dev/null << EOF
+PRAGMA journal_mode=WAL;
+PRAGMA wal_autocheckpoint=0;
+CREATE TABLE t(id INTEGER PRIMARY KEY, s TEXT);
+INSERT INTO t VALUES (1, 'one'), (2, 'two');
+.system cp "$dir/c.db" "$dir/d.db" && cp "$dir/c.db-wal" "$dir/d.db-wal"
+EOF
+before=$(cat "$dir/d.db" "$dir/d.db-wal" | md5sum)
+[ "$("$exe" "$dir/d.db" "SELECT s FROM t ORDER BY id" 2>/dev/null | tr '\n' ' ')" = "one two " ] || fail "reading the log"
+[ "$(cat "$dir/d.db" "$dir/d.db-wal" | md5sum)" = "$before" ] || fail "a read-only session changed the files"
+
+exit $failed